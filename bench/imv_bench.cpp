@@ -0,0 +1,2598 @@
+// Headless navigation benchmark.
+//
+// Drives the catalog, the prev/current/next prefetch window and the decode
+// pipeline through scripted key sequences over generated image folders and
+// prints key-to-ready latency percentiles, throughput and memory as JSON.
+// `--mode render` times the software compositor instead, `--mode phash` the
+// perceptual hashes and the near-duplicate index, `--mode color` the colour
+// management LUTs, `--mode hdr` the high bit depth tone mapping, `--mode
+// decode` the native decoders over the files of a folder, `--mode handoff`
+// a second launch forwarding its path to the single instance server,
+// `--mode startup` the first decode overlapped with the folder scan, `--mode
+// pipeline` the load coroutines against the strand jobs they replaced,
+// `--mode pressure` the caches shrinking under memory pressure, `--mode
+// arena` the pixel arena over 10k navigations, `--mode archive` pictures
+// read out of ZIP archives against plain files, `--mode catalog` the memory
+// a million-file catalog takes, `--mode scrub` the previews of a drag along
+// the scrub bar, `--mode exif` the metadata index and its filters, `--mode
+// names` type-to-filter over file names.
+//
+// Linux:
+//   g++ -std=c++20 -O2 -I../src imv_bench.cpp -o imv_bench -lboost_thread -lpthread
+//   ./imv_bench --corpus small,medium --out results.json
+//   ./imv_bench --mode render
+//   ./imv_bench --mode phash --entries 100000
+//   ./imv_bench --mode color
+//   ./imv_bench --mode hdr
+//   ./imv_bench --mode decode --dir ~/Pictures
+//   ./imv_bench --mode handoff --handoffs 1000
+//   ./imv_bench --mode startup --entries 10000
+//   ./imv_bench --mode pipeline --loads 10000
+//   ./imv_bench --mode pressure
+//   ./imv_bench --mode arena --navigations 10000
+//   ./imv_bench --mode archive --entries 200
+//   ./imv_bench --mode catalog --entries 1000000
+//   ./imv_bench --mode scrub --entries 100000
+//   ./imv_bench --mode exif --entries 2000
+//   ./imv_bench --mode names --entries 1000000
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#	define NOMINMAX
+#	include <Windows.h>
+#	include <Psapi.h>
+#	pragma comment(lib, "psapi")
+#else
+#	include <sys/resource.h>
+#	include <unistd.h>
+#endif
+
+#include <boost/asio/strand.hpp>
+
+#include "thread_pool.hpp"
+#include "interval.hpp"
+#include "catalog.hpp"
+#include "image_buffer.hpp"
+#include "decoder_registry.hpp"
+#include "soft_renderer.hpp"
+#include "phash.hpp"
+#include "color.hpp"
+#include "hdr.hpp"
+#include "single_instance.hpp"
+#include "startup.hpp"
+#include "load_pipeline.hpp"
+#include "memory_governor.hpp"
+#include "zip_archive.hpp"
+#include "pixel_ops.hpp"
+#include "scrub_previews.hpp"
+#include "exif_index.hpp"
+#include "name_filter.hpp"
+
+using tp = thread_pool_3;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+size_t peak_rss_kb() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.PeakWorkingSetSize / 1024;
+#else
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return static_cast<size_t>(ru.ru_maxrss);
+#endif
+}
+
+// Synthetic corpus
+
+enum class bmp_kind { bgr24, bgrx32, indexed8 };
+
+void write_bmp(const fs::path& path, std::uint32_t width, std::uint32_t height, bmp_kind kind, std::uint32_t seed) {
+	const std::uint16_t bpp = kind == bmp_kind::bgr24 ? 24 : kind == bmp_kind::bgrx32 ? 32 : 8;
+	const std::uint32_t palette_size = kind == bmp_kind::indexed8 ? 256 * 4 : 0;
+	const size_t row_bytes = ((static_cast<size_t>(width) * bpp + 31) / 32) * 4;
+	const std::uint32_t offset = 14 + 40 + palette_size;
+	const size_t file_size = offset + row_bytes * height;
+
+	std::vector<std::uint8_t> file(file_size);
+	auto put16 = [&](size_t at, std::uint16_t v) { file[at] = v & 0xFF; file[at + 1] = v >> 8; };
+	auto put32 = [&](size_t at, std::uint32_t v) { for (int i = 0; i < 4; ++i) file[at + i] = (v >> (8 * i)) & 0xFF; };
+
+	file[0] = 'B'; file[1] = 'M';
+	put32(2, static_cast<std::uint32_t>(file_size));
+	put32(10, offset);
+	put32(14, 40);
+	put32(18, width);
+	put32(22, height);
+	put16(26, 1);
+	put16(28, bpp);
+	for (std::uint32_t i = 0; i < palette_size / 4; ++i) put32(54 + i * 4, (i << 16) | ((255 - i) << 8) | (i ^ 0x55));
+
+	// gradient plus noise so the files don't decode as a constant
+	std::uint32_t state = seed * 2654435761u + 1;
+	for (std::uint32_t y = 0; y < height; ++y) {
+		auto* row = file.data() + offset + row_bytes * y;
+		for (std::uint32_t x = 0; x < width; ++x) {
+			state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+			const std::uint8_t v = static_cast<std::uint8_t>((x * 255 / width + (state & 15)) & 0xFF);
+			switch (kind) {
+			case bmp_kind::bgr24: row[x * 3] = v; row[x * 3 + 1] = static_cast<std::uint8_t>(y); row[x * 3 + 2] = static_cast<std::uint8_t>(seed); break;
+			case bmp_kind::bgrx32: row[x * 4] = v; row[x * 4 + 1] = static_cast<std::uint8_t>(y); row[x * 4 + 2] = static_cast<std::uint8_t>(seed); break;
+			case bmp_kind::indexed8: row[x] = v; break;
+			}
+		}
+	}
+
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+struct corpus_spec {
+	std::string name;
+	std::uint32_t count;
+	std::uint32_t width;
+	std::uint32_t height;
+};
+
+const corpus_spec corpora[] = {
+	{"small", 48, 1280, 854},
+	{"medium", 24, 3000, 2000},
+	{"large", 12, 6000, 4000},
+};
+
+fs::path generate_corpus(const fs::path& root, const corpus_spec& spec) {
+	auto dir = root / spec.name;
+	fs::create_directories(dir);
+	constexpr bmp_kind kinds[] = {bmp_kind::bgr24, bmp_kind::bgrx32, bmp_kind::indexed8};
+	for (std::uint32_t i = 0; i < spec.count; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "IMG_%04u.bmp", i);
+		auto path = dir / name;
+		if (fs::exists(path)) continue;
+		write_bmp(path, spec.width, spec.height, kinds[i % 3], i);
+	}
+	return dir;
+}
+
+// Mirrors ImvWindow: a prev/current/next window of images, each loaded by a
+// coroutine on its own strand of the shared pool, the "UI" thread blocks
+// until the current one is decoded the same way Draw() does.
+class headless_viewer {
+	enum class status_t { FAILED_TO_LOAD, LOADING, LOADED };
+
+	struct image {
+		headless_viewer& viewer_;
+		std::string path_;
+		std::int64_t ix_;
+		image_buffer pixels_;
+		status_t status_ = status_t::LOADING;
+		boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+		load::ticket ticket_;
+		std::uint64_t started_ = std::numeric_limits<std::uint64_t>::max();
+		std::uint64_t settled_ = std::numeric_limits<std::uint64_t>::max();
+
+		load::task<> load(std::uint64_t ticket) {
+			const auto ix = ix_;
+			IMV_TRACE_SCOPE_ARG("load", "load", ix);
+			if (!ticket_.valid(ticket)) co_return;
+			pixel_arena::buffer data;
+			{
+				IMV_TRACE_SCOPE_ARG("read", "load", ix);
+				data = read_file(path_);
+			}
+			if (!ticket_.valid(ticket)) co_return;
+			image_buffer pixels;
+			bool ok;
+			{
+				IMV_TRACE_SCOPE_ARG("decode", "load", ix);
+				ok = data && decoders::native::decode(data.data(), data.size(), pixels);
+			}
+			++viewer_.decodes_;
+			{
+				std::lock_guard<std::mutex> lk(viewer_.mutex_);
+				pixels_ = std::move(pixels);
+				status_ = ok ? status_t::LOADED : status_t::FAILED_TO_LOAD;
+				settled_ = ticket;
+			}
+			viewer_.cv_.notify_all();
+		}
+
+		void start() {
+			std::uint64_t ticket;
+			{
+				std::lock_guard<std::mutex> lk(viewer_.mutex_);
+				ticket = started_ = ticket_.current();
+			}
+			load::spawn(strand_, load(ticket));
+		}
+
+		void cancel() {
+			{
+				std::lock_guard<std::mutex> lk(viewer_.mutex_);
+				ticket_.cancel();
+			}
+			viewer_.cv_.notify_all();
+		}
+
+		void free() {
+			std::lock_guard<std::mutex> lk(viewer_.mutex_);
+			pixels_.reset();
+			status_ = status_t::LOADING;
+		}
+
+		image(headless_viewer& viewer, std::string&& path, std::int64_t ix)
+			: viewer_{viewer}, path_{std::move(path)}, ix_{ix}, strand_{boost::asio::make_strand(tp::get_instance().ctx())} {}
+	};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	// a deque, an image's strand and ticket don't move
+	std::deque<image> images_;
+	CirculalInterval<std::int64_t> current_img_idx_;
+	std::atomic<size_t> decodes_{0};
+
+	void post_load(CirculalInterval<std::int64_t> ix) {
+		images_[ix()].start();
+	}
+
+	void post_free(CirculalInterval<std::int64_t> ix) {
+		auto& img = images_[ix()];
+		img.cancel();
+		async<false>(img.strand_, &image::free, &img);
+	}
+public:
+	void next_image() {
+		auto prev = current_img_idx_ - 1;
+		++current_img_idx_;
+		if (current_img_idx_ == prev || current_img_idx_ + 1 == prev || prev == current_img_idx_ - 1) return;
+		post_free(prev);
+		post_load(current_img_idx_ + 1);
+	}
+
+	void prev_image() {
+		auto next = current_img_idx_ + 1;
+		--current_img_idx_;
+		if (current_img_idx_ == next || current_img_idx_ - 1 == next || next == current_img_idx_ + 1) return;
+		post_free(next);
+		post_load(current_img_idx_ - 1);
+	}
+
+	// ImvWindow::go_to_image: what overlaps stays, the rest is called off.
+	void seek_by(std::int64_t delta) {
+		const auto target = current_img_idx_ + static_cast<size_t>(delta);
+		const std::set<std::int64_t> old_window{(current_img_idx_ - 1)(), current_img_idx_(), (current_img_idx_ + 1)()};
+		const std::set<std::int64_t> new_window{(target - 1)(), target(), (target + 1)()};
+		current_img_idx_ = target;
+		for (auto i : old_window) {
+			if (new_window.count(i)) continue;
+			images_[i].cancel();
+			async<false>(images_[i].strand_, &image::free, &images_[i]);
+		}
+		for (auto i : {target(), (target - 1)(), (target + 1)()}) {
+			if (!old_window.count(i)) images_[i].start();
+		}
+	}
+
+	// Blocks until the current image is decoded (or failed), returns true on success.
+	bool wait_ready() {
+		auto& img = images_[current_img_idx_()];
+		IMV_TRACE_SCOPE_ARG("wait", "draw", current_img_idx_());
+		std::unique_lock<std::mutex> lk(mutex_);
+		cv_.wait(lk, [&img]() { return img.settled_ == img.started_ || !img.ticket_.valid(img.started_); });
+		return img.settled_ == img.started_ && img.status_ == status_t::LOADED;
+	}
+
+	size_t size() const noexcept { return images_.size(); }
+	// decode stages that ran, a load called off before it decodes isn't one
+	size_t decodes() const noexcept { return decodes_; }
+
+	explicit headless_viewer(const fs::path& directory) {
+		auto files = scan_directory(directory);
+		if (files.empty()) throw std::runtime_error("no images in " + directory.string());
+
+		for (auto& path : files) images_.emplace_back(*this, path.string(), images_.size());
+
+		current_img_idx_ = CirculalInterval<std::int64_t>(0, images_.size() - 1, 1);
+
+		post_load(current_img_idx_);
+		if (images_.size() > 1) post_load(current_img_idx_ + 1);
+		if (images_.size() > 2) post_load(current_img_idx_ - 1);
+	}
+
+	~headless_viewer() {
+		// drain the strands before the images go away
+		for (auto& img : images_) {
+			async<true>(img.strand_, []() {}).wait();
+		}
+	}
+};
+
+// Scripted input
+
+enum class key { right, left, zoom_in, zoom_out, pan, seek };
+
+struct scenario {
+	const char* name;
+	std::chrono::microseconds interval;
+	std::function<key(size_t)> script;
+};
+
+const scenario scenarios[] = {
+	{"steady", std::chrono::milliseconds(100), [](size_t) { return key::right; }},
+	{"skim", std::chrono::milliseconds(33), [](size_t) { return key::right; }},
+	{"back_and_forth", std::chrono::milliseconds(50), [](size_t i) {
+		constexpr key pattern[] = {key::right, key::right, key::left, key::right, key::left, key::left};
+		return pattern[i % 6];
+	}},
+	{"zoom_pan", std::chrono::milliseconds(8), [](size_t i) {
+		constexpr size_t cycle = 20;
+		const size_t step = i % cycle;
+		if (step < 3) return key::zoom_in;
+		if (step < 16) return key::pan;
+		if (step < 19) return key::zoom_out;
+		return key::right;
+	}},
+	// a third of the folder at a time, a step once in a while
+	{"seek", std::chrono::milliseconds(100), [](size_t i) { return i % 4 == 3 ? key::right : key::seek; }},
+};
+
+double percentile(std::vector<double> values, double p) {
+	if (values.empty()) return 0.0;
+	std::sort(values.begin(), values.end());
+	const double rank = p * (values.size() - 1);
+	const size_t lo = static_cast<size_t>(rank);
+	const size_t hi = std::min(lo + 1, values.size() - 1);
+	return values[lo] + (values[hi] - values[lo]) * (rank - lo);
+}
+
+struct result {
+	std::string corpus;
+	std::string scenario;
+	size_t images;
+	size_t keys;
+	size_t failed;
+	double p50, p95, p99, max;
+	double throughput;
+	double decodes_per_key;
+	size_t peak_rss_kb;
+	pixel_arena::stats_t arena;
+};
+
+// A key is "ready" once the image current after it is decoded. Keys are
+// delivered on a fixed schedule, if the viewer is still busy they queue up
+// like messages do, so the latency includes the time spent waiting in line.
+result run(const std::string& corpus, const fs::path& dir, const scenario& sc, size_t keys) {
+	headless_viewer viewer(dir);
+	viewer.wait_ready();
+
+	std::vector<double> latency;
+	latency.reserve(keys);
+	size_t failed = 0;
+	const auto decodes = viewer.decodes();
+
+	const auto start = clock_type::now();
+	for (size_t i = 0; i < keys; ++i) {
+		const auto scheduled = start + sc.interval * i;
+		std::this_thread::sleep_until(scheduled);
+
+		switch (sc.script(i)) {
+		case key::right: viewer.next_image(); break;
+		case key::left: viewer.prev_image(); break;
+		case key::seek: viewer.seek_by(static_cast<std::int64_t>(viewer.size() / 3 + 1)); break;
+		default: break; // view transform only, nothing to decode
+		}
+
+		if (!viewer.wait_ready()) ++failed;
+		latency.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - scheduled).count());
+	}
+	const double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	result r;
+	r.corpus = corpus;
+	r.scenario = sc.name;
+	r.images = viewer.size();
+	r.keys = keys;
+	r.failed = failed;
+	r.p50 = percentile(latency, 0.50);
+	r.p95 = percentile(latency, 0.95);
+	r.p99 = percentile(latency, 0.99);
+	r.max = latency.empty() ? 0.0 : *std::max_element(latency.begin(), latency.end());
+	r.throughput = elapsed > 0 ? keys / elapsed : 0.0;
+	r.decodes_per_key = keys ? double(viewer.decodes() - decodes) / keys : 0.0;
+	r.peak_rss_kb = peak_rss_kb();
+	r.arena = pixel_arena::get_instance().stats();
+	return r;
+}
+
+void write_json(std::ostream& os, const std::vector<result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"navigation\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"threads\": " << tp::number_of_threads() << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << "    {\"corpus\": \"" << r.corpus << "\", \"scenario\": \"" << r.scenario
+			<< "\", \"images\": " << r.images << ", \"keys\": " << r.keys << ", \"failed\": " << r.failed
+			<< ", \"latency_ms\": {\"p50\": " << r.p50 << ", \"p95\": " << r.p95 << ", \"p99\": " << r.p99 << ", \"max\": " << r.max << "}"
+			<< ", \"keys_per_sec\": " << r.throughput << ", \"decodes_per_key\": " << r.decodes_per_key
+			<< ", \"peak_rss_kb\": " << r.peak_rss_kb
+			<< ", \"arena\": {\"peak_bytes\": " << r.arena.peak_bytes << ", \"reuse_rate\": " << r.arena.reuse_rate() << "}}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+struct render_result {
+	std::uint32_t width, height;
+	std::string zoom;
+	double p50, p95;
+	double mpix_per_sec;
+};
+
+// Frames of the CPU compositor over a 24 MP source, the same work the window
+// does per repaint when there is no GPU.
+std::vector<render_result> run_render(size_t frames) {
+	image_buffer src;
+	src.allocate(6000, 4000);
+	for (std::uint32_t y = 0; y < src.height; ++y) {
+		auto* row = src.data() + size_t(y) * src.width;
+		for (std::uint32_t x = 0; x < src.width; ++x) row[x] = 0xFF000000u | ((x & 0xFF) << 16) | ((y & 0xFF) << 8) | ((x ^ y) & 0xFF);
+	}
+
+	static constexpr std::pair<std::uint32_t, std::uint32_t> windows[] = {{1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+	static constexpr std::pair<const char*, float> zooms[] = {{"fit", 0.0f}, {"1.0", 1.0f}, {"2.5", 2.5f}, {"10.0", 10.0f}};
+
+	std::vector<render_result> results;
+	for (auto [width, height] : windows) {
+		image_buffer frame;
+		frame.allocate(width, height);
+		for (auto [zoom_name, zoom] : zooms) {
+			const float fit = std::min(float(width) / src.width, float(height) / src.height);
+			const float scale = zoom > 0.0f ? zoom : fit;
+			// centred, panned a little every frame like a drag would
+			std::vector<double> ms;
+			for (size_t i = 0; i < frames; ++i) {
+				const auto transform = soft::affine::scale(scale, scale) * soft::affine::translation(
+					(width - src.width * scale) / 2.0f + float(i), (height - src.height * scale) / 2.0f + float(i));
+				const auto start = clock_type::now();
+				soft::render(soft::render_pool::get_instance(), src, frame, transform, 0xFFD3D3D3);
+				ms.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - start).count());
+			}
+			const double p50 = percentile(ms, 0.50);
+			results.push_back({width, height, zoom_name, p50, percentile(ms, 0.95),
+				p50 > 0 ? double(width) * height / (p50 * 1000.0) : 0.0});
+			std::cerr << width << "x" << height << " zoom " << zoom_name << ": " << p50 << " ms\n";
+		}
+	}
+	return results;
+}
+
+void write_render_json(std::ostream& os, const std::vector<render_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"render\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"threads\": " << soft::render_pool::number_of_threads() << ",\n  \"source\": \"6000x4000\",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << "    {\"window\": \"" << r.width << "x" << r.height << "\", \"zoom\": \"" << r.zoom
+			<< "\", \"frame_ms\": {\"p50\": " << r.p50 << ", \"p95\": " << r.p95 << "}"
+			<< ", \"mpix_per_sec\": " << r.mpix_per_sec << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+struct phash_result {
+	size_t entries = 0;
+	unsigned threads = 0;
+	double hashes_per_sec_1 = 0.0;
+	double hashes_per_sec = 0.0;
+	double build_ms = 0.0;
+	double query_p50_us = 0.0;
+	double query_p99_us = 0.0;
+	double groups_ms = 0.0;
+	size_t groups = 0;
+};
+
+// Hashing thumbnails the size the viewer decodes for it, then an index over
+// `entries` hashes made of bursts: a random frame and up to seven neighbours
+// a few bits away.
+phash_result run_phash(size_t entries) {
+	phash_result r;
+	r.entries = entries;
+	std::mt19937_64 rng(42);
+
+	std::vector<image_buffer> thumbnails(256);
+	for (size_t i = 0; i < thumbnails.size(); ++i) {
+		auto& t = thumbnails[i];
+		t.allocate(64, 48);
+		const auto seed = static_cast<std::uint32_t>(rng());
+		for (std::uint32_t y = 0; y < t.height; ++y) {
+			for (std::uint32_t x = 0; x < t.width; ++x) {
+				const std::uint32_t v = (x * (seed & 7) + y * ((seed >> 3) & 7) + ((x ^ y) & (seed >> 6))) & 0xFF;
+				t.data()[size_t(y) * t.width + x] = 0xFF000000u | (v << 16) | ((v ^ seed) & 0xFF) << 8 | ((v + (seed >> 8)) & 0xFF);
+			}
+		}
+	}
+
+	auto hash_all = [&](size_t rounds) {
+		std::uint64_t sink = 0;
+		for (size_t round = 0; round < rounds; ++round) {
+			for (auto& t : thumbnails) sink += phash::compute(t).p;
+		}
+		return sink;
+	};
+	constexpr size_t rounds = 20;
+	{
+		const auto start = clock_type::now();
+		volatile auto sink = hash_all(rounds);
+		(void)sink;
+		r.hashes_per_sec_1 = double(rounds * thumbnails.size()) / std::chrono::duration<double>(clock_type::now() - start).count();
+	}
+	{
+		r.threads = std::max(1u, std::thread::hardware_concurrency());
+		const auto start = clock_type::now();
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < r.threads; ++i) threads.emplace_back([&]() { volatile auto sink = hash_all(rounds); (void)sink; });
+		for (auto& t : threads) t.join();
+		r.hashes_per_sec = double(r.threads * rounds * thumbnails.size()) / std::chrono::duration<double>(clock_type::now() - start).count();
+	}
+	std::cerr << "hash: " << r.hashes_per_sec_1 << "/s on 1 thread, " << r.hashes_per_sec << "/s on " << r.threads << "\n";
+
+	std::vector<phash::hashes> hashes;
+	hashes.reserve(entries);
+	while (hashes.size() < entries) {
+		const phash::hashes frame{rng(), rng()};
+		hashes.push_back(frame);
+		for (auto burst = rng() % 8; burst > 0 && hashes.size() < entries; --burst) {
+			auto h = frame;
+			for (auto flips = rng() % 4; flips > 0; --flips) {
+				h.p ^= std::uint64_t(1) << (rng() % 64);
+				h.d ^= std::uint64_t(1) << (rng() % 64);
+			}
+			hashes.push_back(h);
+		}
+	}
+
+	auto start = clock_type::now();
+	const phash::index index(hashes, 6);
+	r.build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+	std::vector<double> us;
+	for (size_t i = 0; i < 10000; ++i) {
+		const auto& h = hashes[rng() % hashes.size()];
+		const auto q = clock_type::now();
+		volatile auto n = index.query(h).size();
+		(void)n;
+		us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - q).count());
+	}
+	r.query_p50_us = percentile(us, 0.50);
+	r.query_p99_us = percentile(us, 0.99);
+
+	start = clock_type::now();
+	const auto group = index.groups();
+	r.groups_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	std::vector<std::uint32_t> members(group.size(), 0);
+	for (auto g : group) ++members[g];
+	r.groups = static_cast<size_t>(std::count_if(members.begin(), members.end(), [](std::uint32_t n) { return n > 1; }));
+	std::cerr << "index: " << entries << " entries, build " << r.build_ms << " ms, query p50 " << r.query_p50_us
+		<< " us, groups " << r.groups_ms << " ms\n";
+	return r;
+}
+
+void write_phash_json(std::ostream& os, const phash_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"phash\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"hash\": {\"thumbnail\": \"64x48\", \"per_sec_1_thread\": " << r.hashes_per_sec_1
+		<< ", \"per_sec\": " << r.hashes_per_sec << ", \"threads\": " << r.threads << "}"
+		<< ",\n  \"index\": {\"entries\": " << r.entries << ", \"radius\": 6, \"build_ms\": " << r.build_ms
+		<< ", \"query_us\": {\"p50\": " << r.query_p50_us << ", \"p99\": " << r.query_p99_us << "}"
+		<< ", \"groups_ms\": " << r.groups_ms << ", \"groups\": " << r.groups << "}\n}\n";
+}
+
+struct color_result {
+	std::string source;
+	double build_ms = 0.0;
+	double simd_mps = 0.0;
+	double scalar_mps = 0.0;
+	int max_error = 0;
+	double mean_error = 0.0;
+};
+
+// Each wide-gamut source to an sRGB display over a 24 MP frame: building the
+// LUT, the in-place pass the decoder runs, the scalar lookup for comparison,
+// and the error against the transform done in floats with no tables.
+std::vector<color_result> run_color() {
+	const std::pair<const char*, color::profile> sources[] = {
+		{"display_p3", color::profile::display_p3()},
+		{"adobe_rgb", color::profile::adobe_rgb()},
+	};
+	const auto display = color::profile::srgb();
+
+	image_buffer frame;
+	frame.allocate(6000, 4000);
+	std::mt19937 rng(7);
+	for (size_t i = 0; i < size_t(frame.width) * frame.height; ++i) frame.data()[i] = 0xFF000000u | (rng() & 0xFFFFFF);
+
+	std::vector<color_result> results;
+	for (auto& [name, source] : sources) {
+		color_result r;
+		r.source = name;
+		const auto n = size_t(frame.width) * frame.height;
+
+		auto start = clock_type::now();
+		const color::lut lut(source, display);
+		r.build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+		auto pixels = std::vector<std::uint32_t>(frame.data(), frame.data() + n);
+		start = clock_type::now();
+		lut.apply(pixels.data(), n);
+		r.simd_mps = double(n) / std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+
+		start = clock_type::now();
+		std::uint64_t sink = 0;
+		for (size_t i = 0; i < n; ++i) {
+			const auto p = frame.data()[i];
+			std::uint32_t o[3];
+			lut.map((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF, o);
+			sink += o[0] + o[1] + o[2];
+		}
+		r.scalar_mps = double(n) / std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+		volatile auto keep = sink;
+		(void)keep;
+
+		const auto m = color::multiply(color::inverse(display.to_xyz), source.to_xyz);
+		auto exact = [&](int c, float linear) {
+			const float y = std::clamp(linear, 0.0f, 1.0f);
+			float lo = 0.0f, hi = 1.0f;
+			for (int k = 0; k < 24; ++k) {
+				const float mid = 0.5f * (lo + hi);
+				(display.trc[c].eval(mid) < y ? lo : hi) = mid;
+			}
+			return static_cast<int>(std::lround(0.5f * (lo + hi) * 255.0f));
+		};
+		std::uint64_t total = 0;
+		constexpr size_t samples = 1 << 18;
+		for (size_t i = 0; i < samples; ++i) {
+			const auto p = frame.data()[i * (n / samples)];
+			const float in[3] = {
+				source.trc[0].eval(((p >> 16) & 0xFF) / 255.0f),
+				source.trc[1].eval(((p >> 8) & 0xFF) / 255.0f),
+				source.trc[2].eval((p & 0xFF) / 255.0f),
+			};
+			const auto q = pixels[i * (n / samples)];
+			for (int c = 0; c < 3; ++c) {
+				const int want = exact(c, m[c * 3] * in[0] + m[c * 3 + 1] * in[1] + m[c * 3 + 2] * in[2]);
+				const int got = static_cast<int>((q >> (16 - 8 * c)) & 0xFF);
+				r.max_error = std::max(r.max_error, std::abs(want - got));
+				total += static_cast<std::uint64_t>(std::abs(want - got));
+			}
+		}
+		r.mean_error = double(total) / double(samples * 3);
+		std::cerr << name << ": build " << r.build_ms << " ms, " << r.simd_mps << " MP/s (scalar " << r.scalar_mps
+			<< "), max error " << r.max_error << "\n";
+		results.push_back(r);
+	}
+	return results;
+}
+
+void write_color_json(std::ostream& os, const std::vector<color_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"color\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"frame\": \"6000x4000\", \"display\": \"srgb\", \"lut_size\": " << color::lut::size
+		<< ",\n  \"results\": [";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << (i ? "," : "") << "\n    {\"source\": \"" << r.source << "\", \"build_ms\": " << r.build_ms
+			<< ", \"simd_mps\": " << r.simd_mps << ", \"scalar_mps\": " << r.scalar_mps
+			<< ", \"max_error\": " << r.max_error << ", \"mean_error\": " << r.mean_error << "}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+struct hdr_result {
+	double decode_mps = 0.0;
+	double retone_ms = 0.0;
+	double retone_reinhard_ms = 0.0;
+};
+
+// A 24 MP half float frame the way load_di consumes it, in 32-row bands
+// mapped to 8 bits and reduced to the 1500x1000 level kept for retoning,
+// then one retone of that level per tone curve.
+hdr_result run_hdr() {
+	constexpr std::uint32_t width = 6000, height = 4000, band_rows = 32, level = 2;
+	hdr_result r;
+
+	std::vector<std::uint16_t> frame(size_t(width) * height * 4);
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> linear(0.0f, 4.0f);
+	std::vector<std::uint16_t> values(4096);
+	for (auto& v : values) v = hdr::float_to_half(linear(rng));
+	for (size_t i = 0; i < frame.size(); ++i) frame[i] = (i & 3) == 3 ? hdr::float_to_half(1.0f) : values[(i * 2654435761u) >> 20 & 4095];
+
+	image_buffer pixels;
+	pixels.allocate(width, height);
+	const hdr::mapper mapper(hdr::tone{});
+	auto start = clock_type::now();
+	hdr::reducer reducer(width, height, level);
+	for (std::uint32_t y = 0; y < height; y += band_rows) {
+		const auto rows = std::min(band_rows, height - y);
+		mapper.run(frame.data() + size_t(y) * width * 4, pixels.data() + size_t(y) * width, size_t(rows) * width);
+		reducer.add(frame.data() + size_t(y) * width * 4, rows);
+	}
+	const auto kept = reducer.take();
+	r.decode_mps = double(width) * height / std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+
+	image_buffer display;
+	display.allocate(kept.width, kept.height);
+	for (auto [reinhard, ms] : {std::pair{false, &r.retone_ms}, std::pair{true, &r.retone_reinhard_ms}}) {
+		start = clock_type::now();
+		hdr::mapper(hdr::tone{1.0f, reinhard}).run(kept.data(), display.data(), size_t(kept.width) * kept.height);
+		*ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	}
+	std::cerr << "hdr: map+reduce " << r.decode_mps << " MP/s, retone " << kept.width << "x" << kept.height << " "
+		<< r.retone_ms << " ms (reinhard " << r.retone_reinhard_ms << " ms)\n";
+	return r;
+}
+
+void write_hdr_json(std::ostream& os, const hdr_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"hdr\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"decode\": {\"frame\": \"6000x4000\", \"map_reduce_mps\": " << r.decode_mps << "}"
+		<< ",\n  \"retone\": {\"level\": \"1500x1000\", \"clip_ms\": " << r.retone_ms
+		<< ", \"reinhard_ms\": " << r.retone_reinhard_ms << "}\n}\n";
+}
+
+struct decode_result {
+	std::string format;
+	size_t files = 0;
+	size_t declined = 0; // left to the system codecs
+	std::uint64_t pixels = 0;
+	std::uint64_t bytes = 0;
+	double seconds = 0.0;
+};
+
+// Every picture in `dir` decoded from memory by the native registry, best of
+// three runs per file, grouped by the format its bytes sniff as.
+std::vector<decode_result> run_decode(const fs::path& dir) {
+	std::vector<decode_result> results;
+	auto entry = [&](std::string_view format) -> decode_result& {
+		auto it = std::find_if(results.begin(), results.end(), [&](auto& r) { return r.format == format; });
+		if (it != results.end()) return *it;
+		results.push_back({std::string(format)});
+		return results.back();
+	};
+
+	for (auto& path : scan_directory(dir)) {
+		const auto data = read_file(path);
+		if (!data) continue;
+		const auto name = decoders::native::name(data.data(), data.size());
+		auto& r = entry(name.empty() ? std::string_view("unknown") : name);
+		++r.files;
+		double best = 0.0;
+		image_buffer pixels;
+		bool ok = true;
+		for (int run = 0; run < 3 && ok; ++run) {
+			const auto start = clock_type::now();
+			ok = decoders::native::decode(data.data(), data.size(), pixels);
+			const double s = std::chrono::duration<double>(clock_type::now() - start).count();
+			best = run == 0 ? s : std::min(best, s);
+		}
+		if (!ok) {
+			++r.declined;
+			continue;
+		}
+		r.pixels += std::uint64_t(pixels.width) * pixels.height;
+		r.bytes += data.size();
+		r.seconds += best;
+	}
+	for (auto& r : results) {
+		std::cerr << r.format << ": " << r.files << " files, " << r.declined << " declined";
+		if (r.seconds > 0) std::cerr << ", " << double(r.pixels) / 1e6 / r.seconds << " MP/s, " << double(r.bytes) / 1e6 / r.seconds << " MB/s";
+		std::cerr << "\n";
+	}
+	return results;
+}
+
+void write_decode_json(std::ostream& os, const fs::path& dir, const std::vector<decode_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"decode\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"dir\": \"" << dir.filename().string() << "\",\n  \"results\": [";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		const double mps = r.seconds > 0 ? double(r.pixels) / 1e6 / r.seconds : 0.0;
+		const double mbs = r.seconds > 0 ? double(r.bytes) / 1e6 / r.seconds : 0.0;
+		os << (i ? "," : "") << "\n    {\"format\": \"" << r.format << "\", \"files\": " << r.files
+			<< ", \"declined\": " << r.declined << ", \"mps\": " << mps << ", \"mbs\": " << mbs << "}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+struct handoff_result {
+	size_t handoffs = 0;
+	size_t failed = 0;
+	double p50_us = 0.0;
+	double p99_us = 0.0;
+	double max_us = 0.0;
+};
+
+// What a second launch waits for: connect, send the path, the viewer's
+// reply. The handler only queues the path, as posting it to the window does.
+handoff_result run_handoff(size_t handoffs) {
+#ifdef _WIN32
+	const std::string endpoint = "\\\\.\\pipe\\imv-bench-" + std::to_string(::GetCurrentProcessId());
+#else
+	const std::string endpoint = (fs::temp_directory_path() / ("imv-bench-" + std::to_string(::getpid()) + ".sock")).string();
+#endif
+	handoff_result r;
+	single_instance::server server;
+	if (!server.claim(endpoint)) {
+		std::cerr << "handoff: can't claim " << endpoint << "\n";
+		return r;
+	}
+	std::mutex mutex;
+	std::vector<std::string> received;
+	server.serve([&](std::string path) {
+		std::lock_guard<std::mutex> lk(mutex);
+		received.push_back(std::move(path));
+		return true;
+	});
+
+	const std::string path = (fs::temp_directory_path() / "imv_bench" / "medium" / "IMG_0001.jpg").string();
+	std::vector<double> us;
+	us.reserve(handoffs);
+	for (size_t i = 0; i < handoffs; ++i) {
+		const auto start = clock_type::now();
+		const bool ok = single_instance::forward(endpoint, path);
+		us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+		if (!ok) ++r.failed;
+	}
+	server.stop();
+
+	r.handoffs = received.size();
+	r.p50_us = percentile(us, 0.50);
+	r.p99_us = percentile(us, 0.99);
+	r.max_us = us.empty() ? 0.0 : *std::max_element(us.begin(), us.end());
+	std::cerr << "handoff: " << r.handoffs << " forwarded, " << r.failed << " failed, p50 "
+		<< r.p50_us << " us, p99 " << r.p99_us << " us\n";
+	return r;
+}
+
+void write_handoff_json(std::ostream& os, const handoff_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"handoff\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"handoffs\": " << r.handoffs << ",\n  \"failed\": " << r.failed
+		<< ",\n  \"latency_us\": {\"p50\": " << r.p50_us << ", \"p99\": " << r.p99_us << ", \"max\": " << r.max_us << "}\n}\n";
+}
+
+struct startup_result {
+	size_t files = 0;
+	double serial_ms = 0.0;
+	double overlapped_ms = 0.0;
+	double decode_ms = 0.0;
+	double catalog_ms = 0.0;
+};
+
+// The opened picture and `entries` small neighbours. Serial is how the
+// viewer used to start: scan the folder, then decode. Overlapped decodes on
+// the pool from the first moment while the folder is scanned, as ImvWindow
+// does now; the picture is ready once both are done. Medians of 5 runs.
+startup_result run_startup(const fs::path& workdir, size_t entries) {
+	const auto dir = workdir / ("startup_" + std::to_string(entries));
+	fs::create_directories(dir);
+	const auto opened = dir / "IMG_0000.bmp";
+	if (!fs::exists(opened)) write_bmp(opened, 6000, 4000, bmp_kind::bgr24, 0);
+	for (size_t i = 1; i <= entries; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "IMG_%06zu.bmp", i);
+		const auto path = dir / name;
+		if (!fs::exists(path)) write_bmp(path, 16, 16, bmp_kind::bgr24, static_cast<std::uint32_t>(i));
+	}
+
+	auto decode = [&opened]() {
+		const auto data = read_file(opened);
+		image_buffer pixels;
+		return data && decoders::native::decode(data.data(), data.size(), pixels);
+	};
+	auto scan = [&dir, &opened]() {
+		const auto files = scan_directory(dir);
+		return static_cast<size_t>(std::find(files.begin(), files.end(), opened) - files.begin()) < files.size() ? files.size() : 0;
+	};
+
+	startup_result r;
+	std::vector<double> serial, overlapped, decoded, cataloged;
+	for (int run = 0; run < 5; ++run) {
+		auto start = clock_type::now();
+		r.files = scan();
+		decode();
+		serial.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - start).count());
+
+		startup::timeline timeline;
+		auto first = async<true>(tp::get_instance().ctx(), [&]() {
+			decode();
+			timeline.mark(startup::stage::first_decode);
+		});
+		scan();
+		timeline.mark(startup::stage::catalog);
+		first.wait();
+		timeline.mark(startup::stage::first_frame);
+		overlapped.push_back(timeline.ms(startup::stage::first_frame));
+		decoded.push_back(timeline.ms(startup::stage::first_decode));
+		cataloged.push_back(timeline.ms(startup::stage::catalog));
+	}
+	r.serial_ms = percentile(serial, 0.5);
+	r.overlapped_ms = percentile(overlapped, 0.5);
+	r.decode_ms = percentile(decoded, 0.5);
+	r.catalog_ms = percentile(cataloged, 0.5);
+	std::cerr << "startup: " << r.files << " files, serial " << r.serial_ms << " ms, overlapped " << r.overlapped_ms
+		<< " ms (decode " << r.decode_ms << ", folder " << r.catalog_ms << ")\n";
+	return r;
+}
+
+void write_startup_json(std::ostream& os, const startup_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"startup\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"files\": " << r.files << ",\n  \"opened\": \"6000x4000\""
+		<< ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+		<< ",\n  \"serial_ms\": " << r.serial_ms << ",\n  \"overlapped_ms\": " << r.overlapped_ms
+		<< ",\n  \"stages_ms\": {\"first_decode\": " << r.decode_ms << ", \"catalog\": " << r.catalog_ms << "}\n}\n";
+}
+
+// Load pipeline: the strand design the viewer had against the coroutines
+// it has now, over stand-in stages that do a few microseconds of work so
+// the scheduling is what's measured. The strand design posts a job that
+// decodes and uploads and queues the exact statistics behind itself, and
+// can't call off a load once it's queued.
+namespace pipeline {
+
+constexpr size_t n_images = 64;
+
+std::atomic<size_t> stages_run{0};
+
+void stage() {
+	static const std::vector<std::uint32_t> data(4096, 0x9E3779B9u);
+	std::uint32_t h = 2166136261u;
+	for (auto v : data) h = (h ^ v) * 16777619u;
+	static std::atomic<std::uint32_t> sink;
+	sink = h;
+	++stages_run;
+}
+
+enum class status_t { LOADING, LOADED_DI, LOADED_DD };
+
+class strands {
+	struct image {
+		strands& m_;
+		status_t status_ = status_t::LOADING;
+		boost::asio::io_context::strand strand_{tp::get_instance().ctx()};
+
+		void load_di() {
+			stage(); // read
+			stage(); // decode
+			stage(); // convert
+			{
+				std::lock_guard<std::mutex> lk(m_.mutex_);
+				status_ = status_t::LOADED_DI;
+			}
+			m_.cv_.notify_all();
+		}
+
+		void load_dd() {
+			if (status_ < status_t::LOADED_DI) {
+				std::unique_lock<std::mutex> lk(m_.mutex_);
+				m_.cv_.wait(lk, [this]() { return status_ >= status_t::LOADED_DI; });
+			}
+			stage(); // upload
+			{
+				std::lock_guard<std::mutex> lk(m_.mutex_);
+				status_ = status_t::LOADED_DD;
+			}
+			m_.cv_.notify_all();
+			async<false>(strand_, &stage); // exact statistics
+		}
+
+		void load() {
+			load_di();
+			load_dd();
+		}
+
+		void free() {
+			std::lock_guard<std::mutex> lk(m_.mutex_);
+			status_ = status_t::LOADING;
+		}
+
+		explicit image(strands& m) : m_{m} {}
+	};
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<image> images_;
+public:
+	static constexpr const char* name = "strands";
+
+	void request(size_t i) { async<false>(images_[i].strand_, &image::load, &images_[i]); }
+	void release(size_t i) { async<false>(images_[i].strand_, &image::free, &images_[i]); }
+	void wait(size_t i) {
+		std::unique_lock<std::mutex> lk(mutex_);
+		cv_.wait(lk, [&]() { return images_[i].status_ == status_t::LOADED_DD; });
+	}
+	void drain() {
+		for (int round = 0; round < 2; ++round) {
+			for (auto& img : images_) async<true>(img.strand_, []() {}).wait();
+		}
+	}
+
+	strands() { for (size_t i = 0; i < n_images; ++i) images_.emplace_back(*this); }
+};
+
+class coroutines {
+	struct image {
+		coroutines& m_;
+		status_t status_ = status_t::LOADING;
+		boost::asio::strand<boost::asio::io_context::executor_type> strand_{boost::asio::make_strand(tp::get_instance().ctx())};
+		load::ticket ticket_;
+		std::uint64_t started_ = std::numeric_limits<std::uint64_t>::max();
+		std::uint64_t settled_ = std::numeric_limits<std::uint64_t>::max();
+
+		load::task<> run_stage() {
+			stage();
+			co_return;
+		}
+
+		void publish(status_t status, std::uint64_t ticket) {
+			{
+				std::lock_guard<std::mutex> lk(m_.mutex_);
+				status_ = status;
+				if (status == status_t::LOADED_DD) settled_ = ticket;
+			}
+			m_.cv_.notify_all();
+		}
+
+		load::task<> run(std::uint64_t ticket) {
+			for (int s = 0; s < 3; ++s) { // read, decode, convert
+				if (!ticket_.valid(ticket)) co_return;
+				co_await run_stage();
+			}
+			publish(status_t::LOADED_DI, ticket);
+			if (!ticket_.valid(ticket)) co_return;
+			co_await run_stage(); // upload
+			publish(status_t::LOADED_DD, ticket);
+			co_await load::yield(strand_);
+			if (ticket_.valid(ticket)) co_await run_stage(); // exact statistics
+		}
+
+		void start() {
+			std::uint64_t ticket;
+			{
+				std::lock_guard<std::mutex> lk(m_.mutex_);
+				ticket = started_ = ticket_.current();
+			}
+			load::spawn(strand_, run(ticket));
+		}
+
+		void cancel() {
+			{
+				std::lock_guard<std::mutex> lk(m_.mutex_);
+				ticket_.cancel();
+			}
+			m_.cv_.notify_all();
+		}
+
+		void free() {
+			std::lock_guard<std::mutex> lk(m_.mutex_);
+			status_ = status_t::LOADING;
+		}
+
+		explicit image(coroutines& m) : m_{m} {}
+	};
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<image> images_;
+public:
+	static constexpr const char* name = "coroutines";
+
+	void request(size_t i) { images_[i].start(); }
+	void release(size_t i) {
+		images_[i].cancel();
+		async<false>(images_[i].strand_, &image::free, &images_[i]);
+	}
+	void wait(size_t i) {
+		std::unique_lock<std::mutex> lk(mutex_);
+		auto& img = images_[i];
+		cv_.wait(lk, [&]() { return img.settled_ == img.started_ || !img.ticket_.valid(img.started_); });
+	}
+	void drain() {
+		for (int round = 0; round < 2; ++round) {
+			for (auto& img : images_) async<true>(img.strand_, []() {}).wait();
+		}
+	}
+
+	coroutines() { for (size_t i = 0; i < n_images; ++i) images_.emplace_back(*this); }
+};
+
+} // namespace pipeline
+
+struct pipeline_result {
+	std::string design;
+	size_t loads = 0;
+	double stage_us = 0.0;
+	double p50_us = 0.0;
+	double p99_us = 0.0;
+	double burst_us = 0.0;
+	size_t skim_stages = 0;
+};
+
+// Per load: request to ready one at a time, as a step to the next picture
+// waits for it (p50/p99), and the mean when a whole folder is requested at
+// once. Skim requests and at once frees every image, the way holding an
+// arrow key does, and counts the stages that still ran.
+template<typename Design>
+pipeline_result run_pipeline(size_t loads, double stage_us) {
+	pipeline_result r;
+	r.design = Design::name;
+	r.loads = loads;
+	r.stage_us = stage_us;
+	Design design;
+
+	std::vector<double> us;
+	us.reserve(loads);
+	for (size_t i = 0; i < loads; ++i) {
+		const auto idx = i % pipeline::n_images;
+		const auto start = clock_type::now();
+		design.request(idx);
+		design.wait(idx);
+		us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+		design.release(idx);
+	}
+	design.drain();
+	r.p50_us = percentile(us, 0.50);
+	r.p99_us = percentile(us, 0.99);
+
+	const size_t rounds = std::max<size_t>(1, loads / pipeline::n_images);
+	const auto start = clock_type::now();
+	for (size_t round = 0; round < rounds; ++round) {
+		for (size_t i = 0; i < pipeline::n_images; ++i) design.request(i);
+		for (size_t i = 0; i < pipeline::n_images; ++i) design.wait(i);
+		for (size_t i = 0; i < pipeline::n_images; ++i) design.release(i);
+	}
+	design.drain();
+	r.burst_us = std::chrono::duration<double, std::micro>(clock_type::now() - start).count() / double(rounds * pipeline::n_images);
+
+	pipeline::stages_run = 0;
+	for (size_t round = 0; round < rounds; ++round) {
+		for (size_t i = 0; i < pipeline::n_images; ++i) {
+			design.request(i);
+			design.release(i);
+		}
+		design.drain();
+	}
+	r.skim_stages = pipeline::stages_run;
+
+	std::cerr << "pipeline: " << r.design << " p50 " << r.p50_us << " us, p99 " << r.p99_us << " us, burst "
+		<< r.burst_us << " us/load, skim ran " << r.skim_stages << " of " << rounds * pipeline::n_images * 5 << " stages\n";
+	return r;
+}
+
+std::vector<pipeline_result> run_pipelines(size_t loads) {
+	for (int i = 0; i < 100; ++i) pipeline::stage();
+	const auto start = clock_type::now();
+	for (int i = 0; i < 1000; ++i) pipeline::stage();
+	const double stage_us = std::chrono::duration<double, std::micro>(clock_type::now() - start).count() / 1000.0;
+	return {run_pipeline<pipeline::strands>(loads, stage_us), run_pipeline<pipeline::coroutines>(loads, stage_us)};
+}
+
+void write_pipeline_json(std::ostream& os, const std::vector<pipeline_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"pipeline\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+		<< ",\n  \"stages_per_load\": 5"
+		<< ",\n  \"designs\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << "    {\"design\": \"" << r.design << "\", \"loads\": " << r.loads << ", \"stage_us\": " << r.stage_us
+			<< ", \"latency_us\": {\"p50\": " << r.p50_us << ", \"p99\": " << r.p99_us << "}"
+			<< ", \"burst_us_per_load\": " << r.burst_us << ", \"skim_stages_run\": " << r.skim_stages << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+// Memory pressure: prev, current and next 12 MP pictures with their
+// half-size levels, two prefetched slides and a freed picture in the arena's
+// pool, shrunk the way ImvWindow does when the governor reports low and then
+// critical pressure, and loaded again once it's over. The pressure is raised
+// by hand; the OS sources are only listed. The mode exits non-zero when a
+// step keeps more than it should: anything pooled after a trim, more in use
+// than the pictures left at critical, or a resident set that doesn't give
+// back at least half of what critical freed.
+namespace pressure {
+
+struct picture {
+	image_buffer pixels;
+	std::vector<image_buffer> lods;
+
+	void load(std::uint32_t seed) {
+		pixels.allocate(4000, 3000);
+		std::fill_n(pixels.data(), size_t(pixels.width) * pixels.height, seed * 0x01010101u);
+		build_lods();
+	}
+
+	void build_lods() {
+		for (const image_buffer* prev = &pixels; std::max(prev->width, prev->height) > 1024; prev = &lods.back()) {
+			image_buffer half;
+			half.allocate(std::max(1u, prev->width / 2), std::max(1u, prev->height / 2));
+			downsample_2x_32bpp(prev->data(), half.data(), prev->width, prev->height);
+			lods.push_back(std::move(half));
+		}
+	}
+
+	void free() {
+		lods.clear();
+		pixels.reset();
+	}
+
+	// Most the arena can hand out for the levels: a size class is at most
+	// a quarter over the request, plus a large page of rounding.
+	size_t bound() const {
+		constexpr size_t large_page = 2 * 1024 * 1024;
+		size_t n = 0;
+		for (size_t l = 0; l <= lods.size(); ++l) {
+			const auto& level = l == 0 ? pixels : lods[l - 1];
+			if (level.data()) n += level.pixels.size() / 4 * 5 + large_page;
+		}
+		return n;
+	}
+};
+
+// Now, not the peak.
+size_t rss_kb() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.WorkingSetSize / 1024;
+#else
+	long pages = 0, resident = 0;
+	if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+		if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+		std::fclose(f);
+	}
+	return static_cast<size_t>(resident) * static_cast<size_t>(::sysconf(_SC_PAGESIZE)) / 1024;
+#endif
+}
+
+} // namespace pressure
+
+struct pressure_result {
+	struct step {
+		std::string name;
+		double ms = 0.0;
+		size_t in_use = 0;
+		size_t pooled = 0;
+		size_t rss_kb = 0;
+	};
+	std::vector<std::string> sources;
+	double notify_us = 0.0;
+	std::vector<step> steps;
+	// the bounds in the namespace comment, what went past them
+	std::vector<std::string> exceeded;
+};
+
+pressure_result run_pressure() {
+	enum { prev, current, next, slide2, slide3, n_pictures };
+	pressure_result r;
+	auto& arena = pixel_arena::get_instance();
+	std::vector<pressure::picture> pictures(n_pictures);
+	auto record = [&](const char* name, clock_type::time_point start) {
+		const auto stats = arena.stats();
+		r.steps.push_back({name, std::chrono::duration<double, std::milli>(clock_type::now() - start).count(),
+			stats.bytes_in_use, stats.bytes_pooled, pressure::rss_kb()});
+	};
+
+	auto start = clock_type::now();
+	for (int i = 0; i < n_pictures; ++i) pictures[i].load(i);
+	{
+		// the picture navigated away from, its blocks wait in the pool
+		pressure::picture gone;
+		gone.load(n_pictures);
+	}
+	record("cached", start);
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<std::pair<memory::pressure, clock_type::time_point>> changes;
+	memory::governor governor(std::chrono::milliseconds(200));
+	governor.start([&](memory::pressure p) {
+		std::lock_guard<std::mutex> lk(mutex);
+		changes.emplace_back(p, clock_type::now());
+		cv.notify_all();
+	});
+	r.sources = governor.sources();
+	auto wait_for = [&](memory::pressure p) {
+		std::unique_lock<std::mutex> lk(mutex);
+		cv.wait(lk, [&]() { return !changes.empty() && changes.back().first == p; });
+		return changes.back().second;
+	};
+
+	start = clock_type::now();
+	governor.raise(memory::pressure::low);
+	const auto notified = wait_for(memory::pressure::low);
+	r.notify_us = std::chrono::duration<double, std::micro>(notified - start).count();
+	start = clock_type::now();
+	arena.trim();
+	for (int i : {prev, next, slide2, slide3}) pictures[i].lods.clear();
+	arena.trim();
+	record("low", start);
+
+	governor.raise(memory::pressure::critical);
+	wait_for(memory::pressure::critical);
+	start = clock_type::now();
+	for (int i : {prev, slide2, slide3}) pictures[i].free();
+	arena.trim();
+	record("critical", start);
+	const auto kept = pictures[current].bound() + pictures[next].bound();
+
+	// the watcher ends it within a second of the calm period
+	wait_for(memory::pressure::none);
+	start = clock_type::now();
+	pictures[prev].load(prev);
+	pictures[next].build_lods();
+	record("recovered", start);
+	governor.stop();
+
+	const auto& cached = r.steps[0];
+	const auto& low = r.steps[1];
+	const auto& critical = r.steps[2];
+	const auto& recovered = r.steps[3];
+	auto expect = [&](bool ok, const std::string& what) {
+		if (!ok) r.exceeded.push_back(what);
+	};
+	expect(low.pooled == 0, "low: blocks still pooled after the trim");
+	expect(low.in_use < cached.in_use, "low: no levels shed");
+	expect(critical.pooled == 0, "critical: blocks still pooled after the trim");
+	expect(critical.in_use <= kept, "critical: more in use than the current and next pictures");
+	const auto freed_kb = (cached.in_use + cached.pooled - critical.in_use) / 1024;
+	expect(critical.rss_kb + freed_kb / 2 <= cached.rss_kb, "critical: the resident set kept more than half of what was freed");
+	expect(recovered.in_use > critical.in_use, "recovered: nothing loaded again");
+
+	std::cerr << "pressure: sources";
+	for (auto& s : r.sources) std::cerr << ' ' << s;
+	std::cerr << ", notified in " << r.notify_us << " us\n";
+	for (auto& s : r.steps) {
+		std::cerr << "  " << s.name << ": " << s.ms << " ms, in use " << s.in_use / (1024 * 1024) << " MB, pooled "
+			<< s.pooled / (1024 * 1024) << " MB, rss " << s.rss_kb / 1024 << " MB\n";
+	}
+	for (auto& e : r.exceeded) std::cerr << "pressure: " << e << '\n';
+	return r;
+}
+
+void write_pressure_json(std::ostream& os, const pressure_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"pressure\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"picture\": \"4000x3000\",\n  \"sources\": [";
+	for (size_t i = 0; i < r.sources.size(); ++i) os << (i ? ", " : "") << '"' << r.sources[i] << '"';
+	os << "],\n  \"notify_us\": " << r.notify_us << ",\n  \"steps\": [\n";
+	for (size_t i = 0; i < r.steps.size(); ++i) {
+		const auto& s = r.steps[i];
+		os << "    {\"step\": \"" << s.name << "\", \"ms\": " << s.ms << ", \"in_use_bytes\": " << s.in_use
+			<< ", \"pooled_bytes\": " << s.pooled << ", \"rss_kb\": " << s.rss_kb << "}"
+			<< (i + 1 < r.steps.size() ? ",\n" : "\n");
+	}
+	os << "  ],\n  \"within_bounds\": " << (r.exceeded.empty() ? "true" : "false") << "\n}\n";
+}
+
+// Arena: navigations through a folder of mixed sizes, allocating the way
+// the viewer does. The picture coming into the prev/current/next window
+// gets a frame, a conversion scratch buffer that is given back at once and
+// its half-size levels; the picture leaving it is freed. Every page is
+// written as a decode would. After a warm-up the high-water marks of the
+// resident set and of the arena's footprint have to stay where they are,
+// within one frame; the mode exits non-zero when either grows past that.
+namespace churn {
+
+struct picture {
+	image_buffer pixels;
+	std::vector<image_buffer> lods;
+};
+
+// One write per page, what makes a fresh block resident.
+void touch(const image_buffer& b) {
+	auto* bytes = b.pixels.data();
+	for (size_t i = 0; i < b.pixels.size(); i += 4096) bytes[i] = static_cast<std::uint8_t>(i);
+}
+
+void load(picture& p, std::uint32_t width, std::uint32_t height) {
+	p.pixels.allocate(width, height);
+	touch(p.pixels);
+	{
+		image_buffer scratch;
+		scratch.allocate(width, height);
+		touch(scratch);
+	}
+	for (const image_buffer* prev = &p.pixels; std::max(prev->width, prev->height) > 1024; prev = &p.lods.back()) {
+		image_buffer half;
+		half.allocate(std::max(1u, prev->width / 2), std::max(1u, prev->height / 2));
+		touch(half);
+		p.lods.push_back(std::move(half));
+	}
+}
+
+size_t minor_faults() {
+#ifdef _WIN32
+	return 0;
+#else
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return static_cast<size_t>(ru.ru_minflt);
+#endif
+}
+
+} // namespace churn
+
+struct arena_result {
+	size_t navigations = 0;
+	size_t warmup = 0;
+	size_t largest_frame = 0;
+	size_t rss_warm_kb = 0;     // high-water mark after the warm-up
+	size_t rss_peak_kb = 0;     // and at the end
+	size_t rss_end_kb = 0;
+	size_t peak_warm = 0;
+	size_t peak_end = 0;
+	double reuse_rate = 0.0;
+	double faults_per_navigation = 0.0;
+	bool flat = false;
+};
+
+arena_result run_arena(size_t navigations) {
+	static constexpr std::pair<std::uint32_t, std::uint32_t> sizes[] = {
+		{4000, 3000}, {6000, 4000}, {1920, 1080}, {4032, 3024}, {3000, 2000}, {2048, 1536}};
+	constexpr std::int64_t folder = 100;
+	std::mt19937 rng(26);
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> dims(folder);
+	for (auto& d : dims) d = sizes[rng() % std::size(sizes)];
+
+	arena_result r;
+	r.navigations = navigations;
+	r.warmup = std::min<size_t>(navigations / 10, 1000);
+	for (auto& d : sizes) r.largest_frame = std::max(r.largest_frame, size_t(d.first) * d.second * 4);
+
+	auto& arena = pixel_arena::get_instance();
+	std::unordered_map<std::int64_t, churn::picture> window;
+	std::int64_t current = 0;
+	size_t faults_warm = 0;
+	for (size_t n = 0; n < navigations; ++n) {
+		// mostly forward, some back, now and then a jump
+		const auto roll = rng() % 100;
+		current = roll < 2 ? static_cast<std::int64_t>(rng() % folder) : (current + (roll < 12 ? folder - 1 : 1)) % folder;
+		const std::int64_t wanted[] = {(current + folder - 1) % folder, current, (current + 1) % folder};
+		for (auto it = window.begin(); it != window.end();) {
+			if (std::find(std::begin(wanted), std::end(wanted), it->first) == std::end(wanted)) it = window.erase(it);
+			else ++it;
+		}
+		for (auto idx : wanted) {
+			if (window.count(idx)) continue;
+			churn::load(window[idx], dims[idx].first, dims[idx].second);
+		}
+
+		if (n + 1 == r.warmup) {
+			r.rss_warm_kb = peak_rss_kb();
+			r.peak_warm = arena.stats().peak_bytes;
+			faults_warm = churn::minor_faults();
+		}
+	}
+	r.rss_peak_kb = peak_rss_kb();
+	r.rss_end_kb = pressure::rss_kb();
+	const auto stats = arena.stats();
+	r.peak_end = stats.peak_bytes;
+	r.reuse_rate = stats.reuse_rate();
+	r.faults_per_navigation = double(churn::minor_faults() - faults_warm) / double(navigations - r.warmup);
+	r.flat = r.rss_peak_kb <= r.rss_warm_kb + r.largest_frame / 1024 && r.peak_end <= r.peak_warm + r.largest_frame;
+
+	std::cerr << "arena: " << navigations << " navigations, peak rss after " << r.warmup << " " << r.rss_warm_kb / 1024
+		<< " MB -> " << r.rss_peak_kb / 1024 << " MB (now " << r.rss_end_kb / 1024 << " MB); peak footprint "
+		<< r.peak_warm / (1024 * 1024) << " -> " << r.peak_end / (1024 * 1024) << " MB; reuse " << r.reuse_rate * 100.0
+		<< "%, " << r.faults_per_navigation << " page faults per navigation\n";
+	if (!r.flat) std::cerr << "arena: memory grew after the warm-up by more than one " << r.largest_frame / (1024 * 1024) << " MB frame\n";
+	return r;
+}
+
+void write_arena_json(std::ostream& os, const arena_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"arena\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"navigations\": " << r.navigations << ",\n  \"warmup\": " << r.warmup
+		<< ",\n  \"rss_warm_kb\": " << r.rss_warm_kb << ",\n  \"rss_peak_kb\": " << r.rss_peak_kb
+		<< ",\n  \"rss_end_kb\": " << r.rss_end_kb << ",\n  \"peak_warm_bytes\": " << r.peak_warm
+		<< ",\n  \"peak_end_bytes\": " << r.peak_end << ",\n  \"reuse_rate\": " << r.reuse_rate
+		<< ",\n  \"faults_per_navigation\": " << r.faults_per_navigation
+		<< ",\n  \"flat\": " << (r.flat ? "true" : "false") << "\n}\n";
+}
+
+// Archives: a CBZ of generated pictures, stored and deflated, against the
+// same pictures as files. Index is opening the archive and reading its
+// central directory; read is one member into memory, decode includes the
+// native decode after it. The deflated members are fixed Huffman literals,
+// the slowest stream to inflate per byte.
+namespace zipped {
+
+std::uint32_t crc32(const std::uint8_t* data, size_t size) {
+	static const auto table = []() {
+		std::array<std::uint32_t, 256> t{};
+		for (std::uint32_t i = 0; i < 256; ++i) {
+			std::uint32_t c = i;
+			for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+	std::uint32_t c = 0xFFFFFFFFu;
+	for (size_t i = 0; i < size; ++i) c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+	return c ^ 0xFFFFFFFFu;
+}
+
+// One fixed Huffman block of literals.
+std::vector<std::uint8_t> deflate_literals(const std::vector<std::uint8_t>& data) {
+	std::vector<std::uint8_t> out;
+	std::uint64_t bits = 0;
+	int count = 0;
+	auto put = [&](std::uint32_t v, int n) {
+		bits |= std::uint64_t(v) << count;
+		count += n;
+		while (count >= 8) {
+			out.push_back(static_cast<std::uint8_t>(bits));
+			bits >>= 8;
+			count -= 8;
+		}
+	};
+	// Huffman codes go in most significant bit first
+	auto code = [&](std::uint32_t c, int n) {
+		std::uint32_t reversed = 0;
+		for (int b = 0; b < n; ++b) reversed |= ((c >> b) & 1) << (n - 1 - b);
+		put(reversed, n);
+	};
+	put(1, 1);
+	put(1, 2);
+	for (auto byte : data) byte < 144 ? code(0x30 + byte, 8) : code(0x190 + byte - 144, 9);
+	code(0, 7);
+	if (count) put(0, 8 - count);
+	return out;
+}
+
+void write_archive(const fs::path& path, const std::vector<fs::path>& files, bool deflate) {
+	std::vector<std::uint8_t> zip, dir;
+	auto put16 = [](std::vector<std::uint8_t>& v, std::uint32_t x) { v.push_back(x & 0xFF); v.push_back((x >> 8) & 0xFF); };
+	auto put32 = [&](std::vector<std::uint8_t>& v, std::uint32_t x) { put16(v, x & 0xFFFF); put16(v, x >> 16); };
+	for (auto& file : files) {
+		const auto buffer = read_file(file);
+		const std::vector<std::uint8_t> data(buffer.data(), buffer.data() + buffer.size());
+		const auto stored = deflate ? deflate_literals(data) : data;
+		const auto name = file.filename().string();
+		const auto crc = crc32(data.data(), data.size());
+		const auto offset = static_cast<std::uint32_t>(zip.size());
+		for (auto* v : {&zip, &dir}) {
+			put32(*v, v == &zip ? 0x04034b50 : 0x02014b50);
+			if (v == &dir) put16(*v, 20);
+			put16(*v, 20);
+			put16(*v, 0);
+			put16(*v, deflate ? 8 : 0);
+			put32(*v, 0);
+			put32(*v, crc);
+			put32(*v, static_cast<std::uint32_t>(stored.size()));
+			put32(*v, static_cast<std::uint32_t>(data.size()));
+			put16(*v, static_cast<std::uint32_t>(name.size()));
+			put16(*v, 0);
+			if (v == &dir) {
+				// comment, disk, attributes
+				for (int i = 0; i < 5; ++i) put16(*v, 0);
+				put32(*v, offset);
+			}
+			v->insert(v->end(), name.begin(), name.end());
+		}
+		zip.insert(zip.end(), stored.begin(), stored.end());
+	}
+	const auto dir_offset = static_cast<std::uint32_t>(zip.size());
+	zip.insert(zip.end(), dir.begin(), dir.end());
+	put32(zip, 0x06054b50);
+	put32(zip, 0);
+	put16(zip, static_cast<std::uint32_t>(files.size()));
+	put16(zip, static_cast<std::uint32_t>(files.size()));
+	put32(zip, static_cast<std::uint32_t>(dir.size()));
+	put32(zip, dir_offset);
+	put16(zip, 0);
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(zip.data()), zip.size());
+}
+
+} // namespace zipped
+
+struct archive_result {
+	std::string source;
+	size_t entries = 0;
+	double bytes = 0.0;
+	double index_ms = 0.0;
+	double read_p50_us = 0.0;
+	double read_p99_us = 0.0;
+	double read_mbps = 0.0;
+	double decode_p50_us = 0.0;
+};
+
+std::vector<archive_result> run_archive(const fs::path& workdir, size_t entries) {
+	const auto dir = workdir / ("archive_" + std::to_string(entries));
+	fs::create_directories(dir / "files");
+	std::vector<fs::path> files;
+	for (size_t i = 0; i < entries; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "PAGE_%04zu.bmp", i);
+		files.push_back(dir / "files" / name);
+		if (!fs::exists(files.back())) write_bmp(files.back(), 600, 900, bmp_kind::bgr24, static_cast<std::uint32_t>(i));
+	}
+	const auto stored_path = dir / "stored.cbz", deflated_path = dir / "deflated.cbz";
+	if (!fs::exists(stored_path)) zipped::write_archive(stored_path, files, false);
+	if (!fs::exists(deflated_path)) zipped::write_archive(deflated_path, files, true);
+
+	auto measure = [&](const std::string& source, auto&& index, auto&& read) {
+		archive_result r;
+		r.source = source;
+		r.entries = entries;
+		std::vector<double> index_ms, read_us, decode_us;
+		for (int run = 0; run < 5; ++run) {
+			const auto start = clock_type::now();
+			index();
+			index_ms.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - start).count());
+		}
+		double seconds = 0.0;
+		for (size_t i = 0; i < entries; ++i) {
+			auto start = clock_type::now();
+			const auto bytes = read(i);
+			const auto read_time = clock_type::now() - start;
+			image_buffer pixels;
+			const bool ok = bytes && decoders::native::decode(bytes.data(), bytes.size(), pixels);
+			if (!ok) std::cerr << "archive: " << source << " entry " << i << " didn't decode\n";
+			read_us.push_back(std::chrono::duration<double, std::micro>(read_time).count());
+			decode_us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+			seconds += std::chrono::duration<double>(read_time).count();
+			r.bytes += static_cast<double>(bytes.size());
+		}
+		r.index_ms = percentile(index_ms, 0.5);
+		r.read_p50_us = percentile(read_us, 0.50);
+		r.read_p99_us = percentile(read_us, 0.99);
+		r.read_mbps = seconds > 0 ? r.bytes / (1024.0 * 1024.0) / seconds : 0.0;
+		r.decode_p50_us = percentile(decode_us, 0.50);
+		std::cerr << "archive: " << source << " index " << r.index_ms << " ms, read p50 " << r.read_p50_us << " us, p99 "
+			<< r.read_p99_us << " us, " << r.read_mbps << " MB/s, read+decode p50 " << r.decode_p50_us << " us\n";
+		return r;
+	};
+
+	std::vector<archive_result> results;
+	results.push_back(measure("files", [&]() { return scan_directory(dir / "files"); }, [&](size_t i) { return read_file(files[i]); }));
+	for (auto& path : {stored_path, deflated_path}) {
+		const auto archive = zip::archive::open(path);
+		if (!archive || archive->entries().size() != entries) {
+			std::cerr << "archive: " << path << " didn't index\n";
+			continue;
+		}
+		results.push_back(measure(path.stem().string(), [&]() { return zip::archive::open(path); },
+			[&](size_t i) { return archive->read(i); }));
+	}
+	return results;
+}
+
+void write_archive_json(std::ostream& os, const std::vector<archive_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"archive\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"picture\": \"600x900 bmp\",\n  \"sources\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << "    {\"source\": \"" << r.source << "\", \"entries\": " << r.entries << ", \"bytes\": " << r.bytes
+			<< ", \"index_ms\": " << r.index_ms
+			<< ", \"read_us\": {\"p50\": " << r.read_p50_us << ", \"p99\": " << r.read_p99_us << "}"
+			<< ", \"read_mbps\": " << r.read_mbps << ", \"read_decode_p50_us\": " << r.decode_p50_us << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+// Catalog memory: a synthetic folder of `entries` names held the way the
+// viewer used to hold it, an Image per file with its path, strand and empty
+// pixel state, against the catalog's columns. Nothing is read from disk.
+namespace listing {
+
+// The per-file fields Image had before the catalog, none of them loaded.
+struct image_object {
+	void* window;
+	std::string path;
+	image_buffer pixels;
+	std::vector<image_buffer> lods;
+	std::vector<std::shared_ptr<void>> bitmaps;
+	std::uint64_t generation = 0;
+	std::shared_ptr<const void> stats;
+	hdr::half_buffer hdr;
+	size_t hdr_level = 0;
+	hdr::tone tone;
+	std::shared_ptr<const void> lut;
+	size_t finest = 0;
+	int status = 0;
+	boost::asio::strand<boost::asio::io_context::executor_type> strand;
+	load::ticket ticket;
+	std::uint64_t started = 0, settled = 0;
+	std::shared_ptr<const zip::archive> archive;
+	size_t member = 0;
+	std::atomic<std::int64_t> index;
+	std::uint64_t file_bytes;
+	CirculalInterval<std::int64_t> rotation_idx{0, 3, 1};
+
+	image_object(std::string p, std::int64_t i, std::uint64_t bytes)
+		: window{nullptr}, path{std::move(p)}, strand{boost::asio::make_strand(tp::get_instance().ctx())}, index{i}, file_bytes{bytes} {}
+};
+
+const char* const directory = "/home/user/Pictures/2024/shoot";
+
+// Shuffled like a directory listing, which isn't sorted.
+std::vector<std::string> names(size_t entries) {
+	std::vector<std::string> names(entries);
+	for (size_t i = 0; i < entries; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "IMG_%07zu.jpg", i);
+		names[i] = name;
+	}
+	std::shuffle(names.begin(), names.end(), std::mt19937(7));
+	return names;
+}
+
+} // namespace listing
+
+struct catalog_result {
+	std::string layout;
+	size_t entries = 0;
+	double build_ms = 0.0;
+	double rss_bytes_per_entry = 0.0;
+	double heap_bytes_per_entry = 0.0;
+	double find_p50_ns = 0.0;
+};
+
+std::vector<catalog_result> run_catalog(size_t entries) {
+	const auto names = listing::names(entries);
+	std::vector<size_t> probes(10000);
+	std::mt19937 rng(11);
+	for (auto& p : probes) p = rng() % entries;
+	std::vector<catalog_result> results;
+
+	// the columns first, the objects' small blocks would be reused otherwise
+	{
+		catalog_result r{"catalog", entries};
+		const auto rss = pressure::rss_kb();
+		const auto start = clock_type::now();
+		catalog c;
+		const auto dir = c.add_directory(listing::directory);
+		for (auto& name : names) c.add(dir, name, 4u << 20, 0);
+		c.sort();
+		r.build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+		r.rss_bytes_per_entry = double(pressure::rss_kb() - std::min(rss, pressure::rss_kb())) * 1024.0 / entries;
+		r.heap_bytes_per_entry = double(c.bytes()) / entries;
+
+		std::vector<double> find_ns;
+		std::int64_t found = 0;
+		for (auto p : probes) {
+			const auto path = fs::path(listing::directory) / names[p];
+			const auto t = clock_type::now();
+			found += c.find(path) >= 0;
+			find_ns.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - t).count());
+		}
+		if (found != static_cast<std::int64_t>(probes.size())) std::cerr << "catalog: lookups missed\n";
+		r.find_p50_ns = percentile(find_ns, 0.5);
+		results.push_back(r);
+	}
+	{
+		catalog_result r{"image_objects", entries};
+		const auto rss = pressure::rss_kb();
+		const auto start = clock_type::now();
+		auto files = names;
+		std::sort(files.begin(), files.end());
+		std::deque<listing::image_object> images;
+		for (auto& name : files) {
+			images.emplace_back(std::string(listing::directory) + "/" + name, images.size(), 4u << 20);
+		}
+		r.build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+		files = {};
+		r.rss_bytes_per_entry = double(pressure::rss_kb() - std::min(rss, pressure::rss_kb())) * 1024.0 / entries;
+		// the object and its path, the strand's implementation comes on top
+		r.heap_bytes_per_entry = double(sizeof(listing::image_object)) + images.front().path.capacity() + 1;
+
+		std::vector<double> find_ns;
+		for (auto p : probes) {
+			const auto path = std::string(listing::directory) + "/" + names[p];
+			const auto t = clock_type::now();
+			const auto it = std::find_if(images.begin(), images.end(), [&](const listing::image_object& img) { return img.path == path; });
+			find_ns.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - t).count());
+			if (it == images.end()) std::cerr << "catalog: lookups missed\n";
+			if (find_ns.size() == 100) break;
+		}
+		r.find_p50_ns = percentile(find_ns, 0.5);
+		results.push_back(r);
+	}
+	for (auto& r : results) {
+		std::cerr << "catalog: " << r.layout << " " << r.entries << " entries, build " << r.build_ms << " ms, "
+			<< r.rss_bytes_per_entry << " B/entry resident (" << r.heap_bytes_per_entry << " counted), find p50 "
+			<< r.find_p50_ns / 1000.0 << " us\n";
+	}
+	return results;
+}
+
+void write_catalog_json(std::ostream& os, const std::vector<catalog_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"catalog\",\n  \"version\": 1,\n  \"timestamp\": " << now << ",\n  \"layouts\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << "    {\"layout\": \"" << r.layout << "\", \"entries\": " << r.entries << ", \"build_ms\": " << r.build_ms
+			<< ", \"rss_bytes_per_entry\": " << r.rss_bytes_per_entry << ", \"heap_bytes_per_entry\": " << r.heap_bytes_per_entry
+			<< ", \"find_p50_ns\": " << r.find_p50_ns << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+// Scrub bar: a scripted drag over a folder of `entries` pictures, a mouse
+// event every 8 ms. The previews decode latest wins against a decode queued
+// for every position the cursor passes, as a thumbnail strip would. Entries
+// share a few real files, the decoder is the native one at full size, the
+// worst case the viewer falls back to.
+struct scrub_result {
+	std::string design;
+	size_t entries = 0;
+	size_t events = 0;
+	size_t positions = 0;
+	size_t decodes = 0;
+	double latency_p50_ms = 0.0;
+	double latency_p99_ms = 0.0;
+	double settle_ms = 0.0;
+};
+
+std::vector<scrub_result> run_scrub(const fs::path& workdir, size_t entries) {
+	constexpr size_t files = 32;
+	constexpr auto event_interval = std::chrono::milliseconds(8);
+	const auto dir = workdir / "scrub";
+	fs::create_directories(dir);
+	std::vector<fs::path> paths;
+	for (size_t i = 0; i < files; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "IMG_%02zu.bmp", i);
+		paths.push_back(dir / name);
+		if (!fs::exists(paths.back())) write_bmp(paths.back(), 1600, 1200, bmp_kind::bgr24, static_cast<std::uint32_t>(i));
+	}
+	auto decode = [&paths](std::int64_t idx, image_buffer& out) {
+		const auto file = read_file(paths[static_cast<size_t>(idx) % paths.size()]);
+		return file && decoders::native::decode(file.data(), file.size(), out);
+	};
+
+	// a full sweep in 2 s on a 1600 px bar, then a slow look around the end
+	std::vector<std::int64_t> script;
+	const auto n = static_cast<std::int64_t>(entries);
+	for (int e = 0; e <= 250; ++e) script.push_back(scrub::index_at(e * 6.4f, 1600.0f, n));
+	for (int e = 0; e < 60; ++e) script.push_back(scrub::index_at(1600.0f - e * 2.0f, 1600.0f, n));
+
+	struct ready_log {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::unordered_map<std::int64_t, clock_type::time_point> at;
+		std::atomic<size_t> decodes{0};
+
+		void add(std::int64_t idx) {
+			std::lock_guard<std::mutex> lk(mutex);
+			at.emplace(idx, clock_type::now());
+			cv.notify_all();
+		}
+		clock_type::time_point wait(std::int64_t idx) {
+			std::unique_lock<std::mutex> lk(mutex);
+			cv.wait(lk, [&]() { return at.count(idx) != 0; });
+			return at[idx];
+		}
+	};
+
+	// Plays the script; `request` asks for a position. Latency is from a
+	// position's first request to its preview, for those that got one.
+	auto play = [&](scrub_result& r, ready_log& log, const std::function<void(std::int64_t)>& request) {
+		std::unordered_map<std::int64_t, clock_type::time_point> asked;
+		auto next = clock_type::now();
+		std::int64_t last = -1;
+		for (auto idx : script) {
+			std::this_thread::sleep_until(next);
+			next += event_interval;
+			++r.events;
+			if (idx == last) continue;
+			last = idx;
+			++r.positions;
+			asked.emplace(idx, clock_type::now());
+			request(idx);
+		}
+		// the button comes up over `last`
+		const auto release = clock_type::now();
+		r.settle_ms = std::chrono::duration<double, std::milli>(log.wait(last) - release).count();
+		std::vector<double> latency;
+		{
+			std::lock_guard<std::mutex> lk(log.mutex);
+			for (auto& [idx, t] : log.at) {
+				if (const auto it = asked.find(idx); it != asked.end()) {
+					latency.push_back(std::chrono::duration<double, std::milli>(t - it->second).count());
+				}
+			}
+		}
+		r.latency_p50_ms = percentile(latency, 0.50);
+		r.latency_p99_ms = percentile(latency, 0.99);
+	};
+
+	std::vector<scrub_result> results;
+	{
+		scrub_result r{"latest_wins", entries};
+		ready_log log;
+		scrub::previews<tp> previews(tp::get_instance(), size_t(32) << 20, 128, [&log](std::int64_t idx) { log.add(idx); });
+		previews.reset([&](std::int64_t idx, image_buffer& out) {
+			++log.decodes;
+			return decode(idx, out);
+		});
+		play(r, log, [&](std::int64_t idx) { previews.request(idx); });
+		previews.cancel();
+		r.decodes = log.decodes;
+		results.push_back(r);
+	}
+	{
+		scrub_result r{"every_position", entries};
+		ready_log log;
+		std::atomic<size_t> pending{0};
+		play(r, log, [&](std::int64_t idx) {
+			++pending;
+			async<false>(tp::get_instance().ctx(), [&, idx]() {
+				++log.decodes;
+				image_buffer out;
+				if (decode(idx, out)) scrub::shrink(std::move(out), 128);
+				log.add(idx);
+				--pending;
+			});
+		});
+		// the rest of the queue still drains
+		while (pending) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		r.decodes = log.decodes;
+		results.push_back(r);
+	}
+	for (auto& r : results) {
+		std::cerr << "scrub: " << r.design << " " << r.positions << " positions over " << r.entries << " entries, "
+			<< r.decodes << " decodes, preview p50 " << r.latency_p50_ms << " ms p99 " << r.latency_p99_ms
+			<< " ms, settles " << r.settle_ms << " ms after release\n";
+	}
+	return results;
+}
+
+void write_scrub_json(std::ostream& os, const std::vector<scrub_result>& results) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"scrub\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"threads\": " << tp::number_of_threads() << ",\n  \"picture\": \"1600x1200 bmp\",\n  \"designs\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto& r = results[i];
+		os << "    {\"design\": \"" << r.design << "\", \"entries\": " << r.entries << ", \"events\": " << r.events
+			<< ", \"positions\": " << r.positions << ", \"decodes\": " << r.decodes
+			<< ", \"latency_p50_ms\": " << r.latency_p50_ms << ", \"latency_p99_ms\": " << r.latency_p99_ms
+			<< ", \"settle_ms\": " << r.settle_ms << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+// EXIF index: `entries` JPEGs with an Exif segment and 256K of scan data
+// each, indexed from their headers with no cache, from the full files the
+// way a per-file read would, and again from the cache. Filters are timed
+// over a million synthetic rows.
+namespace exif_files {
+
+void be16(std::vector<std::uint8_t>& v, unsigned x) { v.push_back(static_cast<std::uint8_t>(x >> 8)); v.push_back(static_cast<std::uint8_t>(x)); }
+void le16(std::vector<std::uint8_t>& v, unsigned x) { v.push_back(static_cast<std::uint8_t>(x)); v.push_back(static_cast<std::uint8_t>(x >> 8)); }
+void le32(std::vector<std::uint8_t>& v, unsigned x) { le16(v, x & 0xFFFF); le16(v, x >> 16); }
+
+// Picture i of a shoot with three cameras over ten days, a third of them
+// turned portrait.
+exif::fields fields(size_t i) {
+	static const char* const models[] = {"Canon EOS R5", "NIKON Z 6_2", "ILCE-7M4"};
+	static const char* const makes[] = {"Canon", "NIKON CORPORATION", "SONY"};
+	exif::fields f;
+	f.make = makes[i % 3];
+	f.model = models[i % 3];
+	f.lens = i % 2 ? "24-70mm F2.8" : "85mm F1.8";
+	f.taken = (exif::detail::days_from_civil(2024, 5, 1) + static_cast<std::int64_t>(i % 10)) * 86400 + static_cast<std::int64_t>(i % 86400);
+	f.iso = 100u << (i % 6);
+	f.width = 6000;
+	f.height = 4000;
+	f.orientation = i % 3 == 0 ? 6 : 1;
+	return f;
+}
+
+// SOI, the Exif APP1 segment, SOF0 and a scan of filler.
+std::vector<std::uint8_t> jpeg(const exif::fields& f, size_t scan_bytes) {
+	std::vector<std::uint8_t> tiff{'I', 'I', 42, 0};
+	le32(tiff, 8);
+	char date[32];
+	const auto day = f.taken / 86400;
+	const auto name = exif::day_name(day);
+	std::snprintf(date, sizeof(date), "%.4s:%.2s:%.2s %02d:%02d:%02d", name.c_str(), name.c_str() + 5, name.c_str() + 8,
+		static_cast<int>(f.taken % 86400 / 3600), static_cast<int>(f.taken % 3600 / 60), static_cast<int>(f.taken % 60));
+	const std::string strings[] = {f.make, f.model, date, f.lens};
+	const unsigned ifd0 = 8, exif_ifd = ifd0 + 2 + 4 * 12 + 4, data = exif_ifd + 2 + 4 * 12 + 4;
+	unsigned offsets[4], at = data;
+	for (int i = 0; i < 4; ++i) {
+		offsets[i] = at;
+		at += static_cast<unsigned>(strings[i].size()) + 1;
+	}
+	auto entry = [&](unsigned tag, unsigned type, unsigned count, unsigned value) {
+		le16(tiff, tag);
+		le16(tiff, type);
+		le32(tiff, count);
+		le32(tiff, value);
+	};
+	auto text = [&](unsigned tag, int i) { entry(tag, 2, static_cast<unsigned>(strings[i].size()) + 1, offsets[i]); };
+	le16(tiff, 4);
+	text(0x010F, 0);
+	text(0x0110, 1);
+	entry(0x0112, 3, 1, f.orientation);
+	entry(0x8769, 4, 1, exif_ifd);
+	le32(tiff, 0);
+	le16(tiff, 4);
+	text(0x9003, 2);
+	entry(0x8827, 3, 1, f.iso);
+	entry(0xA002, 4, 1, f.width);
+	text(0xA434, 3);
+	le32(tiff, 0);
+	for (auto& s : strings) tiff.insert(tiff.end(), s.c_str(), s.c_str() + s.size() + 1);
+
+	std::vector<std::uint8_t> out{0xFF, 0xD8, 0xFF, 0xE1};
+	be16(out, static_cast<unsigned>(tiff.size()) + 8);
+	out.insert(out.end(), {'E', 'x', 'i', 'f', 0, 0});
+	out.insert(out.end(), tiff.begin(), tiff.end());
+	out.insert(out.end(), {0xFF, 0xC0});
+	be16(out, 17);
+	out.push_back(8);
+	be16(out, f.height);
+	be16(out, f.width);
+	out.insert(out.end(), 12, 0);
+	out.insert(out.end(), {0xFF, 0xDA});
+	out.insert(out.end(), scan_bytes, 0x55);
+	out.insert(out.end(), {0xFF, 0xD9});
+	return out;
+}
+
+} // namespace exif_files
+
+struct exif_result {
+	size_t entries = 0;
+	double headers_files_per_sec = 0.0;
+	double full_files_per_sec = 0.0;
+	double cached_ms = 0.0;
+	size_t matched = 0;
+	struct query { std::string name; size_t kept; double p50_us; };
+	size_t rows = 0;
+	double index_bytes_per_row = 0.0;
+	std::vector<query> queries;
+};
+
+exif_result run_exif(const fs::path& workdir, size_t entries) {
+	exif_result r;
+	r.entries = entries;
+	const auto dir = workdir / ("exif_" + std::to_string(entries));
+	fs::create_directories(dir);
+	for (size_t i = 0; i < entries; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "DSC_%06zu.jpg", i);
+		if (fs::exists(dir / name)) continue;
+		const auto bytes = exif_files::jpeg(exif_files::fields(i), 256 * 1024);
+		std::ofstream(dir / name, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	}
+	const auto pictures = std::make_shared<const catalog>(catalog::scan(dir));
+	const auto cache = workdir / "imv_exif_bench.cache";
+
+	// header reads through the indexer, then from its cache
+	auto index_once = [&](double& ms) {
+		exif::indexer indexer(cache);
+		const auto start = clock_type::now();
+		indexer.start(pictures);
+		std::shared_ptr<const exif::index> index;
+		while (!(index = indexer.get())) std::this_thread::sleep_for(std::chrono::microseconds(200));
+		ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+		return index;
+	};
+	std::error_code ec;
+	fs::remove(cache, ec);
+	double cold_ms = 0.0;
+	const auto index = index_once(cold_ms);
+	r.headers_files_per_sec = entries / (cold_ms / 1000.0);
+	index_once(r.cached_ms);
+	for (size_t i = 0; i < index->size(); ++i) {
+		const auto f = exif_files::fields(std::stoul(pictures->path(i).stem().string().substr(4)));
+		r.matched += index->taken(i) == f.taken && index->iso(i) == f.iso && index->orientation(i) == f.orientation;
+	}
+	if (r.matched != entries) std::cerr << "exif: " << entries - r.matched << " entries read wrong\n";
+
+	// what a read per file on demand costs, the whole file then its fields
+	{
+		const auto start = clock_type::now();
+		std::atomic<size_t> next{0};
+		std::vector<std::thread> workers;
+		for (unsigned t = 0; t < std::max(2u, std::thread::hardware_concurrency()); ++t) {
+			workers.emplace_back([&]() {
+				for (size_t i; (i = next.fetch_add(1)) < pictures->size();) {
+					const auto file = read_file(pictures->path(i));
+					exif::fields f;
+					if (file) exif::read(file.data(), file.size(), f);
+				}
+			});
+		}
+		for (auto& t : workers) t.join();
+		r.full_files_per_sec = entries / std::chrono::duration<double>(clock_type::now() - start).count();
+	}
+
+	// filters over a million rows
+	r.rows = 1000000;
+	exif::index rows(r.rows);
+	for (size_t i = 0; i < r.rows; ++i) rows.set(i, exif_files::fields(i));
+	r.index_bytes_per_row = double(rows.bytes()) / r.rows;
+	auto time_query = [&](const char* name, const exif::filter& f) {
+		std::vector<double> us;
+		size_t kept = 0;
+		for (int rep = 0; rep < 21; ++rep) {
+			const auto t = clock_type::now();
+			kept = rows.select(f).size();
+			us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t).count());
+		}
+		r.queries.push_back({name, kept, percentile(us, 0.5)});
+	};
+	exif::filter camera, day, portrait, combined;
+	camera.camera = rows.camera(0);
+	day.day = rows.day(3);
+	portrait.shape = exif::shape::portrait;
+	combined = camera;
+	combined.day = rows.day(3);
+	combined.shape = exif::shape::portrait;
+	time_query("camera", camera);
+	time_query("day", day);
+	time_query("portrait", portrait);
+	time_query("camera_day_portrait", combined);
+
+	std::cerr << "exif: " << entries << " files, headers " << r.headers_files_per_sec << "/s, full files "
+		<< r.full_files_per_sec << "/s, from the cache in " << r.cached_ms << " ms\n";
+	for (auto& q : r.queries) {
+		std::cerr << "exif: " << q.name << " keeps " << q.kept << " of " << r.rows << " rows in " << q.p50_us << " us\n";
+	}
+	return r;
+}
+
+void write_exif_json(std::ostream& os, const exif_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"exif\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"entries\": " << r.entries << ",\n  \"headers_files_per_sec\": " << r.headers_files_per_sec
+		<< ",\n  \"full_files_per_sec\": " << r.full_files_per_sec << ",\n  \"cached_ms\": " << r.cached_ms
+		<< ",\n  \"matched\": " << r.matched << ",\n  \"rows\": " << r.rows
+		<< ",\n  \"index_bytes_per_row\": " << r.index_bytes_per_row << ",\n  \"queries\": [\n";
+	for (size_t i = 0; i < r.queries.size(); ++i) {
+		const auto& q = r.queries[i];
+		os << "    {\"filter\": \"" << q.name << "\", \"kept\": " << q.kept << ", \"p50_us\": " << q.p50_us << "}"
+			<< (i + 1 < r.queries.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+// Type-to-filter: queries typed a key at a time over a folder of `entries`
+// names the way cameras and phones make them, then erased with Backspace.
+// Every keystroke, the first one included, goes through the index and the
+// result of the query before it, and each result is checked against a
+// case-insensitive scan of every name.
+struct names_result {
+	size_t entries = 0;
+	double build_ms = 0.0;
+	double index_bytes_per_entry = 0.0;
+	struct query { std::string text; size_t kept; double p50_us, max_us, erase_max_us, scan_p50_us, scan_max_us; };
+	std::vector<query> queries;
+};
+
+names_result run_names(size_t entries) {
+	names_result r;
+	r.entries = entries;
+	catalog c;
+	const auto dir = c.add_directory(listing::directory);
+	{
+		std::mt19937 rng(5);
+		const char* const places[] = {"Paris", "Beach", "Alps", "Birthday", "Wedding", "Garden"};
+		for (size_t i = 0; i < entries; ++i) {
+			char name[64];
+			switch (i % 5) {
+			case 0: case 1: std::snprintf(name, sizeof(name), "DSC_%05zu.JPG", rng() % 100000); break;
+			case 2: std::snprintf(name, sizeof(name), "IMG_%07zu.jpg", i); break;
+			case 3: std::snprintf(name, sizeof(name), "PXL_2024%02u%02u_%06u.jpg", unsigned(rng() % 12 + 1), unsigned(rng() % 28 + 1), unsigned(rng() % 240000)); break;
+			default: std::snprintf(name, sizeof(name), "%s %zu - edited.png", places[rng() % 6], i); break;
+			}
+			c.add(dir, name, 4u << 20, 0);
+		}
+		c.sort();
+	}
+	const auto pictures = std::make_shared<const catalog>(std::move(c));
+
+	const auto start = clock_type::now();
+	const auto index = std::make_shared<const names::index>(pictures);
+	r.build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	r.index_bytes_per_entry = double(index->bytes()) / entries;
+
+	auto scan = [&](const std::string& q) {
+		size_t kept = 0;
+		for (size_t i = 0; i < pictures->size(); ++i) {
+			const auto name = pictures->name(i);
+			kept += std::search(name.begin(), name.end(), q.begin(), q.end(),
+				[](char a, char b) { return names::fold(a) == names::fold(b); }) != name.end();
+		}
+		return kept;
+	};
+
+	for (const std::string text : {"dsc_4821", "pxl_20240704", "beach", "edited"}) {
+		// typed, then erased down to nothing
+		std::vector<double> us, erase_us, scan_us;
+		std::vector<size_t> kept(text.size() + 1);
+		for (int rep = 0; rep < 5; ++rep) {
+			names::search s(index);
+			for (size_t n = 1; n <= text.size(); ++n) {
+				const auto t = clock_type::now();
+				const auto found = s.find(text.substr(0, n));
+				us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t).count());
+				kept[n] = found->size();
+			}
+			for (size_t n = text.size(); n-- > 0;) {
+				const auto t = clock_type::now();
+				s.find(text.substr(0, n));
+				erase_us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t).count());
+			}
+		}
+		for (size_t n = 1; n <= text.size(); ++n) {
+			const auto t = clock_type::now();
+			const auto scanned = scan(text.substr(0, n));
+			scan_us.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - t).count());
+			if (scanned != kept[n]) std::cerr << "names: " << text.substr(0, n) << " kept " << kept[n] << ", the scan " << scanned << "\n";
+		}
+		r.queries.push_back({text, kept.back(), percentile(us, 0.5), *std::max_element(us.begin(), us.end()),
+			*std::max_element(erase_us.begin(), erase_us.end()),
+			percentile(scan_us, 0.5), *std::max_element(scan_us.begin(), scan_us.end())});
+	}
+
+	std::cerr << "names: " << entries << " names, index built in " << r.build_ms << " ms, "
+		<< r.index_bytes_per_entry << " B/entry\n";
+	for (auto& q : r.queries) {
+		std::cerr << "names: \"" << q.text << "\" keeps " << q.kept << ", per key p50 " << q.p50_us << " us max "
+			<< q.max_us << " us, erasing max " << q.erase_max_us << " us, scanning p50 " << q.scan_p50_us << " us max " << q.scan_max_us << " us\n";
+	}
+	return r;
+}
+
+void write_names_json(std::ostream& os, const names_result& r) {
+	const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	os << "{\n  \"benchmark\": \"names\",\n  \"version\": 1,\n  \"timestamp\": " << now
+		<< ",\n  \"entries\": " << r.entries << ",\n  \"build_ms\": " << r.build_ms
+		<< ",\n  \"index_bytes_per_entry\": " << r.index_bytes_per_entry << ",\n  \"queries\": [\n";
+	for (size_t i = 0; i < r.queries.size(); ++i) {
+		const auto& q = r.queries[i];
+		os << "    {\"query\": \"" << q.text << "\", \"kept\": " << q.kept << ", \"p50_us\": " << q.p50_us
+			<< ", \"max_us\": " << q.max_us << ", \"erase_max_us\": " << q.erase_max_us << ", \"scan_p50_us\": " << q.scan_p50_us << ", \"scan_max_us\": " << q.scan_max_us << "}"
+			<< (i + 1 < r.queries.size() ? ",\n" : "\n");
+	}
+	os << "  ]\n}\n";
+}
+
+std::vector<std::string> split(const std::string& str) {
+	std::vector<std::string> parts;
+	std::stringstream ss(str);
+	for (std::string part; std::getline(ss, part, ',');) {
+		if (!part.empty()) parts.push_back(part);
+	}
+	return parts;
+}
+
+void usage() {
+	std::cerr <<
+		"usage: imv_bench [options]\n"
+		"  --mode navigation|render|phash|color|hdr|decode|handoff|startup|pipeline|pressure|arena|archive|catalog|scrub|exif|names\n"
+		"                               what to measure (default navigation)\n"
+		"  --corpus small,medium,large  generated corpora to run (default small,medium)\n"
+		"  --dir <path>                 run on an existing folder instead\n"
+		"  --scenario <a,b,...>         steady, skim, back_and_forth, zoom_pan, seek (default all)\n"
+		"  --keys <n>                   key presses per run (default 100)\n"
+		"  --frames <n>                 frames per render case (default 30)\n"
+		"  --entries <n>                hashes in the phash index (default 100000),\n"
+		"                               neighbours of the opened picture in startup mode,\n"
+		"                               members in archive mode, files in catalog, scrub, exif and names modes\n"
+		"  --handoffs <n>               forwarded launches in handoff mode (default 1000)\n"
+		"  --loads <n>                  loads per design in pipeline mode (default 10000)\n"
+		"  --navigations <n>            steps through the folder in arena mode (default 10000)\n"
+		"  --workdir <path>             where corpora are generated (default temp dir)\n"
+		"  --out <file>                 write JSON there instead of stdout\n"
+		"  --trace <file>               record a Chrome trace of the runs\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> corpus_names{"small", "medium"};
+	std::vector<std::string> scenario_names;
+	fs::path dir, out, trace_file;
+	fs::path workdir = fs::temp_directory_path() / "imv_bench";
+	std::string mode = "navigation";
+	size_t keys = 100, frames = 30, entries = 100000, handoffs = 1000, loads = 10000, navigations = 10000;
+	bool mode_entries = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--mode" && has_value) mode = argv[++i];
+		else if (arg == "--corpus" && has_value) corpus_names = split(argv[++i]);
+		else if (arg == "--dir" && has_value) dir = argv[++i];
+		else if (arg == "--scenario" && has_value) scenario_names = split(argv[++i]);
+		else if (arg == "--keys" && has_value) keys = std::stoul(argv[++i]);
+		else if (arg == "--frames" && has_value) frames = std::stoul(argv[++i]);
+		else if (arg == "--entries" && has_value) entries = std::stoul(argv[++i]), mode_entries = true;
+		else if (arg == "--handoffs" && has_value) handoffs = std::stoul(argv[++i]);
+		else if (arg == "--loads" && has_value) loads = std::stoul(argv[++i]);
+		else if (arg == "--navigations" && has_value) navigations = std::stoul(argv[++i]);
+		else if (arg == "--workdir" && has_value) workdir = argv[++i];
+		else if (arg == "--out" && has_value) out = argv[++i];
+		else if (arg == "--trace" && has_value) trace_file = argv[++i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	auto selected = [&scenario_names](const char* name) {
+		return scenario_names.empty() ||
+			std::find(scenario_names.begin(), scenario_names.end(), name) != scenario_names.end();
+	};
+
+	if (!trace_file.empty()) {
+		trace::tracer::get_instance().name_thread("ui");
+		trace::tracer::get_instance().enable(true);
+	}
+
+	if (mode == "render") {
+		const auto results = run_render(frames);
+		if (out.empty()) {
+			write_render_json(std::cout, results);
+		} else {
+			std::ofstream os(out);
+			write_render_json(os, results);
+		}
+		soft::render_pool::get_instance().stop();
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "phash") {
+		const auto result = run_phash(entries);
+		if (out.empty()) {
+			write_phash_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_phash_json(os, result);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "color") {
+		const auto results = run_color();
+		if (out.empty()) {
+			write_color_json(std::cout, results);
+		} else {
+			std::ofstream os(out);
+			write_color_json(os, results);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "hdr") {
+		const auto result = run_hdr();
+		if (out.empty()) {
+			write_hdr_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_hdr_json(os, result);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "decode") {
+		if (dir.empty()) {
+			usage();
+			return 1;
+		}
+		const auto results = run_decode(dir);
+		if (out.empty()) {
+			write_decode_json(std::cout, dir, results);
+		} else {
+			std::ofstream os(out);
+			write_decode_json(os, dir, results);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "handoff") {
+		const auto result = run_handoff(handoffs);
+		if (out.empty()) {
+			write_handoff_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_handoff_json(os, result);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "startup") {
+		const auto result = run_startup(workdir, mode_entries ? entries : 10000);
+		if (out.empty()) {
+			write_startup_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_startup_json(os, result);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "pipeline") {
+		const auto results = run_pipelines(loads);
+		if (out.empty()) {
+			write_pipeline_json(std::cout, results);
+		} else {
+			std::ofstream os(out);
+			write_pipeline_json(os, results);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "archive") {
+		const auto results = run_archive(workdir, mode_entries ? entries : 200);
+		if (out.empty()) {
+			write_archive_json(std::cout, results);
+		} else {
+			std::ofstream os(out);
+			write_archive_json(os, results);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "catalog") {
+		const auto results = run_catalog(mode_entries ? entries : 1000000);
+		if (out.empty()) {
+			write_catalog_json(std::cout, results);
+		} else {
+			std::ofstream os(out);
+			write_catalog_json(os, results);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "scrub") {
+		const auto results = run_scrub(workdir, mode_entries ? entries : 100000);
+		if (out.empty()) {
+			write_scrub_json(std::cout, results);
+		} else {
+			std::ofstream os(out);
+			write_scrub_json(os, results);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "exif") {
+		const auto result = run_exif(workdir, mode_entries ? entries : 2000);
+		if (out.empty()) {
+			write_exif_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_exif_json(os, result);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "names") {
+		const auto result = run_names(mode_entries ? entries : 1000000);
+		if (out.empty()) {
+			write_names_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_names_json(os, result);
+		}
+		tp::get_instance().stop();
+		return 0;
+	} else if (mode == "arena") {
+		const auto result = run_arena(navigations);
+		if (out.empty()) {
+			write_arena_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_arena_json(os, result);
+		}
+		tp::get_instance().stop();
+		return result.flat ? 0 : 1;
+	} else if (mode == "pressure") {
+		const auto result = run_pressure();
+		if (out.empty()) {
+			write_pressure_json(std::cout, result);
+		} else {
+			std::ofstream os(out);
+			write_pressure_json(os, result);
+		}
+		tp::get_instance().stop();
+		return result.exceeded.empty() ? 0 : 1;
+	} else if (mode != "navigation") {
+		usage();
+		return 1;
+	}
+
+	std::vector<result> results;
+	try {
+		std::vector<std::pair<std::string, fs::path>> dirs;
+		if (!dir.empty()) {
+			dirs.emplace_back(dir.filename().string(), dir);
+		} else {
+			for (auto& spec : corpora) {
+				if (std::find(corpus_names.begin(), corpus_names.end(), spec.name) == corpus_names.end()) continue;
+				std::cerr << "generating " << spec.name << "...\n";
+				dirs.emplace_back(spec.name, generate_corpus(workdir, spec));
+			}
+		}
+
+		for (auto& [name, path] : dirs) {
+			for (auto& sc : scenarios) {
+				if (!selected(sc.name)) continue;
+				std::cerr << name << " / " << sc.name << "\n";
+				results.push_back(run(name, path, sc, keys));
+			}
+		}
+	} catch (std::exception& ex) {
+		std::cerr << "error: " << ex.what() << "\n";
+		tp::get_instance().stop();
+		return 1;
+	}
+
+	if (out.empty()) {
+		write_json(std::cout, results);
+	} else {
+		std::ofstream os(out);
+		write_json(os, results);
+	}
+
+	if (!trace_file.empty()) {
+		std::ofstream os(trace_file);
+		trace::tracer::get_instance().dump(os);
+	}
+
+	tp::get_instance().stop();
+	return 0;
+}
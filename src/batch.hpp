@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catalog.hpp"
+#include "image_buffer.hpp"
+#include "pixel_ops.hpp"
+#include "soft_renderer.hpp"
+#include "decoder_registry.hpp"
+#include "bmp_encoder.hpp"
+#include "trace.hpp"
+
+// Headless batch processing: resize, thumbnail or convert every picture in a
+// folder on all cores without opening a window.
+//
+//   imv --batch <dir> --out <dir> [--resize WxH | --thumbnail N] [--jobs N] [--memory MB]
+namespace batch {
+
+enum class mode { convert, resize, thumbnail };
+
+struct options {
+	fs::path input;
+	fs::path output;
+	batch::mode mode = mode::convert;
+	std::uint32_t width = 0;  // resize: bounding box, thumbnail: square side
+	std::uint32_t height = 0;
+	size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+	size_t memory_budget = size_t(1) << 30;
+};
+
+// Blocks until `bytes` fit under the limit. A job bigger than the whole
+// budget still runs, alone, rather than never.
+class byte_budget {
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	const size_t limit_;
+	size_t used_ = 0;
+	size_t peak_ = 0;
+public:
+	void acquire(size_t bytes) {
+		std::unique_lock<std::mutex> lk(mutex_);
+		cv_.wait(lk, [&]() { return used_ == 0 || used_ + bytes <= limit_; });
+		used_ += bytes;
+		peak_ = std::max(peak_, used_);
+	}
+
+	void release(size_t bytes) {
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			used_ -= bytes;
+		}
+		cv_.notify_all();
+	}
+
+	size_t peak() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return peak_;
+	}
+
+	explicit byte_budget(size_t limit) : limit_{limit} {}
+};
+
+// Size probe from the first bytes of the file; a JPEG whose frame header
+// sits behind large metadata segments is read whole.
+inline bool probe(const fs::path& path, std::uint32_t& width, std::uint32_t& height) {
+#ifdef _WIN32
+	FILE* f = _wfopen(path.c_str(), L"rb");
+#else
+	FILE* f = std::fopen(path.c_str(), "rb");
+#endif
+	if (!f) return false;
+	std::vector<std::uint8_t> header(64 * 1024);
+	const size_t n = std::fread(header.data(), 1, header.size(), f);
+	std::fclose(f);
+	if (decoders::native::dimensions(header.data(), n, width, height)) return true;
+	if (n < header.size() || !decoders::native::sniff(header.data(), n)) return false;
+	const auto file = read_file(path);
+	return file && decoders::native::dimensions(file.data(), file.size(), width, height);
+}
+
+// Content decides the decoder, not the extension.
+inline bool decode(const fs::path& path, image_buffer& out) {
+	const auto file = read_file(path);
+	if (!file) return false;
+	return decoders::native::decode(file.data(), file.size(), out);
+}
+
+// Box-halves `src` while it is at least twice the size `fits` asks for,
+// bilinear covers the rest so there is no aliasing at any ratio.
+template<typename Fits>
+const image_buffer& prefilter(const image_buffer& src, image_buffer& scratch, Fits&& fits) {
+	const image_buffer* cur = &src;
+	while (fits(cur->width / 2, cur->height / 2)) {
+		image_buffer half;
+		half.allocate(cur->width / 2, cur->height / 2);
+		downsample_2x_32bpp(cur->data(), half.data(), cur->width, cur->height);
+		scratch = std::move(half);
+		cur = &scratch;
+	}
+	return *cur;
+}
+
+// Largest size with the same aspect ratio inside max_w x max_h, never upscales.
+inline image_buffer resize(const image_buffer& src, std::uint32_t max_w, std::uint32_t max_h) {
+	const double scale = std::min({1.0, double(max_w) / src.width, double(max_h) / src.height});
+	const auto w = std::max(1u, static_cast<std::uint32_t>(src.width * scale + 0.5));
+	const auto h = std::max(1u, static_cast<std::uint32_t>(src.height * scale + 0.5));
+
+	image_buffer scratch;
+	const auto& from = prefilter(src, scratch, [&](std::uint32_t cw, std::uint32_t ch) { return cw >= w && ch >= h; });
+
+	image_buffer out;
+	out.allocate(w, h);
+	soft::render_band(from, out, soft::affine::scale(float(w) / from.width, float(h) / from.height), 0, 0, h);
+	return out;
+}
+
+// side x side square, scaled to cover and centre-cropped.
+inline image_buffer thumbnail(const image_buffer& src, std::uint32_t side) {
+	image_buffer scratch;
+	const auto& from = prefilter(src, scratch, [&](std::uint32_t cw, std::uint32_t ch) { return std::min(cw, ch) >= side; });
+
+	const float scale = float(side) / std::min(from.width, from.height);
+	image_buffer out;
+	out.allocate(side, side);
+	soft::render_band(from, out, soft::affine::scale(scale, scale)
+		* soft::affine::translation((side - from.width * scale) / 2.0f, (side - from.height * scale) / 2.0f), 0, 0, side);
+	return out;
+}
+
+struct report {
+	size_t total = 0;
+	size_t done = 0;
+	size_t failed = 0;
+	std::uint64_t pixels_in = 0;
+	std::uint64_t pixels_out = 0;
+	double seconds = 0.0;
+	size_t peak_bytes = 0;
+};
+
+inline report run(const options& opt) {
+	const auto files = scan_directory(opt.input);
+	fs::create_directories(opt.output);
+
+	// the arena shouldn't keep more than the budget around between images
+	pixel_arena::get_instance().set_max_pooled_bytes(opt.memory_budget);
+	byte_budget budget(opt.memory_budget);
+
+	report r;
+	r.total = files.size();
+	std::atomic<size_t> next{0}, done{0}, failed{0};
+	std::atomic<std::uint64_t> pixels_in{0}, pixels_out{0};
+	std::mutex log_mutex;
+
+	auto fail = [&](const fs::path& path, const char* why) -> void {
+		failed.fetch_add(1, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lk(log_mutex);
+		std::cerr << path.string() << ": " << why << "\n";
+	};
+
+	auto process = [&](size_t i) {
+		IMV_TRACE_SCOPE_ARG("image", "batch", i);
+		const auto& path = files[i];
+		std::uint32_t w, h;
+		if (!probe(path, w, h)) return fail(path, "unsupported format");
+
+		// source, file bytes, the first halving and the output
+		const size_t cost = size_t(w) * h * 4 * 2 + static_cast<size_t>(fs::file_size(path));
+		budget.acquire(cost);
+		struct release_t { byte_budget& b; size_t n; ~release_t() { b.release(n); } } release{budget, cost};
+
+		image_buffer src;
+		if (!decode(path, src)) return fail(path, "decode failed");
+
+		image_buffer out;
+		switch (opt.mode) {
+		case mode::resize: out = resize(src, opt.width, opt.height); break;
+		case mode::thumbnail: out = thumbnail(src, opt.width); break;
+		case mode::convert: out = std::move(src); break;
+		}
+
+		auto target = opt.output / path.filename();
+		target.replace_extension(".bmp");
+		if (!bmp::write_file(target, out)) return fail(path, "write failed");
+
+		pixels_in.fetch_add(std::uint64_t(w) * h, std::memory_order_relaxed);
+		pixels_out.fetch_add(std::uint64_t(out.width) * out.height, std::memory_order_relaxed);
+	};
+
+	auto worker = [&]() {
+		trace::tracer::get_instance().name_thread("batch");
+		for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < files.size();) {
+			process(i);
+			done.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < std::min(opt.jobs, std::max<size_t>(1, files.size())); ++i) workers.emplace_back(worker);
+
+	// progress on stderr while the workers run
+	while (done.load() < files.size()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		std::cerr << "\r" << done.load() << "/" << files.size() << std::flush;
+	}
+	for (auto& t : workers) t.join();
+	if (!files.empty()) std::cerr << "\n";
+
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	r.done = done;
+	r.failed = failed;
+	r.pixels_in = pixels_in;
+	r.pixels_out = pixels_out;
+	r.peak_bytes = budget.peak();
+	return r;
+}
+
+inline void usage() {
+	std::cerr <<
+		"usage: imv --batch <dir> --out <dir> [options]\n"
+		"  --resize WxH      fit inside WxH, keeping the aspect ratio\n"
+		"  --thumbnail N     NxN, scaled to cover and centre-cropped\n"
+		"                    (neither: convert only)\n"
+		"  --jobs N          worker threads (default: all cores)\n"
+		"  --memory MB       in-flight decode budget (default 1024)\n"
+		"Output is written as BMP.\n";
+}
+
+// Command line front end shared by `imv --batch` and the standalone tool,
+// `args` excludes the program name and the --batch switch.
+inline int main(const std::vector<std::string>& args) {
+	options opt;
+	for (size_t i = 0; i < args.size(); ++i) {
+		const auto& arg = args[i];
+		const bool has_value = i + 1 < args.size();
+		if (arg == "--out" && has_value) {
+			opt.output = args[++i];
+		} else if (arg == "--resize" && has_value) {
+			opt.mode = mode::resize;
+			if (std::sscanf(args[++i].c_str(), "%ux%u", &opt.width, &opt.height) != 2 || !opt.width || !opt.height) {
+				usage();
+				return 1;
+			}
+		} else if (arg == "--thumbnail" && has_value) {
+			opt.mode = mode::thumbnail;
+			opt.width = opt.height = static_cast<std::uint32_t>(std::stoul(args[++i]));
+			if (!opt.width) {
+				usage();
+				return 1;
+			}
+		} else if (arg == "--jobs" && has_value) {
+			opt.jobs = std::max<size_t>(1, std::stoul(args[++i]));
+		} else if (arg == "--memory" && has_value) {
+			opt.memory_budget = std::max<size_t>(1, std::stoul(args[++i])) << 20;
+		} else if (opt.input.empty() && arg.rfind("--", 0) != 0) {
+			opt.input = arg;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	if (opt.input.empty() || opt.output.empty()) {
+		usage();
+		return 1;
+	}
+
+	try {
+		const auto r = run(opt);
+		std::printf("%zu images, %zu failed in %.2f s\n", r.total, r.failed, r.seconds);
+		if (r.seconds > 0) {
+			std::printf("%.1f images/s, %.1f MP/s in, %.1f MP/s out, %zu workers, peak %.0f MB in flight\n",
+				static_cast<double>(r.done) / r.seconds,
+				static_cast<double>(r.pixels_in) / 1e6 / r.seconds,
+				static_cast<double>(r.pixels_out) / 1e6 / r.seconds,
+				opt.jobs, static_cast<double>(r.peak_bytes) / (1024.0 * 1024.0));
+		}
+		return r.failed ? 2 : 0;
+	} catch (std::exception& ex) {
+		std::cerr << "error: " << ex.what() << "\n";
+		return 1;
+	}
+}
+
+} // namespace batch
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "image_buffer.hpp"
+
+// Portable BMP decoder: 1/4/8bpp palettized, 16/32bpp with bit fields and 24bpp,
+// bottom-up or top-down. RLE compressed files are left to the system codecs.
+namespace bmp {
+
+inline std::uint32_t read_u32(const std::uint8_t* p) noexcept {
+	return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) | (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 24);
+}
+
+inline std::uint16_t read_u16(const std::uint8_t* p) noexcept {
+	return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+struct channel {
+	std::uint32_t mask = 0;
+	int shift = 0;
+	std::uint32_t max = 0;
+
+	explicit channel(std::uint32_t m) noexcept : mask(m) {
+		if (m) {
+			shift = std::countr_zero(m);
+			max = m >> shift;
+		}
+	}
+
+	std::uint32_t operator()(std::uint32_t px, std::uint32_t none) const noexcept {
+		if (!max) return none;
+		return (((px & mask) >> shift) * 255 + max / 2) / max;
+	}
+};
+
+inline bool is_bmp(const std::uint8_t* data, size_t size) noexcept {
+	return size >= 2 && data[0] == 'B' && data[1] == 'M';
+}
+
+// Size from the headers alone, enough to budget memory before decoding.
+inline bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+	if (size < 26 || !is_bmp(data, size)) return false;
+	const auto w = static_cast<std::int32_t>(read_u32(data + 18));
+	const auto h = static_cast<std::int64_t>(static_cast<std::int32_t>(read_u32(data + 22)));
+	if (w <= 0 || h == 0) return false;
+	width = static_cast<std::uint32_t>(w);
+	height = static_cast<std::uint32_t>(h < 0 ? -h : h);
+	return true;
+}
+
+inline bool decode(const std::uint8_t* data, size_t size, image_buffer& out) {
+	constexpr size_t file_header_size = 14;
+	if (size < file_header_size + 40 || !is_bmp(data, size)) return false;
+
+	const auto* info = data + file_header_size;
+	const std::uint32_t info_size = read_u32(info);
+	const std::uint32_t offset = read_u32(data + 10);
+	if (info_size < 40 || file_header_size + info_size > size) return false;
+
+	const auto width = static_cast<std::int32_t>(read_u32(info + 4));
+	const auto raw_height = static_cast<std::int32_t>(read_u32(info + 8));
+	const std::uint16_t bpp = read_u16(info + 14);
+	const std::uint32_t compression = read_u32(info + 16);
+	const std::uint32_t colors_used = read_u32(info + 32);
+
+	const bool top_down = raw_height < 0;
+	const std::int64_t height = top_down ? -std::int64_t(raw_height) : raw_height;
+	if (width <= 0 || height <= 0 || width > 65535 || height > 65535) return false;
+
+	constexpr std::uint32_t bi_rgb = 0, bi_bitfields = 3, bi_alphabitfields = 6;
+	if (compression != bi_rgb && compression != bi_bitfields && compression != bi_alphabitfields) return false;
+
+	std::uint32_t masks[4] = {};
+	bool has_alpha = false;
+	size_t palette_offset = file_header_size + info_size;
+
+	if (compression != bi_rgb) {
+		const std::uint8_t* m = info + 40;
+		const size_t n_masks = compression == bi_alphabitfields ? 4 : 3;
+		if (info_size == 40) {
+			// masks follow the header
+			if (palette_offset + n_masks * 4 > size) return false;
+			palette_offset += n_masks * 4;
+		} else if (info_size < 40 + n_masks * 4) {
+			return false;
+		}
+		for (size_t i = 0; i < n_masks; ++i) masks[i] = read_u32(m + i * 4);
+		if (n_masks == 3 && info_size >= 56) masks[3] = read_u32(m + 12);
+		has_alpha = masks[3] != 0;
+	} else if (bpp == 16) {
+		masks[0] = 0x7C00; masks[1] = 0x03E0; masks[2] = 0x001F;
+	} else if (bpp == 32) {
+		masks[0] = 0x00FF0000; masks[1] = 0x0000FF00; masks[2] = 0x000000FF;
+	}
+
+	std::uint32_t palette[256] = {};
+	if (bpp <= 8) {
+		if (bpp != 1 && bpp != 4 && bpp != 8) return false;
+		size_t n = colors_used ? colors_used : (size_t(1) << bpp);
+		if (n > 256) n = 256;
+		if (palette_offset + n * 4 > size) return false;
+		for (size_t i = 0; i < n; ++i) {
+			palette[i] = 0xFF000000u | (read_u32(data + palette_offset + i * 4) & 0x00FFFFFFu);
+		}
+	} else if (bpp != 16 && bpp != 24 && bpp != 32) {
+		return false;
+	}
+
+	const size_t row_bytes = ((static_cast<size_t>(width) * bpp + 31) / 32) * 4;
+	if (offset > size || row_bytes * height > size - offset) return false;
+
+	out.allocate(static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height));
+
+	const channel r(masks[0]), g(masks[1]), b(masks[2]), a(masks[3]);
+	const bool plain_bgrx = bpp == 32 && masks[0] == 0x00FF0000 && masks[1] == 0x0000FF00 && masks[2] == 0x000000FF;
+
+	for (std::int64_t y = 0; y < height; ++y) {
+		const std::uint8_t* src = data + offset + row_bytes * (top_down ? y : height - 1 - y);
+		std::uint32_t* dst = out.data() + static_cast<size_t>(y) * width;
+
+		switch (bpp) {
+		case 1:
+		case 4:
+		case 8: {
+			const int per_byte = 8 / bpp;
+			const std::uint32_t index_mask = (1u << bpp) - 1;
+			for (std::int32_t x = 0; x < width; ++x) {
+				const int shift = (per_byte - 1 - x % per_byte) * bpp;
+				dst[x] = palette[(src[x / per_byte] >> shift) & index_mask];
+			}
+			break;
+		}
+		case 24:
+			for (std::int32_t x = 0; x < width; ++x, src += 3) {
+				dst[x] = 0xFF000000u | src[0] | (std::uint32_t(src[1]) << 8) | (std::uint32_t(src[2]) << 16);
+			}
+			break;
+		case 16:
+		case 32:
+			if (plain_bgrx && !has_alpha) {
+				for (std::int32_t x = 0; x < width; ++x) dst[x] = 0xFF000000u | read_u32(src + x * 4);
+				break;
+			}
+			for (std::int32_t x = 0; x < width; ++x) {
+				const std::uint32_t px = bpp == 16 ? read_u16(src + x * 2) : read_u32(src + x * 4);
+				const std::uint32_t alpha = a(px, 255);
+				// premultiply, the rest of the pipeline works on PBGRA
+				const auto pm = [alpha](std::uint32_t c) { return (c * alpha + 127) / 255; };
+				dst[x] = (alpha << 24) | (pm(r(px, 0)) << 16) | (pm(g(px, 0)) << 8) | pm(b(px, 0));
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+} // namespace bmp
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+#include "image_buffer.hpp"
+
+// Writes image_buffers back out as BMP: 24bpp when every pixel is opaque,
+// otherwise 32bpp with an alpha mask (BITMAPV4HEADER), straight alpha.
+namespace bmp {
+
+inline void put_u32(std::uint8_t* p, std::uint32_t v) noexcept {
+	p[0] = static_cast<std::uint8_t>(v);
+	p[1] = static_cast<std::uint8_t>(v >> 8);
+	p[2] = static_cast<std::uint8_t>(v >> 16);
+	p[3] = static_cast<std::uint8_t>(v >> 24);
+}
+
+inline void put_u16(std::uint8_t* p, std::uint16_t v) noexcept {
+	p[0] = static_cast<std::uint8_t>(v);
+	p[1] = static_cast<std::uint8_t>(v >> 8);
+}
+
+inline bool is_opaque(const image_buffer& img) noexcept {
+	const auto* px = img.data();
+	const size_t n = size_t(img.width) * img.height;
+	for (size_t i = 0; i < n; ++i) {
+		if ((px[i] >> 24) != 0xFF) return false;
+	}
+	return true;
+}
+
+inline std::vector<std::uint8_t> encode(const image_buffer& img) {
+	constexpr std::uint32_t file_header_size = 14;
+	const bool opaque = is_opaque(img);
+	const std::uint32_t info_size = opaque ? 40 : 108;
+	const std::uint32_t bpp = opaque ? 24 : 32;
+	const size_t row_bytes = ((size_t(img.width) * bpp + 31) / 32) * 4;
+	const size_t offset = file_header_size + info_size;
+
+	std::vector<std::uint8_t> out(offset + row_bytes * img.height);
+	auto* p = out.data();
+	p[0] = 'B';
+	p[1] = 'M';
+	put_u32(p + 2, static_cast<std::uint32_t>(out.size()));
+	put_u32(p + 10, static_cast<std::uint32_t>(offset));
+
+	auto* info = p + file_header_size;
+	put_u32(info, info_size);
+	put_u32(info + 4, img.width);
+	put_u32(info + 8, img.height); // bottom-up
+	put_u16(info + 12, 1);
+	put_u16(info + 14, static_cast<std::uint16_t>(bpp));
+	put_u32(info + 16, opaque ? 0 : 3); // BI_RGB : BI_BITFIELDS
+	put_u32(info + 20, static_cast<std::uint32_t>(row_bytes * img.height));
+	put_u32(info + 24, 2835); // 72 dpi
+	put_u32(info + 28, 2835);
+	if (!opaque) {
+		put_u32(info + 40, 0x00FF0000);
+		put_u32(info + 44, 0x0000FF00);
+		put_u32(info + 48, 0x000000FF);
+		put_u32(info + 52, 0xFF000000);
+		put_u32(info + 56, 0x73524742); // LCS_sRGB
+	}
+
+	for (std::uint32_t y = 0; y < img.height; ++y) {
+		const auto* src = img.data() + size_t(img.height - 1 - y) * img.width;
+		auto* dst = p + offset + row_bytes * y;
+		for (std::uint32_t x = 0; x < img.width; ++x) {
+			const std::uint32_t px = src[x];
+			const std::uint32_t a = px >> 24;
+			std::uint32_t b = px & 0xFF, g = (px >> 8) & 0xFF, r = (px >> 16) & 0xFF;
+			if (opaque) {
+				dst[0] = static_cast<std::uint8_t>(b);
+				dst[1] = static_cast<std::uint8_t>(g);
+				dst[2] = static_cast<std::uint8_t>(r);
+				dst += 3;
+			} else {
+				// back to straight alpha
+				if (a != 0 && a != 0xFF) {
+					b = std::min<std::uint32_t>(255, (b * 255 + a / 2) / a);
+					g = std::min<std::uint32_t>(255, (g * 255 + a / 2) / a);
+					r = std::min<std::uint32_t>(255, (r * 255 + a / 2) / a);
+				}
+				put_u32(dst, b | (g << 8) | (r << 16) | (a << 24));
+				dst += 4;
+			}
+		}
+	}
+	return out;
+}
+
+inline bool write_file(const std::filesystem::path& path, const image_buffer& img) {
+	const auto bytes = encode(img);
+#ifdef _WIN32
+	FILE* f = _wfopen(path.c_str(), L"wb");
+#else
+	FILE* f = std::fopen(path.c_str(), "wb");
+#endif
+	if (!f) return false;
+	const bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+	return (std::fclose(f) == 0) && ok;
+}
+
+} // namespace bmp
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace zip { class archive; }
+
+using namespace std::string_view_literals;
+
+constexpr std::array<std::string_view, 8> picture_formats =
+{ ".jpg"sv, ".bmp"sv, ".cr2"sv, ".gif"sv, ".png"sv, ".ico"sv, ".webp"sv, ".tif"sv };
+
+
+template <size_t... Size, typename List>
+constexpr bool test_format_impl(std::string_view str, List& lst, std::index_sequence<Size...>) {
+	return ( (str == lst[Size]) || ... );
+}
+
+constexpr bool test_format(std::string_view str) {
+	return test_format_impl(str, picture_formats, std::make_index_sequence<picture_formats.size()>());
+}
+
+inline bool is_picture(const fs::path& path) {
+	if (!path.has_extension()) return false;
+	auto ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+	return test_format(ext);
+}
+
+// The pictures of a folder or an archive in the order they're shown. A
+// column per field rather than an object per file: the directories are
+// stored once and entries refer to them, names are packed back to back, so
+// an entry costs its name and 24 bytes. Nothing about decoding lives
+// here; the viewer makes that state only for the entries it caches.
+// Immutable once built, the window shares it with the duplicate search.
+class catalog {
+	std::vector<std::string> dirs_;
+	// per entry
+	std::vector<std::uint32_t> dir_;
+	std::vector<std::uint32_t> name_end_; // into names_, which stays under 4 GB
+	std::vector<std::uint64_t> size_;
+	std::vector<std::int64_t> mtime_;     // file_time_type ticks
+	std::string names_;
+	// entry i is member i when the pictures come from a ZIP archive
+	std::shared_ptr<const zip::archive> archive_;
+
+	// 8 bytes of the name from `offset` big-endian, zero padded.
+	static std::uint64_t sort_key(std::string_view name, size_t offset = 0) noexcept {
+		std::uint64_t key = 0;
+		for (size_t i = offset; i < offset + 8; ++i) key = key << 8 | (i < name.size() ? static_cast<unsigned char>(name[i]) : 0);
+		return key;
+	}
+
+	struct slot {
+		std::uint32_t dir, index;
+		std::uint64_t key;
+	};
+
+	// Slots of one directory whose names agree up to `offset`, ordered by
+	// the next 8 bytes and then by the bytes after them where those tie.
+	void sort_run(std::vector<slot>::iterator first, std::vector<slot>::iterator last, size_t offset) const {
+		std::sort(first, last, [](const slot& a, const slot& b) { return a.key < b.key; });
+		while (first != last) {
+			const auto run = std::find_if(first, last, [&](const slot& s) { return s.key != first->key; });
+			// names that ended inside these 8 bytes are equal
+			if (run - first > 1 && (first->key & 0xFF) != 0) {
+				for (auto it = first; it != run; ++it) it->key = sort_key(name(it->index), offset + 8);
+				sort_run(first, run, offset + 8);
+			}
+			first = run;
+		}
+	}
+
+public:
+	size_t size() const noexcept { return dir_.size(); }
+	bool empty() const noexcept { return dir_.empty(); }
+
+	std::string_view name(size_t i) const noexcept {
+		const size_t begin = i == 0 ? 0 : name_end_[i - 1];
+		return std::string_view(names_).substr(begin, name_end_[i] - begin);
+	}
+	const std::string& directory(size_t i) const noexcept { return dirs_[dir_[i]]; }
+	fs::path path(size_t i) const { return fs::path(directory(i)) / std::string(name(i)); }
+	std::uint64_t file_bytes(size_t i) const noexcept { return size_[i]; }
+	std::int64_t mtime(size_t i) const noexcept { return mtime_[i]; }
+	const std::shared_ptr<const zip::archive>& archive() const noexcept { return archive_; }
+
+	// the extension, ".jpg"
+	std::string_view format(size_t i) const noexcept {
+		const auto n = name(i);
+		const auto dot = n.rfind('.');
+		if (dot == std::string_view::npos || n.find('/', dot) != std::string_view::npos) return {};
+		return n.substr(dot);
+	}
+
+	// Index of `path`, -1 when it isn't in the catalog. Sorted, so a binary
+	// search.
+	std::int64_t find(const fs::path& path) const {
+		const auto dir = path.parent_path().string();
+		const auto file = path.filename().string();
+		std::int64_t lo = 0, hi = static_cast<std::int64_t>(size());
+		while (lo < hi) {
+			const auto mid = lo + (hi - lo) / 2;
+			const auto& d = directory(mid);
+			if (d < dir || (d == dir && name(mid) < file)) lo = mid + 1;
+			else hi = mid;
+		}
+		if (lo < static_cast<std::int64_t>(size()) && directory(lo) == dir && name(lo) == file) return lo;
+		return -1;
+	}
+
+	// Heap bytes held, the per entry cost times the entries.
+	size_t bytes() const noexcept {
+		size_t n = names_.capacity() + dir_.capacity() * sizeof(std::uint32_t) + name_end_.capacity() * sizeof(std::uint32_t)
+			+ size_.capacity() * sizeof(std::uint64_t) + mtime_.capacity() * sizeof(std::int64_t);
+		for (auto& d : dirs_) n += sizeof(d) + d.capacity();
+		return n;
+	}
+
+	// Building: directories are interned, entries come in any order and are
+	// sorted once at the end.
+
+	std::uint32_t add_directory(const fs::path& directory) {
+		// "C:\pictures\" and "C:\pictures" are one directory
+		auto dir = (directory.has_filename() ? directory : directory.parent_path()).string();
+		const auto it = std::find(dirs_.rbegin(), dirs_.rend(), dir);
+		if (it != dirs_.rend()) return static_cast<std::uint32_t>(dirs_.rend() - it - 1);
+		dirs_.push_back(std::move(dir));
+		return static_cast<std::uint32_t>(dirs_.size() - 1);
+	}
+
+	void add(std::uint32_t dir, std::string_view name, std::uint64_t size, std::int64_t mtime) {
+		dir_.push_back(dir);
+		names_.append(name);
+		name_end_.push_back(static_cast<std::uint32_t>(names_.size()));
+		size_.push_back(size);
+		mtime_.push_back(mtime);
+	}
+
+	void reserve(size_t entries, size_t name_bytes) {
+		dir_.reserve(entries);
+		name_end_.reserve(entries);
+		size_.reserve(entries);
+		mtime_.reserve(entries);
+		names_.reserve(name_bytes);
+	}
+
+	void set_archive(std::shared_ptr<const zip::archive> archive) { archive_ = std::move(archive); }
+
+	// Orders the columns by directory and name, 8 bytes of the name at a
+	// time like a radix sort so most comparisons stay within the slots.
+	void sort() {
+		std::vector<slot> slots(size());
+		for (std::uint32_t i = 0; i < size(); ++i) slots[i] = {dir_[i], i, sort_key(name(i))};
+		if (dirs_.size() > 1) {
+			std::sort(slots.begin(), slots.end(), [this](const slot& a, const slot& b) {
+				return a.dir != b.dir ? dirs_[a.dir] < dirs_[b.dir] : a.index < b.index;
+			});
+		}
+		for (auto first = slots.begin(); first != slots.end();) {
+			const auto last = std::find_if(first, slots.end(), [&](const slot& s) { return s.dir != first->dir; });
+			sort_run(first, last, 0);
+			first = last;
+		}
+		std::vector<std::uint32_t> order(size());
+		for (size_t i = 0; i < size(); ++i) order[i] = slots[i].index;
+		slots = {};
+
+		catalog sorted;
+		sorted.dirs_ = std::move(dirs_);
+		sorted.archive_ = std::move(archive_);
+		sorted.reserve(size(), names_.size());
+		for (auto i : order) sorted.add(dir_[i], name(i), size_[i], mtime_[i]);
+		*this = std::move(sorted);
+	}
+
+	// The picture alone, before its folder is scanned.
+	static catalog of_file(const fs::path& path) {
+		catalog c;
+		std::error_code size_ec, time_ec;
+		const auto size = fs::file_size(path, size_ec);
+		const auto mtime = fs::last_write_time(path, time_ec).time_since_epoch().count();
+		c.add(c.add_directory(path.parent_path()), path.filename().string(), size_ec ? 0 : size,
+			time_ec ? 0 : static_cast<std::int64_t>(mtime));
+		return c;
+	}
+
+	// The pictures in `directory`, sorted by name. Sizes and times come
+	// with the listing on Windows.
+	static catalog scan(const fs::path& directory) {
+		catalog c;
+		const auto dir = c.add_directory(directory);
+		for (auto& it : fs::directory_iterator(directory)) {
+			std::error_code ec;
+			if (!it.is_regular_file(ec) || !is_picture(it.path())) continue;
+			const auto size = it.file_size(ec);
+			const auto mtime = it.last_write_time(ec).time_since_epoch().count();
+			c.add(dir, it.path().filename().string(), ec ? 0 : size, static_cast<std::int64_t>(mtime));
+		}
+		c.sort();
+		return c;
+	}
+};
+
+// Sorted list of the pictures in `directory`.
+inline std::vector<fs::path> scan_directory(const fs::path& directory) {
+	const auto c = catalog::scan(directory);
+	std::vector<fs::path> files;
+	files.reserve(c.size());
+	for (size_t i = 0; i < c.size(); ++i) files.push_back(c.path(i));
+	return files;
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define IMV_COLOR_SSE2
+#endif
+
+#include "singleton.hpp"
+
+// Colour management for matrix/TRC ICC profiles (sRGB, Adobe RGB, Display
+// P3, ProPhoto and most monitor profiles). A source -> display transform is
+// baked once into a 3D LUT and applied with trilinear interpolation.
+namespace color {
+
+// One tone response curve. Parametric curves are all held in the most
+// general ICC form: (a*x + b)^g + e for x >= d, c*x + f below.
+struct curve {
+	float g = 1.0f, a = 1.0f, b = 0.0f, c = 0.0f, d = 0.0f, e = 0.0f, f = 0.0f;
+	std::vector<float> table; // sampled curve, used instead when not empty
+
+	float eval(float x) const noexcept {
+		x = std::clamp(x, 0.0f, 1.0f);
+		if (!table.empty()) {
+			const float t = x * static_cast<float>(table.size() - 1);
+			const auto i = std::min(static_cast<size_t>(t), table.size() - 2);
+			return table[i] + (table[i + 1] - table[i]) * (t - static_cast<float>(i));
+		}
+		if (x >= d) {
+			const float base = a * x + b;
+			return (base > 0.0f ? std::pow(base, g) : 0.0f) + e;
+		}
+		return c * x + f;
+	}
+
+	static curve srgb() noexcept { return {2.4f, 1.0f / 1.055f, 0.055f / 1.055f, 1.0f / 12.92f, 0.04045f, 0.0f, 0.0f, {}}; }
+	static curve gamma(float g) noexcept { return {g, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, {}}; }
+};
+
+using matrix = std::array<float, 9>; // row-major
+
+inline matrix multiply(const matrix& m, const matrix& n) noexcept {
+	matrix r{};
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) r[i * 3 + j] = m[i * 3] * n[j] + m[i * 3 + 1] * n[3 + j] + m[i * 3 + 2] * n[6 + j];
+	}
+	return r;
+}
+
+inline matrix inverse(const matrix& m) noexcept {
+	const float det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) + m[2] * (m[3] * m[7] - m[4] * m[6]);
+	const float s = 1.0f / det;
+	return {
+		(m[4] * m[8] - m[5] * m[7]) * s, (m[2] * m[7] - m[1] * m[8]) * s, (m[1] * m[5] - m[2] * m[4]) * s,
+		(m[5] * m[6] - m[3] * m[8]) * s, (m[0] * m[8] - m[2] * m[6]) * s, (m[2] * m[3] - m[0] * m[5]) * s,
+		(m[3] * m[7] - m[4] * m[6]) * s, (m[1] * m[6] - m[0] * m[7]) * s, (m[0] * m[4] - m[1] * m[3]) * s
+	};
+}
+
+struct profile {
+	// linear RGB to the D50 connection space, the colorants are the columns
+	matrix to_xyz{};
+	std::array<curve, 3> trc;
+
+	// From xy chromaticities with a D65 white, adapted to D50 (Bradford).
+	static profile from_primaries(float rx, float ry, float gx, float gy, float bx, float by, const curve& trc) noexcept {
+		auto xyz = [](float x, float y) { return std::array<float, 3>{x / y, 1.0f, (1.0f - x - y) / y}; };
+		const auto r = xyz(rx, ry), g = xyz(gx, gy), b = xyz(bx, by), w = xyz(0.3127f, 0.3290f);
+		const matrix primaries{r[0], g[0], b[0], r[1], g[1], b[1], r[2], g[2], b[2]};
+		const auto inv = inverse(primaries);
+		const float sr = inv[0] * w[0] + inv[1] * w[1] + inv[2] * w[2];
+		const float sg = inv[3] * w[0] + inv[4] * w[1] + inv[5] * w[2];
+		const float sb = inv[6] * w[0] + inv[7] * w[1] + inv[8] * w[2];
+		const matrix rgb_to_xyz{r[0] * sr, g[0] * sg, b[0] * sb, r[1] * sr, g[1] * sg, b[1] * sb, r[2] * sr, g[2] * sg, b[2] * sb};
+		constexpr matrix bradford_d65_to_d50{
+			1.0478112f, 0.0228866f, -0.0501270f,
+			0.0295424f, 0.9904844f, -0.0170491f,
+			-0.0092345f, 0.0150436f, 0.7521316f};
+		return {multiply(bradford_d65_to_d50, rgb_to_xyz), {trc, trc, trc}};
+	}
+
+	static profile srgb() noexcept { return from_primaries(0.64f, 0.33f, 0.30f, 0.60f, 0.15f, 0.06f, curve::srgb()); }
+	static profile display_p3() noexcept { return from_primaries(0.680f, 0.320f, 0.265f, 0.690f, 0.150f, 0.060f, curve::srgb()); }
+	static profile adobe_rgb() noexcept { return from_primaries(0.64f, 0.33f, 0.21f, 0.71f, 0.15f, 0.06f, curve::gamma(563.0f / 256.0f)); }
+
+	bool operator==(const profile& o) const noexcept {
+		if (to_xyz != o.to_xyz) return false;
+		for (int i = 0; i < 3; ++i) {
+			const auto& x = trc[i];
+			const auto& y = o.trc[i];
+			if (x.table != y.table || x.g != y.g || x.a != y.a || x.b != y.b || x.c != y.c || x.d != y.d || x.e != y.e || x.f != y.f) return false;
+		}
+		return true;
+	}
+};
+
+namespace detail {
+
+inline std::uint32_t be32(const std::uint8_t* p) noexcept {
+	return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+}
+inline std::uint16_t be16(const std::uint8_t* p) noexcept { return static_cast<std::uint16_t>((p[0] << 8) | p[1]); }
+inline float s15f16(const std::uint8_t* p) noexcept { return static_cast<float>(static_cast<std::int32_t>(be32(p))) / 65536.0f; }
+inline constexpr std::uint32_t sig(const char (&s)[5]) noexcept {
+	return (std::uint32_t(std::uint8_t(s[0])) << 24) | (std::uint32_t(std::uint8_t(s[1])) << 16) | (std::uint32_t(std::uint8_t(s[2])) << 8) | std::uint8_t(s[3]);
+}
+
+inline bool parse_curve(const std::uint8_t* p, size_t size, curve& out) {
+	if (size < 12) return false;
+	if (be32(p) == sig("curv")) {
+		const std::uint32_t n = be32(p + 8);
+		if (size < 12 + size_t(n) * 2) return false;
+		if (n == 0) out = curve::gamma(1.0f);
+		else if (n == 1) out = curve::gamma(be16(p + 12) / 256.0f);
+		else {
+			out = curve{};
+			out.table.resize(n);
+			for (std::uint32_t i = 0; i < n; ++i) out.table[i] = be16(p + 12 + 2 * i) / 65535.0f;
+		}
+		return true;
+	}
+	if (be32(p) == sig("para")) {
+		static constexpr int n_params[] = {1, 3, 4, 5, 7};
+		const int type = be16(p + 8);
+		if (type > 4 || size < 12 + size_t(n_params[type]) * 4) return false;
+		float v[7] = {};
+		for (int i = 0; i < n_params[type]; ++i) v[i] = s15f16(p + 12 + 4 * i);
+		out = curve{};
+		out.g = v[0];
+		switch (type) {
+		case 0: break;
+		case 1: out.a = v[1]; out.b = v[2]; out.d = -v[2] / v[1]; break;
+		case 2: out.a = v[1]; out.b = v[2]; out.d = -v[2] / v[1]; out.e = out.f = v[3]; break;
+		case 3: out.a = v[1]; out.b = v[2]; out.c = v[3]; out.d = v[4]; break;
+		case 4: out.a = v[1]; out.b = v[2]; out.c = v[3]; out.d = v[4]; out.e = v[5]; out.f = v[6]; break;
+		}
+		return true;
+	}
+	return false;
+}
+
+} // namespace detail
+
+// Matrix/TRC RGB profiles only; false for anything else (LUT-based, CMYK,
+// gray), which is then shown without conversion.
+inline bool parse_icc(const std::uint8_t* data, size_t size, profile& out) {
+	using namespace detail;
+	if (size < 132 || be32(data + 36) != sig("acsp")) return false;
+	if (be32(data + 16) != sig("RGB ") || be32(data + 20) != sig("XYZ ")) return false;
+	const std::uint32_t n = be32(data + 128);
+	if (size < 132 + size_t(n) * 12) return false;
+
+	bool have[6] = {};
+	profile p;
+	for (std::uint32_t i = 0; i < n; ++i) {
+		const auto* entry = data + 132 + i * 12;
+		const std::uint32_t tag = be32(entry), offset = be32(entry + 4), length = be32(entry + 8);
+		if (size_t(offset) + length > size) return false;
+		const auto* body = data + offset;
+		static constexpr std::uint32_t xyz_tags[] = {sig("rXYZ"), sig("gXYZ"), sig("bXYZ")};
+		static constexpr std::uint32_t trc_tags[] = {sig("rTRC"), sig("gTRC"), sig("bTRC")};
+		for (int c = 0; c < 3; ++c) {
+			if (tag == xyz_tags[c] && length >= 20 && be32(body) == sig("XYZ ")) {
+				p.to_xyz[c] = s15f16(body + 8);
+				p.to_xyz[3 + c] = s15f16(body + 12);
+				p.to_xyz[6 + c] = s15f16(body + 16);
+				have[c] = true;
+			} else if (tag == trc_tags[c]) {
+				have[3 + c] = parse_curve(body, length, p.trc[c]);
+			}
+		}
+	}
+	if (!std::all_of(std::begin(have), std::end(have), [](bool b) { return b; })) return false;
+	out = std::move(p);
+	return true;
+}
+
+// source -> display in three stages, the way CMMs optimize a transform:
+// the source curves as per-channel input tables that place each 8-bit value
+// on the grid, a size^3 grid of display-linear BGR (before gamut clipping)
+// interpolated trilinearly, and a per-channel output table that clips and
+// applies the display encoding. With the grid indexed in linear light the
+// interpolation is exact for matrix profiles, so a small grid suffices.
+class lut {
+public:
+	static constexpr std::uint32_t size = 17;
+	static constexpr std::int32_t encode_size = 4096; // indexed by sqrt(linear)
+private:
+	std::vector<float> grid_; // 4 per entry (BGR, 0), b fastest, then g, then r
+	std::array<std::array<std::uint8_t, 256>, 3> index_{}; // RGB
+	std::array<std::array<float, 256>, 3> weight_{}; // fraction towards index + 1
+	std::array<std::vector<std::uint8_t>, 3> encode_; // BGR
+
+	const float* at(std::uint32_t r, std::uint32_t g, std::uint32_t b) const noexcept {
+		return grid_.data() + ((size_t(r) * size + g) * size + b) * 4;
+	}
+
+	// Inverts the (monotone) display curve by bisection.
+	static std::vector<std::uint8_t> encode_table(const curve& trc) {
+		std::vector<std::uint8_t> table(encode_size);
+		for (std::int32_t i = 0; i < encode_size; ++i) {
+			const float s = static_cast<float>(i) / (encode_size - 1);
+			const float y = s * s;
+			float lo = 0.0f, hi = 1.0f;
+			for (int k = 0; k < 20; ++k) {
+				const float mid = 0.5f * (lo + hi);
+				(trc.eval(mid) < y ? lo : hi) = mid;
+			}
+			table[i] = static_cast<std::uint8_t>(std::lround(0.5f * (lo + hi) * 255.0f));
+		}
+		return table;
+	}
+
+	std::uint8_t encode(int c, float linear) const noexcept {
+		const float s = std::sqrt(std::clamp(linear, 0.0f, 1.0f));
+		return encode_[c][static_cast<size_t>(std::lrint(s * (encode_size - 1)))];
+	}
+public:
+	lut(const profile& source, const profile& display) : grid_(size_t(size) * size * size * 4) {
+		for (int c = 0; c < 3; ++c) encode_[c] = encode_table(display.trc[2 - c]);
+
+		for (int c = 0; c < 3; ++c) {
+			for (std::uint32_t v = 0; v < 256; ++v) {
+				const float t = source.trc[c].eval(static_cast<float>(v) / 255.0f) * (size - 1);
+				const auto i = std::min<std::uint32_t>(static_cast<std::uint32_t>(t), size - 2);
+				index_[c][v] = static_cast<std::uint8_t>(i);
+				weight_[c][v] = t - static_cast<float>(i);
+			}
+		}
+
+		const auto m = multiply(inverse(display.to_xyz), source.to_xyz);
+		for (std::uint32_t r = 0; r < size; ++r) {
+			for (std::uint32_t g = 0; g < size; ++g) {
+				for (std::uint32_t b = 0; b < size; ++b) {
+					const float in[3] = {float(r) / (size - 1), float(g) / (size - 1), float(b) / (size - 1)};
+					auto* out = grid_.data() + ((size_t(r) * size + g) * size + b) * 4;
+					// BGR order like the pixels
+					for (int c = 0; c < 3; ++c) out[2 - c] = m[c * 3] * in[0] + m[c * 3 + 1] * in[1] + m[c * 3 + 2] * in[2];
+					out[3] = 0.0f;
+				}
+			}
+		}
+	}
+
+	// Straight colour through the tables, 8 bits out in BGR.
+	void map(std::uint32_t r, std::uint32_t g, std::uint32_t b, std::uint32_t out[3]) const noexcept {
+		const auto ir = index_[0][r], ig = index_[1][g], ib = index_[2][b];
+		const float wr = weight_[0][r], wg = weight_[1][g], wb = weight_[2][b];
+		auto lerp = [](float x, float y, float w) { return x + (y - x) * w; };
+		for (int c = 0; c < 3; ++c) {
+			auto v = [&](int dr, int dg, int db) { return at(ir + dr, ig + dg, ib + db)[c]; };
+			const float c0 = lerp(lerp(v(0, 0, 0), v(0, 1, 0), wg), lerp(v(1, 0, 0), v(1, 1, 0), wg), wr);
+			const float c1 = lerp(lerp(v(0, 0, 1), v(0, 1, 1), wg), lerp(v(1, 0, 1), v(1, 1, 1), wg), wr);
+			out[c] = encode(c, lerp(c0, c1, wb));
+		}
+	}
+
+	// In place over premultiplied BGRA. Opaque pixels take the SSE2 path,
+	// translucent ones are unpremultiplied around the lookup.
+	void apply(std::uint32_t* px, size_t n) const noexcept {
+		for (size_t i = 0; i < n; ++i) {
+			const std::uint32_t p = px[i];
+			const std::uint32_t a = p >> 24;
+			if (a == 0xFF) {
+#ifdef IMV_COLOR_SSE2
+				px[i] = apply_opaque_sse2(p);
+#else
+				std::uint32_t o[3];
+				map((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF, o);
+				px[i] = 0xFF000000u | o[0] | (o[1] << 8) | (o[2] << 16);
+#endif
+			} else if (a != 0) {
+				auto straight = [a](std::uint32_t v) { return std::min<std::uint32_t>(255, (v * 255 + a / 2) / a); };
+				std::uint32_t o[3];
+				map(straight((p >> 16) & 0xFF), straight((p >> 8) & 0xFF), straight(p & 0xFF), o);
+				auto premul = [a](std::uint32_t v) { return (v * a + 127) / 255; };
+				px[i] = (a << 24) | premul(o[0]) | (premul(o[1]) << 8) | (premul(o[2]) << 16);
+			}
+		}
+	}
+
+#ifdef IMV_COLOR_SSE2
+	// One grid entry is one register, the three channels blend together.
+	std::uint32_t apply_opaque_sse2(std::uint32_t p) const noexcept {
+		const std::uint32_t b = p & 0xFF, g = (p >> 8) & 0xFF, r = (p >> 16) & 0xFF;
+		const auto ir = index_[0][r], ig = index_[1][g], ib = index_[2][b];
+		auto load = [this](std::uint32_t r, std::uint32_t g, std::uint32_t b) { return _mm_loadu_ps(at(r, g, b)); };
+		auto lerp = [](__m128 x, __m128 y, __m128 w) { return _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(y, x), w)); };
+		const __m128 wr = _mm_set1_ps(weight_[0][r]), wg = _mm_set1_ps(weight_[1][g]), wb = _mm_set1_ps(weight_[2][b]);
+
+		const __m128 c0 = lerp(lerp(load(ir, ig, ib), load(ir, ig + 1, ib), wg), lerp(load(ir + 1, ig, ib), load(ir + 1, ig + 1, ib), wg), wr);
+		const __m128 c1 = lerp(lerp(load(ir, ig, ib + 1), load(ir, ig + 1, ib + 1), wg), lerp(load(ir + 1, ig, ib + 1), load(ir + 1, ig + 1, ib + 1), wg), wr);
+		__m128 v = _mm_min_ps(_mm_max_ps(lerp(c0, c1, wb), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		v = _mm_mul_ps(_mm_sqrt_ps(v), _mm_set1_ps(static_cast<float>(encode_size - 1)));
+		const __m128i idx = _mm_cvtps_epi32(v);
+		return 0xFF000000u
+			| encode_[0][_mm_cvtsi128_si32(idx)]
+			| (std::uint32_t(encode_[1][_mm_cvtsi128_si32(_mm_srli_si128(idx, 4))]) << 8)
+			| (std::uint32_t(encode_[2][_mm_cvtsi128_si32(_mm_srli_si128(idx, 8))]) << 16);
+	}
+#endif
+};
+
+// LUTs by source and display profile, built once per pair.
+class lut_cache : public singleton<lut_cache> {
+	friend singleton<lut_cache>;
+
+	std::mutex mutex_;
+	std::vector<std::pair<std::pair<profile, profile>, std::shared_ptr<const lut>>> luts_;
+
+	lut_cache() = default;
+public:
+	// null when the transform would be the identity
+	std::shared_ptr<const lut> get(const profile& source, const profile& display) {
+		if (source == display) return nullptr;
+		std::lock_guard<std::mutex> lk(mutex_);
+		for (auto& [key, l] : luts_) {
+			if (key.first == source && key.second == display) return l;
+		}
+		auto l = std::make_shared<const lut>(source, display);
+		luts_.push_back({{source, display}, l});
+		return l;
+	}
+};
+
+} // namespace color
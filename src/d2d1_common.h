@@ -8,8 +8,11 @@
 #include <d2d1effects_2.h>
 #include <dwrite.h>
 #include <wincodec.h> //	Defines C and C++ versions of the primary WIC APIs.
+#include <future>
+#include <mutex>
 #include <string>
 #include "d2d1_assert.h"
+#include "startup.hpp"
 
 #pragma comment(lib, "d2d1")
 #pragma comment(lib, "d3d11")
@@ -20,68 +23,24 @@
 namespace wrl = Microsoft::WRL;
 namespace d2d = D2D1;
 
+// Factories are made on the UI thread at startup. The D3D device, the
+// slowest part, is started on a thread of its own while the first image
+// decodes and the window is built (StartDevice), and handed to the window
+// that asks first (TakeDevice). DirectWrite is only loaded once the HUD
+// draws text.
 class GlobalResourses {
-	float m_fontSize;
-	std::wstring m_font;
-
-	void ReCreateFont()
-	{
-		HR(dwriteFactory->CreateTextFormat(m_font.c_str(),
-			nullptr,
-			DWRITE_FONT_WEIGHT_NORMAL,
-			DWRITE_FONT_STYLE_NORMAL,
-			DWRITE_FONT_STRETCH_NORMAL,
-			m_fontSize,
-			L"", //locale
-			textFormatCenter.ReleaseAndGetAddressOf()));
-
-		// Center the text horizontally and vertically.
-		HR(textFormatCenter->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_CENTER));
-		HR(textFormatCenter->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER));
-
-		// Left Alignment
-		HR(dwriteFactory->CreateTextFormat(m_font.c_str(),
-			nullptr,
-			DWRITE_FONT_WEIGHT_NORMAL,
-			DWRITE_FONT_STYLE_NORMAL,
-			DWRITE_FONT_STRETCH_NORMAL,
-			m_fontSize,
-			L"", //locale
-			textFormatLeft.ReleaseAndGetAddressOf()));
-
-		// Center the text horizontally and vertically.
-		HR(textFormatLeft->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING));
-		HR(textFormatLeft->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER));
-
-		// Create a DirectWrite text format object.
-		HR(dwriteFactory->CreateTextFormat(m_font.c_str(),
-			nullptr,
-			DWRITE_FONT_WEIGHT_NORMAL,
-			DWRITE_FONT_STYLE_NORMAL,
-			DWRITE_FONT_STRETCH_NORMAL,
-			m_fontSize,
-			L"", //locale
-			textFormatRight.ReleaseAndGetAddressOf()));
-
-		// Center the text horizontally and vertically.
-		HR(textFormatRight->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_TRAILING));
-		HR(textFormatRight->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER));
-	}
+	std::future<HRESULT> device_ready_;
+	wrl::ComPtr<ID3D11Device> d3dDevice_;
+	wrl::ComPtr<ID3D11DeviceContext> d3dContext_;
+	std::once_flag text_once_;
+	wrl::ComPtr<IDWriteFactory> dwriteFactory_;
+	wrl::ComPtr<IDWriteTextFormat> textFormat_;
 public:
-	wrl::ComPtr<ID3D11Device> d3dDevice;
-	wrl::ComPtr<ID3D11DeviceContext> d3dContext;
-	wrl::ComPtr<ID2D1Device1> d2dDevice;
-	wrl::ComPtr<IDXGIAdapter> dxgiAdapter;
-	
 	wrl::ComPtr<ID2D1Factory2> d2dFactory;
 	wrl::ComPtr<IDXGIFactory2> dxgiFactory;
-	wrl::ComPtr<IDWriteFactory> dwriteFactory;
 	wrl::ComPtr<IWICImagingFactory2> wicFactory;
-	wrl::ComPtr<IDWriteTextFormat> textFormatCenter;
-	wrl::ComPtr<IDWriteTextFormat> textFormatLeft;
-	wrl::ComPtr<IDWriteTextFormat> textFormatRight;
 
-	void CreateDevice() {
+	static HRESULT CreateDevice(wrl::ComPtr<ID3D11Device>& device, wrl::ComPtr<ID3D11DeviceContext>& context) {
 		// This flag adds support for surfaces with a different color channel ordering than the API default.
 		// You need it for compatibility with Direct2D.
 		UINT creationFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
@@ -102,8 +61,7 @@ public:
 		};
 
 		// Create the DX11 API device object, and get a corresponding context.
-
-		HR(D3D11CreateDevice(
+		return D3D11CreateDevice(
 			nullptr,                    // specify null to use the default adapter
 			D3D_DRIVER_TYPE_HARDWARE,
 			0,
@@ -111,41 +69,52 @@ public:
 			featureLevels,              // list of feature levels this app can support
 			ARRAYSIZE(featureLevels),   // number of possible feature levels
 			D3D11_SDK_VERSION,
-			d3dDevice.GetAddressOf(),               // returns the Direct3D device created
+			device.ReleaseAndGetAddressOf(),               // returns the Direct3D device created
 			nullptr,            // returns feature level of device created
-			d3dContext.GetAddressOf()                    // returns the device immediate context
-		));
-
-		wrl::ComPtr<IDXGIDevice1> dxgiDevice;
-		// Obtain the underlying DXGI device of the Direct3D11 device.
-		HR(d3dDevice.As(&dxgiDevice));
-		// Obtain the Direct2D device for 2-D rendering.
-		HR(d2dFactory->CreateDevice(dxgiDevice.Get(), d2dDevice.GetAddressOf()));
-		// Identify the physical adapter (GPU or card) this device is runs on.
-		HR(dxgiDevice->GetAdapter(dxgiAdapter.GetAddressOf()));
-		// Ensure that DXGI doesn't queue more than one frame at a time.
-		HR(dxgiDevice->SetMaximumFrameLatency(1));
+			context.ReleaseAndGetAddressOf()                    // returns the device immediate context
+		);
 	}
 
-	HRESULT CreateTextLayoutLeft(const std::wstring& text, const D2D1_RECT_F& rect, wrl::ComPtr<IDWriteTextLayout>& layout) const {
-		return dwriteFactory->CreateTextLayout(text.c_str(), static_cast<UINT32>(text.length()),
-			textFormatLeft.Get(),
-			rect.right - rect.left, rect.bottom - rect.top,
-			layout.ReleaseAndGetAddressOf());
+	// D3D11CreateDevice needs no COM apartment, a plain thread will do.
+	void StartDevice() {
+		device_ready_ = std::async(std::launch::async, [this]() {
+			const HRESULT hr = CreateDevice(d3dDevice_, d3dContext_);
+			startup_timeline::get_instance().mark(startup::stage::device);
+			return hr;
+		});
 	}
 
-	HRESULT CreateTextLayoutCenter(const std::wstring& text, const D2D1_RECT_F& rect, wrl::ComPtr<IDWriteTextLayout>& layout) const {
-		return dwriteFactory->CreateTextLayout(text.c_str(), static_cast<UINT32>(text.length()),
-			textFormatCenter.Get(),
-			rect.right - rect.left, rect.bottom - rect.top,
-			layout.ReleaseAndGetAddressOf());
+	// The device started with the process the first time, waiting for it if
+	// need be; a new one after that (device loss, a second window). A failed
+	// HRESULT means no GPU (remote session, headless VM), the window draws
+	// on the CPU instead.
+	HRESULT TakeDevice(wrl::ComPtr<ID3D11Device>& device, wrl::ComPtr<ID3D11DeviceContext>& context) {
+		if (!device_ready_.valid()) return CreateDevice(device, context);
+		const HRESULT hr = device_ready_.get();
+		device = std::move(d3dDevice_);
+		context = std::move(d3dContext_);
+		return hr;
 	}
 
-	HRESULT CreateTextLayoutRight(const std::wstring& text, const D2D1_RECT_F& rect, wrl::ComPtr<IDWriteTextLayout>& layout) const {
-		return dwriteFactory->CreateTextLayout(text.c_str(), static_cast<UINT32>(text.length()),
-			textFormatRight.Get(),
-			rect.right - rect.left, rect.bottom - rect.top,
-			layout.ReleaseAndGetAddressOf());
+	// Left aligned, vertically centred, for the HUD. Created on first use.
+	IDWriteTextFormat* TextFormat() {
+		std::call_once(text_once_, [this]() {
+			HR(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory),
+				reinterpret_cast<IUnknown**>(dwriteFactory_.GetAddressOf())));
+
+			HR(dwriteFactory_->CreateTextFormat(L"Verdana",
+				nullptr,
+				DWRITE_FONT_WEIGHT_NORMAL,
+				DWRITE_FONT_STYLE_NORMAL,
+				DWRITE_FONT_STRETCH_NORMAL,
+				18.0f,
+				L"", //locale
+				textFormat_.GetAddressOf()));
+
+			HR(textFormat_->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING));
+			HR(textFormat_->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER));
+		});
+		return textFormat_.Get();
 	}
 
 	GlobalResourses() {
@@ -163,32 +132,21 @@ public:
 		HR(CreateDXGIFactory1(__uuidof(dxgiFactory),
 			reinterpret_cast<void **>(dxgiFactory.GetAddressOf())));
 
-		HR(DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(IDWriteFactory),
-			reinterpret_cast<IUnknown**>(dwriteFactory.GetAddressOf())));
-
-		m_font = L"Verdana";
-		m_fontSize = 18;
-
 		// Create the COM imaging factory
 		HR(CoCreateInstance(CLSID_WICImagingFactory2, NULL, CLSCTX_INPROC_SERVER,
 			__uuidof(IWICImagingFactory2), (void**)wicFactory.GetAddressOf()));
-
-		ReCreateFont();
-		CreateDevice();
 	}
 
 	void Uninitialize() {
-		textFormatRight.Reset();
-		textFormatLeft.Reset();
-		textFormatCenter.Reset();
+		// a window that never got as far as taking the device
+		if (device_ready_.valid()) device_ready_.wait();
+		textFormat_.Reset();
+		dwriteFactory_.Reset();
 		wicFactory.Reset();
-		dwriteFactory.Reset();
 		dxgiFactory.Reset();
 		d2dFactory.Reset();
-		dxgiAdapter.Reset();
-		d2dDevice.Reset();
-		d3dContext.Reset();
-		d3dDevice.Reset();
+		d3dContext_.Reset();
+		d3dDevice_.Reset();
 	}
 };
 
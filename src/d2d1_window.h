@@ -2,7 +2,17 @@
 
 #include "d2d1_common.h"
 #include "math2d.h"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "soft_renderer.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #define WM_OCCLUSION (WM_USER + 0)
+// posted by ReleaseDevice, the UI thread builds a new device
+#define WM_DEVICE_LOST (WM_USER + 3)
 
 template <typename T>
 struct D2DWindow 
@@ -20,10 +30,77 @@ struct D2DWindow
 	float m_dpiX;
 	float m_dpiY;
 	BOOL m_visible;
-	DWORD m_occlusion;
+	DWORD m_occlusion = 0;
 	D2D1_SIZE_F m_dimf;
+	// No D3D device, frames are composed by soft::render on the render
+	// thread and blitted with GDI on WM_PAINT, which only copies the last
+	// finished one. Set on the UI thread when the device can't be made,
+	// read from the pool threads uploading pictures.
+	std::atomic_bool software_{false};
+	// render thread only
+	image_buffer soft_frame_;
+	// the last finished frame, swapped with soft_frame_ under soft_mutex_
+	image_buffer soft_shown_;
+	std::mutex soft_mutex_;
+
+	// Frames are drawn and presented on their own thread so a blocking
+	// Present never holds up the message loop. The UI thread only raises
+	// frame_requested_, requests made while one is pending fold into it.
+	std::thread render_thread_;
+	std::mutex frame_mutex_;
+	std::condition_variable frame_cv_;
+	bool frame_requested_ = false;
+	bool render_exit_ = false;
+	std::chrono::steady_clock::time_point frame_requested_at_;
+	// held for a whole frame, swap chain resizes take it too
+	std::mutex render_mutex_;
+	wrl::ComPtr<ID2D1Multithread> d2d_multithread_;
+	// m_d2dContext is swapped under it, for threads that upload outside a frame
+	std::mutex device_mutex_;
+	// bumped on every device loss, bitmaps made before it are stale
+	std::atomic<std::uint64_t> device_generation_{0};
+	// frame budget bookkeeping, render thread only
+	double last_interval_ms_ = 0.0;
+	double refresh_ms_ = 1000.0 / 60.0;
+	double last_cpu_ms_ = 0.0;
 protected:
 	D2D1::Matrix3x2F matrix_;
+
+	bool is_software() const noexcept { return software_; }
+	D2D1_SIZE_F target_size() const noexcept { return m_dimf; }
+
+	// For uploads from other threads: a reference that outlives a device
+	// loss, null while there is no device.
+	wrl::ComPtr<ID2D1DeviceContext1> d2d1_context() {
+		std::lock_guard<std::mutex> lk(device_mutex_);
+		return m_d2dContext;
+	}
+	std::uint64_t device_generation() const noexcept { return device_generation_; }
+
+	void RequestFrame() {
+		static auto& coalesced = metrics::get_counter("frame.coalesced");
+		{
+			std::lock_guard<std::mutex> lk(frame_mutex_);
+			if (frame_requested_) {
+				coalesced.add();
+				return;
+			}
+			frame_requested_ = true;
+			frame_requested_at_ = std::chrono::steady_clock::now();
+		}
+		frame_cv_.notify_one();
+	}
+
+	// Whether the previous frame missed its slot: a skipped vblank on the GPU
+	// path, longer than a 60 Hz refresh on the CPU one.
+	bool FrameOverBudget() const noexcept {
+		if (software_) return last_cpu_ms_ > 1000.0 / 60.0;
+		return last_interval_ms_ > refresh_ms_ * 1.5;
+	}
+
+	static soft::affine ToAffine(const D2D1::Matrix3x2F& m) noexcept {
+		return {m._11, m._12, m._21, m._22, m._31, m._32};
+	}
 	
 	D2D1::MyPoint2F GetCenterPositionScreen() const noexcept {
 		return D2D1::MyPoint2F {m_dimf.width / 2.0f, m_dimf.height / 2.0f};
@@ -46,6 +123,7 @@ private:
 		MESSAGE_HANDLER(WM_ACTIVATE, ActivateHandler)
 		MESSAGE_HANDLER(WM_OCCLUSION, OcclusionHandler)
 		MESSAGE_HANDLER(WM_POWERBROADCAST, PowerHandler)
+		MESSAGE_HANDLER(WM_DEVICE_LOST, DeviceLostHandler)
 	END_MSG_MAP()
 
 	LRESULT OnCreate(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
@@ -55,12 +133,16 @@ private:
 		CRect rc;
 		this->GetClientRect(rc);
 
-		// DX
-		CreateDeviceResources(this->m_hWnd);
+		// DX, IMV_SOFTWARE_RENDER forces the CPU path even when there is a GPU
+		software_ = GetEnvironmentVariableW(L"IMV_SOFTWARE_RENDER", nullptr, 0) != 0;
+		if (!software_) CreateDeviceResources(this->m_hWnd);
 		CreateDeviceSizeResources(rc.Width(), rc.Height());
 		static_cast<T*>(this)->CreateResources();
 		static_cast<T*>(this)->OnResourcesCreated();
 
+		if (!software_) HR(GR::get_instance().d2dFactory.As(&d2d_multithread_));
+		render_thread_ = std::thread(&D2DWindow::RenderLoop, this);
+
 		return 0;
 	}
 
@@ -78,8 +160,10 @@ private:
 	{
 		PAINTSTRUCT ps;
 		this->BeginPaint(&ps);
-		static_cast<T*>(this)->Render();
+		if (software_) BlitSoftware(ps.hdc);
 		this->EndPaint(&ps);
+		// the render thread's frame invalidates the window once it's blitted
+		if (!software_) RequestFrame();
 		return 0;
 	}
 
@@ -97,6 +181,7 @@ private:
 
 		if (m_d2dContext && SIZE_MINIMIZED != wParam) 
 		{
+			std::unique_lock<std::mutex> lk(render_mutex_);
 			m_d2dContext->SetTarget(nullptr);
 			if (S_OK == m_swapChain->ResizeBuffers(0,
 				0, 0,
@@ -106,14 +191,24 @@ private:
 			{
 				CreateDeviceSwapChainBitmap();
 				CreateDeviceSizeResources(width, height);
+				lk.unlock();
 				static_cast<T*>(this)->OnBoundsChanged();
-				Render();
+				RequestFrame();
 			}
 			else
 			{
 				ReleaseDevice();
 			}
 		}
+		else if (software_ && SIZE_MINIMIZED != wParam)
+		{
+			{
+				std::lock_guard<std::mutex> lk(render_mutex_);
+				CreateDeviceSizeResources(width, height);
+			}
+			static_cast<T*>(this)->OnBoundsChanged();
+			RequestFrame();
+		}
 
 		return 0;
 	}
@@ -121,7 +216,8 @@ private:
 	{
 		ASSERT(m_occlusion);
 
-		if (S_OK == m_swapChain->Present(0, DXGI_PRESENT_TEST))
+		std::lock_guard<std::mutex> lk(render_mutex_);
+		if (m_swapChain && S_OK == m_swapChain->Present(0, DXGI_PRESENT_TEST))
 		{
 			GR::get_instance().dxgiFactory->UnregisterOcclusionStatus(m_occlusion);
 			m_occlusion = 0;
@@ -141,50 +237,182 @@ private:
 	}
 	LRESULT DestroyHandler(UINT, WPARAM, LPARAM, BOOL&)
 	{
+		StopRenderThread();
 		PostQuitMessage(0);
 		return 0;
 	}
 	
+	// Render thread after a failed present, or the UI thread after a failed
+	// resize; either way under render_mutex_.
 	void ReleaseDevice()
 	{
-		m_d2dContext.Reset();
+		static auto& lost = metrics::get_counter("device.lost");
+		lost.add();
+		++device_generation_;
+		{
+			std::lock_guard<std::mutex> lk(device_mutex_);
+			m_d2dContext.Reset();
+		}
 		m_swapChain.Reset();
+		m_d2dDevice.Reset();
 		m_d3dDevice.Reset();
 		m_d3dContext.Reset();
 
 		static_cast<T*>(this)->ReleaseDeviceResources();
+		this->PostMessage(WM_DEVICE_LOST);
+	}
+
+	// A new device for the lost one. The decoded pixels stay in memory
+	// through it, the window only uploads them again (OnDeviceRestored).
+	LRESULT DeviceLostHandler(UINT, WPARAM, LPARAM, BOOL&)
+	{
+		static auto& restore_ms = metrics::get_gauge("device.restore_ms");
+		if (software_ || m_d2dContext) return 0;
+		const auto start = std::chrono::steady_clock::now();
+
+		CRect rc;
+		this->GetClientRect(rc);
+		{
+			std::lock_guard<std::mutex> lk(render_mutex_);
+			// no GPU any more falls back to the CPU path
+			CreateDeviceResources(this->m_hWnd);
+			CreateDeviceSizeResources(rc.Width(), rc.Height());
+			static_cast<T*>(this)->CreateResources();
+		}
+		static_cast<T*>(this)->OnDeviceRestored();
+		restore_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		RequestFrame();
+		return 0;
+	}
+
+	// Present(1, 0) waits for vblank with at most one frame queued, so the
+	// loop runs at most once per refresh however much input arrives.
+	void RenderLoop() {
+		static auto& input_latency = metrics::get_histogram("input.latency_ms");
+		static auto& frame_interval = metrics::get_histogram("frame.interval_ms");
+		using clock = std::chrono::steady_clock;
+		auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+		trace::tracer::get_instance().name_thread("render");
+		clock::time_point last_frame;
+		for (;;) {
+			clock::time_point requested_at;
+			{
+				std::unique_lock<std::mutex> lk(frame_mutex_);
+				frame_cv_.wait(lk, [this]() { return frame_requested_ || render_exit_; });
+				if (render_exit_) return;
+				frame_requested_ = false;
+				requested_at = frame_requested_at_;
+			}
+			{
+				std::lock_guard<std::mutex> lk(render_mutex_);
+				if (software_) RenderSoftware();
+				else if (m_d2dContext) Render();
+				else continue;
+			}
+			const auto now = clock::now();
+			input_latency.record(ms(now - requested_at));
+			// only back-to-back frames say anything about pacing, not idle gaps
+			if (requested_at <= last_frame) {
+				last_interval_ms_ = ms(now - last_frame);
+				frame_interval.record(last_interval_ms_);
+				// frames can't come faster than vblank, the shortest gap is the refresh period
+				refresh_ms_ = std::clamp(last_interval_ms_, 4.0, refresh_ms_);
+			} else {
+				last_interval_ms_ = 0.0;
+			}
+			last_frame = now;
+		}
+	}
+
+	void StopRenderThread() {
+		if (!render_thread_.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lk(frame_mutex_);
+			render_exit_ = true;
+		}
+		frame_cv_.notify_one();
+		render_thread_.join();
 	}
 
 	void Render() {
+		static auto& frame_ms = metrics::get_gauge("frame.ms");
+		const auto frame_start = std::chrono::steady_clock::now();
+
 		m_d2dContext->BeginDraw();
 		static_cast<T*>(this)->Draw();
-		m_d2dContext->EndDraw();
-		
+		// D2DERR_RECREATE_TARGET among others, there is nothing to present
+		if (FAILED(m_d2dContext->EndDraw())) {
+			ReleaseDevice();
+			return;
+		}
 
 		// We are accessing Direct3D resources directly without Direct2D's knowledge, so we
-    // must manually acquire and apply the Direct2D factory lock.
-    ID2D1Multithread* m_D2DMultithread;
-    GR::get_instance().d2dFactory->QueryInterface(IID_PPV_ARGS(&m_D2DMultithread));
-    m_D2DMultithread->Enter();
-    
-    // Now it is safe to make Direct3D/DXGI calls, such as IDXGISwapChain::Present
-		auto const hr = m_swapChain->Present(1, 0);
-
-    // It is absolutely critical that the factory lock be released upon
-    // exiting this function, or else any consequent Direct2D calls will be blocked.
-    m_D2DMultithread->Leave();
+		// must manually acquire and apply the Direct2D factory lock.
+		d2d_multithread_->Enter();
+		HRESULT hr;
+		{
+			IMV_TRACE_SCOPE("present", "draw");
+			hr = m_swapChain->Present(1, 0);
+		}
+		d2d_multithread_->Leave();
 
+		frame_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
 		
 		if (S_OK == hr) {
 			// do nothing
 		} else if (DXGI_STATUS_OCCLUDED == hr) {
-			HR(GR::get_instance().dxgiFactory->RegisterOcclusionStatusWindow(this->m_hWnd, WM_USER, &m_occlusion));
-			m_visible = false;
+			// No HR() here, a throw on the render thread ends the process.
+			// Without the notification frames go on being presented.
+			if (!m_occlusion && SUCCEEDED(GR::get_instance().dxgiFactory->RegisterOcclusionStatusWindow(this->m_hWnd, WM_OCCLUSION, &m_occlusion))) {
+				m_visible = false;
+			}
 		} else {
 			ReleaseDevice();
 		}
 	}
 
+	// Render thread: composes a frame into soft_frame_, hands it to the UI
+	// thread to blit and takes back the one blitted before.
+	void RenderSoftware() {
+		static auto& frame_ms = metrics::get_gauge("frame.ms");
+		const auto frame_start = std::chrono::steady_clock::now();
+
+		const auto width = static_cast<std::uint32_t>(m_dimf.width);
+		const auto height = static_cast<std::uint32_t>(m_dimf.height);
+		if (!width || !height) return;
+		if (soft_frame_.width != width || soft_frame_.height != height) soft_frame_.allocate(width, height);
+
+		static_cast<T*>(this)->DrawSoftware(soft_frame_);
+		{
+			std::lock_guard<std::mutex> lk(soft_mutex_);
+			std::swap(soft_frame_, soft_shown_);
+		}
+		this->InvalidateRect(nullptr, FALSE);
+
+		last_cpu_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+		frame_ms.set(last_cpu_ms_);
+	}
+
+	// UI thread, WM_PAINT: copies the last finished frame to the window.
+	void BlitSoftware(HDC hdc) {
+		std::lock_guard<std::mutex> lk(soft_mutex_);
+		const auto width = soft_shown_.width, height = soft_shown_.height;
+		if (!width || !height) return;
+
+		BITMAPINFO bmi = {};
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biWidth = static_cast<LONG>(width);
+		bmi.bmiHeader.biHeight = -static_cast<LONG>(height); // top-down
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biCompression = BI_RGB;
+		{
+			IMV_TRACE_SCOPE("blit", "draw");
+			SetDIBitsToDevice(hdc, 0, 0, width, height, 0, 0, 0, height, soft_shown_.data(), &bmi, DIB_RGB_COLORS);
+		}
+	}
+
 	BOOL SubclassWindow(_In_ HWND hWnd) {
 		ATLASSUME(this->m_hWnd == NULL);
 		ATLASSERT(::IsWindow(hWnd));
@@ -210,39 +438,13 @@ private:
 	}
 
 	void CreateDeviceResources(HWND hwnd) {
-		// This flag adds support for surfaces with a different color channel ordering than the API default.
-		// You need it for compatibility with Direct2D.
-		UINT creationFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
-
-		// This array defines the set of DirectX hardware feature levels this app  supports.
-		// The ordering is important and you should  preserve it.
-		// Don't forget to declare your app's minimum required feature level in its
-		// description.  All apps are assumed to support 9.1 unless otherwise stated.
-		static const D3D_FEATURE_LEVEL featureLevels[] =
-		{
-			D3D_FEATURE_LEVEL_11_1,
-			D3D_FEATURE_LEVEL_11_0,
-			D3D_FEATURE_LEVEL_10_1,
-			D3D_FEATURE_LEVEL_10_0,
-			D3D_FEATURE_LEVEL_9_3,
-			D3D_FEATURE_LEVEL_9_2,
-			D3D_FEATURE_LEVEL_9_1
-		};
-
-		// Create the DX11 API device object, and get a corresponding context.
-
-		HR(D3D11CreateDevice(
-			nullptr,                    // specify null to use the default adapter
-			D3D_DRIVER_TYPE_HARDWARE,
-			0,
-			creationFlags,              // optionally set debug and Direct2D compatibility flags
-			featureLevels,              // list of feature levels this app can support
-			ARRAYSIZE(featureLevels),   // number of possible feature levels
-			D3D11_SDK_VERSION,
-			m_d3dDevice.GetAddressOf(),               // returns the Direct3D device created
-			nullptr,            // returns feature level of device created
-			m_d3dContext.GetAddressOf()                    // returns the device immediate context
-		));
+		// usually created while the window was being built
+		const HRESULT hr = GR::get_instance().TakeDevice(m_d3dDevice, m_d3dContext);
+
+		if (FAILED(hr)) {
+			software_ = true;
+			return;
+		}
 
 		wrl::ComPtr<IDXGIDevice1> dxgiDevice;
 		// Obtain the underlying DXGI device of the Direct3D11 device.
@@ -251,9 +453,14 @@ private:
 		HR(GR::get_instance().d2dFactory->CreateDevice(dxgiDevice.Get(), m_d2dDevice.GetAddressOf()));
 		
 		// Get Direct2D device's corresponding device context object.
+		wrl::ComPtr<ID2D1DeviceContext1> context;
 		HR(m_d2dDevice->CreateDeviceContext(
 			D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
-			m_d2dContext.GetAddressOf()));
+			context.GetAddressOf()));
+		{
+			std::lock_guard<std::mutex> lk(device_mutex_);
+			m_d2dContext = std::move(context);
+		}
 
 		m_d2dContext->SetTransform(matrix_);
 
@@ -339,6 +546,7 @@ private:
 	// stubs
 	void OnBoundsChanged() {}
 	void ReleaseDeviceResources() {}
+	void OnDeviceRestored() {}
 	void CreateResources() {}
 	void OnResourcesCreated() {}
 
@@ -347,24 +555,28 @@ private:
 		m_d2dContext->Clear(D2D1::ColorF(D2D1::ColorF::GreenYellow));
 	}
 
+	void DrawSoftware(image_buffer& frame) {
+		std::fill(frame.data(), frame.data() + size_t(frame.width) * frame.height, 0xFFADFF2Fu);
+	}
+
 	void CleanUp() {
-		m_d2dContext.Reset();
+		{
+			std::lock_guard<std::mutex> lk(device_mutex_);
+			m_d2dContext.Reset();
+		}
 		m_swapChain.Reset();
 		m_d2dDevice.Reset();
 		m_d3dContext.Reset();
 		m_d3dDevice.Reset();
 	}
 	
-	ID2D1DeviceContext1* d2d1_context() {
-		return m_d2dContext.Get();
-	}
-
 	D2DWindow() 
 		: matrix_{D2D1::Matrix3x2F::Identity()}
 	{
 	}
 
 	~D2DWindow() {
+		StopRenderThread();
 		CleanUp();
 	}
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Learns how long it takes to get an image on screen, per file format and
+// per file size class, from the loads that already happened. A combination
+// never seen borrows the throughput of its format, then of all formats.
+class decode_estimator {
+	static constexpr size_t n_size_classes = 40; // log2 of the file size
+	static constexpr double smoothing = 0.3;
+
+	struct rate {
+		double ms_per_mb = 0.0;
+		std::uint32_t samples = 0;
+
+		void add(double v) noexcept {
+			ms_per_mb = samples ? ms_per_mb + (v - ms_per_mb) * smoothing : v;
+			++samples;
+		}
+	};
+
+	struct format_stats {
+		rate overall;
+		std::array<rate, n_size_classes> by_size;
+	};
+
+	mutable std::mutex mutex_;
+	std::map<std::string, format_stats, std::less<>> formats_;
+	rate overall_;
+	// before anything was measured: roughly a JPEG through WIC
+	double default_ms_per_mb_ = 40.0;
+
+	static size_t size_class(std::uint64_t bytes) noexcept {
+		return std::min<size_t>(std::bit_width(bytes), n_size_classes - 1);
+	}
+
+	static std::string key(std::string_view format) {
+		std::string k(format);
+		std::transform(k.begin(), k.end(), k.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return k;
+	}
+public:
+	void record(std::string_view format, std::uint64_t file_bytes, double ms) {
+		if (file_bytes == 0) return;
+		const double v = ms / (static_cast<double>(file_bytes) / (1024.0 * 1024.0));
+		std::lock_guard<std::mutex> lk(mutex_);
+		auto& f = formats_[key(format)];
+		f.by_size[size_class(file_bytes)].add(v);
+		f.overall.add(v);
+		overall_.add(v);
+	}
+
+	double estimate_ms(std::string_view format, std::uint64_t file_bytes) const {
+		const double mb = static_cast<double>(file_bytes) / (1024.0 * 1024.0);
+		std::lock_guard<std::mutex> lk(mutex_);
+		if (auto it = formats_.find(key(format)); it != formats_.end()) {
+			const auto& exact = it->second.by_size[size_class(file_bytes)];
+			if (exact.samples) return exact.ms_per_mb * mb;
+			return it->second.overall.ms_per_mb * mb;
+		}
+		return (overall_.samples ? overall_.ms_per_mb : default_ms_per_mb_) * mb;
+	}
+};
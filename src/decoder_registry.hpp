@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "image_buffer.hpp"
+#include "jpeg_decoder.hpp"
+#include "png_decoder.hpp"
+#include "gif_decoder.hpp"
+#include "bmp_decoder.hpp"
+
+// In-tree decoders picked by the file's magic bytes rather than its name.
+// The set is fixed at compile time, dispatch is a fold over the codecs in
+// order of precedence. A codec that declines a file (an unsupported variant,
+// a corrupt stream) returns false and the caller falls back to the system
+// codecs.
+namespace decoders {
+
+struct jpeg_codec {
+	static constexpr std::string_view name = "jpeg";
+	static bool sniff(const std::uint8_t* data, size_t size) noexcept { return jpeg::is_jpeg(data, size); }
+	static bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+		return jpeg::dimensions(data, size, width, height);
+	}
+	static bool high_bit_depth(const std::uint8_t* data, size_t size) noexcept { return jpeg::is_high_bit_depth(data, size); }
+	static bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>* icc) {
+		return jpeg::decode(data, size, out, icc);
+	}
+};
+
+struct png_codec {
+	static constexpr std::string_view name = "png";
+	static bool sniff(const std::uint8_t* data, size_t size) noexcept { return png::is_png(data, size); }
+	static bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+		return png::dimensions(data, size, width, height);
+	}
+	static bool high_bit_depth(const std::uint8_t* data, size_t size) noexcept { return png::is_high_bit_depth(data, size); }
+	static bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>* icc) {
+		return png::decode(data, size, out, icc);
+	}
+};
+
+struct gif_codec {
+	static constexpr std::string_view name = "gif";
+	static bool sniff(const std::uint8_t* data, size_t size) noexcept { return gif::is_gif(data, size); }
+	static bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+		return gif::dimensions(data, size, width, height);
+	}
+	static bool high_bit_depth(const std::uint8_t*, size_t) noexcept { return false; }
+	static bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>*) {
+		return gif::decode(data, size, out);
+	}
+};
+
+struct bmp_codec {
+	static constexpr std::string_view name = "bmp";
+	static bool sniff(const std::uint8_t* data, size_t size) noexcept { return bmp::is_bmp(data, size); }
+	static bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+		return bmp::dimensions(data, size, width, height);
+	}
+	static bool high_bit_depth(const std::uint8_t*, size_t) noexcept { return false; }
+	static bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>*) {
+		return bmp::decode(data, size, out);
+	}
+};
+
+template<typename... Codecs>
+struct registry {
+	// Calls `fn(Codec{})` for the first codec that recognises the bytes,
+	// false if none does.
+	template<typename Fn>
+	static bool visit(const std::uint8_t* data, size_t size, Fn&& fn) {
+		return ((Codecs::sniff(data, size) ? (fn(Codecs{}), true) : false) || ...);
+	}
+
+	static bool sniff(const std::uint8_t* data, size_t size) noexcept {
+		return (Codecs::sniff(data, size) || ...);
+	}
+
+	// "jpeg", empty for unknown bytes
+	static std::string_view name(const std::uint8_t* data, size_t size) noexcept {
+		std::string_view result;
+		visit(data, size, [&](auto codec) { result = decltype(codec)::name; });
+		return result;
+	}
+
+	static bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+		bool ok = false;
+		visit(data, size, [&](auto codec) { ok = decltype(codec)::dimensions(data, size, width, height); });
+		return ok;
+	}
+
+	// Beyond 8 bits per channel, those go through the half float path.
+	static bool high_bit_depth(const std::uint8_t* data, size_t size) noexcept {
+		bool high = false;
+		visit(data, size, [&](auto codec) { high = decltype(codec)::high_bit_depth(data, size); });
+		return high;
+	}
+
+	static bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>* icc = nullptr) {
+		bool ok = false;
+		visit(data, size, [&](auto codec) { ok = decltype(codec)::decode(data, size, out, icc); });
+		return ok;
+	}
+};
+
+using native = registry<jpeg_codec, png_codec, gif_codec, bmp_codec>;
+
+} // namespace decoders
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#endif
+
+#include "catalog.hpp"
+#include "image_buffer.hpp"
+#include "phash.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+namespace phash {
+
+// Near-duplicate groups of a catalog, entry i at row i.
+struct groups {
+	// the next entry of the folder in its group, itself when alone
+	std::vector<std::int64_t> next;
+	// pictures in its group, other folders included
+	std::vector<std::uint32_t> size;
+	size_t n_groups = 0;
+};
+
+// Background job: perceptually hashes every picture of the folder from a
+// thumbnail-sized decode and groups near-duplicates and bursts. Hashes are
+// kept in a cache file, a folder seen before is grouped at once, and groups
+// reach across every folder in the cache. The groups are also listed in a
+// text file, a blank line after each.
+class finder {
+public:
+	static constexpr std::uint32_t thumbnail_side = 64;
+	static constexpr int radius = 6;
+
+	// The picture at `path` at most thumbnail_side on its longer side, false
+	// when it can't be decoded. Called on several threads at once.
+	using decoder = std::function<bool(const std::filesystem::path& path, image_buffer& out)>;
+private:
+	std::filesystem::path cache_;
+	std::filesystem::path listing_;
+	decoder decode_;
+	std::shared_ptr<const catalog> catalog_;
+	std::thread thread_;
+	std::atomic<bool> stop_{false};
+	std::atomic<size_t> hashed_{0};
+	std::atomic<size_t> to_hash_{0};
+	std::mutex mutex_;
+	std::shared_ptr<const groups> groups_;
+
+	struct Metrics {
+		metrics::counter& hashed = metrics::get_counter("phash.hashed");
+		metrics::gauge& hashes_per_sec = metrics::get_gauge("phash.hashes_per_sec");
+		metrics::gauge& index_ms = metrics::get_gauge("phash.index_ms");
+		metrics::gauge& groups = metrics::get_gauge("phash.groups");
+	} metrics_;
+
+	void run() {
+		trace::tracer::get_instance().name_thread("phash");
+		store cached;
+		cached.load(cache_);
+
+		struct job { size_t catalog_idx; std::uint64_t size; std::int64_t mtime; hashes h; bool ok = false; };
+		std::vector<job> jobs;
+		// sizes and times as the folder was listed
+		for (size_t i = 0; i < catalog_->size(); ++i) {
+			const auto size = catalog_->file_bytes(i);
+			const auto mtime = catalog_->mtime(i);
+			if (size == 0) continue;
+			if (!cached.find(catalog_->path(i).string(), size, mtime)) jobs.push_back({i, size, mtime, {}});
+		}
+		to_hash_ = jobs.size();
+
+		// below normal priority, navigation decodes come first
+		const auto start = std::chrono::steady_clock::now();
+		std::atomic<size_t> next{0};
+		auto worker = [&]() {
+#ifdef _WIN32
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+			image_buffer thumbnail;
+			for (size_t i; !stop_ && (i = next.fetch_add(1)) < jobs.size();) {
+				IMV_TRACE_SCOPE_ARG("phash", "phash", jobs[i].catalog_idx);
+				if (decode_(catalog_->path(jobs[i].catalog_idx), thumbnail)) {
+					jobs[i].h = compute(thumbnail);
+					jobs[i].ok = true;
+				}
+				++hashed_;
+				metrics_.hashed.add();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency() / 2); ++i) workers.emplace_back(worker);
+		for (auto& t : workers) t.join();
+		if (stop_) return;
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!jobs.empty() && seconds > 0) metrics_.hashes_per_sec.set(static_cast<double>(jobs.size()) / seconds);
+
+		for (auto& j : jobs) {
+			if (j.ok) cached.put(catalog_->path(j.catalog_idx).string(), {j.size, j.mtime, j.h});
+		}
+		if (!jobs.empty()) cached.save(cache_);
+
+		build_groups(cached);
+	}
+
+	void build_groups(const store& cached) {
+		IMV_TRACE_SCOPE("index", "phash");
+		const auto start = std::chrono::steady_clock::now();
+
+		std::vector<const std::string*> paths;
+		std::vector<hashes> all;
+		paths.reserve(cached.entries().size());
+		all.reserve(cached.entries().size());
+		for (auto& [path, e] : cached.entries()) {
+			paths.push_back(&path);
+			all.push_back(e.hashes);
+		}
+		const index neighbours(std::move(all), radius);
+		const auto group = neighbours.groups();
+
+		std::map<std::uint32_t, std::vector<std::uint32_t>> members;
+		for (std::uint32_t id = 0; id < group.size(); ++id) members[group[id]].push_back(id);
+
+		std::map<const std::string*, std::int64_t> catalog_idx;
+		{
+			std::map<std::string, std::int64_t, std::less<>> by_path;
+			for (size_t i = 0; i < catalog_->size(); ++i) by_path.emplace(catalog_->path(i).string(), static_cast<std::int64_t>(i));
+			for (auto* p : paths) {
+				if (auto it = by_path.find(*p); it != by_path.end()) catalog_idx.emplace(p, it->second);
+			}
+		}
+
+		auto found = std::make_shared<groups>();
+		found->next.resize(catalog_->size());
+		found->size.assign(catalog_->size(), 1);
+		for (size_t i = 0; i < catalog_->size(); ++i) found->next[i] = static_cast<std::int64_t>(i);
+
+		std::ofstream listing(listing_);
+		for (auto& [root, ids] : members) {
+			if (ids.size() < 2) continue;
+			++found->n_groups;
+			std::vector<std::int64_t> here;
+			for (auto id : ids) {
+				listing << *paths[id] << "\n";
+				if (auto it = catalog_idx.find(paths[id]); it != catalog_idx.end()) here.push_back(it->second);
+			}
+			listing << "\n";
+			std::sort(here.begin(), here.end());
+			for (size_t k = 0; k < here.size(); ++k) {
+				found->next[here[k]] = here[(k + 1) % here.size()];
+				found->size[here[k]] = static_cast<std::uint32_t>(ids.size());
+			}
+		}
+
+		metrics_.index_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		metrics_.groups.set(static_cast<double>(found->n_groups));
+		std::lock_guard<std::mutex> lk(mutex_);
+		groups_ = std::move(found);
+	}
+public:
+	// Hashes are kept in `cache` between sessions, the groups listed in
+	// `listing`.
+	finder(std::filesystem::path cache, std::filesystem::path listing, decoder decode)
+		: cache_{std::move(cache)}, listing_{std::move(listing)}, decode_{std::move(decode)} {}
+	finder(const finder&) = delete;
+	finder& operator=(const finder&) = delete;
+	~finder() { stop(); }
+
+	// A running search for another catalog is abandoned.
+	void start(std::shared_ptr<const catalog> pictures) {
+		stop();
+		stop_ = false;
+		hashed_ = 0;
+		to_hash_ = 0;
+		catalog_ = std::move(pictures);
+		thread_ = std::thread(&finder::run, this);
+	}
+
+	// The groups go too, they are only good for the catalog they were
+	// built for.
+	void stop() {
+		stop_ = true;
+		if (thread_.joinable()) thread_.join();
+		std::lock_guard<std::mutex> lk(mutex_);
+		groups_.reset();
+	}
+
+	// null until every picture is hashed; indexed by the catalog passed to
+	// start(), which a view may be a step behind
+	std::shared_ptr<const groups> get() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return groups_;
+	}
+
+	size_t hashed() const noexcept { return hashed_; }
+	size_t to_hash() const noexcept { return to_hash_; }
+};
+
+} // namespace phash
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Catalog entries a filter keeps, a bit per entry of the catalog. A filter
+// step over a million names writes 128 KB instead of a list of what it
+// kept, and two filters are combined a word at a time. Navigation asks for
+// the k-th kept entry and where an entry is among them: a lookup in the
+// running counts kept per 512 entries, then a popcount or two.
+class entry_set {
+	static constexpr size_t block_words = 8;
+
+	size_t universe_ = 0;
+	size_t size_ = 0;
+	std::vector<std::uint64_t> words_;
+	// entries kept before each block of block_words words
+	std::vector<std::uint32_t> ranks_;
+public:
+	entry_set() = default;
+
+	// None of `universe` entries, insert() and then seal().
+	explicit entry_set(size_t universe) : universe_{universe}, words_((universe + 63) / 64) {}
+
+	// Ascending entries below `universe`.
+	template<typename It>
+	static entry_set of(size_t universe, It first, It last) {
+		entry_set s(universe);
+		for (; first != last; ++first) s.insert(static_cast<size_t>(*first));
+		s.seal();
+		return s;
+	}
+
+	void insert(size_t i) noexcept { words_[i / 64] |= std::uint64_t(1) << (i % 64); }
+	// the words, for filling a whole one at a time; seal() after
+	std::uint64_t* data() noexcept { return words_.data(); }
+
+	// Counts what was inserted, after which the set is only read.
+	void seal() {
+		ranks_.resize((words_.size() + block_words - 1) / block_words);
+		size_t n = 0;
+		for (size_t w = 0; w < words_.size(); ++w) {
+			if (w % block_words == 0) ranks_[w / block_words] = static_cast<std::uint32_t>(n);
+			n += static_cast<size_t>(std::popcount(words_[w]));
+		}
+		size_ = n;
+	}
+
+	size_t universe() const noexcept { return universe_; }
+	size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return size_ == 0; }
+	const std::uint64_t* words() const noexcept { return words_.data(); }
+	size_t word_count() const noexcept { return words_.size(); }
+
+	bool contains(size_t i) const noexcept {
+		return i < universe_ && (words_[i / 64] >> (i % 64) & 1) != 0;
+	}
+
+	// How many kept entries come before entry i.
+	size_t rank(size_t i) const noexcept {
+		if (i >= universe_) return size_;
+		const size_t w = i / 64;
+		size_t n = ranks_[w / block_words];
+		for (size_t k = w / block_words * block_words; k < w; ++k) n += static_cast<size_t>(std::popcount(words_[k]));
+		return n + static_cast<size_t>(std::popcount(words_[w] & ((std::uint64_t(1) << (i % 64)) - 1)));
+	}
+
+	// The k-th kept entry, k < size().
+	std::int64_t at(size_t k) const noexcept {
+		const auto block = static_cast<size_t>(std::upper_bound(ranks_.begin(), ranks_.end(), k) - ranks_.begin()) - 1;
+		size_t left = k - ranks_[block];
+		size_t w = block * block_words;
+		for (;; ++w) {
+			const auto n = static_cast<size_t>(std::popcount(words_[w]));
+			if (left < n) break;
+			left -= n;
+		}
+		auto word = words_[w];
+		for (; left; --left) word &= word - 1;
+		return static_cast<std::int64_t>(w * 64 + static_cast<size_t>(std::countr_zero(word)));
+	}
+
+	// `fn(entry)` for each kept entry, ascending.
+	template<typename Fn>
+	void for_each(Fn&& fn) const {
+		for (size_t w = 0; w < words_.size(); ++w) {
+			for (auto word = words_[w]; word; word &= word - 1) fn(w * 64 + static_cast<size_t>(std::countr_zero(word)));
+		}
+	}
+
+	// Kept by both.
+	friend entry_set operator&(const entry_set& a, const entry_set& b) {
+		entry_set both(std::min(a.universe_, b.universe_));
+		for (size_t w = 0; w < both.words_.size(); ++w) both.words_[w] = a.words_[w] & b.words_[w];
+		both.seal();
+		return both;
+	}
+
+	friend bool operator==(const entry_set& a, const entry_set& b) noexcept {
+		return a.universe_ == b.universe_ && a.words_ == b.words_;
+	}
+
+	// Heap bytes held.
+	size_t bytes() const noexcept {
+		return words_.capacity() * sizeof(std::uint64_t) + ranks_.capacity() * sizeof(std::uint32_t);
+	}
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "decoder_registry.hpp"
+
+// The EXIF fields the metadata index keeps, read from a file's headers only:
+// the JPEG markers up to the first scan with the TIFF structure of the Exif
+// APP1 segment, the IFDs of a TIFF or CR2, and the dimensions of anything
+// else the native decoders recognise. The first 64K of a file are read in
+// one go, which holds all of it for nearly every camera; whatever lies past
+// them is read with a seek, never the pixel data.
+namespace exif {
+
+struct fields {
+	// DateTimeOriginal, seconds since 1970 on the camera's clock, 0 unknown
+	std::int64_t taken = 0;
+	std::string make, model, lens;
+	std::uint32_t iso = 0;
+	std::uint32_t width = 0, height = 0;
+	// as the TIFF tag, 1 to 8, 0 when absent
+	std::uint8_t orientation = 0;
+};
+
+namespace detail {
+
+constexpr size_t head_bytes = 64 * 1024;
+
+// Bytes by offset, from memory or from a file whose head is read once.
+class source {
+	std::vector<std::uint8_t> head_;
+	const std::uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+	FILE* f_ = nullptr;
+public:
+	source(const std::uint8_t* data, size_t size) noexcept : data_{data}, size_{size} {}
+
+	explicit source(const std::filesystem::path& path) {
+#ifdef _WIN32
+		f_ = _wfopen(path.c_str(), L"rb");
+#else
+		f_ = std::fopen(path.c_str(), "rb");
+#endif
+		if (!f_) return;
+		head_.resize(head_bytes);
+		head_.resize(std::fread(head_.data(), 1, head_.size(), f_));
+		data_ = head_.data();
+		size_ = head_.size();
+		// the whole file is in the head
+		if (size_ < head_bytes) {
+			std::fclose(f_);
+			f_ = nullptr;
+		}
+	}
+	source(const source&) = delete;
+	source& operator=(const source&) = delete;
+	~source() {
+		if (f_) std::fclose(f_);
+	}
+
+	explicit operator bool() const noexcept { return size_ != 0; }
+
+	// what is in memory, the first 64K of a file
+	const std::uint8_t* head() const noexcept { return data_; }
+	size_t head_size() const noexcept { return size_; }
+
+	// False past the end.
+	bool read(std::uint64_t offset, size_t size, std::vector<std::uint8_t>& out) {
+		out.resize(size);
+		if (offset + size <= size_) {
+			std::memcpy(out.data(), data_ + offset, size);
+			return true;
+		}
+		if (!f_) return false;
+#ifdef _WIN32
+		if (_fseeki64(f_, static_cast<__int64>(offset), SEEK_SET) != 0) return false;
+#else
+		if (fseeko(f_, static_cast<off_t>(offset), SEEK_SET) != 0) return false;
+#endif
+		return std::fread(out.data(), 1, size, f_) == size;
+	}
+};
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+inline std::int64_t days_from_civil(std::int64_t y, unsigned m, unsigned d) noexcept {
+	y -= m <= 2;
+	const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const auto yoe = static_cast<unsigned>(y - era * 400);
+	const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+// "YYYY:MM:DD HH:MM:SS", 0 for anything else, blanks included.
+inline std::int64_t parse_time(const std::string& s) noexcept {
+	if (s.size() < 19) return 0;
+	auto num = [&](size_t at, size_t len) {
+		int v = 0;
+		for (size_t i = at; i < at + len; ++i) {
+			if (s[i] < '0' || s[i] > '9') return -1;
+			v = v * 10 + (s[i] - '0');
+		}
+		return v;
+	};
+	const int y = num(0, 4), mo = num(5, 2), d = num(8, 2), h = num(11, 2), mi = num(14, 2), sec = num(17, 2);
+	if (y < 1 || mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0 || sec > 60) return 0;
+	return days_from_civil(y, static_cast<unsigned>(mo), static_cast<unsigned>(d)) * 86400 + h * 3600 + mi * 60 + sec;
+}
+
+// A TIFF structure `limit` bytes long at `base` of the source; offsets in
+// it are from its header.
+class tiff {
+	source& src_;
+	std::uint64_t base_, limit_;
+	bool little_ = true;
+
+	std::uint16_t u16(const std::uint8_t* p) const noexcept {
+		return static_cast<std::uint16_t>(little_ ? p[0] | p[1] << 8 : p[0] << 8 | p[1]);
+	}
+	std::uint32_t u32(const std::uint8_t* p) const noexcept {
+		return little_ ? u16(p) | std::uint32_t(u16(p + 2)) << 16 : std::uint32_t(u16(p)) << 16 | u16(p + 2);
+	}
+
+	bool read(std::uint64_t offset, size_t size, std::vector<std::uint8_t>& out) {
+		return offset + size <= limit_ && src_.read(base_ + offset, size, out);
+	}
+public:
+	tiff(source& src, std::uint64_t base, std::uint64_t limit) noexcept : src_{src}, base_{base}, limit_{limit} {}
+
+	// "II*\0" or "MM\0*", the offset of IFD0 in `ifd0`.
+	bool header(std::uint32_t& ifd0) {
+		std::vector<std::uint8_t> h;
+		if (!read(0, 8, h)) return false;
+		if (h[0] == 'I' && h[1] == 'I') little_ = true;
+		else if (h[0] == 'M' && h[1] == 'M') little_ = false;
+		else return false;
+		if (u16(h.data() + 2) != 42) return false;
+		ifd0 = u32(h.data() + 4);
+		return true;
+	}
+
+	// `fn(tag, entry)` for the 12-byte entries of the IFD at `offset`.
+	template<typename Fn>
+	bool ifd(std::uint32_t offset, Fn&& fn) {
+		std::vector<std::uint8_t> count, entries;
+		if (!read(offset, 2, count)) return false;
+		const size_t n = u16(count.data());
+		if (n == 0 || n > 1024 || !read(offset + 2, n * 12, entries)) return false;
+		for (size_t i = 0; i < n; ++i) fn(u16(entries.data() + i * 12), entries.data() + i * 12);
+		return true;
+	}
+
+	// An ASCII entry without its terminator and trailing blanks.
+	std::string text(const std::uint8_t* e) {
+		const auto count = u32(e + 4);
+		if (u16(e + 2) != 2 || count == 0 || count > 1024) return {};
+		std::vector<std::uint8_t> value(e + 8, e + 8 + std::min<std::uint32_t>(count, 4));
+		if (count > 4 && !read(u32(e + 8), count, value)) return {};
+		std::string s(value.begin(), value.end());
+		s.resize(std::strlen(s.c_str()));
+		while (!s.empty() && s.back() == ' ') s.pop_back();
+		return s;
+	}
+
+	// The first value of a SHORT, LONG or IFD entry, 0 for other types.
+	std::uint32_t number(const std::uint8_t* e) const noexcept {
+		switch (u16(e + 2)) {
+		case 3: return u16(e + 8);
+		case 4: case 13: return u32(e + 8);
+		default: return 0;
+		}
+	}
+};
+
+// IFD0 and the Exif IFD it points to.
+inline void parse_tiff(source& src, std::uint64_t base, std::uint64_t limit, fields& f) {
+	tiff t(src, base, limit);
+	std::uint32_t ifd0 = 0, exif_ifd = 0;
+	if (!t.header(ifd0)) return;
+	std::int64_t modified = 0;
+	t.ifd(ifd0, [&](std::uint16_t tag, const std::uint8_t* e) {
+		switch (tag) {
+		case 0x0100: f.width = t.number(e); break;
+		case 0x0101: f.height = t.number(e); break;
+		case 0x010F: f.make = t.text(e); break;
+		case 0x0110: f.model = t.text(e); break;
+		case 0x0112: f.orientation = static_cast<std::uint8_t>(t.number(e) <= 8 ? t.number(e) : 0); break;
+		case 0x0132: modified = parse_time(t.text(e)); break;
+		case 0x8769: exif_ifd = t.number(e); break;
+		}
+	});
+	if (exif_ifd) {
+		t.ifd(exif_ifd, [&](std::uint16_t tag, const std::uint8_t* e) {
+			switch (tag) {
+			case 0x9003: f.taken = parse_time(t.text(e)); break;
+			case 0x8827: f.iso = t.number(e); break;
+			case 0xA002: f.width = t.number(e); break;
+			case 0xA003: f.height = t.number(e); break;
+			case 0xA434: f.lens = t.text(e); break;
+			}
+		});
+	}
+	// scanners and editors that leave out the original time
+	if (!f.taken) f.taken = modified;
+}
+
+// Markers up to the first scan: the Exif APP1 segment, then the frame
+// header, whose dimensions win over the Exif ones.
+inline void parse_jpeg(source& src, fields& f) {
+	std::vector<std::uint8_t> seg;
+	bool exif_seen = false;
+	for (std::uint64_t pos = 2; src.read(pos, 4, seg) && seg[0] == 0xFF;) {
+		const auto marker = seg[1];
+		if (marker == 0xFF) {
+			++pos;
+			continue;
+		}
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+			pos += 2;
+			continue;
+		}
+		if (marker == 0xD9 || marker == 0xDA) return;
+		const size_t len = seg[2] << 8 | seg[3];
+		if (len < 2) return;
+		if (marker == 0xE1 && !exif_seen && len >= 8 && src.read(pos + 4, 6, seg) && std::memcmp(seg.data(), "Exif\0\0", 6) == 0) {
+			exif_seen = true;
+			parse_tiff(src, pos + 10, len - 8, f);
+		} else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			if (len >= 7 && src.read(pos + 4, 5, seg)) {
+				f.height = static_cast<std::uint32_t>(seg[1] << 8 | seg[2]);
+				f.width = static_cast<std::uint32_t>(seg[3] << 8 | seg[4]);
+			}
+			return;
+		}
+		pos += 2 + len;
+	}
+}
+
+inline bool parse(source& src, fields& f) {
+	std::vector<std::uint8_t> magic;
+	if (!src.read(0, 4, magic)) return false;
+	if (magic[0] == 0xFF && magic[1] == 0xD8) {
+		parse_jpeg(src, f);
+	} else if ((magic[0] == 'I' && magic[1] == 'I') || (magic[0] == 'M' && magic[1] == 'M')) {
+		parse_tiff(src, 0, UINT64_MAX / 2, f);
+	} else {
+		decoders::native::dimensions(src.head(), src.head_size(), f.width, f.height);
+	}
+	return true;
+}
+
+} // namespace detail
+
+// False when the file can't be read, fields it doesn't have stay unknown.
+inline bool read(const std::filesystem::path& path, fields& f) {
+	detail::source src(path);
+	return src && detail::parse(src, f);
+}
+
+inline bool read(const std::uint8_t* data, size_t size, fields& f) {
+	detail::source src(data, size);
+	return size && detail::parse(src, f);
+}
+
+} // namespace exif
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#endif
+
+#include "catalog.hpp"
+#include "exif.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+// The EXIF fields of a catalog as columns, entry i at row i, for filters
+// that scan a column or two instead of touching files. A background indexer
+// fills them from header-only reads in parallel; fields are kept by path,
+// size and mtime in a cache file, a folder seen before is indexed without
+// reading anything.
+namespace exif {
+
+enum class shape : std::uint8_t { any, landscape, portrait };
+
+// "2024-05-01" for days since 1970.
+inline std::string day_name(std::int64_t day) {
+	const std::int64_t z = day + 719468;
+	const std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	const auto doe = static_cast<unsigned>(z - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+	const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+	const auto y = static_cast<long long>(yoe) + era * 400 + (m <= 2);
+	char text[32];
+	std::snprintf(text, sizeof(text), "%04lld-%02u-%02u", y, m, d);
+	return text;
+}
+
+// What a filter keeps, every criterion that is set has to hold.
+struct filter {
+	// dictionary ids of index, 0 any
+	std::uint16_t camera = 0, lens = 0;
+	// days since 1970 on the camera's clock, -1 any
+	std::int64_t day = -1;
+	exif::shape shape = shape::any;
+	std::uint32_t iso_min = 0, iso_max = UINT32_MAX;
+
+	bool empty() const noexcept {
+		return !camera && !lens && day < 0 && shape == shape::any && iso_min == 0 && iso_max == UINT32_MAX;
+	}
+};
+
+class index {
+	std::vector<std::int64_t> taken_;
+	std::vector<std::uint32_t> iso_, width_, height_;
+	std::vector<std::uint8_t> orientation_;
+	std::vector<std::uint16_t> camera_, lens_;
+	// derived, what the filters compare
+	std::vector<std::int32_t> day_;
+	std::vector<exif::shape> shape_;
+	// id 0 is the empty name, unknown
+	std::vector<std::string> cameras_{std::string()}, lenses_{std::string()};
+	std::unordered_map<std::string, std::uint16_t> camera_ids_, lens_ids_;
+
+	static std::uint16_t intern(const std::string& name, std::vector<std::string>& names, std::unordered_map<std::string, std::uint16_t>& ids) {
+		if (name.empty()) return 0;
+		if (const auto it = ids.find(name); it != ids.end()) return it->second;
+		// more names than ids stay unknown
+		if (names.size() > UINT16_MAX) return 0;
+		const auto id = static_cast<std::uint16_t>(names.size());
+		names.push_back(name);
+		ids.emplace(name, id);
+		return id;
+	}
+public:
+	explicit index(size_t n)
+		: taken_(n), iso_(n), width_(n), height_(n), orientation_(n), camera_(n), lens_(n), day_(n, -1), shape_(n) {}
+
+	size_t size() const noexcept { return taken_.size(); }
+
+	void set(size_t i, const fields& f) {
+		taken_[i] = f.taken;
+		iso_[i] = f.iso;
+		width_[i] = f.width;
+		height_[i] = f.height;
+		orientation_[i] = f.orientation;
+		day_[i] = f.taken ? static_cast<std::int32_t>(f.taken >= 0 ? f.taken / 86400 : (f.taken - 86399) / 86400) : -1;
+		// as displayed, orientations 5 to 8 turn the picture a quarter
+		auto w = f.width, h = f.height;
+		if (f.orientation >= 5) std::swap(w, h);
+		shape_[i] = w > h ? shape::landscape : h > w ? shape::portrait : shape::any;
+		// "Canon" and "Canon EOS R5" is one name
+		const bool prefixed = !f.make.empty() && f.model.compare(0, f.make.size(), f.make) == 0;
+		camera_[i] = intern(prefixed || f.make.empty() ? f.model : f.model.empty() ? f.make : f.make + " " + f.model, cameras_, camera_ids_);
+		lens_[i] = intern(f.lens, lenses_, lens_ids_);
+	}
+
+	std::int64_t taken(size_t i) const noexcept { return taken_[i]; }
+	std::uint32_t iso(size_t i) const noexcept { return iso_[i]; }
+	std::uint8_t orientation(size_t i) const noexcept { return orientation_[i]; }
+	std::uint16_t camera(size_t i) const noexcept { return camera_[i]; }
+	std::uint16_t lens(size_t i) const noexcept { return lens_[i]; }
+	const std::string& camera_name(std::uint16_t id) const { return cameras_[id]; }
+	const std::string& lens_name(std::uint16_t id) const { return lenses_[id]; }
+
+	// -1 when the time is unknown
+	std::int64_t day(size_t i) const noexcept { return day_[i]; }
+	// any when the dimensions are unknown or square
+	exif::shape shape(size_t i) const noexcept { return shape_[i]; }
+
+	// The entries `f` keeps, ascending. Only the columns a criterion is set
+	// for are read: the first one set is scanned whole, the others are
+	// looked up for the entries still kept, the likeliest to narrow most
+	// first. Tests don't branch, a row is written either way and only the
+	// count moves.
+	std::vector<std::int64_t> select(const filter& f) const {
+		IMV_TRACE_SCOPE("select", "exif");
+		std::vector<std::int64_t> out;
+		bool scanned = false;
+		auto narrow = [&](const auto& column, auto&& keep) {
+			if (!scanned) {
+				size_t n = 0;
+				for (size_t i = 0; i < size(); ++i) n += keep(column[i]);
+				// a spare slot for the last row, written even when it isn't kept
+				out.resize(n + 1);
+				for (size_t i = 0, k = 0; i < size(); ++i) {
+					out[k] = static_cast<std::int64_t>(i);
+					k += keep(column[i]);
+				}
+				out.pop_back();
+				scanned = true;
+				return;
+			}
+			size_t k = 0;
+			for (const auto i : out) {
+				out[k] = i;
+				k += keep(column[static_cast<size_t>(i)]);
+			}
+			out.resize(k);
+		};
+		if (f.day >= 0) narrow(day_, [day = static_cast<std::int32_t>(f.day)](std::int32_t v) { return v == day; });
+		if (f.camera) narrow(camera_, [&](std::uint16_t v) { return v == f.camera; });
+		if (f.lens) narrow(lens_, [&](std::uint16_t v) { return v == f.lens; });
+		if (f.iso_min != 0 || f.iso_max != UINT32_MAX) {
+			narrow(iso_, [&](std::uint32_t v) { return (v >= f.iso_min) & (v <= f.iso_max); });
+		}
+		if (f.shape != shape::any) narrow(shape_, [&](exif::shape v) { return v == f.shape; });
+		if (!scanned) {
+			out.resize(size());
+			std::iota(out.begin(), out.end(), std::int64_t(0));
+		}
+		return out;
+	}
+
+	size_t bytes() const noexcept {
+		return size() * (sizeof(std::int64_t) + 3 * sizeof(std::uint32_t) + sizeof(std::uint8_t) + 2 * sizeof(std::uint16_t)
+			+ sizeof(std::int32_t) + sizeof(exif::shape));
+	}
+};
+
+// Fields by path, valid while the file's size and mtime are the same.
+class store {
+public:
+	struct entry {
+		std::uint64_t size = 0;
+		std::int64_t mtime = 0;
+		exif::fields fields;
+	};
+private:
+	static constexpr std::uint32_t magic = 0x45564D49; // "IMVE"
+	static constexpr std::uint32_t version = 1;
+	std::unordered_map<std::string, entry> entries_;
+
+	template<typename T>
+	static bool get(FILE* f, T& v) { return std::fread(&v, sizeof(T), 1, f) == 1; }
+	template<typename T>
+	static void put(FILE* f, const T& v) { std::fwrite(&v, sizeof(T), 1, f); }
+
+	static bool get(FILE* f, std::string& s) {
+		std::uint32_t len = 0;
+		if (!get(f, len) || len > 32768) return false;
+		s.resize(len);
+		return std::fread(s.data(), 1, len, f) == len;
+	}
+	static void put(FILE* f, const std::string& s) {
+		put(f, static_cast<std::uint32_t>(s.size()));
+		std::fwrite(s.data(), 1, s.size(), f);
+	}
+public:
+	size_t size() const noexcept { return entries_.size(); }
+
+	const entry* find(const std::string& path, std::uint64_t size, std::int64_t mtime) const {
+		auto it = entries_.find(path);
+		if (it == entries_.end() || it->second.size != size || it->second.mtime != mtime) return nullptr;
+		return &it->second;
+	}
+
+	void put(std::string path, entry e) { entries_[std::move(path)] = std::move(e); }
+
+	// A missing or foreign file just leaves the store empty.
+	void load(const std::filesystem::path& file) {
+#ifdef _WIN32
+		FILE* f = _wfopen(file.c_str(), L"rb");
+#else
+		FILE* f = std::fopen(file.c_str(), "rb");
+#endif
+		if (!f) return;
+		std::uint32_t m = 0, v = 0;
+		std::uint64_t count = 0;
+		if (get(f, m) && get(f, v) && get(f, count) && m == magic && v == version) {
+			std::string path;
+			for (std::uint64_t i = 0; i < count; ++i) {
+				entry e;
+				auto& x = e.fields;
+				if (!get(f, path) || !get(f, e.size) || !get(f, e.mtime) || !get(f, x.taken) || !get(f, x.iso) || !get(f, x.width)
+					|| !get(f, x.height) || !get(f, x.orientation) || !get(f, x.make) || !get(f, x.model) || !get(f, x.lens)) break;
+				entries_[path] = std::move(e);
+			}
+		}
+		std::fclose(f);
+	}
+
+	bool save(const std::filesystem::path& file) const {
+		auto tmp = file;
+		tmp += ".tmp";
+#ifdef _WIN32
+		FILE* f = _wfopen(tmp.c_str(), L"wb");
+#else
+		FILE* f = std::fopen(tmp.c_str(), "wb");
+#endif
+		if (!f) return false;
+		put(f, magic);
+		put(f, version);
+		put(f, static_cast<std::uint64_t>(entries_.size()));
+		for (auto& [path, e] : entries_) {
+			const auto& x = e.fields;
+			put(f, path);
+			put(f, e.size);
+			put(f, e.mtime);
+			put(f, x.taken);
+			put(f, x.iso);
+			put(f, x.width);
+			put(f, x.height);
+			put(f, x.orientation);
+			put(f, x.make);
+			put(f, x.model);
+			put(f, x.lens);
+		}
+		const bool ok = std::ferror(f) == 0;
+		if (std::fclose(f) != 0 || !ok) return false;
+		// replaced in one step so a crash never leaves half a file
+		std::error_code ec;
+		std::filesystem::rename(tmp, file, ec);
+		return !ec;
+	}
+};
+
+// Background job: the index of a catalog, from the store where it can and
+// from the files' headers, several at a time, where it can't.
+class indexer {
+	std::filesystem::path cache_;
+	std::shared_ptr<const catalog> catalog_;
+	std::thread thread_;
+	std::atomic<bool> stop_{false};
+	std::atomic<size_t> indexed_{0};
+	std::atomic<size_t> to_index_{0};
+	std::mutex mutex_;
+	std::shared_ptr<const index> index_;
+
+	struct Metrics {
+		metrics::counter& read = metrics::get_counter("exif.read");
+		metrics::gauge& files_per_sec = metrics::get_gauge("exif.files_per_sec");
+		metrics::gauge& index_ms = metrics::get_gauge("exif.index_ms");
+	} metrics_;
+
+	void run() {
+		trace::tracer::get_instance().name_thread("exif");
+		const auto start = std::chrono::steady_clock::now();
+		store cached;
+		cached.load(cache_);
+
+		auto columns = std::make_shared<index>(catalog_->size());
+		struct job { size_t catalog_idx; std::uint64_t size; std::int64_t mtime; fields f; bool ok = false; };
+		std::vector<job> jobs;
+		// sizes and times as the folder was listed
+		for (size_t i = 0; i < catalog_->size(); ++i) {
+			const auto size = catalog_->file_bytes(i);
+			const auto mtime = catalog_->mtime(i);
+			if (size == 0) continue;
+			if (auto* e = cached.find(catalog_->path(i).string(), size, mtime)) columns->set(i, e->fields);
+			else jobs.push_back({i, size, mtime, {}});
+		}
+		to_index_ = jobs.size();
+
+		// the reads wait on the disk more than on the CPU, below normal
+		// priority so navigation decodes come first
+		const auto read_start = std::chrono::steady_clock::now();
+		std::atomic<size_t> next{0};
+		auto worker = [&]() {
+#ifdef _WIN32
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+			for (size_t i; !stop_ && (i = next.fetch_add(1)) < jobs.size();) {
+				IMV_TRACE_SCOPE_ARG("read", "exif", jobs[i].catalog_idx);
+				jobs[i].ok = read(catalog_->path(jobs[i].catalog_idx), jobs[i].f);
+				++indexed_;
+				metrics_.read.add();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < std::max(2u, std::thread::hardware_concurrency()); ++i) workers.emplace_back(worker);
+		for (auto& t : workers) t.join();
+		if (stop_) return;
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - read_start).count();
+		if (!jobs.empty() && seconds > 0) metrics_.files_per_sec.set(static_cast<double>(jobs.size()) / seconds);
+
+		for (auto& j : jobs) {
+			if (!j.ok) continue;
+			columns->set(j.catalog_idx, j.f);
+			cached.put(catalog_->path(j.catalog_idx).string(), {j.size, j.mtime, std::move(j.f)});
+		}
+		if (!jobs.empty()) cached.save(cache_);
+
+		metrics_.index_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		std::lock_guard<std::mutex> lk(mutex_);
+		index_ = std::move(columns);
+	}
+public:
+	// Fields are kept in `cache` between sessions.
+	explicit indexer(std::filesystem::path cache) : cache_{std::move(cache)} {}
+	indexer(const indexer&) = delete;
+	indexer& operator=(const indexer&) = delete;
+	~indexer() { stop(); }
+
+	// An index under way for another catalog is abandoned.
+	void start(std::shared_ptr<const catalog> pictures) {
+		stop();
+		stop_ = false;
+		indexed_ = 0;
+		to_index_ = 0;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			index_.reset();
+		}
+		catalog_ = std::move(pictures);
+		thread_ = std::thread(&indexer::run, this);
+	}
+
+	void stop() {
+		stop_ = true;
+		if (thread_.joinable()) thread_.join();
+	}
+
+	// null until every entry is indexed
+	std::shared_ptr<const index> get() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return index_;
+	}
+
+	size_t indexed() const noexcept { return indexed_; }
+	size_t to_index() const noexcept { return to_index_; }
+};
+
+} // namespace exif
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "image_buffer.hpp"
+
+// Portable GIF decoder for the first frame, drawn at its offset on a
+// transparent canvas the size of the logical screen. Local and global
+// colour tables, transparency and interlacing.
+namespace gif {
+
+inline std::uint16_t read_u16(const std::uint8_t* p) noexcept {
+	return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline bool is_gif(const std::uint8_t* data, size_t size) noexcept {
+	return size >= 6 && (std::memcmp(data, "GIF87a", 6) == 0 || std::memcmp(data, "GIF89a", 6) == 0);
+}
+
+inline bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+	if (size < 13 || !is_gif(data, size)) return false;
+	width = read_u16(data + 6);
+	height = read_u16(data + 8);
+	return width && height;
+}
+
+namespace detail {
+
+// Variable-width LZW codes, LSB first, over the concatenated sub-blocks.
+// `out` gets up to out_size indices; false on a corrupt stream.
+inline bool lzw(const std::uint8_t* data, size_t size, int min_code_size, std::uint8_t* out, size_t out_size) {
+	if (min_code_size < 2 || min_code_size > 11) return false;
+	constexpr int max_codes = 4096;
+	std::uint16_t prefix[max_codes];
+	std::uint8_t suffix[max_codes];
+	std::uint8_t first[max_codes]; // first index of each string
+	std::uint8_t stack[max_codes + 1];
+
+	const int clear = 1 << min_code_size, end = clear + 1;
+	for (int i = 0; i < clear; ++i) {
+		suffix[i] = first[i] = static_cast<std::uint8_t>(i);
+		prefix[i] = 0;
+	}
+	int code_size = min_code_size + 1, next = end + 1, prev = -1;
+	std::uint32_t bits = 0;
+	int count = 0;
+	size_t written = 0;
+
+	for (size_t pos = 0; written < out_size;) {
+		while (count < code_size) {
+			if (pos >= size) return written > 0; // truncated: keep what arrived
+			bits |= std::uint32_t(data[pos++]) << count;
+			count += 8;
+		}
+		const int code = static_cast<int>(bits & ((1u << code_size) - 1));
+		bits >>= code_size;
+		count -= code_size;
+
+		if (code == clear) {
+			code_size = min_code_size + 1;
+			next = end + 1;
+			prev = -1;
+			continue;
+		}
+		if (code == end) break;
+		if (code > next || (code == next && prev < 0)) return false;
+
+		// a code not in the table yet is the previous string plus its own first index
+		int c = code == next ? prev : code;
+		size_t depth = 0;
+		if (code == next) stack[depth++] = first[prev];
+		while (c >= clear) {
+			stack[depth++] = suffix[c];
+			c = prefix[c];
+		}
+		stack[depth++] = static_cast<std::uint8_t>(c);
+		while (depth && written < out_size) out[written++] = stack[--depth];
+
+		if (prev >= 0 && next < max_codes) {
+			prefix[next] = static_cast<std::uint16_t>(prev);
+			suffix[next] = static_cast<std::uint8_t>(c);
+			first[next] = first[prev];
+			if (++next == (1 << code_size) && code_size < 12) ++code_size;
+		}
+		prev = code;
+	}
+	return true;
+}
+
+} // namespace detail
+
+inline bool decode(const std::uint8_t* data, size_t size, image_buffer& out) {
+	std::uint32_t width, height;
+	if (!dimensions(data, size, width, height)) return false;
+
+	std::uint32_t global[256] = {};
+	const std::uint8_t flags = data[10];
+	size_t pos = 13;
+	if (flags & 0x80) {
+		const size_t n = size_t(2) << (flags & 7);
+		if (pos + n * 3 > size) return false;
+		for (size_t i = 0; i < n; ++i) {
+			global[i] = 0xFF000000u | (std::uint32_t(data[pos + i * 3]) << 16) | (std::uint32_t(data[pos + i * 3 + 1]) << 8) | data[pos + i * 3 + 2];
+		}
+		pos += n * 3;
+	}
+
+	int transparent = -1;
+	while (pos < size) {
+		const std::uint8_t block = data[pos++];
+		if (block == 0x21) {
+			// extension: label, then sub-blocks
+			if (pos >= size) return false;
+			const std::uint8_t label = data[pos++];
+			if (label == 0xF9 && pos + 5 <= size && data[pos] >= 4) {
+				transparent = (data[pos + 1] & 1) ? data[pos + 4] : -1;
+			}
+			while (pos < size && data[pos]) pos += size_t(data[pos]) + 1;
+			++pos;
+			continue;
+		}
+		if (block != 0x2C) return false; // trailer before any image
+
+		if (pos + 9 > size) return false;
+		const std::uint32_t left = read_u16(data + pos), top = read_u16(data + pos + 2);
+		const std::uint32_t fw = read_u16(data + pos + 4), fh = read_u16(data + pos + 6);
+		const std::uint8_t fflags = data[pos + 8];
+		pos += 9;
+
+		std::uint32_t local[256];
+		const std::uint32_t* colors = global;
+		if (fflags & 0x80) {
+			const size_t n = size_t(2) << (fflags & 7);
+			if (pos + n * 3 > size) return false;
+			std::fill(std::begin(local), std::end(local), 0xFF000000u);
+			for (size_t i = 0; i < n; ++i) {
+				local[i] = 0xFF000000u | (std::uint32_t(data[pos + i * 3]) << 16) | (std::uint32_t(data[pos + i * 3 + 1]) << 8) | data[pos + i * 3 + 2];
+			}
+			colors = local;
+			pos += n * 3;
+		}
+		if (pos >= size || fw == 0 || fh == 0) return false;
+		const int min_code_size = data[pos++];
+
+		std::vector<std::uint8_t> stream;
+		while (pos < size && data[pos]) {
+			const size_t n = data[pos];
+			if (pos + 1 + n > size) break;
+			stream.insert(stream.end(), data + pos + 1, data + pos + 1 + n);
+			pos += n + 1;
+		}
+
+		std::vector<std::uint8_t> indices(size_t(fw) * fh, transparent >= 0 ? static_cast<std::uint8_t>(transparent) : 0);
+		if (!detail::lzw(stream.data(), stream.size(), min_code_size, indices.data(), indices.size())) return false;
+
+		out.allocate(width, height);
+		std::fill(out.data(), out.data() + size_t(width) * height, 0u);
+		// interlaced rows come in four passes
+		std::vector<std::uint32_t> rows(fh);
+		if (fflags & 0x40) {
+			std::uint32_t r = 0;
+			for (auto [start, step] : {std::pair{0u, 8u}, std::pair{4u, 8u}, std::pair{2u, 4u}, std::pair{1u, 2u}}) {
+				for (std::uint32_t y = start; y < fh; y += step) rows[r++] = y;
+			}
+		} else {
+			for (std::uint32_t y = 0; y < fh; ++y) rows[y] = y;
+		}
+		for (std::uint32_t r = 0; r < fh; ++r) {
+			const std::uint32_t y = top + rows[r];
+			if (y >= height) continue;
+			const auto* src = indices.data() + size_t(r) * fw;
+			auto* dst = out.data() + size_t(y) * width;
+			for (std::uint32_t x = 0; x < fw && left + x < width; ++x) {
+				if (src[x] != transparent) dst[left + x] = colors[src[x]];
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+} // namespace gif
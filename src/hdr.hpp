@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define IMV_HDR_SSE2
+#endif
+
+#include "pixel_arena.hpp"
+
+// High-precision path for sources with more than 8 bits per channel (16-bit
+// TIFF and PNG, JPEG XR, HDR formats). Those decode to linear half floats;
+// an exposure and tone curve map them to the 8-bit levels the renderer
+// draws. Only one reduced level stays in half floats, so the mapping can be
+// changed without decoding again.
+namespace hdr {
+
+// Linear scRGB, premultiplied RGBA half floats: WIC's 64bppPRGBAHalf.
+struct half_buffer {
+	pixel_arena::buffer pixels;
+	std::uint32_t width = 0;
+	std::uint32_t height = 0;
+
+	std::uint32_t stride() const noexcept { return width * 8; }
+	std::uint16_t* data() const noexcept { return reinterpret_cast<std::uint16_t*>(pixels.data()); }
+	explicit operator bool() const noexcept { return static_cast<bool>(pixels); }
+
+	void allocate(std::uint32_t w, std::uint32_t h) {
+		pixels = pixel_arena::get_instance().acquire(static_cast<size_t>(w) * h * 8);
+		width = w;
+		height = h;
+	}
+
+	void reset() noexcept {
+		pixels.reset();
+		width = height = 0;
+	}
+};
+
+// Rebiasing the exponent by a multiply also gets subnormals right;
+// infinities and NaNs come out large and are clipped later anyway.
+inline float half_to_float(std::uint16_t h) noexcept {
+	const std::uint32_t bits = std::uint32_t(h & 0x7FFF) << 13;
+	float f;
+	std::memcpy(&f, &bits, 4);
+	f *= 5.192296858534828e+33f; // 2^112
+	return (h & 0x8000) ? -f : f;
+}
+
+// Round to nearest even.
+inline std::uint16_t float_to_half(float f) noexcept {
+	std::uint32_t x;
+	std::memcpy(&x, &f, 4);
+	const auto sign = static_cast<std::uint16_t>((x >> 16) & 0x8000);
+	x &= 0x7FFFFFFF;
+	if (x >= 0x47800000) return sign | (x > 0x7F800000 ? 0x7E00 : 0x7C00);
+	if (x < 0x38800000) {
+		float a;
+		std::memcpy(&a, &x, 4);
+		return sign | static_cast<std::uint16_t>(std::lrint(a * 16777216.0f)); // 2^24, subnormal
+	}
+	x += 0xC8000FFF + ((x >> 13) & 1); // exponent bias 127 -> 15, plus rounding
+	return sign | static_cast<std::uint16_t>(x >> 13);
+}
+
+#ifdef IMV_HDR_SSE2
+// One pixel, RGBA in the four lanes.
+inline __m128 load_half4(const std::uint16_t* p) noexcept {
+	const __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+	const __m128i magnitude = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7FFF)), 13);
+	const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+	return _mm_or_ps(_mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_set1_ps(5.192296858534828e+33f)), _mm_castsi128_ps(sign));
+}
+#endif
+
+// How the linear values become display values: exposure in stops, then
+// either a hard clip at 1 or an extended Reinhard curve, which rolls off
+// highlights up to `white` instead.
+struct tone {
+	float exposure_ev = 0.0f;
+	bool reinhard = false;
+
+	static constexpr float white = 4.0f;
+
+	bool operator==(const tone&) const = default;
+};
+
+// Half float pixels to 8-bit premultiplied BGRA, sRGB encoded.
+class mapper {
+	static constexpr std::int32_t encode_size = 4096; // indexed by sqrt(linear)
+	float scale_;
+	float inv_white2_;
+	bool reinhard_;
+	std::array<std::uint8_t, encode_size> encode_;
+
+	static std::uint32_t pack(std::uint32_t r, std::uint32_t g, std::uint32_t b, std::uint32_t a) noexcept {
+		if (a != 255) {
+			auto premul = [a](std::uint32_t v) { return (v * a + 127) / 255; };
+			r = premul(r), g = premul(g), b = premul(b);
+		}
+		return b | (g << 8) | (r << 16) | (a << 24);
+	}
+public:
+	explicit mapper(const tone& t)
+		: scale_{std::exp2(t.exposure_ev)}
+		, inv_white2_{1.0f / (tone::white * tone::white)}
+		, reinhard_{t.reinhard}
+	{
+		for (std::int32_t i = 0; i < encode_size; ++i) {
+			const double s = static_cast<double>(i) / (encode_size - 1), v = s * s;
+			const double e = v <= 0.0031308 ? 12.92 * v : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+			encode_[i] = static_cast<std::uint8_t>(std::lround(e * 255.0));
+		}
+	}
+
+	// Straight colour so translucent pixels keep their hue under the curve.
+	void run(const std::uint16_t* src, std::uint32_t* dst, size_t n) const noexcept {
+		for (size_t i = 0; i < n; ++i, src += 4) {
+#ifdef IMV_HDR_SSE2
+			const __m128 px = load_half4(src);
+			const float a = std::clamp(_mm_cvtss_f32(_mm_shuffle_ps(px, px, _MM_SHUFFLE(3, 3, 3, 3))), 0.0f, 1.0f);
+			if (a <= 0.0f) {
+				dst[i] = 0;
+				continue;
+			}
+			__m128 v = _mm_max_ps(_mm_mul_ps(px, _mm_set1_ps(a < 1.0f ? scale_ / a : scale_)), _mm_setzero_ps());
+			if (reinhard_) {
+				const __m128 one = _mm_set1_ps(1.0f);
+				v = _mm_div_ps(_mm_mul_ps(v, _mm_add_ps(one, _mm_mul_ps(v, _mm_set1_ps(inv_white2_)))), _mm_add_ps(one, v));
+			}
+			v = _mm_min_ps(v, _mm_set1_ps(1.0f));
+			const __m128i idx = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(v), _mm_set1_ps(static_cast<float>(encode_size - 1))));
+			dst[i] = pack(encode_[_mm_cvtsi128_si32(idx)],
+				encode_[_mm_cvtsi128_si32(_mm_srli_si128(idx, 4))],
+				encode_[_mm_cvtsi128_si32(_mm_srli_si128(idx, 8))],
+				a < 1.0f ? static_cast<std::uint32_t>(std::lrint(a * 255.0f)) : 255u);
+#else
+			const float a = std::clamp(half_to_float(src[3]), 0.0f, 1.0f);
+			if (a <= 0.0f) {
+				dst[i] = 0;
+				continue;
+			}
+			std::uint32_t c[3];
+			for (int k = 0; k < 3; ++k) {
+				float v = std::max(half_to_float(src[k]) * (scale_ / a), 0.0f);
+				if (reinhard_) v = v * (1.0f + v * inv_white2_) / (1.0f + v);
+				c[k] = encode_[static_cast<size_t>(std::lrint(std::sqrt(std::min(v, 1.0f)) * (encode_size - 1)))];
+			}
+			dst[i] = pack(c[0], c[1], c[2], static_cast<std::uint32_t>(std::lrint(a * 255.0f)));
+#endif
+		}
+	}
+};
+
+// Box-filters rows fed top to bottom down by 2^k in each direction, the
+// size of pyramid level k (trailing rows and columns that don't fill a
+// box are dropped). Sums are in linear light.
+class reducer {
+	std::uint32_t width_;
+	std::uint32_t k_;
+	std::uint32_t row_ = 0;
+	half_buffer out_;
+	std::vector<float> sums_; // RGBA per output pixel of the current row
+public:
+	reducer(std::uint32_t width, std::uint32_t height, std::uint32_t k)
+		: width_{width}
+		, k_{k}
+		, sums_(size_t(std::max(1u, width >> k)) * 4, 0.0f)
+	{
+		out_.allocate(std::max(1u, width >> k), std::max(1u, height >> k));
+	}
+
+	// `n` rows of `width` pixels
+	void add(const std::uint16_t* rows, std::uint32_t n) noexcept {
+		const std::uint32_t box = 1u << k_;
+		const std::uint32_t used = std::min(width_, out_.width << k_);
+		const float norm = 1.0f / static_cast<float>(box * box);
+		for (std::uint32_t r = 0; r < n; ++r, ++row_) {
+			const auto* src = rows + size_t(r) * width_ * 4;
+			if ((row_ >> k_) >= out_.height) continue;
+			if (k_ == 0) {
+				std::memcpy(out_.data() + size_t(row_) * out_.width * 4, src, size_t(out_.width) * 8);
+				continue;
+			}
+			for (std::uint32_t x = 0; x < used; ++x) {
+				float* s = sums_.data() + size_t(x >> k_) * 4;
+#ifdef IMV_HDR_SSE2
+				_mm_storeu_ps(s, _mm_add_ps(_mm_loadu_ps(s), load_half4(src + size_t(x) * 4)));
+#else
+				for (int c = 0; c < 4; ++c) s[c] += half_to_float(src[size_t(x) * 4 + c]);
+#endif
+			}
+			if ((row_ & (box - 1)) == box - 1) {
+				auto* dst = out_.data() + size_t(row_ >> k_) * out_.width * 4;
+				for (size_t i = 0; i < sums_.size(); ++i) dst[i] = float_to_half(sums_[i] * norm);
+				std::fill(sums_.begin(), sums_.end(), 0.0f);
+			}
+		}
+	}
+
+	half_buffer take() noexcept { return std::move(out_); }
+};
+
+} // namespace hdr
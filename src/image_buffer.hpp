@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+#include "pixel_arena.hpp"
+
+// Decoded frame, 32bpp premultiplied BGRA, rows are tightly packed.
+struct image_buffer {
+	pixel_arena::buffer pixels;
+	std::uint32_t width = 0;
+	std::uint32_t height = 0;
+
+	std::uint32_t stride() const noexcept { return width * 4; }
+	std::uint32_t* data() const noexcept { return reinterpret_cast<std::uint32_t*>(pixels.data()); }
+	explicit operator bool() const noexcept { return static_cast<bool>(pixels); }
+
+	void allocate(std::uint32_t w, std::uint32_t h) {
+		pixels = pixel_arena::get_instance().acquire(static_cast<size_t>(w) * h * 4);
+		width = w;
+		height = h;
+	}
+
+	void reset() noexcept {
+		pixels.reset();
+		width = height = 0;
+	}
+};
+
+// Reads a whole file into an arena buffer, the buffer size is the file size.
+inline pixel_arena::buffer read_file(const std::filesystem::path& path) {
+#ifdef _WIN32
+	FILE* f = _wfopen(path.c_str(), L"rb");
+#else
+	FILE* f = std::fopen(path.c_str(), "rb");
+#endif
+	if (!f) return {};
+
+	std::error_code ec;
+	const auto size = std::filesystem::file_size(path, ec);
+	if (ec || size == 0) {
+		std::fclose(f);
+		return {};
+	}
+
+	auto buffer = pixel_arena::get_instance().acquire(static_cast<size_t>(size));
+	const bool ok = std::fread(buffer.data(), 1, buffer.size(), f) == buffer.size();
+	std::fclose(f);
+
+	if (!ok) buffer.reset();
+	return buffer;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "image_buffer.hpp"
+#include "pixel_ops.hpp"
+
+// Per-channel and luminance histograms of premultiplied BGRA pixels, with
+// min/max/mean read off the histograms. Computed from a reduced level
+// first, then again from the full-size pixels.
+struct image_stats {
+	struct channel {
+		std::array<std::uint32_t, 256> histogram{};
+		std::uint8_t min = 0;
+		std::uint8_t max = 0;
+		double mean = 0.0;
+
+		void summarize(std::uint64_t pixels) noexcept {
+			std::uint64_t sum = 0;
+			int lo = 256, hi = -1;
+			for (int i = 0; i < 256; ++i) {
+				if (!histogram[i]) continue;
+				lo = std::min(lo, i);
+				hi = i;
+				sum += std::uint64_t(histogram[i]) * i;
+			}
+			min = static_cast<std::uint8_t>(hi < 0 ? 0 : lo);
+			max = static_cast<std::uint8_t>(hi < 0 ? 0 : hi);
+			mean = pixels ? static_cast<double>(sum) / static_cast<double>(pixels) : 0.0;
+		}
+	};
+
+	channel blue, green, red, luma;
+	std::uint64_t pixels = 0;
+	// from the full-size pixels rather than a reduced level
+	bool exact = false;
+
+	// Fraction of pixels at 255 in the worst channel, and at black.
+	double clipped_highlights() const noexcept {
+		if (!pixels) return 0.0;
+		return static_cast<double>(std::max({blue.histogram[255], green.histogram[255], red.histogram[255]})) / static_cast<double>(pixels);
+	}
+
+	double clipped_shadows() const noexcept {
+		return pixels ? static_cast<double>(luma.histogram[0]) / static_cast<double>(pixels) : 0.0;
+	}
+
+	// Counts go to four interleaved copies of each histogram so that runs of
+	// equal values don't serialize on one counter; luma is SIMD per row.
+	static image_stats compute(const image_buffer& img, bool exact) {
+		image_stats s;
+		s.exact = exact;
+		if (!img) return s;
+
+		std::vector<std::array<std::uint32_t, 4>> b(256), g(256), r(256), l(256);
+		std::vector<std::uint8_t> row(img.width);
+		for (std::uint32_t y = 0; y < img.height; ++y) {
+			const auto* px = img.data() + size_t(y) * img.width;
+			luma_32bpp(px, row.data(), img.width);
+			std::uint32_t x = 0;
+			for (; x + 4 <= img.width; x += 4) {
+				for (std::uint32_t k = 0; k < 4; ++k) {
+					const std::uint32_t p = px[x + k];
+					++b[p & 0xFF][k];
+					++g[(p >> 8) & 0xFF][k];
+					++r[(p >> 16) & 0xFF][k];
+					++l[row[x + k]][k];
+				}
+			}
+			for (; x < img.width; ++x) {
+				const std::uint32_t p = px[x];
+				++b[p & 0xFF][0];
+				++g[(p >> 8) & 0xFF][0];
+				++r[(p >> 16) & 0xFF][0];
+				++l[row[x]][0];
+			}
+		}
+
+		for (int i = 0; i < 256; ++i) {
+			s.blue.histogram[i] = b[i][0] + b[i][1] + b[i][2] + b[i][3];
+			s.green.histogram[i] = g[i][0] + g[i][1] + g[i][2] + g[i][3];
+			s.red.histogram[i] = r[i][0] + r[i][1] + r[i][2] + r[i][3];
+			s.luma.histogram[i] = l[i][0] + l[i][1] + l[i][2] + l[i][3];
+		}
+		s.pixels = std::uint64_t(img.width) * img.height;
+		for (auto* c : {&s.blue, &s.green, &s.red, &s.luma}) c->summarize(s.pixels);
+		return s;
+	}
+};
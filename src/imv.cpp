@@ -1,15 +1,21 @@
 #include "stdafx.h"
 #include "resource.h"
 #include "imv.hpp"
+#include "batch.hpp"
+#include "single_instance.hpp"
 
 CAppModule _Module;
 
-int Run(LPTSTR lpstrCmdLine, int nCmdShow = SW_SHOWDEFAULT) {
+std::string UnquotedPath(LPTSTR lpstrCmdLine) {
+	auto str = std::string(lpstrCmdLine);
+	return str.substr(1, str.length() - 2);
+}
+
+int Run(LPTSTR lpstrCmdLine, int nCmdShow, single_instance::server* server) {
 	CMessageLoop theLoop;
 	_Module.AddMessageLoop(&theLoop);
 
-	auto str = std::string(lpstrCmdLine);
-	str = str.substr(1, str.length() - 2);
+	auto str = UnquotedPath(lpstrCmdLine);
 
 	int nRet = -1;
 	try {
@@ -24,7 +30,17 @@ int Run(LPTSTR lpstrCmdLine, int nCmdShow = SW_SHOWDEFAULT) {
 
 		wndMain.ShowWindow(nCmdShow);
 
+		if (server) {
+			const HWND hwnd = wndMain;
+			// the mailbox outlives the window, a path it never saw isn't leaked
+			server->serve([hwnd, mailbox = wndMain.mailbox()](std::string path) {
+				return mailbox->put(std::move(path), [hwnd]() { return ::PostMessage(hwnd, WM_OPEN_PATH, 0, 0) != FALSE; });
+			});
+		}
+
 		nRet = theLoop.Run();
+		// no handoff may be posted to a window that is gone
+		if (server) server->stop();
 	} catch (std::exception& ex) {
 		MessageBoxA(NULL, ex.what(), NULL, MB_ICONERROR);
 		return -1;
@@ -37,14 +53,44 @@ int Run(LPTSTR lpstrCmdLine, int nCmdShow = SW_SHOWDEFAULT) {
 	return nRet;
 }
 
+int RunBatch() {
+	// GUI subsystem, borrow the console we were started from for the report
+	if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+		FILE* f;
+		freopen_s(&f, "CONOUT$", "w", stdout);
+		freopen_s(&f, "CONOUT$", "w", stderr);
+	}
+	return batch::main(std::vector<std::string>(__argv + 2, __argv + __argc));
+}
+
 int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPTSTR lpstrCmdLine, int nCmdShow) {
+	startup_timeline::get_instance().begin();
 	if (*lpstrCmdLine == '\0') return -1;
+
+	// imv --batch <dir> --out <dir> ..., no window, no COM
+	if (__argc > 1 && std::string_view(__argv[1]) == "--batch") return RunBatch();
+
+	// IMV_SINGLE_INSTANCE: the viewer already running takes the path and
+	// this process exits before COM, D3D or a window exist
+	std::unique_ptr<single_instance::server> server;
+	if (GetEnvironmentVariableW(L"IMV_SINGLE_INSTANCE", nullptr, 0) != 0) {
+		const auto endpoint = single_instance::default_endpoint();
+		server = std::make_unique<single_instance::server>();
+		if (!server->claim(endpoint)) {
+			if (single_instance::forward(endpoint, UnquotedPath(lpstrCmdLine))) return 0;
+			// the owner didn't answer, run on our own
+			server.reset();
+		}
+	}
 	
 	if (CoInitializeEx(NULL, COINIT_MULTITHREADED | COINIT_DISABLE_OLE1DDE) != S_OK) {
 		MessageBoxA(NULL, "CoInitializeEx has failed", "", MB_ICONERROR);
 		return -1;
 	}
 
+	// the device is created while the first image decodes and the window is built
+	if (GetEnvironmentVariableW(L"IMV_SOFTWARE_RENDER", nullptr, 0) == 0) GR::get_instance().StartDevice();
+
 	INITCOMMONCONTROLSEX iccx;
 	iccx.dwSize = sizeof(iccx);
 	iccx.dwICC = ICC_COOL_CLASSES | ICC_BAR_CLASSES;
@@ -57,7 +103,7 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/, LPTSTR lp
 
 	ATLASSERT(SUCCEEDED(hRes));
 
-	int nRet = Run(lpstrCmdLine, nCmdShow);
+	int nRet = Run(lpstrCmdLine, nCmdShow, server.get());
 
 	tp::get_instance().stop();
 	_Module.Term();
@@ -7,291 +7,957 @@
 #include <limits>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
 #include <set>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <fstream>
+#include <chrono>
+#include <cwchar>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
 
 #include <boost/asio/strand.hpp>
 
 #include "thread_pool.hpp"
+#include "interval.hpp"
+#include "catalog.hpp"
+#include "image_buffer.hpp"
+#include "decoder_registry.hpp"
+#include "pixel_ops.hpp"
+#include "image_stats.hpp"
+#include "color.hpp"
+#include "hdr.hpp"
+#include "soft_renderer.hpp"
+#include "metrics.hpp"
+#include "decode_estimator.hpp"
+#include "duplicate_finder.hpp"
 #include "d2d1_window.h"
+#include "startup.hpp"
+#include "load_pipeline.hpp"
+#include "memory_governor.hpp"
+#include "zip_archive.hpp"
+#include "scrub_previews.hpp"
+#include "exif_index.hpp"
+#include "entry_set.hpp"
+#include "name_filter.hpp"
+#include "single_instance.hpp"
+
+// a path is waiting in the window's mailbox(), there's one message per path
+#define WM_OPEN_PATH (WM_USER + 1)
+// lParam is a heap std::vector<fs::path>, the opened picture's folder
+#define WM_CATALOG (WM_USER + 2)
+// wParam is the new memory::pressure
+#define WM_MEMORY_PRESSURE (WM_USER + 4)
+// lParam is a heap names::index, the catalog's names for type-to-filter
+#define WM_NAMES (WM_USER + 5)
 
-using namespace std::string_view_literals;
-
-constexpr std::array<std::string_view, 8> picture_formats =
-{ ".jpg"sv, ".bmp"sv, ".cr2"sv, ".gif"sv, ".png"sv, ".ico"sv, ".webp"sv, ".tif"sv };
+using tp = thread_pool_3;
 
 
-template <size_t... Size, typename List>
-constexpr bool test_format_impl(std::string_view str, List& lst, std::index_sequence<Size...>) {
-	return ( (str == lst[Size]) || ... );
-}
+class ImvWindow
+	: public D2DWindow<ImvWindow>
+{
+	// one wheel notch, smaller deltas from precision touchpads zoom proportionally less
+	static constexpr float zoom_step = 1.25f;
+	static constexpr float max_zoom = 10.0f;
+	// how quickly the drawn view catches up with the requested one
+	static constexpr float zoom_time_constant_ms = 60.0f;
+	CPoint drag_old_point_;
+	CirculalInterval<std::int64_t> current_img_idx_;
+	float zoom_ = 1.0f;
+	bool animate_ = false;
+	CCursorHandle cursor_arrow_;
+	CCursorHandle cursor_sizeall_;
+	CMenu menu_;
+	bool fit_to_window_ = false;
+	bool show_hud_ = false;
+	bool show_histogram_ = false;
+	// the picture number typed after `G`, -1 when none is being typed
+	std::int64_t goto_number_ = -1;
+
+	// The scrub bar along the bottom edge, shown while the cursor is over
+	// it. Dragging it previews the entry under the cursor from a small
+	// decode; the picture itself is only loaded once the button is released.
+	static constexpr float scrub_strip = 40.0f, scrub_margin = 16.0f;
+	static constexpr std::uint32_t scrub_preview_side = 128;
+	static constexpr size_t scrub_preview_budget = size_t(32) << 20;
+	bool scrub_hover_ = false;
+	bool scrubbing_ = false;
+	std::int64_t scrub_idx_ = -1;
+	// render thread: the preview last drawn, kept up while the next decodes
+	std::shared_ptr<const image_buffer> scrub_shown_;
+	wrl::ComPtr<ID2D1Bitmap1> scrub_bitmap_;
+	std::chrono::steady_clock::time_point image_requested_ = std::chrono::steady_clock::now();
+	// render thread only: the request whose first frame was already timed,
+	// the transform actually on screen while a zoom animates and how many
+	// pyramid levels coarser than ideal it is drawn from
+	std::chrono::steady_clock::time_point first_pixel_for_;
+	D2D1::Matrix3x2F shown_matrix_ = D2D1::Matrix3x2F::Identity();
+	std::int64_t shown_image_ = -1;
+	std::chrono::steady_clock::time_point last_draw_;
+	size_t lod_bias_ = 0;
+	size_t frames_on_time_ = 0;
+
+	// Everything a frame needs from the UI thread. Input overwrites it and
+	// asks for a frame, the render thread draws whatever is latest.
+	struct ViewState {
+		D2D1::Matrix3x2F matrix = D2D1::Matrix3x2F::Identity();
+		std::int64_t image = 0;
+		bool hud = false;
+		std::chrono::steady_clock::time_point requested;
+		bool animate = false;
+		bool histogram = false;
+		bool fit = false;
+		// the scrub bar is shown, and the position under the cursor while it's dragged
+		bool bar = false;
+		std::int64_t scrub = -1;
+		// for the HUD
+		bool slideshow = false;
+		std::chrono::milliseconds slide_interval{0};
+	};
+	std::mutex view_mutex_;
+	ViewState view_;
+	wrl::ComPtr<ID2D1SolidColorBrush> hud_text_brush_;
+	wrl::ComPtr<ID2D1SolidColorBrush> hud_background_brush_;
+	wrl::ComPtr<ID2D1SolidColorBrush> histogram_brush_;
+
+	struct Metrics {
+		metrics::counter& cache_hits = metrics::get_counter("cache.hits");
+		metrics::counter& cache_misses = metrics::get_counter("cache.misses");
+		metrics::gauge& resident_bytes = metrics::get_gauge("cache.resident_bytes");
+		metrics::gauge& queue_depth = metrics::get_gauge("pool.queue_depth");
+		metrics::gauge& decodes_in_flight = metrics::get_gauge("decode.in_flight");
+		metrics::counter& decoded_pixels = metrics::get_counter("decode.pixels");
+		metrics::counter& decode_ns = metrics::get_counter("decode.ns");
+		metrics::gauge& decode_mps = metrics::get_gauge("decode.last_mps");
+		metrics::gauge& frame_ms = metrics::get_gauge("frame.ms");
+		metrics::gauge& ttfp_ms = metrics::get_gauge("image.ttfp_ms");
+		metrics::histogram& frame_interval = metrics::get_histogram("frame.interval_ms");
+		metrics::histogram& input_latency = metrics::get_histogram("input.latency_ms");
+		metrics::counter& coalesced = metrics::get_counter("frame.coalesced");
+		metrics::counter& slides_shown = metrics::get_counter("slideshow.shown");
+		metrics::counter& slides_missed = metrics::get_counter("slideshow.missed");
+		metrics::histogram& slide_late = metrics::get_histogram("slideshow.late_ms");
+		metrics::counter& color_managed = metrics::get_counter("color.managed");
+		metrics::counter& hdr_images = metrics::get_counter("hdr.images");
+		metrics::gauge& retone_ms = metrics::get_gauge("hdr.retone_ms");
+		metrics::counter& native_decodes = metrics::get_counter("decode.native");
+		metrics::counter& wic_decodes = metrics::get_counter("decode.wic");
+		metrics::counter& handoffs = metrics::get_counter("instance.handoffs");
+		metrics::gauge& switch_ms = metrics::get_gauge("instance.switch_ms");
+		metrics::counter& loads_cancelled = metrics::get_counter("load.cancelled");
+		metrics::counter& shed_level_bytes = metrics::get_counter("memory.shed_level_bytes");
+		metrics::counter& shed_images = metrics::get_counter("memory.shed_images");
+		metrics::gauge& memory_pressure = metrics::get_gauge("memory.pressure");
+	} metrics_;
+
+	// Slides advance on a timer. Each upcoming slide has a deadline, its load
+	// is started once the estimated load time of everything still queued
+	// ahead of it would otherwise overrun that deadline. A slide that isn't
+	// ready in time keeps the current one up instead of showing grey.
+	static constexpr UINT_PTR slideshow_timer = 1;
+	static constexpr UINT slideshow_tick_ms = 10;
+	static constexpr std::int64_t slideshow_max_ahead = 6;
+	struct Slideshow {
+		bool active = false;
+		std::chrono::milliseconds interval{3000};
+		std::chrono::steady_clock::time_point deadline;
+		bool late = false;
+	} slideshow_;
+	decode_estimator decode_estimator_;
+	// the primary monitor's, sRGB when it has none or one we can't read
+	color::profile display_profile_ = color::profile::srgb();
+	// for high bit depth images, written on the UI thread under mutex_
+	hdr::tone tone_;
+	// loaded ahead of the prev/current/next window by the slideshow, UI thread only
+	std::set<std::int64_t> prefetched_;
+	// perceptual hashes kept in %TEMP%\imv_phash.cache, groups listed in
+	// %TEMP%\imv_duplicates.txt
+	phash::finder duplicates_{fs::temp_directory_path() / "imv_phash.cache", fs::temp_directory_path() / "imv_duplicates.txt",
+		DecodeThumbnail};
+	scrub::previews<tp> previews_{tp::get_instance(), scrub_preview_budget, scrub_preview_side,
+		[this](std::int64_t idx) { OnPreviewReady(idx); }};
+	// EXIF fields of the folder for the filters, kept in %TEMP%\imv_exif.cache
+	exif::indexer metadata_{fs::temp_directory_path() / "imv_exif.cache"};
+	exif::filter filter_;
+	// Catalog entries the filter keeps, null for the whole catalog.
+	// current_img_idx_ is a position among them. Swapped under
+	// render_mutex_, the render thread maps positions too.
+	std::shared_ptr<const entry_set> selection_;
+	// what the EXIF filter keeps on its own, null for everything
+	std::shared_ptr<const entry_set> exif_kept_;
+	// `/` starts typing a name, the selection narrows with every character.
+	// The catalog's names are indexed on the pool, null until they are.
+	std::shared_ptr<const names::index> names_;
+	names::search name_search_;
+	std::string name_query_;
+	bool typing_ = false;
+	// Under pressure the caches shrink cheapest first: blocks the pixel arena
+	// keeps for reuse, then the half-size levels of the pictures not on
+	// screen, then at critical every picture but the current and the next
+	// one. Nothing is prefetched while it lasts. UI thread.
+	memory::governor memory_;
+	memory::pressure pressure_ = memory::pressure::none;
+
+	// Live state of a catalog entry, made when the entry is first requested
+	// and gone once it's freed and nothing queued still holds it.
+	class Image : public std::enable_shared_from_this<Image> {
+		ImvWindow& window_;
+		std::string image_path_;
+	public:
+		// The decoded pixels, the full size and its halvings, shared with the
+		// frames drawing from them. Never changed once published: a retone or
+		// a shed builds a new one that shares the levels it keeps and swaps it
+		// in under the window's mutex_. A level goes back to the arena once
+		// the last pyramid holding it is let go of.
+		struct pyramid {
+			// [0] is the full size, each next one half the one before
+			std::vector<std::shared_ptr<const image_buffer>> buffers;
+			// levels finer than this one don't match the current tone yet
+			size_t finest = 0;
+
+			size_t levels() const noexcept { return buffers.size(); }
+			const image_buffer& level(size_t l) const noexcept { return *buffers[l]; }
+			size_t bytes() const noexcept {
+				size_t n = 0;
+				for (auto& b : buffers) n += b->pixels.size();
+				return n;
+			}
 
-constexpr bool test_format(std::string_view str) {
-	return test_format_impl(str, picture_formats, std::make_index_sequence<picture_formats.size()>());
-}
+			static std::shared_ptr<const pyramid> make(image_buffer pixels, std::vector<image_buffer> lods) {
+				auto p = std::make_shared<pyramid>();
+				p->buffers.reserve(1 + lods.size());
+				p->buffers.push_back(std::make_shared<const image_buffer>(std::move(pixels)));
+				for (auto& lod : lods) p->buffers.push_back(std::make_shared<const image_buffer>(std::move(lod)));
+				return p;
+			}
+		};
+	private:
+		// null until decoded and after a free; only the strand replaces it
+		std::shared_ptr<const pyramid> pyramid_;
+		// one per level, [0] is null when the image exceeds the maximum texture
+		// size; swapped under the window's mutex_, from device `generation_`
+		std::vector<wrl::ComPtr<ID2D1Bitmap1>> bitmaps_;
+		std::uint64_t generation_ = 0;
+		// from a reduced level right after the decode, replaced by the exact
+		// one once the image is on screen
+		std::shared_ptr<const image_stats> stats_;
+		// high bit depth sources only: the level a fitted view draws from in
+		// half floats, the tone and colour transform its 8-bit levels were
+		// mapped with, and the finest level that is still up to date with it
+		hdr::half_buffer hdr_;
+		size_t hdr_level_ = 0;
+		hdr::tone tone_;
+		std::shared_ptr<const color::lut> lut_;
+		enum class ImageStatus { FAILED_TO_LOAD, LOADING, LOADED_DI, LOADED_DD } status_ = ImageStatus::LOADING;
+		boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+		// a load started under an older ticket stops at its next stage
+		load::ticket ticket_;
+		// tickets of the last load started and of the one that made it ready
+		// or failed, under the window's mutex_; a free still queued leaves an
+		// older load's status behind
+		std::uint64_t started_ = std::numeric_limits<std::uint64_t>::max();
+		std::uint64_t settled_ = std::numeric_limits<std::uint64_t>::max();
+		// a member of a ZIP archive rather than a file of its own
+		std::shared_ptr<const zip::archive> archive_;
+		size_t member_ = 0;
+		// position in the catalog, moves once when the folder arrives (OnCatalog)
+		std::atomic<std::int64_t> index_;
+
+		// Leaves `bitmap` null when the device is gone, a new one uploads again.
+		void upload(ID2D1DeviceContext1* context, const image_buffer& src, wrl::ComPtr<ID2D1Bitmap1>& bitmap) {
+			const auto props = D2D1::BitmapProperties1(D2D1_BITMAP_OPTIONS_NONE,
+				D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED));
+			const auto turns = static_cast<int>(rotation_idx());
+			HRESULT hr;
+
+			if (turns != 0) [[unlikely]] {
+				// the rotated copy only lives until it's uploaded
+				const auto [w, h] = (turns & 1) ? std::pair(src.height, src.width) : std::pair(src.width, src.height);
+				image_buffer rotated;
+				rotated.allocate(w, h);
+				{
+					IMV_TRACE_SCOPE_ARG("rotate", "load", index());
+					rotate_32bpp(src.data(), rotated.data(), src.width, src.height, turns);
+				}
+				IMV_TRACE_SCOPE_ARG("upload", "load", index());
+				hr = context->CreateBitmap(D2D1::SizeU(w, h), rotated.data(), rotated.stride(), props, bitmap.ReleaseAndGetAddressOf());
+			} else {
+				IMV_TRACE_SCOPE_ARG("upload", "load", index());
+				hr = context->CreateBitmap(D2D1::SizeU(src.width, src.height), src.data(), src.stride(), props, bitmap.ReleaseAndGetAddressOf());
+			}
+			if (FAILED(hr)) bitmap.Reset();
+		}
 
-using tp = thread_pool_3;
+		// Every level uploaded from the pixels in memory, swapped in whole.
+		void create_bitmap() {
+			const auto pixels = decoded();
+			if (!pixels) return;
+			// read before the context, a loss in between leaves them stale
+			const auto generation = window_.device_generation();
+			const auto context = window_.d2d1_context();
+			std::vector<wrl::ComPtr<ID2D1Bitmap1>> bitmaps(pixels->levels());
+			if (context) {
+				const auto max_size = context->GetMaximumBitmapSize();
+				for (size_t level = 0; level < pixels->levels(); ++level) {
+					const auto& src = pixels->level(level);
+					if (std::max(src.width, src.height) <= max_size) upload(context.Get(), src, bitmaps[level]);
+				}
+			}
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			bitmaps_ = std::move(bitmaps);
+			generation_ = generation;
+		}
 
-template<typename T>
-class Interval {
-	static_assert(std::is_signed_v<T>);
-protected:
-	T value_;
-	T first_;
-	T last_;
-	T increment_decrement_;
-public:
-	Interval operator++() noexcept {
-		if (value_ + increment_decrement_ <= last_) {
-			value_ = value_ + increment_decrement_;
+		// Half-size levels for drawing zoomed out, down to about a screen tile.
+		static std::vector<image_buffer> build_lods(const image_buffer& src) {
+			std::vector<image_buffer> lods;
+			for (const image_buffer* prev = &src; std::max(prev->width, prev->height) > 1024; prev = &lods.back()) {
+				image_buffer half;
+				half.allocate(std::max(1u, prev->width / 2), std::max(1u, prev->height / 2));
+				downsample_2x_32bpp(prev->data(), half.data(), prev->width, prev->height);
+				lods.push_back(std::move(half));
+			}
+			return lods;
 		}
-		return *this;
-	}
 
-	Interval operator--() noexcept {
-		if (value_ - increment_decrement_ >= first_) {
-			value_ = value_ - increment_decrement_;
+		// How many levels build_lods() will make for a width x height image.
+		static size_t level_count(std::uint32_t width, std::uint32_t height) noexcept {
+			size_t n = 1;
+			for (; std::max(width, height) > 1024; ++n) {
+				width = std::max(1u, width / 2);
+				height = std::max(1u, height / 2);
+			}
+			return n;
 		}
-		return *this;
-	}
 
-	T reset() { return value_ = first_; }
-	T operator()() const noexcept { return value_; }
-	bool operator==(const Interval& other) const noexcept { return value_ == other.value_; }
+		// More than 8 bits per channel.
+		static bool is_high_bit_depth(IWICBitmapFrameDecode* frame) {
+			WICPixelFormatGUID format;
+			wrl::ComPtr<IWICComponentInfo> info;
+			wrl::ComPtr<IWICPixelFormatInfo> pixel_format;
+			UINT bits = 0, channels = 0;
+			if (FAILED(frame->GetPixelFormat(&format))
+				|| FAILED(GR::get_instance().wicFactory->CreateComponentInfo(format, info.GetAddressOf()))
+				|| FAILED(info.As(&pixel_format))
+				|| FAILED(pixel_format->GetBitsPerPixel(&bits))
+				|| FAILED(pixel_format->GetChannelCount(&channels))
+				|| channels == 0) return false;
+			return bits / channels > 8;
+		}
 
-	void set_value(T value) noexcept {
-		assert(value >= first_ && value <= last_);
-		value_ = value;
-	}
+		// 64bppPRGBAHalf in bands, each is tone mapped into `pixels` and box
+		// filtered into the returned half float `level` while still in cache.
+		hdr::half_buffer decode_half(IWICBitmapSource* converter, image_buffer& pixels, const hdr::tone& tone,
+			const color::lut* lut, size_t level)
+		{
+			constexpr UINT band_rows = 32;
+			const UINT width = pixels.width, height = pixels.height;
+			const hdr::mapper mapper(tone);
+			hdr::reducer reducer(width, height, static_cast<std::uint32_t>(level));
+			std::vector<std::uint16_t> band(size_t(width) * band_rows * 4);
+			for (UINT y = 0; y < height; y += band_rows) {
+				const UINT rows = std::min(band_rows, height - y);
+				const WICRect rc{0, static_cast<INT>(y), static_cast<INT>(width), static_cast<INT>(rows)};
+				HR(converter->CopyPixels(&rc, width * 8, rows * width * 8, reinterpret_cast<BYTE*>(band.data())));
+				auto* dst = pixels.data() + size_t(y) * width;
+				mapper.run(band.data(), dst, size_t(rows) * width);
+				if (lut) lut->apply(dst, size_t(rows) * width);
+				reducer.add(band.data(), rows);
+			}
+			return reducer.take();
+		}
 
-	Interval()
-		: value_(std::numeric_limits<T>::min())
-		, first_(std::numeric_limits<T>::min())
-		, last_(std::numeric_limits<T>::max())
-		, increment_decrement_(std::numeric_limits<T>::epsilon())
-	{
-	}
+		// Smallest level that still has a few hundred thousand pixels to count.
+		static const image_buffer& stats_level(const image_buffer& pixels, const std::vector<image_buffer>& lods) {
+			for (auto it = lods.rbegin(); it != lods.rend(); ++it) {
+				if (size_t(it->width) * it->height >= (size_t(1) << 18)) return *it;
+			}
+			return pixels;
+		}
 
-	Interval(T first, T last, T increment_decrement)
-		: value_(first)
-		, first_(first)
-		, last_(last)
-		, increment_decrement_(increment_decrement)
-	{
-	}
-};
+		// strand
+		void refine_stats() {
+			std::shared_ptr<const pyramid> pixels;
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				// the full-size pixels are out of date after a retone
+				if (!pyramid_ || !stats_ || stats_->exact || pyramid_->finest != 0) return;
+				pixels = pyramid_;
+			}
+			std::shared_ptr<const image_stats> stats;
+			{
+				IMV_TRACE_SCOPE_ARG("stats_exact", "load", index());
+				stats = std::make_shared<const image_stats>(image_stats::compute(pixels->level(0), true));
+			}
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				stats_ = std::move(stats);
+			}
+			window_.OnImageUpdated(index());
+		}
 
-template<typename T>
-class CirculalInterval : public Interval<T> {
-public:
-	CirculalInterval operator++() noexcept {
-		if (this->value_ + this->increment_decrement_ > this->last_) this->value_ = this->first_;
-		else this->value_ = this->value_ + this->increment_decrement_;
-		return *this;
-	}
+		// strand
+		size_t resident_bytes() const noexcept {
+			return (pyramid_ ? pyramid_->bytes() : 0) + hdr_.pixels.size();
+		}
+	public:
+		CirculalInterval<std::int64_t> rotation_idx{0, 3, 1};
 
-	CirculalInterval operator--() noexcept {
-		if (this->value_ - this->increment_decrement_ < this->first_) this->value_ = this->last_;
-		else this->value_ = this->value_ - this->increment_decrement_;
-		return *this;
-	}
+		// Any thread, what a frame draws from; null until it's decoded. The
+		// copy keeps the pixels alive however long the frame takes.
+		std::shared_ptr<const pyramid> decoded() const {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			return pyramid_;
+		}
 
-	CirculalInterval operator-(size_t ix) noexcept {
-		auto tmp = *this;
-		while (ix--) --tmp;
-		return tmp;
-	}
+		// The requested level, or the next coarser one that could be uploaded;
+		// null after a device loss until the pixels are uploaded again.
+		wrl::ComPtr<ID2D1Bitmap1> bitmap(size_t level = 0) {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			if (generation_ != window_.device_generation()) return nullptr;
+			for (auto i = std::min(level, bitmaps_.size() - 1); i < bitmaps_.size(); ++i) {
+				if (bitmaps_[i]) return bitmaps_[i];
+			}
+			return nullptr;
+		}
 
-	CirculalInterval operator+(size_t ix) noexcept {
-		auto tmp = *this;
-		while (ix--) ++tmp;
-		return tmp;
-	}
+		// Where the picture goes in a `target` sized window before zoom and
+		// pan: centred, shrunk to fit when larger or when `fit`. Computed per
+		// frame, so a resize never reaches the load pipeline.
+		D2D1_RECT_F rect(const pyramid& pixels, D2D1_SIZE_F target, bool fit) const noexcept {
+			const bool turned = rotation_idx() & 1;
+			const auto& full = pixels.level(0);
+			const auto w = static_cast<float>(turned ? full.height : full.width);
+			const auto h = static_cast<float>(turned ? full.width : full.height);
+			const float scale = (fit || w > target.width || h > target.height) ? std::min(target.width / w, target.height / h) : 1.0f;
+			const float left = (target.width - w * scale) / 2.0f, top = (target.height - h * scale) / 2.0f;
+			return D2D1::RectF(left, top, left + w * scale, top + h * scale);
+		}
 
-	CirculalInterval()
-	{
-	}
+		std::shared_ptr<const image_stats> stats() const {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			return stats_;
+		}
+		std::string_view image_path() const noexcept { return image_path_; }
+		bool in_archive() const noexcept { return archive_ != nullptr; }
+		boost::asio::strand<boost::asio::io_context::executor_type>& strand() { return strand_; }
+		std::int64_t index() const noexcept { return index_; }
+		void set_index(std::int64_t index) noexcept { index_ = index; }
+
+		// Pixels of `level` to window coordinates before zoom and pan, what
+		// DrawBitmap into `rect` does on the GPU.
+		soft::affine placement(const pyramid& pixels, const D2D1_RECT_F& rect, size_t level = 0) const noexcept {
+			const auto turns = static_cast<int>(rotation_idx());
+			const auto w = static_cast<float>(pixels.level(0).width), h = static_cast<float>(pixels.level(0).height);
+			const auto [rw, rh] = (turns & 1) ? std::pair(h, w) : std::pair(w, h);
+			const auto& src = pixels.level(level);
+			return soft::affine::scale(w / src.width, h / src.height)
+				* soft::rotation(turns, w, h)
+				* soft::affine::scale((rect.right - rect.left) / rw, (rect.bottom - rect.top) / rh)
+				* soft::affine::translation(rect.left, rect.top);
+		}
 
-	CirculalInterval(T first, T last, T increment_decrement)
-		: Interval<T>(first, last, increment_decrement)
-	{
-	}
-};
+		// Window pixels per full-size image pixel before zoom.
+		float fit_scale(const pyramid& pixels, const D2D1_RECT_F& rect) const noexcept {
+			const auto turns = static_cast<int>(rotation_idx());
+			const auto& full = pixels.level(0);
+			return (rect.right - rect.left) / static_cast<float>((turns & 1) ? full.height : full.width);
+		}
 
+		// doesn't wait, true if the pixels are already in memory
+		bool is_decoded() const noexcept { return status_ >= ImageStatus::LOADED_DI; }
+		// Doesn't wait, true once the last load started made it drawable or
+		// failed; a frame draws something else until then.
+		bool is_ready() const {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			return settled_ == started_ && (status_ == ImageStatus::LOADED_DD || status_ == ImageStatus::FAILED_TO_LOAD);
+		}
+		// the same, without the failure
+		bool is_drawable() const {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			return settled_ == started_ && status_ == ImageStatus::LOADED_DD;
+		}
 
-class ImvWindow
-	: public D2DWindow<ImvWindow>
-{
-	static constexpr float scale_table[]{1.0f, 1.25f, 1.5f, 1.75f, 2.0f, 2.5f, 3.0f, 4.0f, 5.0f, 7.0f, 10.0f};
-	CPoint drag_old_point_;
-	CirculalInterval<std::int64_t> current_img_idx_;
-	Interval<std::int64_t> scale_idx_{0, sizeof(scale_table) / sizeof(float) - 1, 1};
-	CCursorHandle cursor_arrow_;
-	CCursorHandle cursor_sizeall_;
-	CMenu menu_;
-	bool fit_to_window_ = false;
-	bool image_changed_ = true;
+		// the extension, ".jpg"
+		std::string_view format() const noexcept {
+			const auto dot = image_path_.rfind('.');
+			if (dot == std::string::npos || image_path_.find_first_of("\\/", dot) != std::string::npos) return {};
+			return std::string_view(image_path_).substr(dot);
+		}
 
-	class Image {
-		ImvWindow& window_;
-		std::string image_path_;
-		D2D1_RECT_F rect_;
-		wrl::ComPtr<IWICFormatConverter> image_;
-		wrl::ComPtr<IWICBitmapFlipRotator> rotator_;
-		wrl::ComPtr<ID2D1Bitmap1> bitmap_;
-		enum class ImageStatus { FAILED_TO_LOAD, LOADING, LOADED_DI, LOADED_DD } status_ = ImageStatus::LOADING;
-		boost::asio::io_context::strand strand_;
+		// In-tree decoders by the file's magic bytes, false to leave it to WIC.
+		bool decode_native(const pixel_arena::buffer& file, image_buffer& pixels, std::shared_ptr<const color::lut>& lut) {
+			const auto* data = file.data();
+			const size_t size = file.size();
+			if (!decoders::native::sniff(data, size) || decoders::native::high_bit_depth(data, size)) return false;
 
-		IWICBitmapSource* get_image() {
-			if (rotator_ && rotation_idx() != 0) [[unlikely]] {
-				return rotator_.Get();
-			} else {
-				return image_.Get();
+			std::vector<std::uint8_t> icc;
+			{
+				IMV_TRACE_SCOPE_ARG("decode_native", "load", index());
+				if (!decoders::native::decode(data, size, pixels, &icc)) return false;
 			}
-		}
-	public:
-		CirculalInterval<std::int64_t> rotation_idx{0, 3, 1};
 
-		ID2D1Bitmap1* bitmap() { return bitmap_.Get(); }
-		const D2D1_RECT_F& rect() const noexcept { return rect_; }
-		std::string_view image_path() const noexcept { return image_path_; }
-		boost::asio::io_context::strand& strand() { return strand_; }
-
-		bool is_loaded() noexcept {
-			ImageStatus status = status_;
-			if (status != ImageStatus::LOADED_DD) {
-				std::unique_lock<std::mutex> lk(window_.mutex_);
-				window_.cv_.wait(lk, [this]() { return status_ >= ImageStatus::LOADED_DI; });
-				if (status_ == ImageStatus::LOADED_DI) {
-					window_.cv_.wait(lk, [this]() { return status_ >= ImageStatus::LOADED_DD; });
-				}
-				status = status_;
+			{
+				IMV_TRACE_SCOPE_ARG("color", "load", index());
+				color::profile profile;
+				if (icc.empty() || !color::parse_icc(icc.data(), icc.size(), profile)) profile = color::profile::srgb();
+				lut = color::lut_cache::get_instance().get(profile, window_.display_profile_);
+				if (lut) lut->apply(pixels.data(), size_t(pixels.width) * pixels.height);
 			}
-			return (status == ImageStatus::LOADED_DD);
+			return true;
 		}
 
-		void load_di() {
+		// WIC over the bytes already read, false if no codec takes them.
+		bool decode_wic(const pixel_arena::buffer& file, image_buffer& pixels, std::shared_ptr<const color::lut>& lut,
+			hdr::half_buffer& hdr, hdr::tone& tone, size_t& hdr_level)
+		{
+			auto& wic = GR::get_instance().wicFactory;
+			wrl::ComPtr<IWICStream> stream;
 			wrl::ComPtr<IWICBitmapDecoder> decoder;
+			{
+				IMV_TRACE_SCOPE_ARG("open", "load", index());
+				HR(wic->CreateStream(stream.GetAddressOf()));
+				HR(stream->InitializeFromMemory(file.data(), static_cast<DWORD>(file.size())));
+				if (FAILED(wic->CreateDecoderFromStream(stream.Get(), NULL, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf()))) return false;
+			}
 
-			HRESULT hr = GR::get_instance().wicFactory->CreateDecoderFromFilename(
-				wide(image_path_).c_str(),       // Image to be decoded
-				NULL,                            // Do not prefer a particular vendor
-				GENERIC_READ,                    // Desired read access to the file
-				WICDecodeMetadataCacheOnDemand,  // Cache metadata when needed
-				decoder.GetAddressOf()           // Pointer to the decoder
-			);
+			wrl::ComPtr<IWICBitmapFrameDecode> source;
+			wrl::ComPtr<IWICFormatConverter> converter;
+			bool high_bit_depth;
+
+			{
+				IMV_TRACE_SCOPE_ARG("header", "load", index());
+				// Retrieve the first frame of the image from the decoder
+				HR(decoder->GetFrame(0, source.GetAddressOf()));
+				HR(wic->CreateFormatConverter(converter.GetAddressOf()));
+
+				high_bit_depth = is_high_bit_depth(source.Get());
+				HR(converter->Initialize(
+					source.Get(),
+					high_bit_depth ? GUID_WICPixelFormat64bppPRGBAHalf : GUID_WICPixelFormat32bppPBGRA,
+					WICBitmapDitherTypeNone,
+					nullptr,
+					0.0f,
+					WICBitmapPaletteTypeMedianCut)
+				);
+			}
+
+			{
+				IMV_TRACE_SCOPE_ARG("color", "load", index());
+				lut = color::lut_cache::get_instance().get(source_profile(source.Get()), window_.display_profile_);
+			}
+
+			// Decode straight into a pooled buffer, the converter is lazy
+			// and doesn't hold the pixels itself
+			UINT width, height;
+			HR(converter->GetSize(&width, &height));
+			pixels.allocate(width, height);
+
+			if (high_bit_depth) {
+				{
+					std::lock_guard<std::mutex> lk(window_.mutex_);
+					tone = window_.tone_;
+				}
+				// full size while the window has no size yet
+				const auto target = window_.target_size();
+				const bool turned = rotation_idx() & 1;
+				const float fit = target.width > 0.0f && target.height > 0.0f
+					? std::min({1.0f, target.width / static_cast<float>(turned ? height : width), target.height / static_cast<float>(turned ? width : height)})
+					: 1.0f;
+				hdr_level = PickLevel(fit, 0, level_count(width, height));
+				window_.metrics_.hdr_images.add();
+			}
 
-			if (FAILED(hr)) { 
+			IMV_TRACE_SCOPE_ARG("decode_convert", "load", index());
+			if (high_bit_depth) {
+				hdr = decode_half(converter.Get(), pixels, tone, lut.get(), hdr_level);
+			} else if (!lut) {
+				HR(converter->CopyPixels(nullptr, pixels.stride(), static_cast<UINT>(pixels.pixels.size()), pixels.pixels.data()));
+			} else {
+				// in bands, each is colour converted while it's still in cache
+				constexpr UINT band_rows = 32;
+				for (UINT y = 0; y < height; y += band_rows) {
+					const UINT rows = std::min(band_rows, height - y);
+					const WICRect rc{0, static_cast<INT>(y), static_cast<INT>(width), static_cast<INT>(rows)};
+					auto* band = pixels.data() + size_t(y) * width;
+					HR(converter->CopyPixels(&rc, pixels.stride(), rows * pixels.stride(), reinterpret_cast<BYTE*>(band)));
+					lut->apply(band, size_t(rows) * width);
+				}
+			}
+			return true;
+		}
+
+	private:
+		// what decode() hands on to convert()
+		struct decode_result {
+			image_buffer pixels;
+			std::shared_ptr<const color::lut> lut;
+			hdr::half_buffer hdr;
+			hdr::tone tone;
+			size_t hdr_level = 0;
+		};
+
+		void fail(std::uint64_t ticket) {
+			{
 				std::lock_guard<std::mutex> lk(window_.mutex_);
 				status_ = ImageStatus::FAILED_TO_LOAD;
-				window_.cv_.notify_all();
-				return;
+				settled_ = ticket;
 			}
+			// the frame showing the picture before it draws the failure
+			window_.OnImageUpdated(index());
+		}
 
-			wrl::ComPtr<IWICBitmapFrameDecode> source;
+		// The stages of run_load(), each runs on the strand between two
+		// checks of the ticket.
+
+		load::task<pixel_arena::buffer> read() {
+			IMV_TRACE_SCOPE_ARG("read", "load", index());
+			if (archive_) co_return archive_->read(member_);
+			co_return read_file(wide(image_path_));
+		}
+
+		// The native decoders take precedence, any file they decline goes to WIC.
+		load::task<bool> decode(const pixel_arena::buffer& file, decode_result& out) {
+			IMV_TRACE_SCOPE_ARG("decode", "load", index());
+			metrics::gauge_scope in_flight(window_.metrics_.decodes_in_flight);
+			const auto start = std::chrono::steady_clock::now();
+			if (decode_native(file, out.pixels, out.lut)) {
+				window_.metrics_.native_decodes.add();
+			} else if (decode_wic(file, out.pixels, out.lut, out.hdr, out.tone, out.hdr_level)) {
+				window_.metrics_.wic_decodes.add();
+			} else {
+				co_return false;
+			}
+			if (out.lut) window_.metrics_.color_managed.add();
+
+			const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			const auto n_pixels = static_cast<std::uint64_t>(out.pixels.width) * out.pixels.height;
+			window_.metrics_.decoded_pixels.add(n_pixels);
+			window_.metrics_.decode_ns.add(static_cast<std::uint64_t>(ns));
+			if (ns > 0) window_.metrics_.decode_mps.set(static_cast<double>(n_pixels) * 1000.0 / static_cast<double>(ns));
+			co_return true;
+		}
 
-			// Retrieve the first frame of the image from the decoder
-			HR(decoder->GetFrame(0, source.GetAddressOf()));
-			HR(GR::get_instance().wicFactory->CreateFormatConverter(image_.ReleaseAndGetAddressOf()));
+		// Levels and statistics, then the pixels are published: LOADED_DI.
+		load::task<> convert(decode_result d) {
+			std::vector<image_buffer> lods;
+			{
+				IMV_TRACE_SCOPE_ARG("lods", "load", index());
+				lods = build_lods(d.pixels);
+			}
 
-			HR(image_->Initialize(
-				source.Get(),
-				GUID_WICPixelFormat32bppPBGRA,
-				WICBitmapDitherTypeNone,
-				nullptr,
-				0.0f,
-				WICBitmapPaletteTypeMedianCut)
-			);
+			std::shared_ptr<const image_stats> stats;
+			{
+				IMV_TRACE_SCOPE_ARG("stats", "load", index());
+				const auto& level = stats_level(d.pixels, lods);
+				stats = std::make_shared<const image_stats>(image_stats::compute(level, &level == &d.pixels));
+			}
+			auto pixels = pyramid::make(std::move(d.pixels), std::move(lods));
 
 			{
 				std::lock_guard<std::mutex> lk(window_.mutex_);
+				const auto old_bytes = resident_bytes();
+				// what was there before goes after the lock
+				pyramid_.swap(pixels);
+				stats_ = std::move(stats);
+				hdr_ = std::move(d.hdr);
+				hdr_level_ = d.hdr_level;
+				tone_ = d.tone;
+				lut_ = std::move(d.lut);
+				window_.metrics_.resident_bytes.add(static_cast<double>(resident_bytes()) - static_cast<double>(old_bytes));
 				status_ = ImageStatus::LOADED_DI;
 			}
-			window_.cv_.notify_all();
+			startup_timeline::get_instance().mark(startup::stage::first_decode);
+			co_return;
+		}
 
-			if (rotation_idx() != 0) {
-				constexpr WICBitmapTransformOptions tab[] = {
-					WICBitmapTransformRotate0, WICBitmapTransformRotate90,
-					WICBitmapTransformRotate180, WICBitmapTransformRotate270
-				};
-				// Create the flip/rotator.
-				HR(GR::get_instance().wicFactory->CreateBitmapFlipRotator(rotator_.ReleaseAndGetAddressOf()));
-				HR(rotator_->Initialize(image_.Get(), tab[rotation_idx()]));
-			}
+		// Suspends until the window has made its device, a picture opened at
+		// startup decodes before that.
+		load::task<> device() {
+			if (!window_.device_ready_.is_set()) co_await window_.device_ready_.async_wait(boost::asio::use_awaitable);
 		}
 
-		void load_dd(bool recreate_bitmap = false) {
-			if (status_ < ImageStatus::LOADED_DI) {
-				std::unique_lock<std::mutex> lk(window_.mutex_);
-				window_.cv_.wait(lk, [this]() { return status_ >= ImageStatus::LOADED_DI; });
+		// Bitmaps from the pixels in memory: LOADED_DD.
+		load::task<> upload(std::uint64_t ticket) {
+			IMV_TRACE_SCOPE_ARG("bitmaps", "load", index());
+			// the software renderer samples the pyramid directly
+			if (!window_.is_software() && (bitmaps_.empty() || generation_ != window_.device_generation())) {
+				create_bitmap();
 			}
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				status_ = ImageStatus::LOADED_DD;
+				settled_ = ticket;
+			}
+			// the frames drawn meanwhile showed the picture before
+			window_.OnImageUpdated(index());
+			co_return;
+		}
 
-			if (!bitmap_ || recreate_bitmap) {
-				HR(window_.d2d1_context()->CreateBitmapFromWicBitmap(get_image(), bitmap_.ReleaseAndGetAddressOf()));
+		// strand, the whole load under `ticket`. Called off in the meantime it
+		// stops before its next stage, the free queued behind it does the rest.
+		load::task<> run_load(std::uint64_t ticket) {
+			const auto start = std::chrono::steady_clock::now();
+			auto cancelled = [&]() {
+				if (ticket_.valid(ticket)) return false;
+				window_.metrics_.loads_cancelled.add();
+				return true;
+			};
+
+			// what the estimate is keyed on, 0 when nothing was decoded
+			std::uint64_t bytes = 0;
+			try {
+				if (!is_decoded()) {
+					if (cancelled()) co_return;
+					auto file = co_await read();
+					if (!file) {
+						fail(ticket);
+						co_return;
+					}
+					bytes = file.size();
+					if (cancelled()) co_return;
+					decode_result out;
+					if (!co_await decode(file, out)) {
+						fail(ticket);
+						co_return;
+					}
+					// back to the arena before the levels are allocated
+					file.reset();
+					if (cancelled()) co_return;
+					co_await convert(std::move(out));
+				}
+				co_await device();
+				if (cancelled()) co_return;
+				co_await upload(ticket);
+			} catch (std::exception&) {
+				fail(ticket);
+				co_return;
 			}
 
-			auto targetSize = window_.d2d1_context()->GetSize();
-			auto imageSize = bitmap_->GetSize();
+			if (bytes) {
+				window_.decode_estimator_.record(format(), bytes,
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
 
-			if (window_.is_fit_to_window() || imageSize.width > targetSize.width || imageSize.height > targetSize.height) {
-				float imageAspectRatio = imageSize.width / imageSize.height;
-				float targetAspectRatio = targetSize.width / targetSize.height;
+			// the estimate is on screen already, the exact statistics give way
+			// to whatever was queued on the strand meanwhile
+			co_await load::yield(strand_);
+			if (!cancelled()) refine_stats();
+		}
+	public:
 
-				if (imageAspectRatio < targetAspectRatio) {
-					rect_.top = 0.0f;
-					rect_.bottom = targetSize.height;
+		// Embedded ICC profile or EXIF colour space, sRGB otherwise.
+		static color::profile source_profile(IWICBitmapFrameDecode* frame) {
+			auto& wic = GR::get_instance().wicFactory;
+			UINT n = 0;
+			if (FAILED(frame->GetColorContexts(0, nullptr, &n)) || n == 0) return color::profile::srgb();
+
+			std::vector<wrl::ComPtr<IWICColorContext>> contexts(n);
+			std::vector<IWICColorContext*> raw(n);
+			for (UINT i = 0; i < n; ++i) {
+				HR(wic->CreateColorContext(contexts[i].GetAddressOf()));
+				raw[i] = contexts[i].Get();
+			}
+			if (FAILED(frame->GetColorContexts(n, raw.data(), &n))) return color::profile::srgb();
+
+			for (auto* context : raw) {
+				WICColorContextType type;
+				if (FAILED(context->GetType(&type))) continue;
+				if (type == WICColorContextProfile) {
+					UINT size = 0;
+					if (FAILED(context->GetProfileBytes(0, nullptr, &size)) || size == 0) continue;
+					std::vector<BYTE> bytes(size);
+					color::profile profile;
+					if (SUCCEEDED(context->GetProfileBytes(size, bytes.data(), &size)) && color::parse_icc(bytes.data(), size, profile)) return profile;
+				} else if (type == WICColorContextExifColorSpace) {
+					UINT space = 0;
+					if (SUCCEEDED(context->GetExifColorSpace(&space)) && space == 2) return color::profile::adobe_rgb();
+				}
+			}
+			return color::profile::srgb();
+		}
 
-					auto width = imageAspectRatio * targetSize.height;
-					rect_.left = (targetSize.width - width) / 2.0f;
-					rect_.right = width + rect_.left;
+		// strand, after the window's tone changed: maps the half float level
+		// again and rebuilds the coarser ones from it, into new buffers while
+		// frames go on drawing the old ones. Finer levels keep the old mapping
+		// and aren't drawn until the image is decoded again.
+		void retone() {
+			hdr::tone tone;
+			// let go of after the new one is in, outside the lock
+			std::shared_ptr<const pyramid> before;
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				tone = window_.tone_;
+				if (!hdr_ || !pyramid_ || tone == tone_ || hdr_level_ >= pyramid_->levels()) return;
+				before = pyramid_;
+			}
+			if (before->level(hdr_level_).width != hdr_.width || before->level(hdr_level_).height != hdr_.height) return;
+			IMV_TRACE_SCOPE_ARG("retone", "load", index());
+			const auto start = std::chrono::steady_clock::now();
+
+			auto after = std::make_shared<pyramid>(*before);
+			for (size_t l = hdr_level_; l < after->levels(); ++l) {
+				image_buffer level;
+				level.allocate(before->level(l).width, before->level(l).height);
+				if (l == hdr_level_) {
+					hdr::mapper(tone).run(hdr_.data(), level.data(), size_t(level.width) * level.height);
+					if (lut_) lut_->apply(level.data(), size_t(level.width) * level.height);
 				} else {
-					rect_.left = 0.0f;
-					rect_.right = targetSize.width;
+					const auto& prev = after->level(l - 1);
+					downsample_2x_32bpp(prev.data(), level.data(), prev.width, prev.height);
+				}
+				after->buffers[l] = std::make_shared<const image_buffer>(std::move(level));
+			}
+			after->finest = hdr_level_;
 
-					auto heigth = targetSize.width / imageAspectRatio;
-					rect_.top = (targetSize.height - heigth) / 2.0f;
-					rect_.bottom = heigth + rect_.top;
+			// uploaded aside, swapped in while the render thread waits
+			std::vector<wrl::ComPtr<ID2D1Bitmap1>> bitmaps(bitmaps_.size());
+			if (const auto context = window_.d2d1_context(); context && !window_.is_software()) {
+				for (size_t l = hdr_level_; l < bitmaps_.size(); ++l) {
+					if (bitmaps_[l]) upload(context.Get(), after->level(l), bitmaps[l]);
 				}
-			} else {
-				rect_.left = (targetSize.width - imageSize.width) / 2.0f;
-				rect_.right = rect_.left + imageSize.width;
+			}
+			auto stats = std::make_shared<const image_stats>(image_stats::compute(after->level(hdr_level_), hdr_level_ == 0));
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				for (size_t l = hdr_level_; l < bitmaps_.size(); ++l) {
+					if (bitmaps[l]) bitmaps_[l] = std::move(bitmaps[l]);
+				}
+				stats_ = std::move(stats);
+				tone_ = tone;
+				pyramid_ = std::move(after);
+			}
+			window_.metrics_.retone_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			// the picture changed along with the statistics
+			window_.OnImageUpdated(index());
+		}
 
-				rect_.top = (targetSize.height - imageSize.height) / 2.0f;
-				rect_.bottom = rect_.top + imageSize.height;
+		// strand, on a new device: the pixels still in memory uploaded again,
+		// nothing is decoded. The same path as a load's upload: the pyramid a
+		// frame would draw, the bitmaps swapped in under mutex_ that bitmap()
+		// takes, so a frame sees the old set (null for the new generation)
+		// or the whole new one. Images not decoded yet upload in their load.
+		void reupload() {
+			if (window_.is_software() || !decoded()) return;
+			create_bitmap();
+			window_.OnImageUpdated(index());
+		}
+
+		// UI thread: read, decode and upload on the strand, the stages that
+		// are already done are skipped.
+		void start_load() {
+			std::uint64_t ticket;
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				ticket = started_ = ticket_.current();
 			}
+			// the load holds the image, freeing it doesn't wait for the load
+			load::spawn(strand_, [](std::shared_ptr<Image> self, std::uint64_t ticket) -> load::task<> {
+				co_await self->run_load(ticket);
+			}(shared_from_this(), ticket));
+		}
+
+		// UI thread, true from start_load() until cancel().
+		bool is_requested() {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			return ticket_.valid(started_);
+		}
 
+		// strand, under memory pressure: the half-size levels go and the
+		// picture is drawn from the full size one until it's freed and loaded
+		// again. Kept when the full size can't be drawn or is older than a
+		// retone.
+		void drop_levels() {
+			if (status_ < ImageStatus::LOADED_DI || !pyramid_ || pyramid_->levels() == 1 || pyramid_->finest != 0) return;
+			if (!window_.is_software() && (bitmaps_.empty() || !bitmaps_[0])) return;
+			auto full = std::make_shared<pyramid>();
+			full->buffers.push_back(pyramid_->buffers[0]);
+			std::shared_ptr<const pyramid> before;
+			size_t shed;
 			{
 				std::lock_guard<std::mutex> lk(window_.mutex_);
-				status_ = ImageStatus::LOADED_DD;
+				const auto old_bytes = resident_bytes();
+				before.swap(pyramid_);
+				pyramid_ = std::move(full);
+				if (bitmaps_.size() > 1) bitmaps_.resize(1);
+				// mapped from a level that's gone, the picture keeps its tone
+				if (hdr_level_ != 0) hdr_.reset();
+				shed = old_bytes - resident_bytes();
 			}
-			window_.cv_.notify_all();
+			window_.metrics_.resident_bytes.add(-static_cast<double>(shed));
+			window_.metrics_.shed_level_bytes.add(shed);
+			// The levels go back to the arena and the pool isn't kept now. A
+			// frame still drawing them hands them back when it's done, for the
+			// next trim.
+			before.reset();
+			pixel_arena::get_instance().trim();
 		}
 
-		void load_d2d_resources(bool recreate_bitmap) {
-			load_di();
-			load_dd(recreate_bitmap);
+		// UI thread: loads started before stop at their next stage.
+		void cancel() {
+			std::lock_guard<std::mutex> lk(window_.mutex_);
+			ticket_.cancel();
 		}
 
+		// UI thread. A decoded picture is uploaded again right away, a load
+		// still running uploads with the new rotation.
+		void rotate(bool clockwise) {
+			clockwise ? ++rotation_idx : --rotation_idx;
+			if (is_decoded() && !window_.is_software()) create_bitmap();
+		}
+
+		// strand. The pixels go back to the arena for the next image to reuse
+		// once no frame draws from them: what a frame reads is taken out
+		// under mutex_ and let go of after it.
 		void free_d2d_resources() {
-			// release IWICFormatConverter also
-			// otherwise bitmap isn't going to be freed 
-			rotator_.Reset();
-			image_.Reset();
-			bitmap_.Reset();
-			status_ = ImageStatus::LOADING;
+			std::shared_ptr<const pyramid> pixels;
+			std::vector<wrl::ComPtr<ID2D1Bitmap1>> bitmaps;
+			std::shared_ptr<const image_stats> stats;
+			{
+				std::lock_guard<std::mutex> lk(window_.mutex_);
+				window_.metrics_.resident_bytes.add(-static_cast<double>(resident_bytes()));
+				pixels.swap(pyramid_);
+				bitmaps.swap(bitmaps_);
+				stats.swap(stats_);
+				status_ = ImageStatus::LOADING;
+			}
+			// only the strand reads these
+			hdr_.reset();
+			lut_.reset();
 		}
 
-		Image(ImvWindow& window, std::string&& path)
+		Image(ImvWindow& window, const catalog& pictures, std::int64_t index)
 			: window_{window}
-			, image_path_{path}
-			, strand_{tp::get_instance().ctx()}
+			, image_path_{pictures.path(index).string()}
+			, strand_{boost::asio::make_strand(tp::get_instance().ctx())}
+			, archive_{pictures.archive()}
+			, member_{static_cast<size_t>(index)}
+			, index_{index}
 		{
 		}
 	};
 
 	std::mutex mutex_;
-	std::condition_variable cv_;
-	std::vector<Image> images_;
+	// set once the window has its device, see Image::device()
+	load::event device_ready_;
+	// the pictures of the folder or archive, shared with the duplicate search
+	std::shared_ptr<const catalog> catalog_;
+	// live state of the entries that are cached or loading, by catalog index;
+	// changed by the UI thread under mutex_, the render thread looks up what
+	// it draws
+	std::unordered_map<std::int64_t, std::shared_ptr<Image>> images_;
+	// render thread: the picture last drawn, kept up while the one
+	// navigated to loads
+	std::shared_ptr<Image> drawn_;
+	// quarter turns of entries that were rotated and freed since, UI thread
+	std::unordered_map<std::int64_t, std::int64_t> rotations_;
+	// the folder scan started in OnCreate hasn't arrived yet
+	bool catalog_pending_ = false;
+	// paths handed over by later launches, closed as the window goes
+	std::shared_ptr<single_instance::mailbox> mailbox_ = std::make_shared<single_instance::mailbox>();
 public:
 	using Base = D2DWindow<ImvWindow>;
 
@@ -300,11 +966,20 @@ public:
 	BEGIN_MSG_MAP(c)
 		MESSAGE_HANDLER(WM_CREATE, OnCreate);
 		MESSAGE_HANDLER(WM_KEYDOWN, OnKeyDown);
+		MESSAGE_HANDLER(WM_CHAR, OnChar)
 		MESSAGE_HANDLER(WM_MOUSEWHEEL, OnMouseWheel)
 		MESSAGE_HANDLER(WM_LBUTTONDOWN, OnLButtonDown)
 		MESSAGE_HANDLER(WM_LBUTTONUP, OnLButtonUp)
 		MESSAGE_HANDLER(WM_MOUSEMOVE, OnMouseMove)
+		MESSAGE_HANDLER(WM_MOUSELEAVE, OnMouseLeave)
+		MESSAGE_HANDLER(WM_CAPTURECHANGED, OnCaptureChanged)
 		MESSAGE_HANDLER(WM_RBUTTONDOWN, OnRButtonDown)
+		MESSAGE_HANDLER(WM_TIMER, OnTimer)
+		MESSAGE_HANDLER(WM_OPEN_PATH, OnOpenPath)
+		MESSAGE_HANDLER(WM_CATALOG, OnCatalog)
+		MESSAGE_HANDLER(WM_MEMORY_PRESSURE, OnMemoryPressure)
+		MESSAGE_HANDLER(WM_NAMES, OnNames)
+		MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
 		COMMAND_ID_HANDLER(ID_APP_EXIT, OnAppExit)
 		COMMAND_ID_HANDLER(ID_ROTATE_CLOCKWISE, OnRotateClockwise)
 		COMMAND_ID_HANDLER(ID_ROTATE_ANTICLOCKWISE, OnRotateAntiClockwise)
@@ -318,50 +993,610 @@ public:
 
 	LRESULT OnRotateClockwise(WORD wNotifyCode, WORD wID, HWND hWndCtl, BOOL& bHandled) {
 		rotate_clockwise();
-		Invalidate();
+		PublishView();
 		return 0;
 	}
 
 	LRESULT OnRotateAntiClockwise(WORD wNotifyCode, WORD wID, HWND hWndCtl, BOOL& bHandled) {
 		rotate_anti_clockwise();
-		Invalidate();
+		PublishView();
 		return 0;
 	}
 
+	// UI thread: the live state of `idx`, made the first time it's needed.
+	Image& image(std::int64_t idx) {
+		if (auto it = images_.find(idx); it != images_.end()) return *it->second;
+		auto image = std::make_shared<Image>(*this, *catalog_, idx);
+		if (auto it = rotations_.find(idx); it != rotations_.end()) image->rotation_idx.set_value(it->second);
+		std::lock_guard<std::mutex> lk(mutex_);
+		return *images_.emplace(idx, std::move(image)).first->second;
+	}
+
+	// Any thread, null when `idx` isn't cached.
+	std::shared_ptr<Image> find_image(std::int64_t idx) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		const auto it = images_.find(idx);
+		return it != images_.end() ? it->second : nullptr;
+	}
+
 	Image& current_image() {
-		return images_[current_img_idx_()];
+		return image(entry(current_img_idx_()));
 	}
 
-	void CreateResources() { // override
-		//using D2D1::ColorF;
-		//m_d2dContext->CreateSolidColorBrush(ColorF(ColorF::LightSlateGray), m_brush.GetAddressOf());
+	// Pictures navigation goes through, those the filter keeps.
+	std::int64_t shown() const {
+		return static_cast<std::int64_t>(selection_ ? selection_->size() : catalog_->size());
 	}
 
-	bool is_fit_to_window() { return fit_to_window_; }
+	// The catalog index at position `pos`.
+	std::int64_t entry(std::int64_t pos) const {
+		return selection_ ? selection_->at(static_cast<size_t>(pos)) : pos;
+	}
 
-	void Draw() {
+	std::int64_t entry(const CirculalInterval<std::int64_t>& pos) const {
+		return entry(pos());
+	}
+
+	// The position of catalog index `idx`, -1 when the filter leaves it out.
+	std::int64_t position(std::int64_t idx) const {
+		if (!selection_) return idx;
+		return selection_->contains(static_cast<size_t>(idx)) ? static_cast<std::int64_t>(selection_->rank(static_cast<size_t>(idx))) : -1;
+	}
+
+	void CreateResources() { // override
+		if (is_software()) return;
 		using D2D1::ColorF;
+		HR(m_d2dContext->CreateSolidColorBrush(ColorF(ColorF::White), hud_text_brush_.ReleaseAndGetAddressOf()));
+		HR(m_d2dContext->CreateSolidColorBrush(ColorF(ColorF::Black, 0.6f), hud_background_brush_.ReleaseAndGetAddressOf()));
+		HR(m_d2dContext->CreateSolidColorBrush(ColorF(ColorF::White), histogram_brush_.ReleaseAndGetAddressOf()));
+		// made on the old device
+		scrub_bitmap_.Reset();
+		scrub_shown_.reset();
+	}
+
+	void PublishView() {
+		{
+			std::lock_guard<std::mutex> lk(view_mutex_);
+			view_ = ViewState{matrix_, entry(current_img_idx_), show_hud_, image_requested_, animate_, show_histogram_, fit_to_window_,
+				scrub_hover_ || scrubbing_, scrubbing_ ? scrub_idx_ : -1, slideshow_.active, slideshow_.interval};
+		}
+		animate_ = false;
+		RequestFrame();
+	}
+
+	// Eases the drawn transform toward the requested one, true while it is
+	// still moving. Matrices here are uniform scale plus translation; the
+	// change between two of them has a fixed screen point (the cursor for a
+	// wheel zoom), scaling about it by r^k keeps that point still all the way.
+	bool Animate(const ViewState& view, D2D1::Matrix3x2F& matrix) {
+		using namespace std::chrono;
+		const auto now = steady_clock::now();
+		const float dt = std::min(duration<float, std::milli>(now - last_draw_).count(), 1000.0f / 60.0f);
+		last_draw_ = now;
+
+		const auto& from = shown_matrix_;
+		const auto& to = view.matrix;
+		const float r = to._11 / from._11;
+		const float dx = to._31 - from._31, dy = to._32 - from._32;
+		if (!view.animate || view.image != shown_image_ || (std::abs(r - 1.0f) < 1e-3f && std::abs(dx) < 0.25f && std::abs(dy) < 0.25f)) {
+			shown_matrix_ = matrix = to;
+			shown_image_ = view.image;
+			return false;
+		}
+
+		const float k = 1.0f - std::exp(-dt / zoom_time_constant_ms);
+		if (std::abs(r - 1.0f) > 1e-4f) {
+			const auto fixed = D2D1::Point2F((to._31 - r * from._31) / (1.0f - r), (to._32 - r * from._32) / (1.0f - r));
+			const float s = std::pow(r, k);
+			shown_matrix_ = from * D2D1::Matrix3x2F::Scale(s, s, fixed);
+		} else {
+			shown_matrix_ = from * D2D1::Matrix3x2F::Translation(dx * k, dy * k);
+		}
+		matrix = shown_matrix_;
+		return true;
+	}
+
+	// Drop a pyramid level each time an animated frame misses its slot, win
+	// it back after a run of frames on time; a settled view is always exact.
+	void UpdateLodBias(bool animating) {
+		if (!animating) {
+			lod_bias_ = 0;
+			frames_on_time_ = 0;
+		} else if (FrameOverBudget()) {
+			lod_bias_ = std::min<size_t>(lod_bias_ + 1, 3);
+			frames_on_time_ = 0;
+		} else if (lod_bias_ > 0 && ++frames_on_time_ >= 8) {
+			--lod_bias_;
+			frames_on_time_ = 0;
+		}
+	}
+
+	// Coarsest level that still has a source pixel per screen pixel, plus the bias.
+	static size_t PickLevel(float screen_scale, size_t bias, size_t levels) {
+		size_t level = 0;
+		while (level + 1 < levels && screen_scale * static_cast<float>(size_t(2) << level) <= 1.0f) ++level;
+		return std::min(level + bias, levels - 1);
+	}
+
+	ViewState CurrentView() {
+		std::lock_guard<std::mutex> lk(view_mutex_);
+		return view_;
+	}
+
+	// UI thread, once per navigation
+	void OnImageChanged() {
+		image_requested_ = std::chrono::steady_clock::now();
+		const auto live = images_.find(entry(current_img_idx_));
+		(live != images_.end() && live->second->is_decoded() ? metrics_.cache_hits : metrics_.cache_misses).add();
+		// a jump, or shed under memory pressure
+		request_load(entry(current_img_idx_));
+		ShowTitle();
+	}
 
-		auto& current = current_image();
+	// The picture's path; with a filter on, what it keeps and where in it
+	// this picture is. The name being typed instead while it is.
+	void ShowTitle() {
+		if (typing_) {
+			ShowFind();
+			return;
+		}
+		std::string title(current_image().image_path());
+		if (selection_) {
+			title += "  [" + FilterName() + ": " + std::to_string(current_img_idx_() + 1) + " of " + std::to_string(shown()) + "]";
+		}
+		this->SetWindowText(title.c_str());
+	}
 
-		if (image_changed_) {
-			this->SetWindowText(current.image_path().data());
-			image_changed_ = false;
+	void OnFirstPixel(const ViewState& view) {
+		if (first_pixel_for_ != view.requested) {
+			metrics_.ttfp_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - view.requested).count());
+			first_pixel_for_ = view.requested;
+			startup_timeline::get_instance().mark(startup::stage::first_frame);
 		}
+	}
+
+	// The picture a frame shows: the view's once it's ready, the one drawn
+	// last until then. A frame never waits for a load, it holds
+	// render_mutex_ and the UI thread takes that; the load asks for another
+	// frame when it's done. Null when neither can be drawn.
+	std::shared_ptr<Image> Shown(const ViewState& view) {
+		// null when a later navigation freed it already
+		auto current = find_image(view.image);
+		if (current && current->is_drawable()) return drawn_ = std::move(current);
+		// one that failed to load is shown as nothing
+		if (current && current->is_ready()) drawn_.reset();
+		else if (drawn_ && !drawn_->is_drawable()) drawn_.reset();
+		return drawn_;
+	}
+
+	void Draw() {
+		const auto view = CurrentView();
+		IMV_TRACE_SCOPE_ARG("draw", "draw", view.image);
+		using D2D1::ColorF;
+
+		const auto current = Shown(view);
+		D2D1::Matrix3x2F matrix;
+		const bool animating = Animate(view, matrix);
+		UpdateLodBias(animating);
+		m_d2dContext->SetTransform(matrix);
 
-		if (current.is_loaded()) {
+		// held for the frame, a free on the strand lets go of it after
+		const auto pixels = current ? current->decoded() : nullptr;
+		if (pixels) {
 			m_d2dContext->Clear(ColorF(ColorF::LightGray));
-			m_d2dContext->DrawBitmap(current.bitmap(), current.rect(),
-				1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR);
+			const auto rect = current->rect(*pixels, target_size(), view.fit);
+			const auto level = std::max(PickLevel(current->fit_scale(*pixels, rect) * matrix._11, lod_bias_, pixels->levels()), pixels->finest);
+			// null until a new device has the pixels again
+			if (const auto bitmap = current->bitmap(level)) {
+				// cheap filtering while moving, the settled frame gets the good one
+				m_d2dContext->DrawBitmap(bitmap.Get(), rect, 1.0f,
+					animating ? D2D1_INTERPOLATION_MODE_LINEAR : D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC);
+				if (current->index() == view.image) OnFirstPixel(view);
+			}
 		} else {
 			m_d2dContext->Clear(ColorF(ColorF::LightGray));
 		}
+
+		if (view.hud) DrawHud(matrix, view);
+		if (view.histogram && current) DrawHistogram(matrix, current->stats());
+		if (view.bar) DrawScrubBar(matrix, view);
+		if (animating) RequestFrame();
 		
 		//auto targetSize = m_d2dContext->GetSize();
 		//auto targetRect = D2D1::RectF(0, 0, targetSize.width, targetSize.height);
 		//m_d2dContext->DrawRectangle(targetRect, m_brush.Get());
 	}
 
+	// Same picture as Draw() composed on the CPU, no HUD in this mode; the
+	// scrub bar is drawn in plain fills.
+	void DrawSoftware(image_buffer& frame) {
+		const auto view = CurrentView();
+		IMV_TRACE_SCOPE_ARG("draw", "draw", view.image);
+		constexpr std::uint32_t light_gray = 0xFFD3D3D3;
+
+		const auto current = Shown(view);
+		D2D1::Matrix3x2F matrix;
+		const bool animating = Animate(view, matrix);
+		UpdateLodBias(animating);
+
+		// the levels are sampled from the render pool, so the frame holds them
+		const auto pixels = current ? current->decoded() : nullptr;
+		if (pixels) {
+			const auto rect = current->rect(*pixels, target_size(), view.fit);
+			const auto level = std::max(PickLevel(current->fit_scale(*pixels, rect) * matrix._11, lod_bias_, pixels->levels()), pixels->finest);
+			soft::render(soft::render_pool::get_instance(), pixels->level(level), frame, current->placement(*pixels, rect, level) * ToAffine(matrix), light_gray);
+			if (current->index() == view.image) OnFirstPixel(view);
+		} else {
+			std::fill(frame.data(), frame.data() + size_t(frame.width) * frame.height, light_gray);
+		}
+
+		if (view.bar) DrawScrubBarSoftware(frame, view);
+		if (animating) RequestFrame();
+	}
+
+	void DrawHud(const D2D1::Matrix3x2F& matrix, const ViewState& view) {
+		const double hits = static_cast<double>(metrics_.cache_hits.value());
+		const double lookups = hits + static_cast<double>(metrics_.cache_misses.value());
+		const auto arena = pixel_arena::get_instance().stats();
+		const auto& timeline = startup_timeline::get_instance();
+		hdr::tone tone;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			tone = tone_;
+		}
+
+		wchar_t text[1024];
+		swprintf_s(text,
+			L"cache hit   %.0f%% of %.0f\n"
+			L"resident    %.1f MB\n"
+			L"queue       %.0f    in flight %.0f\n"
+			L"decode      %.1f MP/s\n"
+			L"frame       %.2f ms\n"
+			L"pacing      p50 %.1f  p99 %.1f ms\n"
+			L"input lag   p50 %.1f  p99 %.1f ms  coalesced %.0f\n"
+			L"first pixel %.1f ms\n"
+			L"startup     %.0f ms  device %.0f  decode %.0f  folder %.0f\n"
+			L"arena       reuse %.0f%%  peak %.0f MB\n"
+			L"memory      pressure %s  shed %.0f MB  %.0f images\n"
+			L"slideshow   %s %.0f s  missed %.0f of %.0f\n"
+			L"duplicates  %s\n"
+			L"tone        %+.2f EV  %s  (%.0f images)",
+			lookups > 0 ? hits * 100.0 / lookups : 0.0, lookups,
+			metrics_.resident_bytes.value() / (1024.0 * 1024.0),
+			metrics_.queue_depth.value(), metrics_.decodes_in_flight.value(),
+			metrics_.decode_mps.value(),
+			metrics_.frame_ms.value(),
+			metrics_.frame_interval.percentile(0.50), metrics_.frame_interval.percentile(0.99),
+			metrics_.input_latency.percentile(0.50), metrics_.input_latency.percentile(0.99),
+			static_cast<double>(metrics_.coalesced.value()),
+			metrics_.ttfp_ms.value(),
+			timeline.ms(startup::stage::first_frame), timeline.ms(startup::stage::device),
+			timeline.ms(startup::stage::first_decode), timeline.ms(startup::stage::catalog),
+			arena.reuse_rate() * 100.0, static_cast<double>(arena.peak_bytes) / (1024.0 * 1024.0),
+			PressureName(), static_cast<double>(metrics_.shed_level_bytes.value()) / (1024.0 * 1024.0),
+			static_cast<double>(metrics_.shed_images.value()),
+			view.slideshow ? L"on " : L"off", std::chrono::duration<double>(view.slide_interval).count(),
+			static_cast<double>(metrics_.slides_missed.value()), static_cast<double>(metrics_.slides_shown.value()),
+			DuplicatesStatus(view).c_str(),
+			tone.exposure_ev, tone.reinhard ? L"reinhard" : L"clip", static_cast<double>(metrics_.hdr_images.value()));
+
+		// the overlay stays put while the image is zoomed and panned
+		m_d2dContext->SetTransform(D2D1::Matrix3x2F::Identity());
+		auto rect = D2D1::RectF(8.0f, 8.0f, 460.0f, 8.0f + 14 * 24.0f + 16.0f);
+		m_d2dContext->FillRectangle(rect, hud_background_brush_.Get());
+		rect.left += 8.0f;
+		m_d2dContext->DrawText(text, static_cast<UINT32>(std::wcslen(text)), GR::get_instance().TextFormat(),
+			rect, hud_text_brush_.Get());
+		m_d2dContext->SetTransform(matrix);
+	}
+
+	// render thread, pressure_ belongs to the UI thread
+	const wchar_t* PressureName() {
+		switch (static_cast<memory::pressure>(metrics_.memory_pressure.value())) {
+		case memory::pressure::low: return L"low";
+		case memory::pressure::critical: return L"critical";
+		default: return L"none";
+		}
+	}
+
+	std::wstring DuplicatesStatus(const ViewState& view) {
+		wchar_t text[128];
+		const auto groups = duplicates_.get();
+		if (groups && view.image >= 0 && static_cast<size_t>(view.image) < groups->size.size()) {
+			swprintf_s(text, L"%u in this group, %zu groups", groups->size[view.image], groups->n_groups);
+		} else {
+			swprintf_s(text, L"hashing %zu/%zu", duplicates_.hashed(), duplicates_.to_hash());
+		}
+		return text;
+	}
+
+	// Any thread, what `idx` draws changed: it finished loading, exact
+	// statistics for the estimate, a retoned picture, bitmaps on a new device.
+	void OnImageUpdated(std::int64_t idx) {
+		if (CurrentView().image == idx) RequestFrame();
+	}
+
+	// Luminance filled, the channels as lines, bottom right. Clipping is the
+	// share of pixels at black and at 255 in the worst channel.
+	void DrawHistogram(const D2D1::Matrix3x2F& matrix, const std::shared_ptr<const image_stats>& stats) {
+		if (!stats || !stats->pixels) return;
+		using D2D1::ColorF;
+		constexpr float width = 256.0f, height = 100.0f, margin = 8.0f, text_height = 48.0f;
+		const auto target = m_d2dContext->GetSize();
+		const float left = target.width - width - 2 * margin - margin;
+		const float bottom = target.height - 2 * margin - text_height - margin;
+
+		m_d2dContext->SetTransform(D2D1::Matrix3x2F::Identity());
+		m_d2dContext->FillRectangle(D2D1::RectF(left - margin, bottom - height - margin, left + width + margin,
+			bottom + text_height + margin), hud_background_brush_.Get());
+
+		// scaled to the tallest bin apart from the ends, which clipping can make huge
+		std::uint32_t peak = 1;
+		for (auto* c : {&stats->blue, &stats->green, &stats->red, &stats->luma}) {
+			peak = std::max(peak, *std::max_element(c->histogram.begin() + 1, c->histogram.end() - 1));
+		}
+		auto y_of = [&](std::uint32_t n) { return bottom - height * std::min(1.0f, static_cast<float>(n) / static_cast<float>(peak)); };
+
+		histogram_brush_->SetColor(ColorF(ColorF::White, 0.35f));
+		for (int i = 0; i < 256; ++i) {
+			m_d2dContext->FillRectangle(D2D1::RectF(left + i, y_of(stats->luma.histogram[i]), left + i + 1, bottom), histogram_brush_.Get());
+		}
+		const std::pair<const image_stats::channel*, ColorF> channels[] = {
+			{&stats->red, ColorF(ColorF::Red, 0.9f)}, {&stats->green, ColorF(ColorF::Lime, 0.9f)}, {&stats->blue, ColorF(ColorF::DodgerBlue, 0.9f)}};
+		for (auto& [c, color] : channels) {
+			histogram_brush_->SetColor(color);
+			for (int i = 1; i < 256; ++i) {
+				m_d2dContext->DrawLine(D2D1::Point2F(left + i - 0.5f, y_of(c->histogram[i - 1])),
+					D2D1::Point2F(left + i + 0.5f, y_of(c->histogram[i])), histogram_brush_.Get());
+			}
+		}
+
+		wchar_t text[256];
+		swprintf_s(text,
+			L"luma %u..%u  mean %.1f%s\n"
+			L"clipped  shadows %.2f%%  highlights %.2f%%",
+			stats->luma.min, stats->luma.max, stats->luma.mean, stats->exact ? L"" : L"  (estimate)",
+			stats->clipped_shadows() * 100.0, stats->clipped_highlights() * 100.0);
+		m_d2dContext->DrawText(text, static_cast<UINT32>(std::wcslen(text)), GR::get_instance().TextFormat(),
+			D2D1::RectF(left, bottom + margin, left + width + margin, bottom + text_height), hud_text_brush_.Get());
+		m_d2dContext->SetTransform(matrix);
+	}
+
+	// The bar's track in client pixels, inset by the margins and centred in
+	// the strip.
+	static D2D1_RECT_F ScrubTrack(float width, float height) {
+		const float y = height - scrub_strip / 2;
+		return D2D1::RectF(scrub_margin, y - 2.0f, std::max(scrub_margin, width - scrub_margin), y + 2.0f);
+	}
+
+	// Where the marker of position `pos` goes on `track`, the bar spans
+	// the pictures the filter keeps.
+	float ScrubX(const D2D1_RECT_F& track, std::int64_t pos) {
+		const auto n = shown();
+		return track.left + (n > 1 ? (track.right - track.left) * static_cast<float>(pos) / static_cast<float>(n - 1) : 0.0f);
+	}
+
+	// Render thread: the preview of the entry under the cursor, or the one
+	// drawn last until it's decoded. True when it changed.
+	bool UpdateScrubPreview(std::int64_t idx) {
+		auto preview = previews_.find(idx);
+		if (!preview || preview == scrub_shown_) return false;
+		scrub_shown_ = std::move(preview);
+		return true;
+	}
+
+	// Track with a marker for the picture on screen and, while dragging, one
+	// for the entry under the cursor with its preview and number above it.
+	void DrawScrubBar(const D2D1::Matrix3x2F& matrix, const ViewState& view) {
+		using D2D1::ColorF;
+		constexpr float label_height = 20.0f;
+		const auto target = m_d2dContext->GetSize();
+		const auto track = ScrubTrack(target.width, target.height);
+
+		m_d2dContext->SetTransform(D2D1::Matrix3x2F::Identity());
+		m_d2dContext->FillRectangle(D2D1::RectF(0.0f, target.height - scrub_strip, target.width, target.height), hud_background_brush_.Get());
+		histogram_brush_->SetColor(ColorF(ColorF::White, 0.35f));
+		m_d2dContext->FillRectangle(track, histogram_brush_.Get());
+		const float x = ScrubX(track, position(view.image));
+		histogram_brush_->SetColor(ColorF(ColorF::White));
+		m_d2dContext->FillRectangle(D2D1::RectF(x - 2.0f, track.top - 6.0f, x + 2.0f, track.bottom + 6.0f), histogram_brush_.Get());
+
+		if (view.scrub >= 0) {
+			const float sx = ScrubX(track, view.scrub);
+			histogram_brush_->SetColor(ColorF(ColorF::DodgerBlue));
+			m_d2dContext->FillRectangle(D2D1::RectF(sx - 2.0f, track.top - 6.0f, sx + 2.0f, track.bottom + 6.0f), histogram_brush_.Get());
+
+			if (UpdateScrubPreview(entry(view.scrub))) {
+				const auto props = D2D1::BitmapProperties1(D2D1_BITMAP_OPTIONS_NONE,
+					D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED));
+				if (FAILED(m_d2dContext->CreateBitmap(D2D1::SizeU(scrub_shown_->width, scrub_shown_->height), scrub_shown_->data(),
+					scrub_shown_->stride(), props, scrub_bitmap_.ReleaseAndGetAddressOf()))) scrub_bitmap_.Reset();
+			}
+			// fitted into a square of 1.5 preview sides
+			float w = 120.0f, h = 0.0f;
+			if (scrub_bitmap_) {
+				const float side = 1.5f * scrub_preview_side;
+				const float scale = side / static_cast<float>(std::max(scrub_shown_->width, scrub_shown_->height));
+				w = std::max(w, scrub_shown_->width * scale);
+				h = scrub_shown_->height * scale;
+			}
+			const float left = std::clamp(sx - w / 2, scrub_margin, std::max(scrub_margin, target.width - scrub_margin - w));
+			const float bottom = target.height - scrub_strip - scrub_margin / 2;
+			const float top = bottom - h - label_height;
+			m_d2dContext->FillRectangle(D2D1::RectF(left - 4.0f, top - 4.0f, left + w + 4.0f, bottom + 4.0f), hud_background_brush_.Get());
+			if (scrub_bitmap_) {
+				const float image_w = scrub_shown_->width * (h / scrub_shown_->height);
+				const float image_left = left + (w - image_w) / 2;
+				m_d2dContext->DrawBitmap(scrub_bitmap_.Get(), D2D1::RectF(image_left, top, image_left + image_w, top + h), 1.0f,
+					D2D1_INTERPOLATION_MODE_LINEAR);
+			}
+			wchar_t text[64];
+			swprintf_s(text, L"%lld / %lld", static_cast<long long>(view.scrub + 1), static_cast<long long>(shown()));
+			m_d2dContext->DrawText(text, static_cast<UINT32>(std::wcslen(text)), GR::get_instance().TextFormat(),
+				D2D1::RectF(left, bottom - label_height, left + w, bottom), hud_text_brush_.Get());
+		}
+		m_d2dContext->SetTransform(matrix);
+	}
+
+	// DrawScrubBar() in plain fills, the preview copied 1:1 and no number.
+	void DrawScrubBarSoftware(image_buffer& frame, const ViewState& view) {
+		const auto width = static_cast<float>(frame.width), height = static_cast<float>(frame.height);
+		auto fill = [&](float x0, float y0, float x1, float y1, std::uint32_t color) {
+			const auto left = static_cast<std::uint32_t>(std::clamp(x0, 0.0f, width)), right = static_cast<std::uint32_t>(std::clamp(x1, 0.0f, width));
+			const auto top = static_cast<std::uint32_t>(std::clamp(y0, 0.0f, height)), bottom = static_cast<std::uint32_t>(std::clamp(y1, 0.0f, height));
+			for (auto y = top; y < bottom; ++y) std::fill_n(frame.data() + size_t(y) * frame.width + left, right - left, color);
+		};
+		const auto track = ScrubTrack(width, height);
+		fill(0.0f, height - scrub_strip, width, height, 0xFF303030);
+		fill(track.left, track.top, track.right, track.bottom, 0xFF808080);
+		const float x = ScrubX(track, position(view.image));
+		fill(x - 2.0f, track.top - 6.0f, x + 2.0f, track.bottom + 6.0f, 0xFFFFFFFF);
+		if (view.scrub < 0) return;
+
+		const float sx = ScrubX(track, view.scrub);
+		fill(sx - 2.0f, track.top - 6.0f, sx + 2.0f, track.bottom + 6.0f, 0xFF1E90FF);
+		UpdateScrubPreview(entry(view.scrub));
+		if (!scrub_shown_) return;
+		const auto& preview = *scrub_shown_;
+		const float w = static_cast<float>(preview.width), h = static_cast<float>(preview.height);
+		const float left = std::clamp(sx - w / 2, 0.0f, std::max(0.0f, width - w));
+		const float top = std::max(0.0f, height - scrub_strip - scrub_margin / 2 - h);
+		fill(left - 4.0f, top - 4.0f, left + w + 4.0f, top + h + 4.0f, 0xFF303030);
+		const auto x0 = static_cast<std::uint32_t>(left), y0 = static_cast<std::uint32_t>(top);
+		const auto cols = std::min(preview.width, frame.width - std::min(frame.width, x0));
+		for (std::uint32_t y = 0; y < preview.height && y0 + y < frame.height; ++y) {
+			std::copy_n(preview.data() + size_t(y) * preview.width, cols, frame.data() + size_t(y0 + y) * frame.width + x0);
+		}
+	}
+
+	// Pool thread, positions can't be mapped here: any preview while
+	// dragging is worth a frame.
+	void OnPreviewReady(std::int64_t idx) {
+		if (CurrentView().scrub >= 0) RequestFrame();
+	}
+
+	// Pool thread: entry `idx` of `pictures` at a reduced size, scaled by
+	// WIC as it decodes. The native decoders are the fallback, the preview
+	// cache shrinks what they make.
+	static bool DecodePreview(const catalog& pictures, std::int64_t idx, image_buffer& out) {
+		IMV_TRACE_SCOPE_ARG("preview", "scrub", idx);
+		const auto file = pictures.archive() ? pictures.archive()->read(static_cast<size_t>(idx)) : read_file(wide(pictures.path(idx).string()));
+		if (!file) return false;
+
+		auto& wic = GR::get_instance().wicFactory;
+		wrl::ComPtr<IWICStream> stream;
+		wrl::ComPtr<IWICBitmapDecoder> decoder;
+		wrl::ComPtr<IWICBitmapFrameDecode> frame;
+		wrl::ComPtr<IWICBitmapScaler> scaler;
+		wrl::ComPtr<IWICFormatConverter> converter;
+		UINT width = 0, height = 0;
+		if (SUCCEEDED(wic->CreateStream(stream.GetAddressOf()))
+			&& SUCCEEDED(stream->InitializeFromMemory(file.data(), static_cast<DWORD>(file.size())))
+			&& SUCCEEDED(wic->CreateDecoderFromStream(stream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf()))
+			&& SUCCEEDED(decoder->GetFrame(0, frame.GetAddressOf()))
+			&& SUCCEEDED(frame->GetSize(&width, &height)) && width && height)
+		{
+			const double scale = std::min(1.0, double(scrub_preview_side) / std::max(width, height));
+			const UINT w = std::max(1u, static_cast<UINT>(width * scale)), h = std::max(1u, static_cast<UINT>(height * scale));
+			if (SUCCEEDED(wic->CreateBitmapScaler(scaler.GetAddressOf()))
+				&& SUCCEEDED(scaler->Initialize(frame.Get(), w, h, WICBitmapInterpolationModeFant))
+				&& SUCCEEDED(wic->CreateFormatConverter(converter.GetAddressOf()))
+				&& SUCCEEDED(converter->Initialize(scaler.Get(), GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, nullptr,
+					0.0f, WICBitmapPaletteTypeCustom)))
+			{
+				out.allocate(w, h);
+				if (SUCCEEDED(converter->CopyPixels(nullptr, out.stride(), static_cast<UINT>(out.pixels.size()), out.pixels.data()))) return true;
+			}
+		}
+		return decoders::native::sniff(file.data(), file.size()) && decoders::native::decode(file.data(), file.size(), out);
+	}
+
+	// Hashing threads: the picture at `path` Fant-scaled straight out of the
+	// decoder, codecs that can (JPEG) skip most of the full-size decode.
+	static bool DecodeThumbnail(const fs::path& path, image_buffer& out) {
+		auto& wic = GR::get_instance().wicFactory;
+		wrl::ComPtr<IWICBitmapDecoder> decoder;
+		wrl::ComPtr<IWICBitmapFrameDecode> frame;
+		wrl::ComPtr<IWICBitmapScaler> scaler;
+		wrl::ComPtr<IWICFormatConverter> converter;
+
+		if (FAILED(wic->CreateDecoderFromFilename(wide(path.string()).c_str(), nullptr, GENERIC_READ,
+			WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf()))) return false;
+		if (FAILED(decoder->GetFrame(0, frame.GetAddressOf()))) return false;
+
+		UINT width, height;
+		if (FAILED(frame->GetSize(&width, &height)) || width == 0 || height == 0) return false;
+		const double scale = std::min(1.0, double(phash::finder::thumbnail_side) / std::max(width, height));
+		const UINT tw = std::max(1u, static_cast<UINT>(width * scale)), th = std::max(1u, static_cast<UINT>(height * scale));
+
+		if (FAILED(wic->CreateBitmapScaler(scaler.GetAddressOf()))) return false;
+		if (FAILED(scaler->Initialize(frame.Get(), tw, th, WICBitmapInterpolationModeFant))) return false;
+		if (FAILED(wic->CreateFormatConverter(converter.GetAddressOf()))) return false;
+		if (FAILED(converter->Initialize(scaler.Get(), GUID_WICPixelFormat32bppPBGRA,
+			WICBitmapDitherTypeNone, nullptr, 0.0f, WICBitmapPaletteTypeCustom))) return false;
+
+		out.allocate(tw, th);
+		return SUCCEEDED(converter->CopyPixels(nullptr, out.stride(), static_cast<UINT>(out.pixels.size()), out.pixels.data()));
+	}
+
+	// A new catalog, its previews decode from it. UI thread, under
+	// render_mutex_ once the window is up.
+	void ResetPreviews() {
+		previews_.reset([pictures = catalog_](std::int64_t idx, image_buffer& out) { return DecodePreview(*pictures, idx, out); });
+		scrub_shown_.reset();
+		scrub_bitmap_.Reset();
+	}
+
+	// UI thread: the position under client `x` on the bar.
+	std::int64_t ScrubIndexAt(int x) {
+		CRect rc;
+		GetClientRect(&rc);
+		const auto track = ScrubTrack(static_cast<float>(rc.Width()), static_cast<float>(rc.Height()));
+		return scrub::index_at(static_cast<float>(x) - track.left, track.right - track.left, shown());
+	}
+
+	// Only the preview of where the cursor is now is asked for, nothing is
+	// loaded for the entries it passes over.
+	void Scrub(CPoint point) {
+		const auto idx = ScrubIndexAt(point.x);
+		if (idx == scrub_idx_) return;
+		scrub_idx_ = idx;
+		previews_.request(entry(idx));
+		PublishView();
+	}
+
+	// The button came up over `scrub_idx_`: that picture loads. Cancelled
+	// scrubbing leaves the picture on screen as it was.
+	void EndScrub(bool commit) {
+		if (!scrubbing_) return;
+		// before the capture goes, WM_CAPTURECHANGED would end it again
+		scrubbing_ = false;
+		ReleaseCapture();
+		previews_.cancel();
+		if (commit && scrub_idx_ >= 0) seek(scrub_idx_);
+		scrub_idx_ = -1;
+		PublishView();
+	}
+
+	void UpdateScrubHover(CPoint point) {
+		CRect rc;
+		GetClientRect(&rc);
+		const bool over = shown() > 1 && point.y >= rc.bottom - static_cast<LONG>(scrub_strip);
+		if (over == scrub_hover_) return;
+		scrub_hover_ = over;
+		if (over) {
+			// WM_MOUSELEAVE hides it again
+			TRACKMOUSEEVENT tme{sizeof(tme), TME_LEAVE, m_hWnd, 0};
+			::TrackMouseEvent(&tme);
+		}
+		PublishView();
+	}
+
+	void dump_metrics() {
+		std::ofstream os(fs::temp_directory_path() / "imv_metrics.json");
+		metrics::registry::get_instance().dump(os);
+	}
+
 	LRESULT OnCreate(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
 		menu_.LoadMenuA(MAKEINTRESOURCE(IDR_CONTEXTMENU));
 
@@ -377,58 +1612,497 @@ public:
 		*/
 
 		CenterWindow();
+		OnImageChanged();
+		PublishView();
+
+		memory_.start([hwnd = m_hWnd](memory::pressure p) {
+			::PostMessage(hwnd, WM_MEMORY_PRESSURE, static_cast<WPARAM>(p), 0);
+		});
+
+		// an archive was indexed whole in the constructor
+		if (catalog_->archive()) {
+			StartFolderJobs();
+			return bHandled = 0;
+		}
+
+		// the folder is enumerated behind the first decode, see OnCatalog
+		catalog_pending_ = true;
+		const auto directory = catalog_->directory(0);
+		async<false>(tp::get_instance().ctx(), [hwnd = m_hWnd, directory]() {
+			auto files = std::make_unique<catalog>();
+			try {
+				*files = catalog::scan(directory);
+			} catch (std::exception&) {
+				// unreadable, the picture stays on its own
+				return;
+			}
+			if (::PostMessage(hwnd, WM_CATALOG, 0, reinterpret_cast<LPARAM>(files.get()))) files.release();
+		});
 
 		return bHandled = 0;
 	}
 
 	void rotate_clockwise() {
-		++current_image().rotation_idx;
-		current_image().load_d2d_resources(true);
+		current_image().rotate(true);
 	}
 
 	void rotate_anti_clockwise() {
-		--current_image().rotation_idx;
-		current_image().load_d2d_resources(true);
+		current_image().rotate(false);
+	}
+
+	// A slide the slideshow already loaded isn't loaded twice, nor is an
+	// image whose load is under way. Under critical memory pressure only
+	// the current and the next image load.
+	void request_load(std::int64_t idx) {
+		if (prefetched_.erase(idx)) return;
+		if (pressure_ == memory::pressure::critical && idx != entry(current_img_idx_) && idx != entry(current_img_idx_ + 1)) return;
+		auto& requested = image(idx);
+		if (requested.is_requested()) return;
+		requested.start_load();
+	}
+
+	// A load still queued for it never decodes. The live state goes once
+	// the free has run, only the rotation is kept. The free hands the image's
+	// pixels over under mutex_; a frame drawing them keeps them to its end.
+	void request_free(std::int64_t idx) {
+		prefetched_.erase(idx);
+		std::shared_ptr<Image> image;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			const auto it = images_.find(idx);
+			if (it == images_.end()) return;
+			image = std::move(it->second);
+			images_.erase(it);
+		}
+		if (const auto turns = image->rotation_idx(); turns != 0) rotations_[idx] = turns;
+		else rotations_.erase(idx);
+		image->cancel();
+		async<false>(image->strand(), [image]() { image->free_d2d_resources(); });
 	}
 
 	void next_image() {
 		auto prev = current_img_idx_ - 1;
 		++current_img_idx_;
-		image_changed_ = true;
+		OnImageChanged();
 
 		if (current_img_idx_ == prev || current_img_idx_ + 1 == prev || prev == current_img_idx_ - 1) return;
 
-		async<false>(images_[prev()].strand(), &Image::free_d2d_resources, &images_[prev()]);
-		async<false>(images_[(current_img_idx_ + 1)()].strand(), &Image::load_d2d_resources, &images_[(current_img_idx_ + 1)()], false);
+		request_free(entry(prev));
+		request_load(entry(current_img_idx_ + 1));
 	}
 
 	void prev_image() {
 		auto next = current_img_idx_ + 1;
 		--current_img_idx_;
-		image_changed_ = true;
+		OnImageChanged();
 
 		if (current_img_idx_ == next || current_img_idx_ - 1 == next || next == current_img_idx_ + 1) return;
 	
-		async<false>(images_[next()].strand(), &Image::free_d2d_resources, &images_[next()]);
-		async<false>(images_[(current_img_idx_ - 1)()].strand(), &Image::load_d2d_resources, &images_[(current_img_idx_ - 1)()], false);
+		request_free(entry(next));
+		request_load(entry(current_img_idx_ - 1));
+	}
+
+	// prev, current and next, fewer in a folder of one or two
+	std::set<std::int64_t> cached_indices() {
+		return {entry(current_img_idx_ - 1), entry(current_img_idx_), entry(current_img_idx_ + 1)};
+	}
+
+	// Moves the prev/current/next window to `idx`, keeping what overlaps.
+	// Slides loaded ahead of the old position are called off too, so a jump
+	// decodes the target and its two neighbours and nothing in between.
+	// A picture the filter leaves out turns the filter off.
+	void go_to_image(std::int64_t idx) {
+		if (idx == entry(current_img_idx_)) return;
+		if (position(idx) < 0) ClearFilters();
+		const auto old_window = cached_indices();
+		current_img_idx_.set_value(position(idx));
+		const auto new_window = cached_indices();
+		OnImageChanged();
+
+		for (auto i : old_window) {
+			if (!new_window.count(i)) request_free(i);
+		}
+		for (auto i : std::set<std::int64_t>(prefetched_)) {
+			if (!new_window.count(i)) request_free(i);
+		}
+		for (auto i : new_window) {
+			if (!old_window.count(i)) request_load(i);
+		}
+	}
+
+	// Next picture of the same near-duplicate group in this folder.
+	void next_duplicate() {
+		const auto groups = duplicates_.get();
+		const auto idx = entry(current_img_idx_);
+		if (groups && idx >= 0 && static_cast<size_t>(idx) < groups->next.size()) go_to_image(groups->next[idx]);
+	}
+
+	// Seeking lands on the picture at position `pos` in one step however far
+	// it is, the slideshow goes on from there.
+	void seek(std::int64_t pos) {
+		go_to_image(entry(pos));
+		slideshow_.deadline = std::chrono::steady_clock::now() + slideshow_.interval;
+	}
+
+	// `delta` pictures on, wrapping around like the arrow keys.
+	void seek_by(std::int64_t delta) {
+		seek((delta < 0 ? current_img_idx_ - static_cast<size_t>(-delta) : current_img_idx_ + static_cast<size_t>(delta))());
+	}
+
+	// 0 is the first picture, 100 the last.
+	void seek_percent(std::int64_t percent) {
+		seek((shown() - 1) * percent / 100);
+	}
+
+	// `G`, the number typed so far and Enter. The title bar shows it.
+	void ShowGoTo() {
+		const auto number = goto_number_ > 0 ? std::to_string(goto_number_) : std::string();
+		this->SetWindowText(("Go to " + number + " of " + std::to_string(shown())).c_str());
+	}
+
+	// Keys while a picture number is typed, false for those that end it
+	// and act as usual.
+	bool OnGoToKey(WPARAM key) {
+		const auto n = shown();
+		int digit = -1;
+		if (key >= '0' && key <= '9') digit = static_cast<int>(key - '0');
+		else if (key >= VK_NUMPAD0 && key <= VK_NUMPAD9) digit = static_cast<int>(key - VK_NUMPAD0);
+
+		if (digit >= 0) {
+			// more digits than the catalog has pictures can't name one
+			if (goto_number_ <= n) goto_number_ = goto_number_ * 10 + digit;
+		} else if (key == VK_BACK) {
+			goto_number_ /= 10;
+		} else if (key == VK_RETURN) {
+			// nothing typed stays put
+			if (goto_number_ > 0) seek(std::min(goto_number_, n) - 1);
+			goto_number_ = -1;
+			ShowTitle();
+		} else {
+			goto_number_ = -1;
+			ShowTitle();
+			return key == VK_ESCAPE || key == 'G';
+		}
+		if (goto_number_ >= 0) ShowGoTo();
+		return true;
+	}
+
+	// `/`, the name typed so far and what it keeps.
+	void ShowFind() {
+		std::string title = "Find " + name_query_;
+		if (!names_) title += "  (reading names)";
+		else title += "  [" + std::to_string(current_img_idx_() + 1) + " of " + std::to_string(shown()) + "]";
+		this->SetWindowText(title.c_str());
+	}
+
+	// Keys while a name is typed, false for those that act as usual. The
+	// characters themselves come with WM_CHAR.
+	bool OnFindKey(WPARAM key) {
+		switch (key) {
+		case VK_LEFT: case VK_RIGHT: case VK_HOME: case VK_END:
+			return false;
+		case VK_BACK:
+			if (!name_query_.empty()) SetNameQuery(name_query_.substr(0, name_query_.size() - 1));
+			break;
+		case VK_ESCAPE:
+			typing_ = false;
+			SetNameQuery({});
+			break;
+		case VK_RETURN:
+			typing_ = false;
+			break;
+		default:
+			return true;
+		}
+		ShowTitle();
+		return true;
+	}
+
+	// The window is ANSI, characters come in the code page the catalog's
+	// names are in.
+	LRESULT OnChar(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		const auto ch = static_cast<char>(wParam);
+		// control characters, and the `/` that started typing
+		if (!typing_ || static_cast<unsigned char>(ch) < ' ' || ch == '/' || ch == 0x7F) return 0;
+		SetNameQuery(name_query_ + ch);
+		PublishView();
+		return 0;
+	}
+
+	// What the filters keep, "\"dsc_48\", Canon EOS R5, 2024-05-01, portrait".
+	std::string FilterName() {
+		std::vector<std::string> parts;
+		if (!name_query_.empty()) parts.push_back("\"" + name_query_ + "\"");
+		if (const auto columns = metadata_.get()) {
+			if (filter_.camera) parts.push_back(columns->camera_name(filter_.camera));
+			if (filter_.lens) parts.push_back(columns->lens_name(filter_.lens));
+		}
+		if (filter_.day >= 0) parts.push_back(exif::day_name(filter_.day));
+		if (filter_.shape != exif::shape::any) parts.push_back(filter_.shape == exif::shape::portrait ? "portrait" : "landscape");
+		std::string name;
+		for (auto& part : parts) name += (name.empty() ? "" : ", ") + part;
+		return name;
+	}
+
+	// Navigation, prefetch and the scrub bar go through the pictures
+	// `selection` holds from now on. The picture on screen stays when it's
+	// in it, the next one that is takes its place otherwise.
+	void SetSelection(std::shared_ptr<const entry_set> selection) {
+		EndScrub(false);
+		const auto current = entry(current_img_idx_);
+		const auto old_window = cached_indices();
+		std::int64_t pos = current;
+		if (selection) {
+			const auto below = selection->rank(static_cast<size_t>(current));
+			pos = below == selection->size() ? 0 : static_cast<std::int64_t>(below);
+		}
+		bool moved = false;
+		{
+			// between frames, positions are mapped while drawing; the view
+			// they map is published before a frame can see the new selection
+			std::lock_guard<std::mutex> lk(render_mutex_);
+			selection_ = std::move(selection);
+			current_img_idx_ = CirculalInterval<std::int64_t>(0, shown() - 1, 1);
+			current_img_idx_.set_value(pos);
+			moved = entry(current_img_idx_) != current;
+			PublishView();
+		}
+		// the title and the load are window work, no frame waits for them
+		if (moved) {
+			OnImageChanged();
+			PublishView();
+		} else {
+			ShowTitle();
+		}
+		const auto new_window = cached_indices();
+		for (auto i : old_window) {
+			if (!new_window.count(i)) request_free(i);
+		}
+		for (auto i : std::set<std::int64_t>(prefetched_)) {
+			if (!new_window.count(i)) request_free(i);
+		}
+		for (auto i : new_window) {
+			if (!old_window.count(i)) request_load(i);
+		}
+	}
+
+	// The pictures both `a` and `b` keep, null ones keep everything.
+	static std::shared_ptr<const entry_set> Intersect(std::shared_ptr<const entry_set> a, std::shared_ptr<const entry_set> b) {
+		if (!a || !b) return a ? a : b;
+		return std::make_shared<const entry_set>(*a & *b);
+	}
+
+	// An empty filter keeps the whole catalog; one nothing passes is refused.
+	void SetFilter(const exif::filter& f) {
+		std::shared_ptr<const entry_set> kept;
+		if (!f.empty()) {
+			const auto columns = metadata_.get();
+			if (!columns || columns->size() != catalog_->size()) return;
+			const auto selected = columns->select(f);
+			kept = std::make_shared<const entry_set>(entry_set::of(catalog_->size(), selected.begin(), selected.end()));
+		}
+		auto selection = Intersect(kept, name_search_.find(name_query_));
+		if (selection && selection->empty()) {
+			this->SetWindowText("No picture matches");
+			return;
+		}
+		filter_ = f;
+		exif_kept_ = std::move(kept);
+		SetSelection(std::move(selection));
+	}
+
+	// The pictures whose name has `query` as far as it's typed. One nothing
+	// matches is refused, the characters after it can't match either.
+	bool SetNameQuery(std::string query) {
+		auto selection = Intersect(exif_kept_, name_search_.find(query));
+		if (selection && selection->empty()) {
+			this->SetWindowText(("Find " + query + ": no match").c_str());
+			return false;
+		}
+		name_query_ = std::move(query);
+		SetSelection(std::move(selection));
+		return true;
+	}
+
+	// Both filters off, the whole catalog again.
+	void ClearFilters() {
+		typing_ = false;
+		name_query_.clear();
+		SetFilter({});
+	}
+
+	// `C`, `L` and `Y` keep the pictures with this one's camera, lens or day
+	// and stop doing so when pressed again; `O` goes through landscape,
+	// portrait and both.
+	void ToggleFilter(WPARAM key) {
+		const auto columns = metadata_.get();
+		if (!columns || columns->size() != catalog_->size()) {
+			this->SetWindowText(catalog_->archive() ? "No EXIF filters in archives"
+				: ("Reading EXIF " + std::to_string(metadata_.indexed()) + " of " + std::to_string(metadata_.to_index())).c_str());
+			return;
+		}
+		const auto idx = static_cast<size_t>(entry(current_img_idx_));
+		auto f = filter_;
+		switch (key) {
+		case 'C': f.camera = f.camera ? 0 : columns->camera(idx); break;
+		case 'L': f.lens = f.lens ? 0 : columns->lens(idx); break;
+		case 'Y': f.day = f.day >= 0 ? -1 : columns->day(idx); break;
+		case 'O':
+			f.shape = f.shape == exif::shape::any ? exif::shape::landscape
+				: f.shape == exif::shape::landscape ? exif::shape::portrait : exif::shape::any;
+			break;
+		}
+		SetFilter(f);
+	}
+
+	// Maps the decoded high bit depth images again, no decode needed.
+	void set_tone(const hdr::tone& tone) {
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			tone_ = tone;
+		}
+		update_cached(std::mem_fn(&Image::retone));
+	}
+
+	void adjust_exposure(float ev) {
+		auto tone = tone_;
+		tone.exposure_ev = ev == 0.0f ? 0.0f : std::clamp(tone.exposure_ev + ev, -8.0f, 8.0f);
+		set_tone(tone);
+	}
+
+	void toggle_slideshow() {
+		slideshow_.active = !slideshow_.active;
+		if (slideshow_.active) {
+			slideshow_.deadline = std::chrono::steady_clock::now() + slideshow_.interval;
+			slideshow_.late = false;
+			SetTimer(slideshow_timer, slideshow_tick_ms);
+		} else {
+			KillTimer(slideshow_timer);
+			while (!prefetched_.empty()) request_free(*prefetched_.begin());
+		}
+	}
+
+	// Earliest deadline first: slide k is due (k - 1) intervals after the next
+	// deadline and has to wait for every unfinished slide before it, spread
+	// over the pool. Loads start when that, with some slack, reaches the deadline.
+	void SchedulePrefetch(std::chrono::steady_clock::time_point now) {
+		using namespace std::chrono;
+		constexpr double slack = 1.5;
+		const auto n = shown();
+		const auto ahead = std::min(slideshow_max_ahead, n - 2);
+
+		double backlog_ms = 0.0;
+		for (std::int64_t k = 1; k <= ahead; ++k) {
+			const auto idx = entry(current_img_idx_ + k);
+			const auto live = images_.find(idx);
+			if (live != images_.end() && live->second->is_ready()) continue;
+			backlog_ms += decode_estimator_.estimate_ms(catalog_->format(idx), catalog_->file_bytes(idx));
+
+			// +1 is always loading already
+			if (k == 1 || prefetched_.count(idx)) continue;
+			const auto due = slideshow_.deadline + slideshow_.interval * (k - 1);
+			const auto lead = duration<double, std::milli>(backlog_ms * slack / tp::number_of_threads());
+			if (now + duration_cast<steady_clock::duration>(lead) < due) continue;
+			// nothing is prefetched under memory pressure
+			if (pressure_ != memory::pressure::none) break;
+			prefetched_.insert(idx);
+			image(idx).start_load();
+		}
+	}
+
+	void SlideshowTick() {
+		using namespace std::chrono;
+		const auto now = steady_clock::now();
+		SchedulePrefetch(now);
+		if (now < slideshow_.deadline) return;
+
+		// hold the current slide rather than show a grey frame
+		const auto next = images_.find(entry(current_img_idx_ + 1));
+		if (next == images_.end() || !next->second->is_ready()) {
+			if (!slideshow_.late) metrics_.slides_missed.add();
+			slideshow_.late = true;
+			return;
+		}
+		if (slideshow_.late) metrics_.slide_late.record(duration<double, std::milli>(now - slideshow_.deadline).count());
+
+		next_image();
+		metrics_.slides_shown.add();
+		slideshow_.late = false;
+		slideshow_.deadline = now + slideshow_.interval;
+		PublishView();
+	}
+
+	LRESULT OnTimer(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		if (wParam != slideshow_timer) {
+			bHandled = FALSE;
+			return 0;
+		}
+		if (slideshow_.active) SlideshowTick();
+		return 0;
+	}
+
+	// First press starts recording, the second one writes %TEMP%\imv_trace.json
+	// which can be opened in chrome://tracing or ui.perfetto.dev.
+	void toggle_tracing() {
+		auto& tracer = trace::tracer::get_instance();
+		if (!tracer.enabled()) {
+			tracer.name_thread("ui");
+			tracer.enable(true);
+			return;
+		}
+		tracer.enable(false);
+		std::ofstream os(fs::temp_directory_path() / "imv_trace.json");
+		tracer.dump(os);
 	}
 
 	LRESULT OnKeyDown(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		if (scrubbing_ && wParam == VK_ESCAPE) {
+			EndScrub(false);
+			return 0;
+		}
+		if (goto_number_ >= 0 && OnGoToKey(wParam)) {
+			PublishView();
+			return 0;
+		}
+		if (typing_ && OnFindKey(wParam)) {
+			PublishView();
+			return 0;
+		}
+		// arrows with Ctrl move 10 pictures, with Shift 100
+		const std::int64_t stride = ::GetKeyState(VK_SHIFT) < 0 ? 100 : ::GetKeyState(VK_CONTROL) < 0 ? 10 : 1;
+
 		switch (wParam) {
 		case VK_UP:
-			scale_idx_.set_value(0);
+			zoom_ = 1.0f;
 			matrix_ = D2D1::Matrix3x2F::Identity();
-			m_d2dContext->SetTransform(matrix_);
+			animate_ = true;
 			break;
 		case VK_DOWN:
 			fit_to_window_ = !fit_to_window_;
-			load_dd();
 			break;
 		case VK_LEFT:
-			prev_image();
+			if (stride == 1) prev_image();
+			else seek_by(-stride);
+			slideshow_.deadline = std::chrono::steady_clock::now() + slideshow_.interval;
 			break;
 		case VK_RIGHT:
-			next_image();
+			if (stride == 1) next_image();
+			else seek_by(stride);
+			slideshow_.deadline = std::chrono::steady_clock::now() + slideshow_.interval;
+			break;
+		case VK_HOME:
+			seek(0);
+			break;
+		case VK_END:
+			seek(shown() - 1);
+			break;
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			seek_percent(static_cast<std::int64_t>(wParam - '0') * 10);
+			break;
+		case 'G':
+			goto_number_ = 0;
+			ShowGoTo();
 			break;
 		case VK_NEXT:
 			rotate_clockwise();
@@ -439,44 +2113,87 @@ public:
 		case VK_ESCAPE:
 			PostMessage(WM_QUIT);
 			break;
+		case 'T':
+			toggle_tracing();
+			break;
+		case 'H':
+			show_hud_ = !show_hud_;
+			break;
+		case 'M':
+			dump_metrics();
+			break;
+		case 'S':
+			toggle_slideshow();
+			break;
+		case 'I':
+			show_histogram_ = !show_histogram_;
+			break;
+		case 'C': case 'L': case 'Y': case 'O':
+			ToggleFilter(wParam);
+			break;
+		case 'X':
+			ClearFilters();
+			break;
+		case VK_OEM_2: // /
+			typing_ = true;
+			ShowTitle();
+			break;
+		case 'D':
+			next_duplicate();
+			slideshow_.deadline = std::chrono::steady_clock::now() + slideshow_.interval;
+			break;
+		case VK_OEM_4: // [
+			adjust_exposure(-1.0f / 3.0f);
+			break;
+		case VK_OEM_6: // ]
+			adjust_exposure(1.0f / 3.0f);
+			break;
+		case VK_OEM_5: // back to 0 EV
+			adjust_exposure(0.0f);
+			break;
+		case 'R': {
+			auto tone = tone_;
+			tone.reinhard = !tone.reinhard;
+			set_tone(tone);
+			break;
+		}
+		case VK_OEM_PLUS:
+		case VK_ADD:
+			slideshow_.interval = std::min(slideshow_.interval + std::chrono::seconds(1), std::chrono::milliseconds(60000));
+			break;
+		case VK_OEM_MINUS:
+		case VK_SUBTRACT:
+			slideshow_.interval = std::max(slideshow_.interval - std::chrono::seconds(1), std::chrono::milliseconds(1000));
+			break;
 		default:
 			return 0;
 			break;
 		}
 
-		Invalidate();
+		PublishView();
 
 		return 0;
 	}
 
 	LRESULT OnMouseWheel(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
-		short zDelta = GET_WHEEL_DELTA_WPARAM(wParam);
-
-		if (zDelta > 0) {
-			++scale_idx_;
-		} else {
-			--scale_idx_;
-		}
-
-		if (scale_idx_() != 0) {
-			auto const scale = scale_table[scale_idx_()];
+		const float notches = static_cast<float>(GET_WHEEL_DELTA_WPARAM(wParam)) / WHEEL_DELTA;
+		const float zoom = std::clamp(zoom_ * std::pow(zoom_step, notches), 1.0f, max_zoom);
+		if (zoom == zoom_) return 0;
 
-			auto center = GetCenterPosition();
-			auto screen_center = GetCenterPositionScreen();
+		// the image point under the cursor stays under it
+		CPoint cursor(lParam);
+		ScreenToClient(&cursor);
 
-			auto pt = center * scale;
-			matrix_ = D2D1::Matrix3x2F
-			{
-				scale, 0,
-				0, scale,
-				-(pt.x - screen_center.x), -(pt.y - screen_center.y)
-			};
-		} else {
+		if (zoom == 1.0f) {
 			matrix_ = D2D1::Matrix3x2F::Identity();
+		} else {
+			const float ratio = zoom / zoom_;
+			matrix_ = matrix_ * D2D1::Matrix3x2F::Scale(ratio, ratio, D2D1::Point2F(static_cast<float>(cursor.x), static_cast<float>(cursor.y)));
 		}
+		zoom_ = zoom;
+		animate_ = true;
 
-		m_d2dContext->SetTransform(matrix_);
-		Invalidate();
+		PublishView();
 		return 0;
 	}
 
@@ -488,7 +2205,13 @@ public:
 	}
 
 	LRESULT OnLButtonDown(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
-		if (scale_idx_() == 0) return 0;
+		if (scrub_hover_) {
+			scrubbing_ = true;
+			SetCapture();
+			Scrub(CPoint(lParam));
+			return 0;
+		}
+		if (zoom_ == 1.0f) return 0;
 
 		drag_old_point_ = CPoint(lParam);
 		SetCursor(cursor_sizeall_);
@@ -497,10 +2220,15 @@ public:
 	}
 
 	LRESULT OnMouseMove(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
-		if (scale_idx_() == 0) return 0;
+		CPoint point(lParam);
+		if (scrubbing_) {
+			Scrub(point);
+			return 0;
+		}
+		UpdateScrubHover(point);
+		if (zoom_ == 1.0f) return 0;
 
 		UINT flags = static_cast<UINT>(wParam);
-		CPoint point(lParam);
 
 		if (flags & MK_LBUTTON) {
 			if (drag_old_point_ == static_cast<POINT>(point)) return 0;
@@ -510,84 +2238,302 @@ public:
 
 			drag_old_point_ = point;
 
-			m_d2dContext->SetTransform(matrix_);
-			Invalidate();
+			// coalesced with whatever else arrives before the next vblank
+			PublishView();
 		}
 
 		return 0;
 	}
 
 	LRESULT OnLButtonUp(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
-		if (scale_idx_() == 0) return 0;
+		if (scrubbing_) {
+			EndScrub(true);
+			return 0;
+		}
+		if (zoom_ == 1.0f) return 0;
 
 		ReleaseCapture();
 		SetCursor(cursor_arrow_);
 		return 0;
 	}
 
-	void OnBoundsChanged() {
-		load_dd(false);
+	LRESULT OnMouseLeave(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		if (scrub_hover_ && !scrubbing_) {
+			scrub_hover_ = false;
+			PublishView();
+		}
+		return 0;
 	}
 
-	template<typename Func, typename... Args> 
-	void update_cached(Func&& fn, Args&&... args) {
-		auto prev = current_img_idx_ - 1;
-		auto next = current_img_idx_ + 1;
+	// Another window took the mouse mid-drag, the scrub is dropped.
+	LRESULT OnCaptureChanged(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		EndScrub(false);
+		return 0;
+	}
 
-		if (next != prev) { // more than 3
-			async<false>(images_[prev()].strand(), fn, &images_[prev()], std::forward<Args>(args)...);
-			async<false>(images_[current_img_idx_()].strand(), fn, &images_[current_img_idx_()], std::forward<Args>(args)...);
-			async<false>(images_[next()].strand(), fn, &images_[next()], std::forward<Args>(args)...);
-		} else if (current_img_idx_ != next) { // 2 images
-			async<false>(images_[current_img_idx_()].strand(), fn, &images_[current_img_idx_()], std::forward<Args>(args)...);
-			async<false>(images_[next()].strand(), fn, &images_[next()], std::forward<Args>(args)...);
-		} else { // 1 image
-			std::invoke(fn, &images_[current_img_idx_()], std::forward<Args>(args)...);
-		}
+	// Loads that got to their upload before the device did go on.
+	void OnResourcesCreated() {
+		device_ready_.set();
 	}
 
-	void load_di() {
-		update_cached(std::mem_fn(&Image::load_di));
+	// UI thread, once the new device is up. The decoded pixels outlived the
+	// old one, only the bitmaps are made again, each on its image's strand.
+	void OnDeviceRestored() {
+		update_cached(std::mem_fn(&Image::reupload));
 	}
 
-	void load_dd(bool recreate_bitmap = false) {
-		update_cached(std::mem_fn(&Image::load_dd), recreate_bitmap);
+	// `fn` on the strand of every live image: prev, current, next and the
+	// slides loaded ahead.
+	template<typename Func>
+	void update_cached(Func fn) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		for (auto& [idx, image] : images_) {
+			async<false>(image->strand(), [image = image, fn]() { fn(*image); });
+		}
 	}
 
-	ImvWindow(const fs::path image_path) {
+	// The pictures next to `image_path` into `pictures`, and its index among
+	// them, -1 if it isn't one. The pictures of an archive are its catalog,
+	// the first one is shown.
+	static std::int64_t LoadFolder(const fs::path& image_path, std::shared_ptr<const catalog>& pictures) {
+		if (zip::is_archive(image_path)) {
+			const auto archive = zip::archive::open(image_path);
+			if (!archive || archive->entries().empty()) return -1;
+			pictures = std::make_shared<const catalog>(zip::make_catalog(archive));
+			return 0;
+		}
 		auto directory = image_path;
 		directory.remove_filename();
+		pictures = std::make_shared<const catalog>(catalog::scan(directory));
+		return pictures->find(image_path);
+	}
+
+	// The names for type-to-filter, off the UI thread: a million take a
+	// few hundred milliseconds.
+	void IndexNames() {
+		async<false>(tp::get_instance().ctx(), [hwnd = m_hWnd, pictures = catalog_]() {
+			auto index = std::make_unique<names::index>(pictures);
+			if (::PostMessage(hwnd, WM_NAMES, 0, reinterpret_cast<LPARAM>(index.get()))) index.release();
+		});
+	}
+
+	// The names are indexed for any catalog, the rest not over an archive,
+	// its members aren't files to stat.
+	void StartFolderJobs() {
+		IndexNames();
+		if (catalog_->archive()) return;
+		duplicates_.start(catalog_);
+		metadata_.start(catalog_);
+	}
 
-		std::set<fs::path> files;
-		for (auto& it : fs::directory_iterator(directory)) {
-			if (!it.is_regular_file()) continue;
-			const auto& path = it.path();
-			if (path.has_extension()) {
-				auto ext = path.extension().string();
-				std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
-				if (test_format(ext)) files.emplace(path);
+	// A later launch handed `image_path` over. In this folder it's a jump,
+	// another folder replaces the catalog; what is still queued for the old
+	// one holds its images until it has run. The device, the pool, the pixel
+	// arena and the colour LUTs stay.
+	void OpenPath(const fs::path& image_path) {
+		const auto start = std::chrono::steady_clock::now();
+		metrics_.handoffs.add();
+		if (IsIconic()) ShowWindow(SW_RESTORE);
+		SetForegroundWindow(m_hWnd);
+
+		if (const auto same = catalog_->find(image_path); same != -1) {
+			go_to_image(same);
+			PublishView();
+		} else {
+			std::shared_ptr<const catalog> pictures;
+			const auto img_idx = LoadFolder(image_path, pictures);
+			if (img_idx == -1) return;
+
+			if (slideshow_.active) toggle_slideshow();
+			EndScrub(false);
+			duplicates_.stop();
+			catalog_pending_ = false;
+			// what hasn't decoded yet never will
+			std::vector<std::int64_t> live;
+			for (auto& [idx, image] : images_) live.push_back(idx);
+			for (auto idx : live) request_free(idx);
+			{
+				// between frames, and the view published before the lock is
+				// released never indexes past the new catalog
+				std::lock_guard<std::mutex> lk(render_mutex_);
+				rotations_.clear();
+				filter_ = {};
+				selection_.reset();
+				exif_kept_.reset();
+				names_.reset();
+				name_search_ = {};
+				name_query_.clear();
+				typing_ = false;
+				catalog_ = std::move(pictures);
+				ResetPreviews();
+				current_img_idx_ = CirculalInterval<std::int64_t>(0, catalog_->size() - 1, 1);
+				current_img_idx_.set_value(img_idx);
+				zoom_ = 1.0f;
+				matrix_ = D2D1::Matrix3x2F::Identity();
+				shown_image_ = -1;
+				PublishView();
 			}
+			// outside the lock, as in SetSelection; this view has the request time
+			OnImageChanged();
+			PublishView();
+			for (auto idx : cached_indices()) request_load(idx);
+			StartFolderJobs();
 		}
-		
-		images_.reserve(files.size());
-		
-		int64_t img_idx = -1;
+		metrics_.switch_ms.set(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// Sheds what is cheapest to get back first and loads it again once the
+	// pressure is over. The current picture is never touched.
+	LRESULT OnMemoryPressure(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		const auto old = pressure_;
+		pressure_ = static_cast<memory::pressure>(wParam);
+		if (pressure_ == memory::pressure::none) {
+			for (auto idx : cached_indices()) request_load(idx);
+			return 0;
+		}
+		const auto current = entry(current_img_idx_), next = entry(current_img_idx_ + 1);
+		std::set<std::int64_t> shed;
+		if (pressure_ == memory::pressure::critical && old != memory::pressure::critical) {
+			for (auto idx : cached_indices()) {
+				if (idx != current && idx != next) shed.insert(idx);
+			}
+			shed.insert(prefetched_.begin(), prefetched_.end());
+			shed.erase(current);
+			shed.erase(next);
+		}
+		for (auto idx : shed) {
+			const auto image = find_image(idx);
+			if (!image) continue;
+			request_free(idx);
+			// after the free, which hands the pixels to the pool
+			async<false>(image->strand(), []() { pixel_arena::get_instance().trim(); });
+		}
+		metrics_.shed_images.add(shed.size());
+		pixel_arena::get_instance().trim();
+		for (auto idx : cached_indices()) {
+			if (idx == current || shed.count(idx)) continue;
+			if (const auto image = find_image(idx)) async<false>(image->strand(), [image]() { image->drop_levels(); });
+		}
+		return 0;
+	}
 
-		for (auto& path : files) {
-			images_.emplace_back(*this, path.string());
-			if (img_idx == -1 && image_path == path) {
-				img_idx = images_.size() - 1;
+	// The opened picture's folder, enumerated on the pool while the picture
+	// decoded. It becomes the catalog, the opened picture moves to its place
+	// in it and isn't reloaded, unless it was freed before the folder came.
+	LRESULT OnCatalog(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		std::unique_ptr<catalog> files(reinterpret_cast<catalog*>(lParam));
+		// a handoff replaced the catalog in the meantime
+		if (!catalog_pending_) return 0;
+		catalog_pending_ = false;
+		startup_timeline::get_instance().mark(startup::stage::catalog);
+
+		const auto idx = files->find(catalog_->path(0));
+		// not a picture by its extension, it stays on its own
+		if (idx == -1) return 0;
+		const auto n = static_cast<std::int64_t>(files->size());
+		bool kept = false;
+		{
+			// a frame may be half drawn from entry 0
+			std::lock_guard<std::mutex> lk(render_mutex_);
+			{
+				std::lock_guard<std::mutex> images_lk(mutex_);
+				if (auto it = images_.find(0); it != images_.end()) {
+					auto opened = std::move(it->second);
+					images_.erase(it);
+					opened->set_index(idx);
+					images_.emplace(idx, std::move(opened));
+					kept = true;
+				}
+			}
+			// a freed picture left only its rotation behind
+			if (auto it = rotations_.find(0); it != rotations_.end() && idx != 0) {
+				const auto turns = it->second;
+				rotations_.erase(it);
+				rotations_[idx] = turns;
 			}
+			// it meant the opened picture, not the folder's first
+			prefetched_.erase(0);
+			catalog_ = std::shared_ptr<const catalog>(std::move(files));
+			ResetPreviews();
+			current_img_idx_ = CirculalInterval<std::int64_t>(0, n - 1, 1);
+			current_img_idx_.set_value(idx);
+			shown_image_ = idx;
+			PublishView();
 		}
+		if (!kept) request_load(idx);
+		const auto prev = (current_img_idx_ - 1)(), next = (current_img_idx_ + 1)();
+		if (prev != idx) request_load(prev);
+		if (next != idx && next != prev) request_load(next);
+		StartFolderJobs();
+		return 0;
+	}
 
-		if (img_idx == -1) throw;
+	// The typed name, if any, narrows the selection from now on.
+	LRESULT OnNames(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		std::shared_ptr<const names::index> index(reinterpret_cast<names::index*>(lParam));
+		// built for a catalog since replaced
+		if (index->pictures() != catalog_) return 0;
+		names_ = std::move(index);
+		name_search_ = names::search(names_);
+		if (!name_query_.empty()) SetNameQuery(name_query_);
+		else if (typing_) ShowTitle();
+		return 0;
+	}
+
+	// Any thread hands paths over through it, see WM_OPEN_PATH.
+	std::shared_ptr<single_instance::mailbox> mailbox() const { return mailbox_; }
+
+	LRESULT OnOpenPath(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		const auto path = mailbox_->take();
+		if (!path) return 0;
+		try {
+			OpenPath(*path);
+		} catch (std::exception&) {
+			// a folder we can't read leaves the current one up
+		}
+		return 0;
+	}
+
+	// Paths handed over from now on are turned down, the ones whose message
+	// the window won't see are dropped. The base class ends the loop.
+	LRESULT OnDestroy(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled) {
+		mailbox_->close();
+		bHandled = FALSE;
+		return 0;
+	}
 
-		current_img_idx_ = CirculalInterval<std::int64_t>(0, images_.size() - 1, 1);
-		current_img_idx_.set_value(img_idx);
+	static color::profile DisplayProfile() {
+		wchar_t path[MAX_PATH];
+		DWORD size = MAX_PATH;
+		HDC dc = ::GetDC(nullptr);
+		const BOOL found = ::GetICMProfileW(dc, &size, path);
+		::ReleaseDC(nullptr, dc);
+
+		color::profile profile;
+		if (found) {
+			const auto bytes = read_file(path);
+			if (bytes && color::parse_icc(bytes.data(), bytes.size(), profile)) return profile;
+		}
+		return color::profile::srgb();
+	}
+
+	ImvWindow(const fs::path image_path) {
+		// before the first decode is queued
+		display_profile_ = DisplayProfile();
+
+		// the opened picture alone until its folder arrives (OnCatalog), it
+		// starts decoding right away; an archive's index is read here
+		if (!zip::is_archive(image_path)) {
+			catalog_ = std::make_shared<const catalog>(catalog::of_file(image_path));
+		} else if (LoadFolder(image_path, catalog_) == -1) {
+			throw std::runtime_error("No pictures in " + image_path.string());
+		}
+		current_img_idx_ = CirculalInterval<std::int64_t>(0, catalog_->size() - 1, 1);
+		ResetPreviews();
 
 		cursor_arrow_.LoadSysCursor(IDC_ARROW);
 		cursor_sizeall_.LoadSysCursor(IDC_SIZEALL);
 
-		load_di();
+		image(0).start_load();
 	}
 };
\ No newline at end of file
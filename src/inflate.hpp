@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Portable DEFLATE decoder (RFC 1951) and the zlib wrapper around it
+// (RFC 1950), for PNG image data and ZIP entries.
+namespace inflate {
+
+namespace detail {
+
+// LSB-first, the way DEFLATE packs its bits. Past the end it reads zeros
+// and remembers, a stream that needed them is truncated.
+class bit_reader {
+	const std::uint8_t* p_;
+	const std::uint8_t* end_;
+	const std::uint8_t* begin_;
+	std::uint64_t bits_ = 0;
+	int count_ = 0;
+	size_t overrun_ = 0;
+public:
+	bit_reader(const std::uint8_t* data, size_t size) noexcept : p_{data}, end_{data + size}, begin_{data} {}
+
+	void refill() noexcept {
+		while (count_ <= 56) {
+			std::uint64_t byte = 0;
+			if (p_ < end_) byte = *p_++;
+			else ++overrun_;
+			bits_ |= byte << count_;
+			count_ += 8;
+		}
+	}
+
+	std::uint32_t peek(int n) noexcept {
+		if (count_ < n) refill();
+		return static_cast<std::uint32_t>(bits_ & ((std::uint64_t(1) << n) - 1));
+	}
+
+	void drop(int n) noexcept {
+		bits_ >>= n;
+		count_ -= n;
+	}
+
+	std::uint32_t get(int n) noexcept {
+		if (n == 0) return 0;
+		const auto v = peek(n);
+		drop(n);
+		return v;
+	}
+
+	// to the next byte boundary, for stored blocks
+	void align() noexcept { drop(count_ & 7); }
+
+	// Bytes handed out to the caller, unread buffered ones given back.
+	const std::uint8_t* position() const noexcept { return p_ - (count_ / 8 - static_cast<int>(overrun_)); }
+	size_t consumed() const noexcept { return static_cast<size_t>(position() - begin_); }
+	bool overrun() const noexcept { return static_cast<std::int64_t>(overrun_) * 8 > count_; }
+	bool at_least(size_t bytes) const noexcept { return position() + bytes <= end_; }
+};
+
+// Canonical Huffman code. Codes up to fast_bits long decode with one table
+// lookup, longer ones walk the code lengths.
+class huffman {
+	static constexpr int fast_bits = 10;
+	std::array<std::uint16_t, 1 << fast_bits> fast_{}; // symbol << 4 | length, 0 when longer
+	std::array<std::uint16_t, 16> count_{};
+	std::array<std::uint16_t, 288> symbol_{};
+public:
+	// False when the lengths over-subscribe the code space; incomplete
+	// codes are allowed (a distance code with a single symbol is legal).
+	bool build(const std::uint8_t* lengths, int n) noexcept {
+		count_.fill(0);
+		fast_.fill(0);
+		for (int i = 0; i < n; ++i) ++count_[lengths[i]];
+		count_[0] = 0;
+
+		int left = 1;
+		for (int len = 1; len < 16; ++len) {
+			left = (left << 1) - count_[len];
+			if (left < 0) return false;
+		}
+
+		std::array<std::uint16_t, 16> offset{};
+		for (int len = 1; len < 15; ++len) offset[len + 1] = offset[len] + count_[len];
+		for (int i = 0; i < n; ++i) {
+			if (lengths[i]) symbol_[offset[lengths[i]]++] = static_cast<std::uint16_t>(i);
+		}
+
+		// the table is indexed by the stream bits, which hold codes reversed
+		std::uint32_t code = 0;
+		int index = 0;
+		for (int len = 1; len <= fast_bits; ++len) {
+			for (int k = 0; k < count_[len]; ++k, ++code, ++index) {
+				std::uint32_t reversed = 0;
+				for (int b = 0; b < len; ++b) reversed |= ((code >> b) & 1) << (len - 1 - b);
+				for (std::uint32_t fill = reversed; fill < fast_.size(); fill += 1u << len) {
+					fast_[fill] = static_cast<std::uint16_t>(symbol_[index] << 4 | len);
+				}
+			}
+			code <<= 1;
+		}
+		return true;
+	}
+
+	// -1 on a code that isn't in the table
+	int decode(bit_reader& in) const noexcept {
+		const auto e = fast_[in.peek(fast_bits)];
+		if (e) {
+			in.drop(e & 15);
+			return e >> 4;
+		}
+		int code = 0, first = 0, index = 0;
+		for (int len = 1; len < 16; ++len) {
+			code |= static_cast<int>(in.get(1));
+			const int count = count_[len];
+			if (code - count < first) return symbol_[index + (code - first)];
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+};
+
+constexpr std::uint16_t length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::uint16_t distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::uint8_t distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// `out` is grown ahead in steps and trimmed to what was written on return.
+template<typename Output>
+bool codes(bit_reader& in, Output& out, const huffman& lit, const huffman& dist, size_t max_size) {
+	size_t n = out.size();
+	auto grow = [&](size_t need) {
+		if (n + need > out.size()) out.resize(std::min(max_size, std::max(n + need, out.size() * 2 + 4096)));
+	};
+	auto done = [&](bool ok) {
+		out.resize(n);
+		return ok;
+	};
+	for (;;) {
+		const int sym = lit.decode(in);
+		if (sym < 0) return done(false);
+		if (sym < 256) {
+			if (n >= max_size) return done(false);
+			grow(1);
+			out[n++] = static_cast<std::uint8_t>(sym);
+			continue;
+		}
+		if (sym == 256) return done(!in.overrun());
+		if (sym > 285) return done(false);
+
+		const size_t length = length_base[sym - 257] + in.get(length_extra[sym - 257]);
+		const int d = dist.decode(in);
+		if (d < 0 || d > 29) return done(false);
+		const size_t distance = distance_base[d] + in.get(distance_extra[d]);
+		if (distance > n || n + length > max_size || in.overrun()) return done(false);
+
+		// overlapping copies repeat the last `distance` bytes
+		grow(length);
+		auto* o = out.data() + n;
+		const auto* s = o - distance;
+		for (size_t i = 0; i < length; ++i) o[i] = s[i];
+		n += length;
+	}
+}
+
+template<typename Output>
+bool fixed_block(bit_reader& in, Output& out, size_t max_size) {
+	static const auto tables = []() {
+		std::pair<huffman, huffman> t;
+		std::uint8_t lengths[288];
+		for (int i = 0; i < 144; ++i) lengths[i] = 8;
+		for (int i = 144; i < 256; ++i) lengths[i] = 9;
+		for (int i = 256; i < 280; ++i) lengths[i] = 7;
+		for (int i = 280; i < 288; ++i) lengths[i] = 8;
+		t.first.build(lengths, 288);
+		for (int i = 0; i < 30; ++i) lengths[i] = 5;
+		t.second.build(lengths, 30);
+		return t;
+	}();
+	return codes(in, out, tables.first, tables.second, max_size);
+}
+
+template<typename Output>
+bool dynamic_block(bit_reader& in, Output& out, size_t max_size) {
+	constexpr std::uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+	const int n_lit = static_cast<int>(in.get(5)) + 257;
+	const int n_dist = static_cast<int>(in.get(5)) + 1;
+	const int n_len = static_cast<int>(in.get(4)) + 4;
+	if (n_lit > 286 || n_dist > 30) return false;
+
+	std::uint8_t lengths[286 + 30] = {};
+	for (int i = 0; i < n_len; ++i) lengths[order[i]] = static_cast<std::uint8_t>(in.get(3));
+	huffman len_code;
+	if (!len_code.build(lengths, 19)) return false;
+
+	std::fill(std::begin(lengths), std::end(lengths), std::uint8_t(0));
+	for (int i = 0; i < n_lit + n_dist;) {
+		const int sym = len_code.decode(in);
+		if (sym < 0) return false;
+		if (sym < 16) {
+			lengths[i++] = static_cast<std::uint8_t>(sym);
+			continue;
+		}
+		std::uint8_t value = 0;
+		int repeat;
+		if (sym == 16) {
+			if (i == 0) return false;
+			value = lengths[i - 1];
+			repeat = 3 + static_cast<int>(in.get(2));
+		} else if (sym == 17) {
+			repeat = 3 + static_cast<int>(in.get(3));
+		} else {
+			repeat = 11 + static_cast<int>(in.get(7));
+		}
+		if (i + repeat > n_lit + n_dist) return false;
+		while (repeat--) lengths[i++] = value;
+	}
+	if (lengths[256] == 0 || in.overrun()) return false;
+
+	huffman lit, dist;
+	if (!lit.build(lengths, n_lit) || !dist.build(lengths + n_lit, n_dist)) return false;
+	return codes(in, out, lit, dist, max_size);
+}
+
+} // namespace detail
+
+// Output of a known size, a ZIP entry's say: raw() inflates straight into
+// the caller's memory and stops at its end.
+class span_output {
+	std::uint8_t* data_;
+	size_t capacity_;
+	size_t size_ = 0;
+public:
+	span_output(std::uint8_t* data, size_t capacity) noexcept : data_{data}, capacity_{capacity} {}
+
+	std::uint8_t* data() const noexcept { return data_; }
+	size_t size() const noexcept { return size_; }
+	size_t capacity() const noexcept { return capacity_; }
+	void resize(size_t n) noexcept { size_ = std::min(n, capacity_); }
+	std::uint8_t& operator[](size_t i) noexcept { return data_[i]; }
+	void push_back(std::uint8_t b) noexcept {
+		if (size_ < capacity_) data_[size_++] = b;
+	}
+};
+
+// Appends the raw DEFLATE stream at `data` to `out`, never growing it past
+// `max_size`. `consumed` gets the compressed size. False on a corrupt or
+// truncated stream. `out` is a std::vector<std::uint8_t> or a span_output.
+template<typename Output>
+bool raw(const std::uint8_t* data, size_t size, Output& out,
+	size_t max_size = size_t(1) << 31, size_t* consumed = nullptr)
+{
+	detail::bit_reader in(data, size);
+	for (bool last = false; !last;) {
+		last = in.get(1) != 0;
+		const auto type = in.get(2);
+		bool ok;
+		if (type == 0) {
+			in.align();
+			const auto len = in.get(16), nlen = in.get(16);
+			if ((len ^ 0xFFFF) != nlen || out.size() + len > max_size) return false;
+			// what's left in the bit buffer is whole bytes of the block
+			for (std::uint32_t i = 0; i < len; ++i) out.push_back(static_cast<std::uint8_t>(in.get(8)));
+			ok = !in.overrun();
+		} else if (type == 1) {
+			ok = detail::fixed_block(in, out, max_size);
+		} else if (type == 2) {
+			ok = detail::dynamic_block(in, out, max_size);
+		} else {
+			ok = false;
+		}
+		if (!ok) return false;
+	}
+	if (consumed) *consumed = in.consumed();
+	return true;
+}
+
+inline std::uint32_t adler32(const std::uint8_t* data, size_t size) noexcept {
+	std::uint32_t a = 1, b = 0;
+	while (size) {
+		// largest run before the sums can overflow
+		const size_t n = std::min<size_t>(size, 5552);
+		for (size_t i = 0; i < n; ++i) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += n;
+		size -= n;
+	}
+	return (b << 16) | a;
+}
+
+// A zlib stream: header, DEFLATE data, Adler-32 of the output.
+inline bool zlib(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& out, size_t max_size = size_t(1) << 31) {
+	if (size < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) return false;
+	const size_t start = out.size();
+	size_t consumed = 0;
+	if (!raw(data + 2, size - 2, out, max_size, &consumed)) return false;
+	if (2 + consumed + 4 > size) return false;
+	const auto* p = data + 2 + consumed;
+	const std::uint32_t expected = (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+	return adler32(out.data() + start, out.size() - start) == expected;
+}
+
+} // namespace inflate
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+template<typename T>
+class Interval {
+	static_assert(std::is_signed_v<T>);
+protected:
+	T value_;
+	T first_;
+	T last_;
+	T increment_decrement_;
+public:
+	Interval operator++() noexcept {
+		if (value_ + increment_decrement_ <= last_) {
+			value_ = value_ + increment_decrement_;
+		}
+		return *this;
+	}
+
+	Interval operator--() noexcept {
+		if (value_ - increment_decrement_ >= first_) {
+			value_ = value_ - increment_decrement_;
+		}
+		return *this;
+	}
+
+	T reset() { return value_ = first_; }
+	T operator()() const noexcept { return value_; }
+	bool operator==(const Interval& other) const noexcept { return value_ == other.value_; }
+
+	void set_value(T value) noexcept {
+		assert(value >= first_ && value <= last_);
+		value_ = value;
+	}
+
+	Interval()
+		: value_(std::numeric_limits<T>::min())
+		, first_(std::numeric_limits<T>::min())
+		, last_(std::numeric_limits<T>::max())
+		, increment_decrement_(std::numeric_limits<T>::epsilon())
+	{
+	}
+
+	Interval(T first, T last, T increment_decrement)
+		: value_(first)
+		, first_(first)
+		, last_(last)
+		, increment_decrement_(increment_decrement)
+	{
+	}
+};
+
+template<typename T>
+class CirculalInterval : public Interval<T> {
+public:
+	CirculalInterval operator++() noexcept {
+		if (this->value_ + this->increment_decrement_ > this->last_) this->value_ = this->first_;
+		else this->value_ = this->value_ + this->increment_decrement_;
+		return *this;
+	}
+
+	CirculalInterval operator--() noexcept {
+		if (this->value_ - this->increment_decrement_ < this->first_) this->value_ = this->last_;
+		else this->value_ = this->value_ - this->increment_decrement_;
+		return *this;
+	}
+
+	// `ix` times --, in constant time: down to the first step that would go
+	// below first_, then round the steps down from last_.
+	CirculalInterval operator-(size_t ix) const noexcept {
+		auto tmp = *this;
+		const auto step = this->increment_decrement_;
+		const auto before_wrap = static_cast<size_t>((this->value_ - this->first_) / step);
+		if (ix <= before_wrap) {
+			tmp.value_ = this->value_ - static_cast<T>(ix) * step;
+		} else {
+			const auto cycle = static_cast<size_t>((this->last_ - this->first_) / step) + 1;
+			tmp.value_ = this->last_ - static_cast<T>((ix - before_wrap - 1) % cycle) * step;
+		}
+		return tmp;
+	}
+
+	// `ix` times ++, in constant time.
+	CirculalInterval operator+(size_t ix) const noexcept {
+		auto tmp = *this;
+		const auto step = this->increment_decrement_;
+		const auto before_wrap = static_cast<size_t>((this->last_ - this->value_) / step);
+		if (ix <= before_wrap) {
+			tmp.value_ = this->value_ + static_cast<T>(ix) * step;
+		} else {
+			const auto cycle = static_cast<size_t>((this->last_ - this->first_) / step) + 1;
+			tmp.value_ = this->first_ + static_cast<T>((ix - before_wrap - 1) % cycle) * step;
+		}
+		return tmp;
+	}
+
+	CirculalInterval()
+	{
+	}
+
+	CirculalInterval(T first, T last, T increment_decrement)
+		: Interval<T>(first, last, increment_decrement)
+	{
+	}
+};
@@ -0,0 +1,759 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define IMV_JPEG_SSE2
+#endif
+
+#include "image_buffer.hpp"
+
+// Portable JPEG decoder: 8-bit baseline and progressive Huffman-coded
+// frames, greyscale, YCbCr or RGB, any sampling factors, restart markers.
+// Chroma is upsampled with libjpeg's triangle filter for 2x1 and 2x2.
+// CMYK, 12-bit, arithmetic-coded and lossless files are declined and left
+// to the system codecs.
+namespace jpeg {
+
+inline std::uint16_t read_u16(const std::uint8_t* p) noexcept {
+	return static_cast<std::uint16_t>(p[0] << 8 | p[1]);
+}
+
+inline bool is_jpeg(const std::uint8_t* data, size_t size) noexcept {
+	return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+namespace detail {
+
+// Zigzag position to natural (row-major) position, padded so that a
+// corrupt run length past 63 lands on a harmless slot.
+constexpr std::uint8_t natural[64 + 16] = {
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+	63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63,
+};
+
+// Starts of the segments before the first scan, the frame header among them.
+struct segment {
+	std::uint8_t marker;
+	const std::uint8_t* body;
+	size_t size;
+};
+
+// Calls `fn(segment)` for each marker segment up to and including `stop`,
+// false if the stream ends or is malformed first.
+template<typename Fn>
+bool for_each_segment(const std::uint8_t* data, size_t size, size_t& pos, Fn&& fn) {
+	while (pos + 4 <= size) {
+		if (data[pos] != 0xFF) return false;
+		const std::uint8_t marker = data[pos + 1];
+		if (marker == 0xFF) { // fill byte
+			++pos;
+			continue;
+		}
+		pos += 2;
+		if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+		if (marker == 0xD9) return false;
+		const size_t length = read_u16(data + pos);
+		if (length < 2 || pos + length > size) return false;
+		const segment s{marker, data + pos + 2, length - 2};
+		pos += length;
+		if (!fn(s)) return true;
+	}
+	return false;
+}
+
+inline bool is_frame(std::uint8_t marker) noexcept {
+	return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+// MSB-first with 0xFF00 unstuffing. Stops at a marker and feeds zeros from
+// there, so a truncated scan decodes to flat blocks instead of failing.
+class bit_reader {
+	const std::uint8_t* p_;
+	const std::uint8_t* end_;
+	std::uint64_t bits_ = 0;
+	int count_ = 0;
+	bool marker_ = false;
+
+	void fill() noexcept {
+		while (count_ <= 56) {
+			std::uint32_t byte = 0;
+			if (!marker_ && p_ < end_) {
+				byte = *p_;
+				if (byte == 0xFF) {
+					const std::uint8_t next = p_ + 1 < end_ ? p_[1] : 0xD9;
+					if (next == 0) {
+						p_ += 2;
+					} else {
+						marker_ = true;
+						byte = 0;
+					}
+				} else {
+					++p_;
+				}
+			}
+			bits_ |= std::uint64_t(byte) << (56 - count_);
+			count_ += 8;
+		}
+	}
+public:
+	bit_reader(const std::uint8_t* data, size_t size) noexcept : p_{data}, end_{data + size} {}
+
+	std::uint32_t peek(int n) noexcept {
+		if (count_ < n) fill();
+		return static_cast<std::uint32_t>(bits_ >> (64 - n));
+	}
+
+	void drop(int n) noexcept {
+		bits_ <<= n;
+		count_ -= n;
+	}
+
+	std::uint32_t get(int n) noexcept {
+		if (n == 0) return 0;
+		const auto v = peek(n);
+		drop(n);
+		return v;
+	}
+
+	// s bits as a signed magnitude category
+	int extend(int s) noexcept {
+		if (s == 0) return 0;
+		const int v = static_cast<int>(get(s));
+		return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+	}
+
+	// Past the RSTn marker that ends a restart interval; any other marker
+	// is left for the caller.
+	bool restart() noexcept {
+		bits_ = 0;
+		count_ = 0;
+		marker_ = false;
+		while (p_ + 1 < end_ && !(p_[0] == 0xFF && p_[1] != 0 && p_[1] != 0xFF)) ++p_;
+		if (p_ + 1 >= end_ || p_[1] < 0xD0 || p_[1] > 0xD7) return false;
+		p_ += 2;
+		return true;
+	}
+
+	// The marker after the scan.
+	const std::uint8_t* next_marker() const noexcept {
+		const std::uint8_t* p = p_;
+		while (p + 1 < end_ && !(p[0] == 0xFF && p[1] != 0 && !(p[1] >= 0xD0 && p[1] <= 0xD7))) ++p;
+		return p;
+	}
+};
+
+class huffman {
+	std::uint16_t fast_[1 << 9] = {}; // length << 8 | symbol for codes up to 9 bits
+	std::int32_t max_code_[18] = {};
+	std::int32_t offset_[17] = {};
+	std::uint8_t values_[256] = {};
+public:
+	bool build(const std::uint8_t counts[16], const std::uint8_t* symbols) noexcept {
+		std::fill(std::begin(fast_), std::end(fast_), std::uint16_t(0));
+		std::int32_t code = 0;
+		int k = 0;
+		for (int len = 1; len <= 16; ++len) {
+			offset_[len] = k - code;
+			for (int i = 0; i < counts[len - 1]; ++i, ++code, ++k) {
+				// more codes than the length has room for
+				if (k >= 256 || code >= (1 << len)) return false;
+				values_[k] = symbols[k];
+				if (len <= 9) {
+					const int base = code << (9 - len);
+					for (int j = 0; j < (1 << (9 - len)); ++j) fast_[base + j] = static_cast<std::uint16_t>(len << 8 | symbols[k]);
+				}
+			}
+			max_code_[len] = counts[len - 1] ? code - 1 : -1;
+			code <<= 1;
+		}
+		max_code_[17] = INT_MAX;
+		return true;
+	}
+
+	// -1 on a code that isn't in the table
+	int decode(bit_reader& in) const noexcept {
+		const auto e = fast_[in.peek(9)];
+		if (e) {
+			in.drop(e >> 8);
+			return e & 0xFF;
+		}
+		const std::int32_t code16 = static_cast<std::int32_t>(in.peek(16));
+		for (int len = 10; len <= 16; ++len) {
+			const std::int32_t c = code16 >> (16 - len);
+			if (c <= max_code_[len]) {
+				in.drop(len);
+				return values_[(c + offset_[len]) & 0xFF];
+			}
+		}
+		return -1;
+	}
+};
+
+// Dequantized coefficients of 8-bit data fit in 11 bits, corrupt streams
+// are held there so the IDCT below can't overflow.
+inline int dequantize(int coef, int q) noexcept { return std::clamp(coef * q, -1024, 1023); }
+
+// DC predictions are kept in 16 bits for the same reason.
+inline int predict(int pred, int diff) noexcept { return std::clamp(pred + diff, -32768, 32767); }
+
+// libjpeg's accurate integer IDCT (jidctint), dequantized coefficients in
+// natural order to 8x8 samples.
+inline void idct(const int* in, std::uint8_t* out, size_t stride) noexcept {
+	constexpr int const_bits = 13, pass1_bits = 2;
+	constexpr int fix_0_298631336 = 2446, fix_0_390180644 = 3196, fix_0_541196100 = 4433, fix_0_765366865 = 6270;
+	constexpr int fix_0_899976223 = 7373, fix_1_175875602 = 9633, fix_1_501321110 = 12299, fix_1_847759065 = 15137;
+	constexpr int fix_1_961570560 = 16069, fix_2_053119869 = 16819, fix_2_562915447 = 20995, fix_3_072711026 = 25172;
+	int ws[64];
+
+	auto butterfly = [&](int i0, int i1, int i2, int i3, int i4, int i5, int i6, int i7, int shift, int bias, auto&& store) {
+		int z2 = i2, z3 = i6;
+		int z1 = (z2 + z3) * fix_0_541196100;
+		int tmp2 = z1 + z3 * -fix_1_847759065;
+		int tmp3 = z1 + z2 * fix_0_765366865;
+		int tmp0 = (i0 + i4) * (1 << const_bits);
+		int tmp1 = (i0 - i4) * (1 << const_bits);
+		const int tmp10 = tmp0 + tmp3 + bias, tmp13 = tmp0 - tmp3 + bias;
+		const int tmp11 = tmp1 + tmp2 + bias, tmp12 = tmp1 - tmp2 + bias;
+
+		tmp0 = i7, tmp1 = i5, tmp2 = i3, tmp3 = i1;
+		z1 = tmp0 + tmp3;
+		z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2;
+		int z4 = tmp1 + tmp3;
+		const int z5 = (z3 + z4) * fix_1_175875602;
+		tmp0 *= fix_0_298631336;
+		tmp1 *= fix_2_053119869;
+		tmp2 *= fix_3_072711026;
+		tmp3 *= fix_1_501321110;
+		z1 *= -fix_0_899976223;
+		z2 *= -fix_2_562915447;
+		z3 = z3 * -fix_1_961570560 + z5;
+		z4 = z4 * -fix_0_390180644 + z5;
+		tmp0 += z1 + z3;
+		tmp1 += z2 + z4;
+		tmp2 += z2 + z3;
+		tmp3 += z1 + z4;
+
+		store(0, (tmp10 + tmp3) >> shift);
+		store(7, (tmp10 - tmp3) >> shift);
+		store(1, (tmp11 + tmp2) >> shift);
+		store(6, (tmp11 - tmp2) >> shift);
+		store(2, (tmp12 + tmp1) >> shift);
+		store(5, (tmp12 - tmp1) >> shift);
+		store(3, (tmp13 + tmp0) >> shift);
+		store(4, (tmp13 - tmp0) >> shift);
+	};
+
+	// columns
+	for (int c = 0; c < 8; ++c) {
+		const int* s = in + c;
+		int* w = ws + c;
+		if (!s[8] && !s[16] && !s[24] && !s[32] && !s[40] && !s[48] && !s[56]) {
+			const int dc = s[0] * (1 << pass1_bits);
+			for (int r = 0; r < 8; ++r) w[r * 8] = dc;
+			continue;
+		}
+		constexpr int shift = const_bits - pass1_bits;
+		butterfly(s[0], s[8], s[16], s[24], s[32], s[40], s[48], s[56], shift, 1 << (shift - 1),
+			[w](int r, int v) { w[r * 8] = v; });
+	}
+	// rows, with the +128 level shift folded into the rounding
+	for (int r = 0; r < 8; ++r) {
+		const int* s = ws + r * 8;
+		std::uint8_t* o = out + r * stride;
+		if (!(s[1] | s[2] | s[3] | s[4] | s[5] | s[6] | s[7])) {
+			const auto v = static_cast<std::uint8_t>(std::clamp(((s[0] + (1 << (pass1_bits + 2))) >> (pass1_bits + 3)) + 128, 0, 255));
+			std::memset(o, v, 8);
+			continue;
+		}
+		constexpr int shift = const_bits + pass1_bits + 3;
+		butterfly(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], shift, (1 << (shift - 1)) + (128 << shift),
+			[o](int c, int v) { o[c] = static_cast<std::uint8_t>(std::clamp(v, 0, 255)); });
+	}
+}
+
+// BT.601 full range YCbCr to opaque BGRA, 14-bit fixed point so eight
+// pixels fit the SSE2 multiply-adds; within one level of libjpeg.
+inline void ycc_row(const std::uint8_t* y, const std::uint8_t* cb, const std::uint8_t* cr, std::uint32_t* dst, std::uint32_t n) noexcept {
+	constexpr int k_cr_r = 22970, k_cb_g = -5638, k_cr_g = -11700, k_cb_b = 29032, round = 1 << 13;
+	std::uint32_t i = 0;
+#ifdef IMV_JPEG_SSE2
+	const __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi16(128), opaque = _mm_set1_epi8(-1);
+	const __m128i r_k = _mm_set1_epi32(k_cr_r), b_k = _mm_set1_epi32(k_cb_b);
+	const __m128i g_k = _mm_set1_epi32(static_cast<std::int32_t>(std::uint32_t(std::uint16_t(k_cr_g)) << 16 | std::uint16_t(k_cb_g)));
+	const __m128i rounding = _mm_set1_epi32(round);
+	auto load = [zero](const std::uint8_t* p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero); };
+	// (a * k.lo + b * k.hi) >> 14 for eight 16-bit lanes
+	auto chroma = [rounding](__m128i a, __m128i b, __m128i k) {
+		const __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), k), rounding), 14);
+		const __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), k), rounding), 14);
+		return _mm_packs_epi32(lo, hi);
+	};
+	for (; i + 8 <= n; i += 8) {
+		const __m128i l = load(y + i);
+		const __m128i u = _mm_sub_epi16(load(cb + i), bias);
+		const __m128i v = _mm_sub_epi16(load(cr + i), bias);
+		const __m128i r = _mm_add_epi16(l, chroma(v, zero, r_k));
+		const __m128i g = _mm_add_epi16(l, chroma(u, v, g_k));
+		const __m128i b = _mm_add_epi16(l, chroma(u, zero, b_k));
+		const __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+		const __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), opaque);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+	}
+#endif
+	for (; i < n; ++i) {
+		const int l = y[i], u = cb[i] - 128, v = cr[i] - 128;
+		const auto r = static_cast<std::uint32_t>(std::clamp(l + ((k_cr_r * v + round) >> 14), 0, 255));
+		const auto g = static_cast<std::uint32_t>(std::clamp(l + ((k_cb_g * u + k_cr_g * v + round) >> 14), 0, 255));
+		const auto b = static_cast<std::uint32_t>(std::clamp(l + ((k_cb_b * u + round) >> 14), 0, 255));
+		dst[i] = 0xFF000000u | (r << 16) | (g << 8) | b;
+	}
+}
+
+struct component {
+	std::uint8_t id = 0;
+	int h = 1, v = 1;
+	int tq = 0, td = 0, ta = 0;
+	std::uint32_t bw = 0, bh = 0; // blocks per row and column, padded to whole MCUs
+	std::uint32_t cw = 0, ch = 0; // samples actually covered
+	int pred = 0;
+	std::vector<std::uint8_t> plane;
+	std::vector<std::int16_t> coefs; // progressive only, natural order, not dequantized
+
+	size_t stride() const noexcept { return size_t(bw) * 8; }
+};
+
+struct decoder {
+	std::uint32_t width = 0, height = 0;
+	bool progressive = false;
+	int hmax = 1, vmax = 1;
+	std::uint32_t mcux = 0, mcuy = 0;
+	std::vector<component> comps;
+	huffman dc[4], ac[4];
+	std::uint16_t q[4][64] = {}; // natural order
+	std::uint32_t restart_interval = 0;
+	int adobe_transform = -1;
+	std::uint32_t eobrun = 0;
+
+	bool frame(const segment& s) {
+		if (s.size < 6 || s.body[0] != 8) return false;
+		height = read_u16(s.body + 1);
+		width = read_u16(s.body + 3);
+		const int n = s.body[5];
+		if (!width || !height || (n != 1 && n != 3) || s.size < 6 + size_t(n) * 3) return false;
+		comps.resize(n);
+		for (int i = 0; i < n; ++i) {
+			auto& c = comps[i];
+			const auto* p = s.body + 6 + i * 3;
+			c.id = p[0];
+			c.h = p[1] >> 4;
+			c.v = p[1] & 15;
+			c.tq = p[2];
+			if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.tq > 3) return false;
+			hmax = std::max(hmax, c.h);
+			vmax = std::max(vmax, c.v);
+		}
+		mcux = (width + 8 * hmax - 1) / (8 * hmax);
+		mcuy = (height + 8 * vmax - 1) / (8 * vmax);
+		for (auto& c : comps) {
+			c.bw = mcux * c.h;
+			c.bh = mcuy * c.v;
+			c.cw = (width * c.h + hmax - 1) / hmax;
+			c.ch = (height * c.v + vmax - 1) / vmax;
+			c.plane.assign(c.stride() * c.bh * 8, 128);
+			if (progressive) c.coefs.assign(size_t(c.bw) * c.bh * 64, 0);
+		}
+		return true;
+	}
+
+	bool tables(const segment& s) {
+		for (size_t pos = 0; pos < s.size;) {
+			const int tc = s.body[pos] >> 4, th = s.body[pos] & 15;
+			if (tc > 1 || th > 3 || pos + 17 > s.size) return false;
+			const auto* counts = s.body + pos + 1;
+			size_t total = 0;
+			for (int i = 0; i < 16; ++i) total += counts[i];
+			if (total > 256 || pos + 17 + total > s.size) return false;
+			if (!(tc ? ac[th] : dc[th]).build(counts, s.body + pos + 17)) return false;
+			pos += 17 + total;
+		}
+		return true;
+	}
+
+	bool quantization(const segment& s) {
+		for (size_t pos = 0; pos < s.size;) {
+			const int pq = s.body[pos] >> 4, tq = s.body[pos] & 15;
+			const size_t bytes = pq ? 128 : 64;
+			if (tq > 3 || pq > 1 || pos + 1 + bytes > s.size) return false;
+			for (int k = 0; k < 64; ++k) {
+				q[tq][natural[k]] = pq ? read_u16(s.body + pos + 1 + k * 2) : s.body[pos + 1 + k];
+			}
+			pos += 1 + bytes;
+		}
+		return true;
+	}
+
+	bool baseline_block(bit_reader& in, component& c, std::uint32_t bx, std::uint32_t by) {
+		int block[64] = {};
+		const auto* qt = q[c.tq];
+		const int t = dc[c.td].decode(in);
+		if (t < 0 || t > 16) return false;
+		c.pred = predict(c.pred, in.extend(t));
+		block[0] = dequantize(c.pred, qt[0]);
+		for (int k = 1; k < 64;) {
+			const int rs = ac[c.ta].decode(in);
+			if (rs < 0) return false;
+			const int r = rs >> 4, s = rs & 15;
+			if (s == 0) {
+				if (r != 15) break;
+				k += 16;
+				continue;
+			}
+			k += r;
+			const int z = natural[k];
+			block[z] = dequantize(in.extend(s), qt[z]);
+			++k;
+		}
+		idct(block, c.plane.data() + size_t(by) * 8 * c.stride() + size_t(bx) * 8, c.stride());
+		return true;
+	}
+
+	bool progressive_block(bit_reader& in, component& c, std::uint32_t bx, std::uint32_t by, int ss, int se, int ah, int al) {
+		auto* block = c.coefs.data() + (size_t(by) * c.bw + bx) * 64;
+		if (ss == 0) {
+			// DC, first pass or one more bit
+			if (ah == 0) {
+				const int t = dc[c.td].decode(in);
+				if (t < 0 || t > 16) return false;
+				c.pred = predict(c.pred, in.extend(t));
+				block[0] = static_cast<std::int16_t>(c.pred * (1 << al));
+			} else if (in.get(1)) {
+				block[0] = static_cast<std::int16_t>(block[0] | (1 << al));
+			}
+			return true;
+		}
+
+		if (ah == 0) {
+			// AC first pass
+			if (eobrun) {
+				--eobrun;
+				return true;
+			}
+			for (int k = ss; k <= se;) {
+				const int rs = ac[c.ta].decode(in);
+				if (rs < 0) return false;
+				const int r = rs >> 4, s = rs & 15;
+				if (s == 0) {
+					if (r < 15) {
+						eobrun = (1u << r) - 1 + in.get(r);
+						break;
+					}
+					k += 16;
+					continue;
+				}
+				k += r;
+				block[natural[k]] = static_cast<std::int16_t>(in.extend(s) * (1 << al));
+				++k;
+			}
+			return true;
+		}
+
+		// AC refinement, libjpeg's decode_mcu_AC_refine
+		const int p1 = 1 << al, m1 = -1 * (1 << al);
+		auto refine = [&](std::int16_t& coef) {
+			if (in.get(1) && (coef & p1) == 0) coef = static_cast<std::int16_t>(coef + (coef >= 0 ? p1 : m1));
+		};
+		int k = ss;
+		if (eobrun == 0) {
+			for (; k <= se; ++k) {
+				const int rs = ac[c.ta].decode(in);
+				if (rs < 0) return false;
+				int r = rs >> 4, s = rs & 15;
+				if (s) {
+					s = in.get(1) ? p1 : m1;
+				} else if (r != 15) {
+					eobrun = (1u << r) + in.get(r);
+					break;
+				}
+				do {
+					auto& coef = block[natural[k]];
+					if (coef != 0) refine(coef);
+					else if (--r < 0) break;
+					++k;
+				} while (k <= se);
+				if (s) block[natural[k]] = static_cast<std::int16_t>(s);
+			}
+		}
+		if (eobrun > 0) {
+			for (; k <= se; ++k) {
+				auto& coef = block[natural[k]];
+				if (coef != 0) refine(coef);
+			}
+			--eobrun;
+		}
+		return true;
+	}
+
+	// Entropy-coded data from `data`, returns where the next marker is.
+	const std::uint8_t* scan(const segment& s, const std::uint8_t* data, size_t size) {
+		if (comps.empty() || s.size < 1) return nullptr;
+		const int n = s.body[0];
+		if (n < 1 || n > 4 || s.size < 4 + size_t(n) * 2) return nullptr;
+		std::vector<component*> in_scan;
+		for (int i = 0; i < n; ++i) {
+			const auto* p = s.body + 1 + i * 2;
+			auto it = std::find_if(comps.begin(), comps.end(), [&](const component& c) { return c.id == p[0]; });
+			if (it == comps.end()) return nullptr;
+			it->td = p[1] >> 4;
+			it->ta = p[1] & 15;
+			if (it->td > 3 || it->ta > 3) return nullptr;
+			in_scan.push_back(&*it);
+		}
+		const auto* p = s.body + 1 + n * 2;
+		const int ss = p[0], se = p[1], ah = p[2] >> 4, al = p[2] & 15;
+		if (progressive && (ss > se || se > 63 || (ss == 0 && se != 0) || (ss > 0 && n != 1) || al > 13)) return nullptr;
+
+		bit_reader in(data, size);
+		for (auto& c : comps) c.pred = 0;
+		eobrun = 0;
+
+		auto block = [&](component& c, std::uint32_t bx, std::uint32_t by) {
+			return progressive ? progressive_block(in, c, bx, by, ss, se, ah, al) : baseline_block(in, c, bx, by);
+		};
+		std::uint32_t mcus = 0;
+		auto next_mcu = [&]() {
+			if (restart_interval && ++mcus % restart_interval == 0) {
+				in.restart();
+				for (auto& c : comps) c.pred = 0;
+				eobrun = 0;
+			}
+		};
+
+		if (n == 1) {
+			// non-interleaved: the component's own blocks, one per MCU
+			auto& c = *in_scan[0];
+			const std::uint32_t bw = (c.cw + 7) / 8, bh = (c.ch + 7) / 8;
+			for (std::uint32_t by = 0; by < bh; ++by) {
+				for (std::uint32_t bx = 0; bx < bw; ++bx) {
+					if (!block(c, bx, by)) return nullptr;
+					next_mcu();
+				}
+			}
+		} else {
+			for (std::uint32_t my = 0; my < mcuy; ++my) {
+				for (std::uint32_t mx = 0; mx < mcux; ++mx) {
+					for (auto* c : in_scan) {
+						for (int v = 0; v < c->v; ++v) {
+							for (int h = 0; h < c->h; ++h) {
+								if (!block(*c, mx * c->h + h, my * c->v + v)) return nullptr;
+							}
+						}
+					}
+					next_mcu();
+				}
+			}
+		}
+		return in.next_marker();
+	}
+
+	// Progressive coefficients to samples once every scan is in.
+	void finish() {
+		if (!progressive) return;
+		for (auto& c : comps) {
+			const auto* qt = q[c.tq];
+			for (std::uint32_t by = 0; by < c.bh; ++by) {
+				for (std::uint32_t bx = 0; bx < c.bw; ++bx) {
+					const auto* coefs = c.coefs.data() + (size_t(by) * c.bw + bx) * 64;
+					int block[64];
+					for (int i = 0; i < 64; ++i) block[i] = dequantize(coefs[i], qt[i]);
+					idct(block, c.plane.data() + size_t(by) * 8 * c.stride() + size_t(bx) * 8, c.stride());
+				}
+			}
+			c.coefs = {};
+		}
+	}
+
+	// Row `y` of component `c` at full resolution into `row` (width + 1 entries).
+	void upsample_row(const component& c, std::uint32_t y, std::uint8_t* row) const noexcept {
+		const int fx = hmax / c.h, fy = vmax / c.v;
+		const auto* plane = c.plane.data();
+		const size_t stride = c.stride();
+		if (c.h == hmax && c.v == vmax) {
+			std::memcpy(row, plane + size_t(y) * stride, width);
+			return;
+		}
+		const bool exact = hmax % c.h == 0 && vmax % c.v == 0;
+		if (exact && fx == 2 && (fy == 1 || fy == 2) && c.cw >= 2) {
+			const std::uint32_t cy = y / fy;
+			const auto* closer = plane + size_t(cy) * stride;
+			if (fy == 1) {
+				row[0] = closer[0];
+				row[1] = static_cast<std::uint8_t>((closer[0] * 3 + closer[1] + 2) >> 2);
+				for (std::uint32_t i = 1; i + 1 < c.cw; ++i) {
+					const int v = closer[i] * 3;
+					row[i * 2] = static_cast<std::uint8_t>((v + closer[i - 1] + 1) >> 2);
+					row[i * 2 + 1] = static_cast<std::uint8_t>((v + closer[i + 1] + 2) >> 2);
+				}
+				const std::uint32_t last = c.cw - 1;
+				row[last * 2] = static_cast<std::uint8_t>((closer[last] * 3 + closer[last - 1] + 1) >> 2);
+				row[last * 2 + 1] = closer[last];
+				return;
+			}
+			// the nearer chroma row weighs 3/4, the other one 1/4, then the same across
+			const std::int64_t fy_row = (y & 1) ? std::min<std::int64_t>(cy + 1, c.ch - 1) : std::max<std::int64_t>(std::int64_t(cy) - 1, 0);
+			const auto* other = plane + size_t(fy_row) * stride;
+			auto sum = [&](std::uint32_t i) { return closer[i] * 3 + other[i]; };
+			int last_sum = sum(0), this_sum = last_sum, next_sum = sum(1);
+			row[0] = static_cast<std::uint8_t>((this_sum * 4 + 8) >> 4);
+			row[1] = static_cast<std::uint8_t>((this_sum * 3 + next_sum + 7) >> 4);
+			for (std::uint32_t i = 1; i + 1 < c.cw; ++i) {
+				last_sum = this_sum;
+				this_sum = next_sum;
+				next_sum = sum(i + 1);
+				row[i * 2] = static_cast<std::uint8_t>((this_sum * 3 + last_sum + 8) >> 4);
+				row[i * 2 + 1] = static_cast<std::uint8_t>((this_sum * 3 + next_sum + 7) >> 4);
+			}
+			const std::uint32_t last = c.cw - 1;
+			row[last * 2] = static_cast<std::uint8_t>((next_sum * 3 + this_sum + 8) >> 4);
+			row[last * 2 + 1] = static_cast<std::uint8_t>((next_sum * 4 + 7) >> 4);
+			return;
+		}
+		// anything else replicates samples
+		const auto* src = plane + size_t(std::min<std::uint64_t>(std::uint64_t(y) * c.v / vmax, c.ch - 1)) * stride;
+		for (std::uint32_t x = 0; x < width; ++x) row[x] = src[std::uint64_t(x) * c.h / hmax];
+	}
+
+	void convert(image_buffer& out) const {
+		out.allocate(width, height);
+		const size_t row_size = size_t(width) + 2 * hmax + 8;
+		std::vector<std::uint8_t> rows(row_size * comps.size());
+		const bool rgb = comps.size() == 3 && (adobe_transform == 0 || (comps[0].id == 'R' && comps[1].id == 'G' && comps[2].id == 'B'));
+		for (std::uint32_t y = 0; y < height; ++y) {
+			for (size_t i = 0; i < comps.size(); ++i) upsample_row(comps[i], y, rows.data() + i * row_size);
+			auto* dst = out.data() + size_t(y) * width;
+			const auto* c0 = rows.data();
+			if (comps.size() == 1) {
+				for (std::uint32_t x = 0; x < width; ++x) dst[x] = 0xFF000000u | c0[x] * 0x010101u;
+				continue;
+			}
+			const auto* c1 = c0 + row_size;
+			const auto* c2 = c1 + row_size;
+			if (rgb) {
+				for (std::uint32_t x = 0; x < width; ++x) dst[x] = 0xFF000000u | (std::uint32_t(c0[x]) << 16) | (std::uint32_t(c1[x]) << 8) | c2[x];
+				continue;
+			}
+			ycc_row(c0, c1, c2, dst, width);
+		}
+	}
+};
+
+} // namespace detail
+
+inline bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+	if (!is_jpeg(data, size)) return false;
+	size_t pos = 2;
+	bool found = false;
+	detail::for_each_segment(data, size, pos, [&](const detail::segment& s) {
+		if (!detail::is_frame(s.marker)) return true;
+		if (s.size >= 5) {
+			height = read_u16(s.body + 1);
+			width = read_u16(s.body + 3);
+			found = width && height;
+		}
+		return false;
+	});
+	return found;
+}
+
+// 12-bit samples, which only the system codecs take.
+inline bool is_high_bit_depth(const std::uint8_t* data, size_t size) noexcept {
+	if (!is_jpeg(data, size)) return false;
+	size_t pos = 2;
+	bool high = false;
+	detail::for_each_segment(data, size, pos, [&](const detail::segment& s) {
+		if (!detail::is_frame(s.marker)) return true;
+		high = s.size >= 1 && s.body[0] > 8;
+		return false;
+	});
+	return high;
+}
+
+// `icc`, when given, receives the embedded profile if there is one.
+inline bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>* icc = nullptr) {
+	if (!is_jpeg(data, size)) return false;
+	detail::decoder d;
+	std::vector<std::pair<int, std::vector<std::uint8_t>>> icc_chunks;
+	bool ok = true, have_frame = false, have_scan = false;
+
+	for (size_t pos = 2; ok;) {
+		const detail::segment* sos = nullptr;
+		detail::segment current{};
+		const bool more = detail::for_each_segment(data, size, pos, [&](const detail::segment& s) {
+			switch (s.marker) {
+			case 0xC0: case 0xC1: case 0xC2:
+				d.progressive = s.marker == 0xC2;
+				ok = !have_frame && d.frame(s);
+				have_frame = true;
+				break;
+			case 0xC4:
+				ok = d.tables(s);
+				break;
+			case 0xDB:
+				ok = d.quantization(s);
+				break;
+			case 0xDD:
+				ok = s.size >= 2;
+				if (ok) d.restart_interval = read_u16(s.body);
+				break;
+			case 0xEE:
+				if (s.size >= 12 && std::memcmp(s.body, "Adobe", 5) == 0) d.adobe_transform = s.body[11];
+				break;
+			case 0xE2:
+				if (icc && s.size > 14 && std::memcmp(s.body, "ICC_PROFILE", 12) == 0) {
+					icc_chunks.emplace_back(s.body[12], std::vector<std::uint8_t>(s.body + 14, s.body + s.size));
+				}
+				break;
+			case 0xDA:
+				current = s;
+				sos = &current;
+				return false;
+			default:
+				// other coding processes aren't supported
+				if (detail::is_frame(s.marker)) ok = false;
+				break;
+			}
+			return ok;
+		});
+		if (!ok || !more || !sos) break;
+		if (!have_frame) return false;
+
+		const auto* next = d.scan(*sos, data + pos, size - pos);
+		if (!next) return false;
+		have_scan = true;
+		pos = static_cast<size_t>(next - data);
+	}
+	if (!ok || !have_scan) return false;
+
+	d.finish();
+	d.convert(out);
+
+	if (icc && !icc_chunks.empty()) {
+		std::sort(icc_chunks.begin(), icc_chunks.end(), [](auto& a, auto& b) { return a.first < b.first; });
+		icc->clear();
+		for (auto& [seq, chunk] : icc_chunks) icc->insert(icc->end(), chunk.begin(), chunk.end());
+	}
+	return true;
+}
+
+} // namespace jpeg
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include "metrics.hpp"
+
+// An image load is one coroutine on the image's strand: read, decode,
+// convert and upload follow each other in its body instead of being posted
+// as separate jobs that wait for one another on a condition variable. A
+// stage that has to wait, for the device say, suspends the coroutine and
+// gives the thread back to the pool.
+//
+// Cancellation is structured by ticket: every load is started under the
+// image's current ticket, and calling the ticket off makes every load
+// started before stop at its next stage boundary. Nothing is interrupted
+// in the middle of a stage.
+namespace load {
+
+template<typename T = void>
+using task = boost::asio::awaitable<T>;
+
+class ticket {
+	std::atomic<std::uint64_t> value_{0};
+public:
+	// what a new load is started under
+	std::uint64_t current() const noexcept { return value_; }
+	// every load started before stops at its next stage
+	void cancel() noexcept { ++value_; }
+	bool valid(std::uint64_t issued) const noexcept { return value_ == issued; }
+};
+
+// Set once. Coroutines waiting on it resume on their own executors, later
+// ones don't suspend at all.
+class event {
+	std::mutex mutex_;
+	bool set_ = false;
+	std::vector<std::function<void()>> waiters_;
+public:
+	template<typename CompletionToken>
+	auto async_wait(CompletionToken&& token) {
+		return boost::asio::async_initiate<CompletionToken, void()>([this](auto handler) {
+			// the handler is move-only, std::function wants a copy
+			auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+			auto resume = [shared]() {
+				const auto ex = boost::asio::get_associated_executor(*shared);
+				boost::asio::post(ex, std::move(*shared));
+			};
+			std::unique_lock<std::mutex> lk(mutex_);
+			if (!set_) {
+				waiters_.emplace_back(std::move(resume));
+				return;
+			}
+			lk.unlock();
+			resume();
+		}, token);
+	}
+
+	void set() {
+		std::vector<std::function<void()>> waiters;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			set_ = true;
+			waiters.swap(waiters_);
+		}
+		for (auto& resume : waiters) resume();
+	}
+
+	bool is_set() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return set_;
+	}
+};
+
+// Loads waiting for a thread count in the same gauge as posted jobs.
+inline metrics::gauge& queue_depth() {
+	static auto& depth = metrics::get_gauge("pool.queue_depth");
+	return depth;
+}
+
+// Lets the jobs already queued on `executor` run first, a load that gave
+// way may be called off by one of them.
+template<typename Executor>
+task<> yield(const Executor& executor) {
+	queue_depth().add(1.0);
+	co_await boost::asio::post(executor, boost::asio::use_awaitable);
+	queue_depth().add(-1.0);
+}
+
+// Starts `load` on `executor` and forgets it. A load handles its own
+// failures, whatever escapes it is counted and dropped so a pool thread
+// never unwinds. It is queued until its first stage runs.
+template<typename Executor>
+void spawn(const Executor& executor, task<> load) {
+	static auto& escaped = metrics::get_counter("load.escaped");
+	queue_depth().add(1.0);
+	boost::asio::co_spawn(executor, [](task<> load) -> task<> {
+		queue_depth().add(-1.0);
+		co_await std::move(load);
+	}(std::move(load)), [](std::exception_ptr e) {
+		if (e) escaped.add();
+	});
+}
+
+} // namespace load
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <cerrno>
+#	include <cstdio>
+#	include <cstring>
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <sys/eventfd.h>
+#	include <unistd.h>
+#endif
+
+#include "metrics.hpp"
+
+// Tells the viewer when the system runs short of memory so it can shrink its
+// caches before the pager does it for everyone. Windows reports it through
+// the low memory resource notification and the memory load, Linux through
+// PSI triggers on /proc/pressure/memory and the cgroup's memory.events.
+// Pressure goes up as soon as it's reported and is over once nothing was
+// reported for a while.
+namespace memory {
+
+enum class pressure { none, low, critical };
+
+inline const char* to_string(pressure p) noexcept {
+	switch (p) {
+	case pressure::low: return "low";
+	case pressure::critical: return "critical";
+	default: return "none";
+	}
+}
+
+class governor {
+public:
+	// Called on the watcher thread, or on the thread that called raise(),
+	// once for every change of level and in the order they happened. It
+	// mustn't call raise().
+	using listener = std::function<void(pressure)>;
+private:
+	using clock = std::chrono::steady_clock;
+
+	listener listener_;
+	std::chrono::milliseconds calm_;
+	// held from a change of level until the listener has it, so a raise()
+	// and the watcher's decay can't hand them over out of order
+	std::mutex notify_mutex_;
+	std::mutex mutex_;
+	pressure level_ = pressure::none;
+	clock::time_point last_;
+	std::thread thread_;
+	std::atomic<bool> stop_{false};
+	std::vector<std::string> sources_;
+	metrics::gauge& level_gauge_ = metrics::get_gauge("memory.pressure");
+	metrics::counter& reports_ = metrics::get_counter("memory.pressure_reports");
+#ifdef _WIN32
+	std::condition_variable cv_;
+	HANDLE low_memory_ = nullptr;
+#else
+	int wake_ = -1;
+	int psi_some_ = -1;
+	int psi_full_ = -1;
+	int cgroup_events_ = -1;
+	std::uint64_t cgroup_high_ = 0, cgroup_max_ = 0;
+#endif
+
+	void notify(pressure p) {
+		level_gauge_.set(static_cast<double>(p));
+		if (listener_) listener_(p);
+	}
+
+	// How often the watcher looks for pressure that has calmed down.
+	std::chrono::milliseconds tick() const noexcept {
+		return std::clamp(calm_, std::chrono::milliseconds(1), std::chrono::milliseconds(1000));
+	}
+
+	// Lower levels than the current one only refresh it.
+	void report(pressure p) {
+		reports_.add();
+		std::lock_guard<std::mutex> order(notify_mutex_);
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			last_ = clock::now();
+			if (p <= level_) return;
+			level_ = p;
+		}
+		notify(p);
+	}
+
+	void decay() {
+		std::lock_guard<std::mutex> order(notify_mutex_);
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			if (level_ == pressure::none || clock::now() - last_ < calm_) return;
+			level_ = pressure::none;
+		}
+		notify(pressure::none);
+	}
+
+#ifdef _WIN32
+	bool open_sources() {
+		low_memory_ = ::CreateMemoryResourceNotification(LowMemoryResourceNotification);
+		sources_.push_back("memory_load");
+		if (low_memory_) sources_.push_back("low_memory_notification");
+		return true;
+	}
+
+	void close_sources() {
+		if (low_memory_) ::CloseHandle(low_memory_);
+		low_memory_ = nullptr;
+	}
+
+	// The notification stays signalled while memory is low, it's polled
+	// along with the memory load rather than waited on.
+	void run() {
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lk(mutex_);
+				if (cv_.wait_for(lk, tick(), [this]() { return stop_.load(); })) break;
+			}
+			BOOL low = FALSE;
+			MEMORYSTATUSEX status{sizeof(status)};
+			if (low_memory_ && ::QueryMemoryResourceNotification(low_memory_, &low) && low) {
+				report(pressure::critical);
+			} else if (::GlobalMemoryStatusEx(&status) && status.dwMemoryLoad >= 90) {
+				report(pressure::low);
+			}
+			decay();
+		}
+	}
+
+	void wake() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		cv_.notify_all();
+	}
+#else
+	// A stall of `stall_us` within each 2 s window; unprivileged processes
+	// may only use windows in whole seconds.
+	static int psi_trigger(const char* kind, unsigned stall_us) {
+		const int fd = ::open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) return -1;
+		char trigger[64];
+		const int n = std::snprintf(trigger, sizeof(trigger), "%s %u 2000000", kind, stall_us);
+		if (::write(fd, trigger, n + 1) < 0) {
+			::close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	// "0::/user.slice/..." in /proc/self/cgroup, cgroup v2 only.
+	static std::string cgroup_events_path() {
+		FILE* f = std::fopen("/proc/self/cgroup", "r");
+		if (!f) return {};
+		char line[4096];
+		std::string path;
+		while (std::fgets(line, sizeof(line), f)) {
+			if (std::strncmp(line, "0::", 3) != 0) continue;
+			path = line + 3;
+			while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) path.pop_back();
+			break;
+		}
+		std::fclose(f);
+		if (path.empty()) return {};
+		return "/sys/fs/cgroup" + (path == "/" ? std::string() : path) + "/memory.events";
+	}
+
+	// The high and max counters of memory.events, false if it can't be read.
+	static bool read_cgroup_events(int fd, std::uint64_t& high, std::uint64_t& max) {
+		char text[512];
+		const auto n = ::pread(fd, text, sizeof(text) - 1, 0);
+		if (n <= 0) return false;
+		text[n] = '\0';
+		for (char* line = std::strtok(text, "\n"); line; line = std::strtok(nullptr, "\n")) {
+			unsigned long long value = 0;
+			char key[32];
+			if (std::sscanf(line, "%31s %llu", key, &value) != 2) continue;
+			if (std::strcmp(key, "high") == 0) high = value;
+			else if (std::strcmp(key, "max") == 0) max = value;
+		}
+		return true;
+	}
+
+	// False only when there is no way to stop the watcher.
+	bool open_sources() {
+		wake_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (wake_ < 0) return false;
+		if ((psi_some_ = psi_trigger("some", 150000)) >= 0) sources_.push_back("psi_some");
+		if ((psi_full_ = psi_trigger("full", 100000)) >= 0) sources_.push_back("psi_full");
+		if (const auto path = cgroup_events_path(); !path.empty()) {
+			cgroup_events_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (cgroup_events_ >= 0 && read_cgroup_events(cgroup_events_, cgroup_high_, cgroup_max_)) {
+				sources_.push_back("cgroup_events");
+			} else if (cgroup_events_ >= 0) {
+				::close(cgroup_events_);
+				cgroup_events_ = -1;
+			}
+		}
+		return true;
+	}
+
+	void close_sources() {
+		for (int* fd : {&wake_, &psi_some_, &psi_full_, &cgroup_events_}) {
+			if (*fd >= 0) ::close(*fd);
+			*fd = -1;
+		}
+	}
+
+	// Stall over the PSI threshold is low pressure, every task stalled at
+	// once critical. Reclaim forced at the cgroup's high limit is low, hitting
+	// its max critical.
+	void run() {
+		pollfd fds[4] = {
+			{wake_, POLLIN, 0}, {psi_some_, POLLPRI, 0}, {psi_full_, POLLPRI, 0}, {cgroup_events_, POLLPRI, 0},
+		};
+		while (!stop_) {
+			const int n = ::poll(fds, 4, static_cast<int>(tick().count()));
+			if (n < 0 && errno != EINTR) break;
+			if (stop_) break;
+			if (fds[2].revents & POLLPRI) report(pressure::critical);
+			else if (fds[1].revents & POLLPRI) report(pressure::low);
+			if (fds[3].revents & (POLLPRI | POLLERR)) {
+				std::uint64_t high = cgroup_high_, max = cgroup_max_;
+				if (read_cgroup_events(cgroup_events_, high, max)) {
+					if (max > cgroup_max_) report(pressure::critical);
+					else if (high > cgroup_high_) report(pressure::low);
+					cgroup_high_ = high;
+					cgroup_max_ = max;
+				}
+			}
+			// a trigger the kernel dropped isn't polled again
+			for (auto& fd : fds) {
+				if (fd.revents & (POLLERR | POLLNVAL) && &fd != &fds[3]) fd.fd = -1;
+			}
+			decay();
+		}
+	}
+
+	void wake() {
+		const std::uint64_t one = 1;
+		if (wake_ < 0) return;
+		const auto n = ::write(wake_, &one, sizeof(one));
+		(void)n;
+	}
+#endif
+public:
+	// Sources and the watcher thread, which also ends pressure that was
+	// raise()d. False when the system reports no pressure at all.
+	bool start(listener l) {
+		listener_ = std::move(l);
+		if (!open_sources()) {
+			close_sources();
+			return false;
+		}
+		thread_ = std::thread(&governor::run, this);
+		return !sources_.empty();
+	}
+
+	void stop() {
+		if (stop_.exchange(true)) return;
+		wake();
+		if (thread_.joinable()) thread_.join();
+		close_sources();
+	}
+
+	// What the sources call. A test or benchmark fakes pressure with it.
+	void raise(pressure p) {
+		if (p != pressure::none) report(p);
+	}
+
+	pressure level() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return level_;
+	}
+
+	// what start() found, "psi_some", "cgroup_events", ...
+	const std::vector<std::string>& sources() const noexcept { return sources_; }
+
+	// How long pressure lasts after it was last reported.
+	explicit governor(std::chrono::milliseconds calm = std::chrono::seconds(10)) : calm_{calm} {}
+	governor(const governor&) = delete;
+	governor& operator=(const governor&) = delete;
+	~governor() { stop(); }
+};
+
+} // namespace memory
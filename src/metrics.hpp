@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "singleton.hpp"
+
+// Always-on counters and gauges. Look a metric up once by name and keep the
+// reference, updating it is a single atomic operation.
+namespace metrics {
+
+class counter {
+	std::atomic<std::uint64_t> value_{0};
+public:
+	void add(std::uint64_t n = 1) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+	std::uint64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+	void reset() noexcept { value_.store(0, std::memory_order_relaxed); }
+};
+
+class gauge {
+	std::atomic<double> value_{0.0};
+public:
+	void set(double v) noexcept { value_.store(v, std::memory_order_relaxed); }
+
+	void add(double v) noexcept {
+		auto cur = value_.load(std::memory_order_relaxed);
+		while (!value_.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed));
+	}
+
+	double value() const noexcept { return value_.load(std::memory_order_relaxed); }
+};
+
+// Adds one to a gauge for the lifetime of the scope, e.g. work in flight.
+class gauge_scope {
+	gauge& gauge_;
+public:
+	explicit gauge_scope(gauge& g) noexcept : gauge_{g} { gauge_.add(1.0); }
+	~gauge_scope() { gauge_.add(-1.0); }
+
+	gauge_scope(const gauge_scope&) = delete;
+	gauge_scope& operator=(const gauge_scope&) = delete;
+};
+
+// Distribution of durations in milliseconds, e.g. frame intervals. Fixed
+// quarter-millisecond buckets up to 128 ms, anything longer lands in the
+// last one. Recording is a relaxed increment, percentiles are computed on read.
+class histogram {
+public:
+	static constexpr size_t n_buckets = 512;
+	static constexpr double bucket_ms = 0.25;
+private:
+	std::array<std::atomic<std::uint64_t>, n_buckets> buckets_{};
+	std::atomic<std::uint64_t> count_{0};
+	std::atomic<double> max_{0.0};
+public:
+	void record(double ms) noexcept {
+		const auto i = ms > 0.0 ? std::min(static_cast<size_t>(ms / bucket_ms), n_buckets - 1) : 0;
+		buckets_[i].fetch_add(1, std::memory_order_relaxed);
+		count_.fetch_add(1, std::memory_order_relaxed);
+		auto cur = max_.load(std::memory_order_relaxed);
+		while (ms > cur && !max_.compare_exchange_weak(cur, ms, std::memory_order_relaxed));
+	}
+
+	std::uint64_t count() const noexcept { return count_.load(std::memory_order_relaxed); }
+	double max() const noexcept { return max_.load(std::memory_order_relaxed); }
+
+	// Upper edge of the bucket holding the p-th value, 0 <= p <= 1; the
+	// largest value seen for the last bucket, which has no upper edge.
+	double percentile(double p) const noexcept {
+		const auto n = count();
+		if (n == 0) return 0.0;
+		const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(n))));
+		std::uint64_t seen = 0;
+		for (size_t i = 0; i < n_buckets; ++i) {
+			seen += buckets_[i].load(std::memory_order_relaxed);
+			if (seen >= rank) return i + 1 == n_buckets ? max() : std::min(static_cast<double>(i + 1) * bucket_ms, max());
+		}
+		return max();
+	}
+
+	void reset() noexcept {
+		for (auto& b : buckets_) b.store(0, std::memory_order_relaxed);
+		count_.store(0, std::memory_order_relaxed);
+		max_.store(0.0, std::memory_order_relaxed);
+	}
+};
+
+struct sample {
+	std::string name;
+	double value;
+};
+
+class registry : public singleton<registry> {
+	friend singleton<registry>;
+
+	mutable std::mutex mutex_;
+	// std::less<> so lookups by string_view don't allocate
+	std::map<std::string, std::unique_ptr<counter>, std::less<>> counters_;
+	std::map<std::string, std::unique_ptr<gauge>, std::less<>> gauges_;
+	std::map<std::string, std::unique_ptr<histogram>, std::less<>> histograms_;
+
+	template<typename T, typename Map>
+	static T& get_or_create(Map& map, std::string_view name) {
+		auto it = map.find(name);
+		if (it == map.end()) it = map.emplace(std::string(name), std::make_unique<T>()).first;
+		return *it->second;
+	}
+
+	registry() = default;
+public:
+	counter& get_counter(std::string_view name) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return get_or_create<counter>(counters_, name);
+	}
+
+	gauge& get_gauge(std::string_view name) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return get_or_create<gauge>(gauges_, name);
+	}
+
+	histogram& get_histogram(std::string_view name) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return get_or_create<histogram>(histograms_, name);
+	}
+
+	// Current value of a metric by name, 0 if it was never registered.
+	double value(std::string_view name) const {
+		std::lock_guard<std::mutex> lk(mutex_);
+		if (auto it = counters_.find(name); it != counters_.end()) return static_cast<double>(it->second->value());
+		if (auto it = gauges_.find(name); it != gauges_.end()) return it->second->value();
+		return 0.0;
+	}
+
+	// All metrics sorted by name, histograms as name.count, name.p50 etc.
+	std::vector<sample> snapshot() const {
+		std::vector<sample> samples;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			samples.reserve(counters_.size() + gauges_.size() + histograms_.size() * 5);
+			for (auto& [name, c] : counters_) samples.push_back({name, static_cast<double>(c->value())});
+			for (auto& [name, g] : gauges_) samples.push_back({name, g->value()});
+			for (auto& [name, h] : histograms_) {
+				samples.push_back({name + ".count", static_cast<double>(h->count())});
+				samples.push_back({name + ".max", h->max()});
+				samples.push_back({name + ".p50", h->percentile(0.50)});
+				samples.push_back({name + ".p95", h->percentile(0.95)});
+				samples.push_back({name + ".p99", h->percentile(0.99)});
+			}
+		}
+		std::sort(samples.begin(), samples.end(), [](const sample& a, const sample& b) { return a.name < b.name; });
+		return samples;
+	}
+
+	// One flat JSON object, {"name": value, ...}. JSON has no NaN or
+	// infinity, a gauge holding one is written as null.
+	void dump(std::ostream& os) const {
+		os << "{";
+		bool first = true;
+		for (auto& s : snapshot()) {
+			os << (first ? "\n" : ",\n") << "  \"" << s.name << "\": ";
+			if (std::isfinite(s.value)) os << s.value;
+			else os << "null";
+			first = false;
+		}
+		os << "\n}\n";
+	}
+};
+
+inline counter& get_counter(std::string_view name) { return registry::get_instance().get_counter(name); }
+inline gauge& get_gauge(std::string_view name) { return registry::get_instance().get_gauge(name); }
+inline histogram& get_histogram(std::string_view name) { return registry::get_instance().get_histogram(name); }
+
+} // namespace metrics
@@ -0,0 +1,521 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catalog.hpp"
+#include "entry_set.hpp"
+
+// Type-to-filter over file names. The index is built once per catalog on
+// the pool: the names folded to lower case back to back, for every trigram
+// the ascending list of entries whose name has it, and for every byte the
+// set of entries with one. What many names have, a pair or a trigram, and a
+// trigram at the same place in many names, is kept as a set too. A query of
+// such pairs or trigrams is answered a word at a time: the names with each
+// of its trigrams first right after the last at one of those places have
+// it, and only the others the sets keep are checked. Any other query picks
+// its rarest trigram and checks only the entries on that list, or what the
+// query a character shorter kept when that is fewer, so each keystroke
+// narrows the last result instead of going through the catalog again.
+// Results are entry sets, a bit per entry, never a list of what was kept.
+namespace names {
+
+// ASCII case folding, the rest of UTF-8 is compared byte for byte.
+inline char fold(char c) noexcept {
+	return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline std::string fold(std::string_view s) {
+	std::string out(s.size(), '\0');
+	std::transform(s.begin(), s.end(), out.begin(), [](char c) { return fold(c); });
+	return out;
+}
+
+class index {
+	// Trigrams are keyed over 41 classes of folded bytes: letters, digits,
+	// "_-. " and everything else in one. A list is exact for a trigram
+	// without the last class and holds extra entries for one with it.
+	static constexpr unsigned classes = 41, other = classes - 1;
+	static constexpr unsigned keys = classes * classes * classes;
+	// a set for what at least one entry in dense_share has, and no more
+	// than dense_sets of them, 32 bytes an entry
+	static constexpr size_t dense_share = 16, dense_sets = 256;
+
+	std::shared_ptr<const catalog> catalog_;
+	// the names with a 0 after each, which no query byte matches
+	std::string folded_;
+	std::vector<std::uint32_t> name_end_;
+	// postings_[offsets_[k], offsets_[k + 1]) are the entries with trigram
+	// k, at_ where in the name it first is. A name's last two bytes make a
+	// trigram with its terminator, which is in the last class.
+	std::vector<std::uint32_t> offsets_;
+	std::vector<std::uint32_t> postings_;
+	std::vector<std::uint8_t> at_;
+	// per byte class, the entries whose name has one
+	std::vector<std::shared_ptr<const entry_set>> singles_;
+public:
+	// `at` for a set of everything on a list, not only what has it at a place
+	static constexpr int anywhere = INT_MIN;
+
+	// Entries with an exact trigram, or with a pair keyed past the trigrams,
+	// first `at` bytes into their name or -`at` bytes from its end.
+	struct dense {
+		unsigned key;
+		int at;
+		std::shared_ptr<const entry_set> kept;
+	};
+private:
+	// by key, then place
+	std::vector<dense> dense_;
+
+	static unsigned byte_class(char c) noexcept {
+		if (c >= 'a' && c <= 'z') return static_cast<unsigned>(c - 'a');
+		if (c >= '0' && c <= '9') return 26 + static_cast<unsigned>(c - '0');
+		switch (c) {
+		case '_': return 36;
+		case '-': return 37;
+		case '.': return 38;
+		case ' ': return 39;
+		default: return other;
+		}
+	}
+
+	static unsigned key(const char* p) noexcept {
+		return (byte_class(p[0]) * classes + byte_class(p[1])) * classes + byte_class(p[2]);
+	}
+
+	static unsigned pair_key(const char* p) noexcept {
+		return keys + byte_class(p[0]) * classes + byte_class(p[1]);
+	}
+
+	void pairs(unsigned pair, entry_set& out) const noexcept {
+		const auto k = (pair - keys) * classes;
+		for (auto o = offsets_[k]; o < offsets_[k + classes]; ++o) out.insert(postings_[o]);
+	}
+
+	static bool less(const dense& d, std::pair<unsigned, int> k) noexcept {
+		return d.key != k.first ? d.key < k.first : d.at < k.second;
+	}
+
+	// The sets worth their memory, the ones with the most entries first.
+	void densify() {
+		struct wanted {
+			size_t count;
+			unsigned key;
+			int at;
+		};
+		std::vector<wanted> want;
+		const size_t n = size(), least = std::max<size_t>(1, n / dense_share);
+		std::vector<size_t> from_start(deep), from_end(deep);
+		for (unsigned k = 0; k < keys; ++k) {
+			if (k / (classes * classes) == other || k / classes % classes == other || k % classes == other) continue;
+			const size_t count = offsets_[k + 1] - offsets_[k];
+			if (count < least) continue;
+			want.push_back({count, k, anywhere});
+			std::fill(from_start.begin(), from_start.end(), 0);
+			std::fill(from_end.begin(), from_end.end(), 0);
+			for (auto o = offsets_[k]; o < offsets_[k + 1]; ++o) {
+				if (at_[o] == deep) continue;
+				const auto i = postings_[o];
+				++from_start[at_[o]];
+				const size_t back = name_end_[i] - begin(i) - at_[o];
+				if (back < deep) ++from_end[back];
+			}
+			for (size_t p = 0; p < deep; ++p) {
+				if (from_start[p] >= least) want.push_back({from_start[p], k, static_cast<int>(p)});
+				if (from_end[p] >= least) want.push_back({from_end[p], k, -static_cast<int>(p)});
+			}
+		}
+		// a pair has at most the entries of the trigrams it starts
+		for (unsigned a = 0; a < other; ++a) {
+			for (unsigned b = 0; b < other; ++b) {
+				const auto k = (a * classes + b) * classes;
+				const size_t count = offsets_[k + classes] - offsets_[k];
+				if (count >= least) want.push_back({count, keys + a * classes + b, anywhere});
+			}
+		}
+		std::sort(want.begin(), want.end(), [](const wanted& a, const wanted& b) { return a.count > b.count; });
+		if (want.size() > dense_sets) want.resize(dense_sets);
+
+		dense_.reserve(want.size());
+		for (auto& w : want) {
+			entry_set s(n);
+			if (w.key >= keys) {
+				pairs(w.key, s);
+			} else {
+				for (auto o = offsets_[w.key]; o < offsets_[w.key + 1]; ++o) {
+					const auto i = postings_[o];
+					const int at = w.at >= 0 ? at_[o] : static_cast<int>(at_[o]) - static_cast<int>(name_end_[i] - begin(i));
+					if (w.at == anywhere || (at_[o] != deep && at == w.at)) s.insert(i);
+				}
+			}
+			s.seal();
+			dense_.push_back({w.key, w.at, std::make_shared<const entry_set>(std::move(s))});
+		}
+		std::sort(dense_.begin(), dense_.end(), [](const dense& a, const dense& b) { return less(a, {b.key, b.at}); });
+	}
+
+	// `fn(key, entry, offset)` for the first of each trigram in every name.
+	template<typename Fn>
+	void trigrams(std::vector<std::uint32_t>& last, Fn&& fn) const {
+		std::fill(last.begin(), last.end(), UINT32_MAX);
+		for (std::uint32_t i = 0; i < name_end_.size(); ++i) {
+			const auto n = name(i);
+			for (size_t p = 0; p + 2 <= n.size(); ++p) {
+				const auto k = key(n.data() + p);
+				if (last[k] == i) continue;
+				last[k] = i;
+				fn(k, i, p);
+			}
+		}
+	}
+public:
+	// an offset in at_ too far into the name to hold
+	static constexpr std::uint8_t deep = 0xFF;
+	static constexpr auto npos = std::string_view::npos;
+
+	explicit index(std::shared_ptr<const catalog> pictures) : catalog_{std::move(pictures)} {
+		const auto n = catalog_->size();
+		name_end_.reserve(n);
+		for (size_t i = 0; i < n; ++i) {
+			const auto name = catalog_->name(i);
+			folded_.reserve(folded_.size() + name.size() + 1);
+			for (auto c : name) folded_.push_back(fold(c));
+			name_end_.push_back(static_cast<std::uint32_t>(folded_.size()));
+			folded_.push_back('\0');
+		}
+
+		// counted first, then each list filled in entry order
+		std::vector<std::uint32_t> last(keys);
+		offsets_.assign(keys + 1, 0);
+		trigrams(last, [&](unsigned k, std::uint32_t, size_t) { ++offsets_[k + 1]; });
+		for (unsigned k = 0; k < keys; ++k) offsets_[k + 1] += offsets_[k];
+		postings_.resize(offsets_[keys]);
+		at_.resize(offsets_[keys]);
+		auto fill = offsets_;
+		trigrams(last, [&](unsigned k, std::uint32_t i, size_t p) {
+			at_[fill[k]] = static_cast<std::uint8_t>(std::min<size_t>(p, deep));
+			postings_[fill[k]++] = i;
+		});
+
+		std::vector<entry_set> singles(classes, entry_set(n));
+		for (std::uint32_t i = 0; i < n; ++i) {
+			for (auto c : name(i)) singles[byte_class(c)].insert(i);
+		}
+		singles_.reserve(classes);
+		for (auto& s : singles) {
+			s.seal();
+			singles_.push_back(std::make_shared<const entry_set>(std::move(s)));
+		}
+		densify();
+	}
+	index(const index&) = delete;
+	index& operator=(const index&) = delete;
+
+	// the catalog the index was built over
+	const std::shared_ptr<const catalog>& pictures() const noexcept { return catalog_; }
+	size_t size() const noexcept { return name_end_.size(); }
+
+	// Offsets are into the folded names, all of them back to back.
+	const char* text() const noexcept { return folded_.data(); }
+	size_t begin(size_t i) const noexcept { return i == 0 ? 0 : name_end_[i - 1] + 1; }
+
+	// Entry i's name in lower case.
+	std::string_view name(size_t i) const noexcept {
+		return std::string_view(folded_).substr(begin(i), name_end_[i] - begin(i));
+	}
+
+	// Offset of the first `folded`, a query in lower case, in entry i's name
+	// at `from` or after it, npos when there's none.
+	size_t match(size_t i, std::string_view folded, size_t from) const noexcept {
+		const auto at = std::string_view(folded_).substr(from, name_end_[i] - from).find(folded);
+		return at == npos ? npos : from + at;
+	}
+	size_t match(size_t i, std::string_view folded) const noexcept { return match(i, folded, begin(i)); }
+
+	struct postings {
+		const std::uint32_t* entries;
+		const std::uint8_t* at;
+		size_t size;
+		// no entry is on the list without the trigram
+		bool exact;
+	};
+
+	// A byte that has a class of its own, not one lumped in with the others.
+	static bool distinct(char c) noexcept { return byte_class(c) != other; }
+
+	// The entries whose name has the trigram at `p`, ascending.
+	postings find(const char* p) const noexcept {
+		const auto k = key(p);
+		const bool exact = distinct(p[0]) && distinct(p[1]) && distinct(p[2]);
+		return {postings_.data() + offsets_[k], at_.data() + offsets_[k], offsets_[k + 1] - offsets_[k], exact};
+	}
+
+	// The entries whose name has a byte of c's class.
+	const std::shared_ptr<const entry_set>& single(char c) const noexcept { return singles_[byte_class(c)]; }
+
+	// Into `out`, the entries whose name has the two bytes at `p` next to
+	// each other in their classes: every trigram the two start, whose lists
+	// are next to each other.
+	void pairs(const char* p, entry_set& out) const noexcept { pairs(pair_key(p), out); }
+
+	// The set kept for the `length` 2 or 3 bytes at `p`, anywhere or at a
+	// place as in `dense`; null when there's none, or a byte shares a class.
+	std::shared_ptr<const entry_set> set(const char* p, size_t length, int at = anywhere) const {
+		for (size_t j = 0; j < length; ++j) {
+			if (!distinct(p[j])) return nullptr;
+		}
+		const std::pair k{length == 3 ? key(p) : pair_key(p), at};
+		const auto it = std::lower_bound(dense_.begin(), dense_.end(), k, less);
+		return it != dense_.end() && it->key == k.first && it->at == at ? it->kept : nullptr;
+	}
+
+	// The sets kept for the trigram at `p` at a place, by place.
+	std::span<const dense> places(const char* p) const {
+		for (size_t j = 0; j < 3; ++j) {
+			if (!distinct(p[j])) return {};
+		}
+		const auto k = key(p);
+		const auto first = std::lower_bound(dense_.begin(), dense_.end(), std::pair{k, anywhere + 1}, less);
+		const auto last = std::lower_bound(first, dense_.end(), std::pair{k + 1, anywhere}, less);
+		return {first, last};
+	}
+
+	// Heap bytes held.
+	size_t bytes() const noexcept {
+		size_t n = folded_.capacity() + at_.capacity()
+			+ (name_end_.capacity() + offsets_.capacity() + postings_.capacity()) * sizeof(std::uint32_t)
+			+ dense_.capacity() * sizeof(dense);
+		for (auto& s : singles_) n += s->bytes();
+		for (auto& d : dense_) n += d.kept->bytes();
+		return n;
+	}
+};
+
+// The query as it's typed. A step per character keeps what matched and
+// either where each match ends, so the next character is one byte to
+// compare for most entries, or the sets of names with the query at a
+// place, which the next character narrows a word at a time. Backspace goes
+// back a step without a search.
+class search {
+public:
+	using result = std::shared_ptr<const entry_set>;
+private:
+	// entries whose name has every trigram of the query first right after
+	// the last, the first one `at` as in index::dense
+	struct place {
+		int at;
+		result kept;
+	};
+	struct step {
+		std::string query;
+		result kept;
+		// per kept entry, ascending, the offset right after its first match
+		std::vector<std::uint32_t> next;
+		// false when the step came from the sets and `next` is empty
+		bool located = false;
+		// every place the index has sets for, when the step came from them
+		std::vector<place> places;
+		bool placed = false;
+	};
+	std::shared_ptr<const index> index_;
+	std::vector<step> steps_;
+
+	// `q` is the query of `before` and one more character.
+	step extend(const step& before, const std::string& q) const {
+		const auto* text = index_->text();
+		const auto c = q.back();
+		step s{q, nullptr, {}, true, {}, false};
+		s.next.reserve(before.next.size());
+		entry_set kept(index_->size());
+		size_t j = 0;
+		before.kept->for_each([&](size_t i) {
+			auto at = before.next[j++];
+			if (text[at] != c) {
+				// the first match doesn't go on, a later one may
+				const auto later = index_->match(i, q, at - before.query.size() + 1);
+				if (later == index::npos) return;
+				at = static_cast<std::uint32_t>(later + before.query.size());
+			}
+			kept.insert(i);
+			s.next.push_back(at + 1);
+		});
+		kept.seal();
+		// nothing dropped out, the set before is the same one
+		s.kept = kept.size() == before.kept->size() ? before.kept : std::make_shared<const entry_set>(std::move(kept));
+		return s;
+	}
+
+	// The entries `candidates(visit)` visits in ascending order whose name
+	// has `q`. `visit(i, at)` is given where it is when that's known already,
+	// npos otherwise. What `before` left out is skipped.
+	template<typename Candidates>
+	step verify(const std::string& q, const step* before, Candidates&& candidates) const {
+		step s{q, nullptr, {}, true, {}, false};
+		entry_set kept(index_->size());
+		candidates([&](size_t i, size_t at) {
+			if (before && !before->kept->contains(i)) return;
+			if (at == index::npos) at = index_->match(i, q);
+			if (at == index::npos) return;
+			kept.insert(i);
+			s.next.push_back(static_cast<std::uint32_t>(at + q.size()));
+		});
+		kept.seal();
+		s.kept = std::make_shared<const entry_set>(std::move(kept));
+		return s;
+	}
+
+	// Bytes that share a class with others are checked in the names.
+	step from_sets(const std::string& q) const {
+		if (q.size() == 1 && index::distinct(q[0])) return {q, index_->single(q[0]), {}, false, {}, false};
+		if (q.size() == 2) {
+			if (auto kept = index_->set(q.data(), 2)) return {q, std::move(kept), {}, false, {}, false};
+		}
+		entry_set candidates(index_->size());
+		if (q.size() == 1) {
+			candidates = *index_->single(q[0]);
+		} else {
+			index_->pairs(q.data(), candidates);
+			candidates.seal();
+			if (index::distinct(q[0]) && index::distinct(q[1])) {
+				return {q, std::make_shared<const entry_set>(std::move(candidates)), {}, false, {}, false};
+			}
+		}
+		return verify(q, nullptr, [&](auto&& visit) {
+			candidates.for_each([&](size_t i) { visit(i, index::npos); });
+		});
+	}
+
+	// Every trigram of `q` has a set. What `before` and the sets of the
+	// trigrams it didn't have keep has `q` at the places left, and the rest
+	// is checked in the names.
+	step from_dense(const std::string& q, const step* before) const {
+		step s{q, nullptr, {}, false, {}, true};
+		size_t k = 0;
+		result candidates;
+		if (before && before->placed) {
+			s.places = before->places;
+			candidates = before->kept;
+			k = before->query.size() - 2;
+		} else {
+			for (auto& d : index_->places(q.data())) s.places.push_back({d.at, d.kept});
+		}
+		for (size_t t = k; t + 3 <= q.size(); ++t) {
+			auto has = index_->set(q.data() + t, 3);
+			if (!candidates) {
+				candidates = std::move(has);
+				continue;
+			}
+			auto both = *candidates & *has;
+			if (both.size() != candidates->size()) candidates = std::make_shared<const entry_set>(std::move(both));
+		}
+		if (q.size() == 3) {
+			s.kept = std::move(candidates);
+			return s;
+		}
+		// the trigrams past the first right after it
+		for (size_t t = std::max<size_t>(k, 1); t + 3 <= q.size(); ++t) {
+			std::vector<place> narrowed;
+			for (auto& p : s.places) {
+				// no further than the end of the name
+				const auto at = p.at + static_cast<int>(t);
+				if (p.at < 0 && at > -3) continue;
+				const auto next = index_->set(q.data() + t, 3, at);
+				if (!next) continue;
+				auto both = std::make_shared<const entry_set>(*p.kept & *next);
+				if (!both->empty()) narrowed.push_back({p.at, std::move(both)});
+			}
+			s.places = std::move(narrowed);
+		}
+
+		entry_set kept(index_->size());
+		auto* out = kept.data();
+		const auto* in = candidates->words();
+		for (size_t w = 0; w < kept.word_count(); ++w) {
+			std::uint64_t found = 0;
+			for (auto& p : s.places) found |= p.kept->words()[w];
+			for (auto rest = in[w] & ~found; rest; rest &= rest - 1) {
+				const auto bit = rest & (~rest + 1);
+				if (index_->match(w * 64 + static_cast<size_t>(std::countr_zero(rest)), q) != index::npos) found |= bit;
+			}
+			out[w] = found;
+		}
+		kept.seal();
+		s.kept = kept.size() == candidates->size() ? candidates : std::make_shared<const entry_set>(std::move(kept));
+		return s;
+	}
+public:
+	search() = default;
+	explicit search(std::shared_ptr<const index> idx) : index_{std::move(idx)} {}
+
+	explicit operator bool() const noexcept { return index_ != nullptr; }
+
+	// The entries whose name contains `query` ignoring ASCII case; null for
+	// an empty query, which keeps everything.
+	result find(std::string_view query) {
+		const auto q = fold(query);
+		// back to the longest query this one starts with
+		while (!steps_.empty() && q.compare(0, steps_.back().query.size(), steps_.back().query) != 0) steps_.pop_back();
+		if (!index_ || q.empty()) return nullptr;
+		if (!steps_.empty() && steps_.back().query == q) return steps_.back().kept;
+
+		const step* before = steps_.empty() ? nullptr : &steps_.back();
+		if (q.size() < 3) {
+			steps_.push_back(from_sets(q));
+			return steps_.back().kept;
+		}
+
+		// the rarest trigram and where it is in the query
+		index::postings rare{};
+		size_t rare_at = 0;
+		bool dense = true;
+		for (size_t p = 0; p + 3 <= q.size(); ++p) {
+			const auto list = index_->find(q.data() + p);
+			if (!rare.entries || list.size < rare.size) {
+				rare = list;
+				rare_at = p;
+			}
+			dense = dense && index_->set(q.data() + p, 3);
+		}
+
+		// a byte per entry against a search per entry
+		if (before && before->located && before->query.size() + 1 == q.size() && before->kept->size() <= 2 * rare.size) {
+			auto s = extend(*before, q);
+			steps_.push_back(std::move(s));
+		} else if (dense) {
+			auto s = from_dense(q, before);
+			steps_.push_back(std::move(s));
+		} else if (!before || rare.size <= before->kept->size()) {
+			// A match starts no later than the trigram's first place less its
+			// place in the query, so that's tried first; a trigram that is
+			// the whole query is there.
+			const bool whole = q.size() == 3 && rare.exact;
+			auto s = verify(q, before, [&](auto&& visit) {
+				for (size_t j = 0; j < rare.size; ++j) {
+					const size_t i = rare.entries[j];
+					size_t at = index::npos;
+					if (rare.at[j] != index::deep && rare.at[j] >= rare_at) {
+						const auto guess = index_->begin(i) + rare.at[j] - rare_at;
+						if (whole || index_->name(i).substr(rare.at[j] - rare_at).starts_with(q)) at = guess;
+					}
+					visit(i, at);
+				}
+			});
+			steps_.push_back(std::move(s));
+		} else {
+			auto s = verify(q, nullptr, [&](auto&& visit) {
+				before->kept->for_each([&](size_t i) { visit(i, index::npos); });
+			});
+			steps_.push_back(std::move(s));
+		}
+		return steps_.back().kept;
+	}
+};
+
+} // namespace names
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "image_buffer.hpp"
+#include "pixel_ops.hpp"
+
+// Perceptual hashes for finding near-duplicates and bursts: two pictures of
+// the same thing hash to a small Hamming distance whatever their size or
+// encoding. Meant to be fed a thumbnail-sized decode.
+namespace phash {
+
+struct hashes {
+	std::uint64_t d = 0; // gradient (dHash), 9x8 luminance grid
+	std::uint64_t p = 0; // low DCT frequencies (pHash), 32x32 grid
+};
+
+inline int distance(std::uint64_t a, std::uint64_t b) noexcept { return std::popcount(a ^ b); }
+
+namespace detail {
+
+// Mean luma of each cell of a gw x gh grid laid over the image.
+inline std::vector<float> luma_grid(const image_buffer& src, std::uint32_t gw, std::uint32_t gh) {
+	std::vector<std::uint64_t> sums(size_t(gw) * gh, 0);
+	std::vector<std::uint32_t> counts(size_t(gw) * gh, 0);
+	std::vector<std::uint8_t> row(src.width);
+	std::vector<std::uint32_t> cell_x(src.width);
+	for (std::uint32_t x = 0; x < src.width; ++x) cell_x[x] = static_cast<std::uint32_t>(std::uint64_t(x) * gw / src.width);
+
+	for (std::uint32_t y = 0; y < src.height; ++y) {
+		luma_32bpp(src.data() + size_t(y) * src.width, row.data(), src.width);
+		const size_t cy = size_t(std::uint64_t(y) * gh / src.height) * gw;
+		for (std::uint32_t x = 0; x < src.width; ++x) {
+			sums[cy + cell_x[x]] += row[x];
+			++counts[cy + cell_x[x]];
+		}
+	}
+
+	std::vector<float> grid(sums.size());
+	for (size_t i = 0; i < grid.size(); ++i) grid[i] = counts[i] ? static_cast<float>(sums[i]) / counts[i] : 0.0f;
+	return grid;
+}
+
+} // namespace detail
+
+// Bit set where a cell is brighter than its right neighbour.
+inline std::uint64_t dhash(const image_buffer& src) {
+	const auto grid = detail::luma_grid(src, 9, 8);
+	std::uint64_t h = 0;
+	for (std::uint32_t y = 0; y < 8; ++y) {
+		for (std::uint32_t x = 0; x < 8; ++x) {
+			h = (h << 1) | (grid[y * 9 + x] > grid[y * 9 + x + 1] ? 1 : 0);
+		}
+	}
+	return h;
+}
+
+// The 8x8 lowest frequencies of a 32x32 DCT-II, bit set where a coefficient
+// is above their median. The DC term carries only brightness, its bit stays 0.
+inline std::uint64_t phash(const image_buffer& src) {
+	constexpr std::uint32_t n = 32, k = 8;
+	static const auto cosines = []() {
+		std::array<float, k * n> c{};
+		for (std::uint32_t u = 0; u < k; ++u) {
+			for (std::uint32_t x = 0; x < n; ++x) c[u * n + x] = static_cast<float>(std::cos((2.0 * x + 1.0) * u * 3.14159265358979323846 / (2.0 * n)));
+		}
+		return c;
+	}();
+
+	const auto grid = detail::luma_grid(src, n, n);
+	// rows first, only the k lowest frequencies are needed
+	std::array<float, n * k> rows{};
+	for (std::uint32_t y = 0; y < n; ++y) {
+		for (std::uint32_t u = 0; u < k; ++u) {
+			float s = 0.0f;
+			for (std::uint32_t x = 0; x < n; ++x) s += grid[y * n + x] * cosines[u * n + x];
+			rows[y * k + u] = s;
+		}
+	}
+	std::array<float, k * k> coeffs{};
+	for (std::uint32_t v = 0; v < k; ++v) {
+		for (std::uint32_t u = 0; u < k; ++u) {
+			float s = 0.0f;
+			for (std::uint32_t y = 0; y < n; ++y) s += rows[y * k + u] * cosines[v * n + y];
+			coeffs[v * k + u] = s;
+		}
+	}
+
+	auto sorted = std::array<float, k * k - 1>{};
+	std::copy(coeffs.begin() + 1, coeffs.end(), sorted.begin());
+	std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+	const float median = sorted[sorted.size() / 2];
+
+	std::uint64_t h = 0;
+	for (std::uint32_t i = 0; i < k * k; ++i) h = (h << 1) | (i != 0 && coeffs[i] > median ? 1 : 0);
+	return h;
+}
+
+inline hashes compute(const image_buffer& src) {
+	if (!src) return {};
+	return {dhash(src), phash(src)};
+}
+
+// Hamming neighbour queries by multi-index hashing: the 64 bits are split
+// into radius + 1 chunks, two hashes within `radius` agree exactly on at
+// least one of them, so only entries sharing a chunk with the query are
+// compared. pHash finds the candidates, dHash has to agree as well, which
+// keeps flat or low-texture frames from matching by accident.
+class index {
+	struct slot {
+		std::uint64_t key;
+		std::uint32_t id;
+		bool operator<(const slot& o) const noexcept { return key < o.key || (key == o.key && id < o.id); }
+	};
+
+	int radius_ = 0;
+	std::vector<hashes> hashes_;
+	std::vector<std::vector<slot>> tables_; // one per chunk, sorted by key
+
+	std::uint64_t chunk(std::uint64_t h, size_t i) const noexcept {
+		const auto m = tables_.size();
+		const auto lo = 64 * i / m, hi = 64 * (i + 1) / m;
+		return (h >> lo) & (hi - lo == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << (hi - lo)) - 1);
+	}
+public:
+	index() = default;
+
+	index(std::vector<hashes> entries, int radius)
+		: radius_{std::clamp(radius, 0, 31)}
+		, hashes_{std::move(entries)}
+		, tables_(static_cast<size_t>(radius_) + 1)
+	{
+		for (size_t i = 0; i < tables_.size(); ++i) {
+			auto& t = tables_[i];
+			t.reserve(hashes_.size());
+			for (std::uint32_t id = 0; id < hashes_.size(); ++id) t.push_back({chunk(hashes_[id].p, i), id});
+			std::sort(t.begin(), t.end());
+		}
+	}
+
+	size_t size() const noexcept { return hashes_.size(); }
+	int radius() const noexcept { return radius_; }
+	const hashes& at(std::uint32_t id) const noexcept { return hashes_[id]; }
+
+	bool similar(const hashes& a, const hashes& b) const noexcept {
+		return distance(a.p, b.p) <= radius_ && distance(a.d, b.d) <= 2 * radius_;
+	}
+
+	// Ids of every entry near `h`, sorted.
+	std::vector<std::uint32_t> query(const hashes& h) const {
+		std::vector<std::uint32_t> found;
+		for (size_t i = 0; i < tables_.size(); ++i) {
+			const auto key = chunk(h.p, i);
+			auto it = std::lower_bound(tables_[i].begin(), tables_[i].end(), slot{key, 0});
+			for (; it != tables_[i].end() && it->key == key; ++it) {
+				if (similar(h, hashes_[it->id])) found.push_back(it->id);
+			}
+		}
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+		return found;
+	}
+
+	// Group id per entry, entries connected through near pairs share one. A
+	// group id is the smallest entry id in it.
+	std::vector<std::uint32_t> groups() const {
+		std::vector<std::uint32_t> parent(hashes_.size());
+		std::iota(parent.begin(), parent.end(), 0u);
+		auto find = [&](std::uint32_t x) {
+			while (parent[x] != x) x = parent[x] = parent[parent[x]];
+			return x;
+		};
+		for (std::uint32_t id = 0; id < hashes_.size(); ++id) {
+			for (auto other : query(hashes_[id])) {
+				const auto a = find(id), b = find(other);
+				if (a != b) parent[std::max(a, b)] = std::min(a, b);
+			}
+		}
+		for (std::uint32_t id = 0; id < hashes_.size(); ++id) parent[id] = find(id);
+		return parent;
+	}
+};
+
+// Hashes on disk keyed by path, reused while the file's size and
+// modification time are unchanged.
+class store {
+public:
+	struct entry {
+		std::uint64_t size = 0;
+		std::int64_t mtime = 0;
+		phash::hashes hashes;
+	};
+private:
+	static constexpr std::uint32_t magic = 0x48564D49; // "IMVH"
+	static constexpr std::uint32_t version = 1;
+	std::unordered_map<std::string, entry> entries_;
+
+	template<typename T>
+	static bool get(FILE* f, T& v) { return std::fread(&v, sizeof(T), 1, f) == 1; }
+	template<typename T>
+	static void put(FILE* f, const T& v) { std::fwrite(&v, sizeof(T), 1, f); }
+public:
+	const std::unordered_map<std::string, entry>& entries() const noexcept { return entries_; }
+
+	const entry* find(const std::string& path, std::uint64_t size, std::int64_t mtime) const {
+		auto it = entries_.find(path);
+		if (it == entries_.end() || it->second.size != size || it->second.mtime != mtime) return nullptr;
+		return &it->second;
+	}
+
+	void put(std::string path, const entry& e) { entries_[std::move(path)] = e; }
+
+	// A missing or foreign file just leaves the store empty.
+	void load(const std::filesystem::path& file) {
+#ifdef _WIN32
+		FILE* f = _wfopen(file.c_str(), L"rb");
+#else
+		FILE* f = std::fopen(file.c_str(), "rb");
+#endif
+		if (!f) return;
+		std::uint32_t m = 0, v = 0;
+		std::uint64_t count = 0;
+		if (get(f, m) && get(f, v) && get(f, count) && m == magic && v == version) {
+			std::string path;
+			for (std::uint64_t i = 0; i < count; ++i) {
+				std::uint32_t len = 0;
+				entry e;
+				if (!get(f, len) || len > 32768) break;
+				path.resize(len);
+				if (std::fread(path.data(), 1, len, f) != len) break;
+				if (!get(f, e.size) || !get(f, e.mtime) || !get(f, e.hashes.d) || !get(f, e.hashes.p)) break;
+				entries_[path] = e;
+			}
+		}
+		std::fclose(f);
+	}
+
+	bool save(const std::filesystem::path& file) const {
+		auto tmp = file;
+		tmp += ".tmp";
+#ifdef _WIN32
+		FILE* f = _wfopen(tmp.c_str(), L"wb");
+#else
+		FILE* f = std::fopen(tmp.c_str(), "wb");
+#endif
+		if (!f) return false;
+		put(f, magic);
+		put(f, version);
+		put(f, static_cast<std::uint64_t>(entries_.size()));
+		for (auto& [path, e] : entries_) {
+			put(f, static_cast<std::uint32_t>(path.size()));
+			std::fwrite(path.data(), 1, path.size(), f);
+			put(f, e.size);
+			put(f, e.mtime);
+			put(f, e.hashes.d);
+			put(f, e.hashes.p);
+		}
+		const bool ok = std::ferror(f) == 0;
+		if (std::fclose(f) != 0 || !ok) return false;
+		// replaced in one step so a crash never leaves half a file
+		std::error_code ec;
+		std::filesystem::rename(tmp, file, ec);
+		return !ec;
+	}
+};
+
+} // namespace phash
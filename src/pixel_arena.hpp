@@ -0,0 +1,282 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+#include "singleton.hpp"
+
+// Size-classed pool of page-aligned pixel buffers.
+// Decoded frames, rotated copies and scratch surfaces are all a few megabytes
+// and come in a handful of sizes, so instead of going back to the heap for
+// every navigation the blocks are kept in per-class free lists and reused.
+// Classes are 64K and then four steps per power of two (at most 25% slack).
+class pixel_arena : public singleton<pixel_arena> {
+	friend singleton<pixel_arena>;
+
+	static constexpr size_t min_class_log2 = 16;
+	static constexpr size_t n_classes = (48 - min_class_log2) * 4;
+
+	struct block {
+		void* ptr;
+		size_t mapped;
+		bool large;
+	};
+public:
+	struct stats_t {
+		std::uint64_t acquired;     // total acquire() calls
+		std::uint64_t reused;       // served from a free list
+		std::uint64_t os_allocated; // went to the OS
+		std::uint64_t os_freed;
+		size_t bytes_in_use;
+		size_t bytes_pooled;
+		size_t peak_bytes;          // peak of in use + pooled
+
+		double reuse_rate() const noexcept {
+			return acquired ? static_cast<double>(reused) / static_cast<double>(acquired) : 0.0;
+		}
+	};
+
+	class buffer {
+		friend pixel_arena;
+
+		pixel_arena* arena_ = nullptr;
+		block block_{};
+		size_t class_idx_ = 0;
+		size_t size_ = 0;
+
+		buffer(pixel_arena* arena, block b, size_t class_idx, size_t size) noexcept
+			: arena_{arena}, block_{b}, class_idx_{class_idx}, size_{size} {}
+	public:
+		std::uint8_t* data() const noexcept { return static_cast<std::uint8_t*>(block_.ptr); }
+		size_t size() const noexcept { return size_; }
+		size_t capacity() const noexcept { return block_.mapped; }
+		bool large_pages() const noexcept { return block_.large; }
+		explicit operator bool() const noexcept { return block_.ptr != nullptr; }
+
+		void reset() noexcept {
+			if (arena_) arena_->release(block_, class_idx_);
+			arena_ = nullptr;
+			block_ = {};
+			size_ = 0;
+		}
+
+		buffer& operator=(buffer&& other) noexcept {
+			if (this != &other) {
+				reset();
+				arena_ = std::exchange(other.arena_, nullptr);
+				block_ = std::exchange(other.block_, {});
+				class_idx_ = other.class_idx_;
+				size_ = std::exchange(other.size_, 0);
+			}
+			return *this;
+		}
+
+		buffer(buffer&& other) noexcept { *this = std::move(other); }
+		buffer(const buffer&) = delete;
+		buffer& operator=(const buffer&) = delete;
+		buffer() = default;
+		~buffer() { reset(); }
+	};
+private:
+	mutable std::mutex mutex_;
+	std::array<std::vector<block>, n_classes> free_;
+	stats_t stats_{};
+	size_t max_pooled_bytes_ = 256 * 1024 * 1024;
+	size_t page_size_;
+	size_t large_page_size_ = 0;
+	std::atomic_bool use_large_pages_{false};
+
+	static size_t class_index(size_t size, size_t& class_size) noexcept {
+		if (size <= (size_t(1) << min_class_log2)) {
+			class_size = size_t(1) << min_class_log2;
+			return 0;
+		}
+		const size_t log2 = std::bit_width(size) - 1;
+		const size_t step = (size_t(1) << log2) >> 2;
+		const size_t quarters = (size + step - 1) / step; // 4..8
+		class_size = quarters * step;
+		return (log2 - min_class_log2) * 4 + (quarters - 4);
+	}
+
+	static size_t round_up(size_t size, size_t alignment) noexcept {
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	block os_alloc(size_t size) noexcept {
+		const bool want_large = use_large_pages_ && large_page_size_ && size >= large_page_size_;
+#ifdef _WIN32
+		if (want_large) {
+			const size_t mapped = round_up(size, large_page_size_);
+			if (auto ptr = VirtualAlloc(nullptr, mapped, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE)) {
+				return {ptr, mapped, true};
+			}
+		}
+		const size_t mapped = round_up(size, page_size_);
+		return {VirtualAlloc(nullptr, mapped, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE), mapped, false};
+#else
+		if (want_large) {
+			const size_t mapped = round_up(size, large_page_size_);
+			auto ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (ptr != MAP_FAILED) {
+				// transparent huge pages, the kernel falls back to 4K pages on its own
+				madvise(ptr, mapped, MADV_HUGEPAGE);
+				return {ptr, mapped, true};
+			}
+		}
+		const size_t mapped = round_up(size, page_size_);
+		auto ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return {ptr == MAP_FAILED ? nullptr : ptr, mapped, false};
+#endif
+	}
+
+	static void os_free(const block& b) noexcept {
+#ifdef _WIN32
+		VirtualFree(b.ptr, 0, MEM_RELEASE);
+#else
+		munmap(b.ptr, b.mapped);
+#endif
+	}
+
+	void update_peak() noexcept {
+		const auto footprint = stats_.bytes_in_use + stats_.bytes_pooled;
+		if (footprint > stats_.peak_bytes) stats_.peak_bytes = footprint;
+	}
+
+	void release(const block& b, size_t class_idx) noexcept {
+		if (!b.ptr) return;
+		bool pooled = false;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			stats_.bytes_in_use -= b.mapped;
+			// blocks mapped before a large page switch are not interchangeable
+			if (b.large == use_large_pages_ && stats_.bytes_pooled + b.mapped <= max_pooled_bytes_) {
+				free_[class_idx].push_back(b);
+				stats_.bytes_pooled += b.mapped;
+				pooled = true;
+			} else {
+				++stats_.os_freed;
+			}
+		}
+		if (!pooled) os_free(b);
+	}
+
+	pixel_arena() {
+#ifdef _WIN32
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		page_size_ = si.dwPageSize;
+#else
+		page_size_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		large_page_size_ = 2 * 1024 * 1024;
+#endif
+	}
+public:
+	// Returns a page-aligned buffer of at least `size` bytes, contents are undefined.
+	buffer acquire(size_t size) {
+		size_t class_size;
+		const size_t idx = class_index(size, class_size);
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			++stats_.acquired;
+			if (auto& list = free_[idx]; !list.empty()) {
+				auto b = list.back();
+				list.pop_back();
+				++stats_.reused;
+				stats_.bytes_pooled -= b.mapped;
+				stats_.bytes_in_use += b.mapped;
+				return buffer(this, b, idx, size);
+			}
+		}
+
+		auto b = os_alloc(class_size);
+		if (!b.ptr) {
+			// give the cached blocks back and try once more before giving up
+			trim();
+			b = os_alloc(class_size);
+			if (!b.ptr) throw std::bad_alloc();
+		}
+
+		std::lock_guard<std::mutex> lk(mutex_);
+		++stats_.os_allocated;
+		stats_.bytes_in_use += b.mapped;
+		update_peak();
+		return buffer(this, b, idx, size);
+	}
+
+	// Returns pooled blocks to the OS until at most `keep_bytes` remain cached.
+	void trim(size_t keep_bytes = 0) noexcept {
+		std::vector<block> to_free;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			// largest classes first, they are the least likely to be reused
+			for (auto it = free_.rbegin(); it != free_.rend() && stats_.bytes_pooled > keep_bytes; ++it) {
+				while (!it->empty() && stats_.bytes_pooled > keep_bytes) {
+					stats_.bytes_pooled -= it->back().mapped;
+					++stats_.os_freed;
+					to_free.push_back(it->back());
+					it->pop_back();
+				}
+			}
+		}
+		for (auto& b : to_free) os_free(b);
+	}
+
+	void set_max_pooled_bytes(size_t bytes) noexcept {
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			max_pooled_bytes_ = bytes;
+		}
+		trim(bytes);
+	}
+
+	// Backs buffers of at least one large page with large (Windows) or
+	// transparent huge (Linux) pages. On Windows this needs SeLockMemoryPrivilege,
+	// returns false if the privilege can't be acquired.
+	bool set_large_pages(bool enable) noexcept {
+		if (enable == use_large_pages_) return true;
+#ifdef _WIN32
+		if (enable) {
+			large_page_size_ = GetLargePageMinimum();
+			if (!large_page_size_) return false;
+
+			HANDLE token;
+			if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+
+			TOKEN_PRIVILEGES tp{};
+			tp.PrivilegeCount = 1;
+			tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			bool ok = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid) &&
+				AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) &&
+				GetLastError() == ERROR_SUCCESS;
+			CloseHandle(token);
+			if (!ok) return false;
+		}
+#endif
+		use_large_pages_ = enable;
+		trim();
+		return true;
+	}
+
+	stats_t stats() const noexcept {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return stats_;
+	}
+
+	~pixel_arena() {
+		trim();
+	}
+};
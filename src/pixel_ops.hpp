@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define IMV_PIXEL_OPS_SSE2
+#endif
+
+// Whole-image kernels over 32bpp pixels stored as tightly packed uint32_t.
+
+// Rotates `src` (width x height) clockwise by `quarter_turns` * 90 degrees into `dst`.
+// For odd turns the destination is height x width. Works in square tiles so that
+// both the reads and the scattered writes stay within a few cache lines.
+inline void rotate_32bpp(const std::uint32_t* src, std::uint32_t* dst,
+	std::uint32_t width, std::uint32_t height, int quarter_turns) noexcept
+{
+	constexpr std::uint32_t tile = 64;
+	const size_t w = width, h = height;
+
+	switch (quarter_turns & 3) {
+	case 0:
+		std::memcpy(dst, src, w * h * sizeof(std::uint32_t));
+		break;
+	case 1:
+		for (size_t ty = 0; ty < h; ty += tile) {
+			for (size_t tx = 0; tx < w; tx += tile) {
+				const size_t ey = std::min(ty + tile, h), ex = std::min(tx + tile, w);
+				for (size_t y = ty; y < ey; ++y) {
+					for (size_t x = tx; x < ex; ++x) dst[x * h + (h - 1 - y)] = src[y * w + x];
+				}
+			}
+		}
+		break;
+	case 2:
+		for (size_t y = 0; y < h; ++y) {
+			const auto* s = src + y * w;
+			auto* d = dst + (h - 1 - y) * w + (w - 1);
+			for (size_t x = 0; x < w; ++x) *(d - x) = s[x];
+		}
+		break;
+	case 3:
+		for (size_t ty = 0; ty < h; ty += tile) {
+			for (size_t tx = 0; tx < w; tx += tile) {
+				const size_t ey = std::min(ty + tile, h), ex = std::min(tx + tile, w);
+				for (size_t y = ty; y < ey; ++y) {
+					for (size_t x = tx; x < ex; ++x) dst[(w - 1 - x) * h + y] = src[y * w + x];
+				}
+			}
+		}
+		break;
+	}
+}
+
+// BT.601 luma of n BGRA pixels into `dst`, 8.8 fixed point weights, alpha
+// ignored. Four pixels per step with SSE2.
+inline void luma_32bpp(const std::uint32_t* src, std::uint8_t* dst, size_t n) noexcept {
+	size_t x = 0;
+#ifdef IMV_PIXEL_OPS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+	for (; x + 4 <= n; x += 4) {
+		const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+		// [b*wb + g*wg, r*wr] per pixel
+		const __m128i lo = _mm_shuffle_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(p, zero), weights), _MM_SHUFFLE(3, 1, 2, 0));
+		const __m128i hi = _mm_shuffle_epi32(_mm_madd_epi16(_mm_unpackhi_epi8(p, zero), weights), _MM_SHUFFLE(3, 1, 2, 0));
+		__m128i sum = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi)), 8);
+		sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+		const auto four = static_cast<std::uint32_t>(_mm_cvtsi128_si32(sum));
+		std::memcpy(dst + x, &four, 4);
+	}
+#endif
+	for (; x < n; ++x) {
+		const std::uint32_t p = src[x];
+		dst[x] = static_cast<std::uint8_t>(((p & 0xFF) * 29 + ((p >> 8) & 0xFF) * 150 + ((p >> 16) & 0xFF) * 77) >> 8);
+	}
+}
+
+// Halves `src` (width x height) with a 2x2 box filter into `dst`, which is
+// max(1, width / 2) x max(1, height / 2). An odd last row or column is
+// dropped. Works on two channels at a time in 0x00FF00FF lanes.
+inline void downsample_2x_32bpp(const std::uint32_t* src, std::uint32_t* dst,
+	std::uint32_t width, std::uint32_t height) noexcept
+{
+	const size_t w = width, dw = std::max<size_t>(1, w / 2), dh = std::max<size_t>(1, height / 2);
+	const size_t next_col = width > 1 ? 1 : 0, next_row = height > 1 ? w : 0;
+	constexpr std::uint32_t mask = 0x00FF00FF;
+
+	for (size_t y = 0; y < dh; ++y) {
+		const auto* r0 = src + 2 * y * w;
+		const auto* r1 = r0 + next_row;
+		auto* d = dst + y * dw;
+		for (size_t x = 0; x < dw; ++x) {
+			const auto a = r0[2 * x], b = r0[2 * x + next_col], c = r1[2 * x], e = r1[2 * x + next_col];
+			const std::uint32_t rb = ((a & mask) + (b & mask) + (c & mask) + (e & mask) + 0x00020002) >> 2;
+			const std::uint32_t ag = (((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((e >> 8) & mask) + 0x00020002) >> 2;
+			d[x] = (rb & mask) | ((ag & mask) << 8);
+		}
+	}
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "image_buffer.hpp"
+#include "inflate.hpp"
+
+// Portable PNG decoder: every colour type and bit depth, tRNS transparency
+// and Adam7 interlacing. 16-bit samples are cut to 8 bits; gamma chunks are
+// ignored, an embedded ICC profile is handed back.
+namespace png {
+
+inline std::uint32_t read_u32(const std::uint8_t* p) noexcept {
+	return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+inline bool is_png(const std::uint8_t* data, size_t size) noexcept {
+	static constexpr std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	return size >= 8 && std::memcmp(data, signature, 8) == 0;
+}
+
+struct header {
+	std::uint32_t width = 0;
+	std::uint32_t height = 0;
+	std::uint8_t bit_depth = 0;
+	std::uint8_t color_type = 0;
+	std::uint8_t interlace = 0;
+
+	int channels() const noexcept {
+		switch (color_type) {
+		case 0: return 1; // grey
+		case 2: return 3; // RGB
+		case 3: return 1; // palette
+		case 4: return 2; // grey + alpha
+		case 6: return 4; // RGBA
+		default: return 0;
+		}
+	}
+};
+
+// IHDR, always the first chunk.
+inline bool read_header(const std::uint8_t* data, size_t size, header& h) noexcept {
+	if (size < 33 || !is_png(data, size) || read_u32(data + 8) != 13 || std::memcmp(data + 12, "IHDR", 4) != 0) return false;
+	const auto* p = data + 16;
+	h.width = read_u32(p);
+	h.height = read_u32(p + 4);
+	h.bit_depth = p[8];
+	h.color_type = p[9];
+	h.interlace = p[12];
+	if (h.width == 0 || h.height == 0 || h.width > (1u << 24) || h.height > (1u << 24) || h.channels() == 0 || h.interlace > 1) return false;
+	switch (h.bit_depth) {
+	case 1: case 2: case 4: return h.color_type == 0 || h.color_type == 3;
+	case 8: return true;
+	case 16: return h.color_type != 3;
+	default: return false;
+	}
+}
+
+inline bool dimensions(const std::uint8_t* data, size_t size, std::uint32_t& width, std::uint32_t& height) noexcept {
+	header h;
+	if (!read_header(data, size, h)) return false;
+	width = h.width;
+	height = h.height;
+	return true;
+}
+
+inline bool is_high_bit_depth(const std::uint8_t* data, size_t size) noexcept {
+	header h;
+	return read_header(data, size, h) && h.bit_depth == 16;
+}
+
+namespace detail {
+
+inline std::uint8_t paeth(int a, int b, int c) noexcept {
+	const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc) return static_cast<std::uint8_t>(a);
+	return static_cast<std::uint8_t>(pb <= pc ? b : c);
+}
+
+// In place, `prev` is the unfiltered row above or null for the first one.
+inline bool unfilter(std::uint8_t filter, std::uint8_t* row, const std::uint8_t* prev, size_t bytes, size_t bpp) noexcept {
+	switch (filter) {
+	case 0:
+		break;
+	case 1:
+		for (size_t i = bpp; i < bytes; ++i) row[i] = static_cast<std::uint8_t>(row[i] + row[i - bpp]);
+		break;
+	case 2:
+		if (prev) for (size_t i = 0; i < bytes; ++i) row[i] = static_cast<std::uint8_t>(row[i] + prev[i]);
+		break;
+	case 3:
+		for (size_t i = 0; i < bytes; ++i) {
+			const int left = i >= bpp ? row[i - bpp] : 0, up = prev ? prev[i] : 0;
+			row[i] = static_cast<std::uint8_t>(row[i] + ((left + up) >> 1));
+		}
+		break;
+	case 4:
+		for (size_t i = 0; i < bytes; ++i) {
+			const int left = i >= bpp ? row[i - bpp] : 0, up = prev ? prev[i] : 0, corner = prev && i >= bpp ? prev[i - bpp] : 0;
+			row[i] = static_cast<std::uint8_t>(row[i] + paeth(left, up, corner));
+		}
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+// Everything the pixels need besides the samples.
+struct palette {
+	std::uint32_t colors[256] = {}; // straight BGRA
+	std::uint16_t key[3] = {};      // tRNS colour of grey and RGB images
+	bool has_key = false;
+};
+
+inline std::uint32_t premultiply(std::uint32_t r, std::uint32_t g, std::uint32_t b, std::uint32_t a) noexcept {
+	if (a == 255) return 0xFF000000u | (r << 16) | (g << 8) | b;
+	auto pm = [a](std::uint32_t c) { return (c * a + 127) / 255; };
+	return (a << 24) | (pm(r) << 16) | (pm(g) << 8) | pm(b);
+}
+
+// One unfiltered row of `n` pixels to every `step`-th pixel of `dst`.
+inline void convert_row(const header& h, const palette& pal, const std::uint8_t* src, std::uint32_t* dst, std::uint32_t n, std::uint32_t step) noexcept {
+	const int depth = h.bit_depth;
+	auto sample = [&](std::uint32_t x, int c) -> std::uint32_t {
+		// the high byte of 16-bit samples
+		return depth == 16 ? src[(size_t(x) * h.channels() + c) * 2] : src[size_t(x) * h.channels() + c];
+	};
+	auto raw16 = [&](std::uint32_t x, int c) -> std::uint16_t {
+		const auto* p = src + (size_t(x) * h.channels() + c) * 2;
+		return static_cast<std::uint16_t>(p[0] << 8 | p[1]);
+	};
+
+	switch (h.color_type) {
+	case 0:
+		if (depth < 8) {
+			const std::uint32_t mask = (1u << depth) - 1, scale = 255 / mask;
+			for (std::uint32_t x = 0; x < n; ++x) {
+				const std::uint32_t bit = x * depth;
+				const std::uint32_t v = (src[bit / 8] >> (8 - depth - bit % 8)) & mask;
+				const std::uint32_t g = v * scale;
+				dst[size_t(x) * step] = pal.has_key && v == pal.key[0] ? 0 : premultiply(g, g, g, 255);
+			}
+		} else {
+			for (std::uint32_t x = 0; x < n; ++x) {
+				const std::uint32_t g = sample(x, 0);
+				const bool transparent = pal.has_key && (depth == 16 ? raw16(x, 0) : g) == pal.key[0];
+				dst[size_t(x) * step] = transparent ? 0 : premultiply(g, g, g, 255);
+			}
+		}
+		break;
+	case 3: {
+		const std::uint32_t mask = (1u << depth) - 1;
+		for (std::uint32_t x = 0; x < n; ++x) {
+			const std::uint32_t bit = x * depth;
+			const std::uint32_t i = depth == 8 ? src[x] : (src[bit / 8] >> (8 - depth - bit % 8)) & mask;
+			const std::uint32_t c = pal.colors[i];
+			dst[size_t(x) * step] = premultiply((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, c >> 24);
+		}
+		break;
+	}
+	case 2:
+		for (std::uint32_t x = 0; x < n; ++x) {
+			const bool transparent = pal.has_key && (depth == 16
+				? raw16(x, 0) == pal.key[0] && raw16(x, 1) == pal.key[1] && raw16(x, 2) == pal.key[2]
+				: sample(x, 0) == pal.key[0] && sample(x, 1) == pal.key[1] && sample(x, 2) == pal.key[2]);
+			dst[size_t(x) * step] = transparent ? 0 : premultiply(sample(x, 0), sample(x, 1), sample(x, 2), 255);
+		}
+		break;
+	case 4:
+		for (std::uint32_t x = 0; x < n; ++x) {
+			const std::uint32_t g = sample(x, 0);
+			dst[size_t(x) * step] = premultiply(g, g, g, sample(x, 1));
+		}
+		break;
+	case 6:
+		if (depth == 8) {
+			for (std::uint32_t x = 0; x < n; ++x, src += 4) dst[size_t(x) * step] = premultiply(src[0], src[1], src[2], src[3]);
+		} else {
+			for (std::uint32_t x = 0; x < n; ++x) dst[size_t(x) * step] = premultiply(sample(x, 0), sample(x, 1), sample(x, 2), sample(x, 3));
+		}
+		break;
+	}
+}
+
+} // namespace detail
+
+// `icc`, when given, receives the embedded profile if there is one.
+inline bool decode(const std::uint8_t* data, size_t size, image_buffer& out, std::vector<std::uint8_t>* icc = nullptr) {
+	header h;
+	if (!read_header(data, size, h)) return false;
+
+	detail::palette pal;
+	std::vector<std::uint8_t> idat;
+	bool has_palette = false;
+	for (size_t pos = 8; pos + 12 <= size;) {
+		const std::uint32_t length = read_u32(data + pos);
+		const auto* type = data + pos + 4;
+		const auto* body = data + pos + 8;
+		if (length > size - pos - 12) return false;
+
+		if (std::memcmp(type, "IDAT", 4) == 0) {
+			idat.insert(idat.end(), body, body + length);
+		} else if (std::memcmp(type, "PLTE", 4) == 0) {
+			if (length % 3 || length > 768) return false;
+			for (std::uint32_t i = 0; i < length / 3; ++i) {
+				pal.colors[i] = 0xFF000000u | (std::uint32_t(body[i * 3]) << 16) | (std::uint32_t(body[i * 3 + 1]) << 8) | body[i * 3 + 2];
+			}
+			has_palette = true;
+		} else if (std::memcmp(type, "tRNS", 4) == 0) {
+			if (h.color_type == 3) {
+				for (std::uint32_t i = 0; i < std::min<std::uint32_t>(length, 256); ++i) {
+					pal.colors[i] = (pal.colors[i] & 0x00FFFFFFu) | (std::uint32_t(body[i]) << 24);
+				}
+			} else if (h.color_type == 0 && length >= 2) {
+				pal.key[0] = static_cast<std::uint16_t>(body[0] << 8 | body[1]);
+				pal.has_key = true;
+			} else if (h.color_type == 2 && length >= 6) {
+				for (int c = 0; c < 3; ++c) pal.key[c] = static_cast<std::uint16_t>(body[c * 2] << 8 | body[c * 2 + 1]);
+				pal.has_key = true;
+			}
+		} else if (std::memcmp(type, "iCCP", 4) == 0 && icc) {
+			// name, NUL, compression method, zlib stream
+			const auto* nul = static_cast<const std::uint8_t*>(std::memchr(body, 0, std::min<std::uint32_t>(length, 80)));
+			if (nul && nul + 2 <= body + length) {
+				icc->clear();
+				if (!inflate::zlib(nul + 2, static_cast<size_t>(body + length - nul - 2), *icc, size_t(1) << 24)) icc->clear();
+			}
+		} else if (std::memcmp(type, "IEND", 4) == 0) {
+			break;
+		}
+		pos += size_t(length) + 12;
+	}
+	if (idat.empty() || (h.color_type == 3 && !has_palette)) return false;
+
+	const size_t bits_per_pixel = size_t(h.channels()) * h.bit_depth;
+	const size_t bpp = std::max<size_t>(1, bits_per_pixel / 8);
+	auto row_bytes = [&](std::uint32_t w) { return (w * bits_per_pixel + 7) / 8; };
+
+	struct pass { std::uint32_t x0, y0, dx, dy; };
+	static constexpr pass adam7[7] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}};
+	static constexpr pass whole[1] = {{0, 0, 1, 1}};
+	const pass* passes = h.interlace ? adam7 : whole;
+	const int n_passes = h.interlace ? 7 : 1;
+
+	size_t expected = 0;
+	for (int i = 0; i < n_passes; ++i) {
+		const auto& p = passes[i];
+		const std::uint32_t pw = (h.width - p.x0 + p.dx - 1) / p.dx, ph = (h.height - p.y0 + p.dy - 1) / p.dy;
+		if (h.width > p.x0 && h.height > p.y0) expected += (row_bytes(pw) + 1) * ph;
+	}
+
+	std::vector<std::uint8_t> raw;
+	raw.reserve(expected);
+	if (!inflate::zlib(idat.data(), idat.size(), raw, expected) && raw.size() < expected) return false;
+	if (raw.size() < expected) return false;
+
+	out.allocate(h.width, h.height);
+	if (h.interlace) std::fill(out.data(), out.data() + size_t(h.width) * h.height, 0u);
+
+	std::uint8_t* in = raw.data();
+	for (int i = 0; i < n_passes; ++i) {
+		const auto& p = passes[i];
+		if (h.width <= p.x0 || h.height <= p.y0) continue;
+		const std::uint32_t pw = (h.width - p.x0 + p.dx - 1) / p.dx, ph = (h.height - p.y0 + p.dy - 1) / p.dy;
+		const size_t bytes = row_bytes(pw);
+		const std::uint8_t* prev = nullptr;
+		for (std::uint32_t y = 0; y < ph; ++y) {
+			const std::uint8_t filter = *in++;
+			if (!detail::unfilter(filter, in, prev, bytes, bpp)) return false;
+			detail::convert_row(h, pal, in, out.data() + size_t(p.y0 + y * p.dy) * h.width + p.x0, pw, p.dx);
+			prev = in;
+			in += bytes;
+		}
+	}
+	return true;
+}
+
+} // namespace png
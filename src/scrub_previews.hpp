@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "image_buffer.hpp"
+#include "metrics.hpp"
+#include "pixel_ops.hpp"
+#include "thread_pool.hpp"
+
+// Small previews for the scrub bar. While the bar is dragged only the
+// position under the cursor is wanted: a request replaces the one before
+// it, and a single pool job decodes whatever is wanted when it gets to it,
+// so positions passed over are never decoded. Previews are kept by catalog
+// index in an LRU bounded by bytes, scrubbing back over a stretch is free.
+namespace scrub {
+
+// Halves `src` until its longer side is at most 2 * `side`.
+inline image_buffer shrink(image_buffer src, std::uint32_t side) {
+	while (std::max(src.width, src.height) > 2 * side) {
+		image_buffer half;
+		half.allocate(std::max(1u, src.width / 2), std::max(1u, src.height / 2));
+		downsample_2x_32bpp(src.data(), half.data(), src.width, src.height);
+		src = std::move(half);
+	}
+	return src;
+}
+
+// The entry a bar `width` wide shows at `x`, the ends are the first and
+// last of `n`.
+inline std::int64_t index_at(float x, float width, std::int64_t n) {
+	if (n <= 1 || width <= 0.0f) return 0;
+	const float t = std::clamp(x / width, 0.0f, 1.0f);
+	return std::min<std::int64_t>(n - 1, static_cast<std::int64_t>(t * static_cast<float>(n - 1) + 0.5f));
+}
+
+template<typename ThreadPool>
+class previews {
+public:
+	// Any pool thread: the picture `idx` at some reduced size, false if it
+	// can't be read.
+	using decoder = std::function<bool(std::int64_t idx, image_buffer& out)>;
+	// Pool thread, the preview of `idx` is in.
+	using listener = std::function<void(std::int64_t idx)>;
+private:
+	using entry = std::pair<std::int64_t, std::shared_ptr<const image_buffer>>;
+
+	ThreadPool& pool_;
+	const size_t budget_;
+	const std::uint32_t side_;
+	listener listener_;
+	std::mutex mutex_;
+	std::condition_variable idle_;
+	decoder decoder_;
+	// bumped by reset(), a preview decoded for an older catalog is dropped
+	std::uint64_t generation_ = 0;
+	std::int64_t wanted_ = -1;
+	bool busy_ = false;
+	// most recently used first
+	std::list<entry> lru_;
+	std::unordered_map<std::int64_t, std::list<entry>::iterator> by_index_;
+	size_t bytes_ = 0;
+	metrics::counter& decoded_ = metrics::get_counter("scrub.previews");
+	metrics::counter& skipped_ = metrics::get_counter("scrub.skipped");
+	metrics::gauge& cached_bytes_ = metrics::get_gauge("scrub.cached_bytes");
+
+	// under mutex_
+	void evict() {
+		while (bytes_ > budget_ && lru_.size() > 1) {
+			bytes_ -= lru_.back().second->pixels.size();
+			by_index_.erase(lru_.back().first);
+			lru_.pop_back();
+		}
+		cached_bytes_.set(static_cast<double>(bytes_));
+	}
+
+	void run() {
+		while (true) {
+			std::int64_t idx;
+			std::uint64_t generation;
+			decoder decode;
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				if (wanted_ < 0) {
+					busy_ = false;
+					idle_.notify_all();
+					return;
+				}
+				idx = std::exchange(wanted_, -1);
+				generation = generation_;
+				decode = decoder_;
+			}
+			image_buffer out;
+			if (!decode || !decode(idx, out) || !out) continue;
+			auto preview = std::make_shared<const image_buffer>(shrink(std::move(out), side_));
+			decoded_.add();
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				if (generation != generation_ || by_index_.count(idx)) continue;
+				bytes_ += preview->pixels.size();
+				lru_.emplace_front(idx, std::move(preview));
+				by_index_.emplace(idx, lru_.begin());
+				evict();
+			}
+			if (listener_) listener_(idx);
+		}
+	}
+public:
+	// The preview of `idx`, null until it's decoded.
+	std::shared_ptr<const image_buffer> find(std::int64_t idx) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		const auto it = by_index_.find(idx);
+		if (it == by_index_.end()) return nullptr;
+		lru_.splice(lru_.begin(), lru_, it->second);
+		return it->second->second;
+	}
+
+	// Latest wins: a position still waiting is dropped for this one.
+	void request(std::int64_t idx) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		if (by_index_.count(idx)) return;
+		if (wanted_ >= 0 && wanted_ != idx) skipped_.add();
+		wanted_ = idx;
+		if (busy_) return;
+		busy_ = true;
+		async<false>(pool_.ctx(), [this]() { run(); });
+	}
+
+	// Nothing is wanted any more, a decode under way still finishes.
+	void cancel() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		wanted_ = -1;
+	}
+
+	// Another catalog: the previews go and `decode` reads from it.
+	void reset(decoder decode) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		++generation_;
+		decoder_ = std::move(decode);
+		wanted_ = -1;
+		lru_.clear();
+		by_index_.clear();
+		bytes_ = 0;
+		cached_bytes_.set(0.0);
+	}
+
+	size_t bytes() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		return bytes_;
+	}
+
+	// Previews of about `side` pixels, at most `budget` bytes of them.
+	previews(ThreadPool& pool, size_t budget, std::uint32_t side, listener l)
+		: pool_{pool}, budget_{budget}, side_{side}, listener_{std::move(l)} {}
+	previews(const previews&) = delete;
+	previews& operator=(const previews&) = delete;
+	// waits for the pool job, it refers to this
+	~previews() {
+		std::unique_lock<std::mutex> lk(mutex_);
+		wanted_ = -1;
+		idle_.wait(lk, [this]() { return !busy_; });
+	}
+};
+
+} // namespace scrub
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <cerrno>
+#	include <cstdlib>
+#	include <poll.h>
+#	include <sys/socket.h>
+#	include <sys/time.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+#endif
+
+// One viewer per user session. A launch first offers its path to the
+// running viewer over a local endpoint, a named pipe on Windows and a Unix
+// socket elsewhere, and exits if it was taken. Otherwise it claims the
+// endpoint and serves the launches after it.
+//
+// A request is a little-endian u32 length and the path, the reply is one
+// byte, 1 once the path was handed to the viewer. Either side gives up on a
+// request that isn't through by its deadline.
+namespace single_instance {
+
+constexpr std::uint32_t max_path_bytes = 64 * 1024;
+
+namespace detail {
+
+using clock = std::chrono::steady_clock;
+
+// Whole milliseconds left until `deadline`, 0 once it passed.
+inline long long remaining(clock::time_point deadline) noexcept {
+	const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+	return left > 0 ? left : 0;
+}
+
+#ifdef _WIN32
+using handle = HANDLE;
+inline handle invalid_handle() noexcept { return INVALID_HANDLE_VALUE; }
+inline void close(handle h) noexcept { ::CloseHandle(h); }
+
+inline std::wstring widen(std::string_view ascii) { return std::wstring(ascii.begin(), ascii.end()); }
+
+// Both ends of the pipe are opened for overlapped I/O, so a read or write
+// can be waited for with a timeout and cancelled.
+struct overlapped : OVERLAPPED {
+	overlapped() noexcept : OVERLAPPED{} { hEvent = ::CreateEventW(nullptr, TRUE, FALSE, nullptr); }
+	overlapped(const overlapped&) = delete;
+	overlapped& operator=(const overlapped&) = delete;
+	~overlapped() { if (hEvent) ::CloseHandle(hEvent); }
+};
+
+// The bytes an I/O `started` on `o` moved, 0 when it failed or was still
+// pending at `deadline`; a pending one is cancelled before `o` can go.
+inline DWORD finish(handle h, overlapped& o, BOOL started, clock::time_point deadline) noexcept {
+	DWORD n = 0;
+	if (!started && ::GetLastError() != ERROR_IO_PENDING) return 0;
+	if (::WaitForSingleObject(o.hEvent, static_cast<DWORD>(remaining(deadline))) != WAIT_OBJECT_0) {
+		::CancelIoEx(h, &o);
+		::GetOverlappedResult(h, &o, &n, TRUE);
+		return 0;
+	}
+	return ::GetOverlappedResult(h, &o, &n, FALSE) ? n : 0;
+}
+
+inline bool read_exact(handle h, void* data, size_t size, clock::time_point deadline) noexcept {
+	overlapped o;
+	if (!o.hEvent) return false;
+	auto* p = static_cast<char*>(data);
+	while (size) {
+		const DWORD n = finish(h, o, ::ReadFile(h, p, static_cast<DWORD>(size), nullptr, &o), deadline);
+		if (n == 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+inline bool write_exact(handle h, const void* data, size_t size, clock::time_point deadline) noexcept {
+	overlapped o;
+	if (!o.hEvent) return false;
+	auto* p = static_cast<const char*>(data);
+	while (size) {
+		const DWORD n = finish(h, o, ::WriteFile(h, p, static_cast<DWORD>(size), nullptr, &o), deadline);
+		if (n == 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+// Another instance of the pipe for the next client, `first` fails if any
+// process already owns the name.
+inline handle create_pipe(const std::string& endpoint, bool first) noexcept {
+	return ::CreateNamedPipeW(widen(endpoint).c_str(),
+		PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+		PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, nullptr);
+}
+
+inline handle connect(const std::string& endpoint, std::chrono::milliseconds timeout) noexcept {
+	const auto name = widen(endpoint);
+	// fails at once when nobody serves the name
+	if (!::WaitNamedPipeW(name.c_str(), static_cast<DWORD>(timeout.count()))) return invalid_handle();
+	return ::CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+}
+#else
+using handle = int;
+inline handle invalid_handle() noexcept { return -1; }
+inline void close(handle h) noexcept { ::close(h); }
+
+// False when `events` don't come on `h` before `deadline`.
+inline bool ready(handle h, short events, clock::time_point deadline) noexcept {
+	while (true) {
+		pollfd fd{h, events, 0};
+		const int n = ::poll(&fd, 1, static_cast<int>(remaining(deadline)));
+		if (n < 0 && errno == EINTR) continue;
+		return n > 0;
+	}
+}
+
+inline bool read_exact(handle h, void* data, size_t size, clock::time_point deadline) noexcept {
+	auto* p = static_cast<char*>(data);
+	while (size) {
+		if (!ready(h, POLLIN, deadline)) return false;
+		const auto n = ::recv(h, p, size, 0);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+inline bool write_exact(handle h, const void* data, size_t size, clock::time_point deadline) noexcept {
+	auto* p = static_cast<const char*>(data);
+	while (size) {
+		if (!ready(h, POLLOUT, deadline)) return false;
+		const auto n = ::send(h, p, size, MSG_NOSIGNAL);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+// Each recv or send gives up after `timeout` even without a poll first,
+// and a connect into a full backlog does too.
+inline void set_timeouts(handle s, std::chrono::milliseconds timeout) noexcept {
+	timeval tv{static_cast<time_t>(timeout.count() / 1000), static_cast<suseconds_t>(timeout.count() % 1000 * 1000)};
+	::setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	::setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+inline bool address(const std::string& endpoint, sockaddr_un& addr) noexcept {
+	addr = {};
+	addr.sun_family = AF_UNIX;
+	if (endpoint.size() >= sizeof(addr.sun_path)) return false;
+	endpoint.copy(addr.sun_path, endpoint.size());
+	return true;
+}
+
+inline handle connect(const std::string& endpoint, std::chrono::milliseconds timeout) noexcept {
+	sockaddr_un addr;
+	if (!address(endpoint, addr)) return invalid_handle();
+	const handle s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) return invalid_handle();
+	set_timeouts(s, timeout);
+	if (::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+		::close(s);
+		return invalid_handle();
+	}
+	return s;
+}
+#endif
+
+} // namespace detail
+
+// Per user and session: a pipe name on Windows, a socket path elsewhere.
+inline std::string default_endpoint() {
+#ifdef _WIN32
+	DWORD session = 0;
+	::ProcessIdToSessionId(::GetCurrentProcessId(), &session);
+	return "\\\\.\\pipe\\imv-" + std::to_string(session);
+#else
+	if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) return std::string(runtime) + "/imv.sock";
+	return "/tmp/imv-" + std::to_string(::getuid()) + ".sock";
+#endif
+}
+
+// True if the viewer serving `endpoint` took `path`.
+inline bool forward(const std::string& endpoint, std::string_view path,
+	std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+{
+	if (path.size() > max_path_bytes) return false;
+	const auto deadline = detail::clock::now() + timeout;
+	const auto h = detail::connect(endpoint, timeout);
+	if (h == detail::invalid_handle()) return false;
+#ifdef _WIN32
+	// lets the viewer come to the front, only the launch the user clicked may
+	ULONG server = 0;
+	if (::GetNamedPipeServerProcessId(h, &server)) ::AllowSetForegroundWindow(server);
+#endif
+	const auto n = static_cast<std::uint32_t>(path.size());
+	const std::uint8_t length[4] = {
+		static_cast<std::uint8_t>(n), static_cast<std::uint8_t>(n >> 8),
+		static_cast<std::uint8_t>(n >> 16), static_cast<std::uint8_t>(n >> 24),
+	};
+	std::uint8_t reply = 0;
+	const bool ok = detail::write_exact(h, length, 4, deadline) && detail::write_exact(h, path.data(), path.size(), deadline)
+		&& detail::read_exact(h, &reply, 1, deadline) && reply == 1;
+	detail::close(h);
+	return ok;
+}
+
+// Paths the server took, kept until the viewer's thread takes them, so a
+// message that only says one is waiting owns nothing. Once closed, as the
+// viewer goes, it turns new ones away and drops what it held.
+class mailbox {
+	std::mutex mutex_;
+	std::deque<std::string> paths_;
+	bool closed_ = false;
+public:
+	// `notify()` tells the viewer, under the lock so close() can't come in
+	// between. False, and the path isn't kept, when closed or it failed.
+	template<typename Notify>
+	bool put(std::string path, Notify&& notify) {
+		std::lock_guard<std::mutex> lk(mutex_);
+		if (closed_) return false;
+		paths_.push_back(std::move(path));
+		if (notify()) return true;
+		paths_.pop_back();
+		return false;
+	}
+
+	// The oldest path, in the order they came.
+	std::optional<std::string> take() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		if (paths_.empty()) return std::nullopt;
+		auto path = std::move(paths_.front());
+		paths_.pop_front();
+		return path;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		closed_ = true;
+		paths_.clear();
+	}
+};
+
+// The endpoint's owner. `claim` first, it fails while another process
+// serves; `serve` then answers requests on a thread of its own until
+// `stop` or destruction.
+class server {
+public:
+	// Called on the server thread, true once the viewer has the path.
+	using handler = std::function<bool(std::string path)>;
+private:
+	std::string endpoint_;
+	detail::handle listener_ = detail::invalid_handle();
+	std::thread thread_;
+	std::atomic<bool> stop_{false};
+	handler handler_;
+	// a client that connects and goes quiet holds the thread no longer
+	std::chrono::milliseconds timeout_;
+
+	void answer(detail::handle h) {
+		const auto deadline = detail::clock::now() + timeout_;
+		std::uint8_t length[4];
+		if (!detail::read_exact(h, length, 4, deadline)) return;
+		const std::uint32_t n = length[0] | (length[1] << 8) | (length[2] << 16) | (std::uint32_t(length[3]) << 24);
+		if (n > max_path_bytes) return;
+		std::string path(n, '\0');
+		if (!detail::read_exact(h, path.data(), n, deadline)) return;
+		const std::uint8_t reply = !stop_ && handler_(std::move(path)) ? 1 : 0;
+		detail::write_exact(h, &reply, 1, deadline);
+	}
+
+	void run() {
+#ifdef _WIN32
+		// the next pipe instance exists before the current one closes, so
+		// the name is never free for a second viewer to claim
+		auto pipe = listener_;
+		listener_ = detail::invalid_handle();
+		while (pipe != INVALID_HANDLE_VALUE) {
+			// waits for a client as long as it takes, stop() connects one
+			detail::overlapped o;
+			DWORD unused = 0;
+			bool connected = o.hEvent && ::ConnectNamedPipe(pipe, &o);
+			if (!connected && o.hEvent) {
+				const auto error = ::GetLastError();
+				connected = error == ERROR_PIPE_CONNECTED
+					|| (error == ERROR_IO_PENDING && ::GetOverlappedResult(pipe, &o, &unused, TRUE));
+			}
+			const auto next = stop_ ? INVALID_HANDLE_VALUE : detail::create_pipe(endpoint_, false);
+			if (connected && !stop_) answer(pipe);
+			::FlushFileBuffers(pipe);
+			::DisconnectNamedPipe(pipe);
+			::CloseHandle(pipe);
+			pipe = next;
+		}
+#else
+		while (!stop_) {
+			const int client = ::accept(listener_, nullptr, nullptr);
+			if (client < 0) {
+				if (errno == EINTR || errno == ECONNABORTED) continue;
+				break;
+			}
+			detail::set_timeouts(client, timeout_);
+			if (!stop_) answer(client);
+			::close(client);
+		}
+#endif
+	}
+public:
+	bool claim(const std::string& endpoint) {
+		endpoint_ = endpoint;
+#ifdef _WIN32
+		listener_ = detail::create_pipe(endpoint, true);
+		return listener_ != INVALID_HANDLE_VALUE;
+#else
+		sockaddr_un addr;
+		if (!detail::address(endpoint, addr)) return false;
+		listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener_ < 0) return false;
+		auto bind = [&]() { return ::bind(listener_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0; };
+		bool bound = bind();
+		if (!bound && errno == EADDRINUSE) {
+			// a socket file nobody answers on is left over from a crash
+			const auto probe = detail::connect(endpoint, std::chrono::milliseconds(100));
+			if (probe != detail::invalid_handle()) {
+				::close(probe);
+			} else {
+				::unlink(endpoint.c_str());
+				bound = bind();
+			}
+		}
+		if (!bound || ::listen(listener_, 16) != 0) {
+			::close(listener_);
+			listener_ = -1;
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	void serve(handler h) {
+		handler_ = std::move(h);
+		thread_ = std::thread(&server::run, this);
+	}
+
+	void stop() {
+		if (stop_.exchange(true)) return;
+		if (thread_.joinable()) {
+			// wakes the blocked accept with a connection of our own
+			const auto h = detail::connect(endpoint_, std::chrono::milliseconds(1000));
+			if (h != detail::invalid_handle()) detail::close(h);
+			thread_.join();
+		}
+		if (listener_ != detail::invalid_handle()) {
+			detail::close(listener_);
+			listener_ = detail::invalid_handle();
+#ifndef _WIN32
+			::unlink(endpoint_.c_str());
+#endif
+		}
+	}
+
+	// How long a client has to send its path and take the reply.
+	explicit server(std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) : timeout_{timeout} {}
+	server(const server&) = delete;
+	server& operator=(const server&) = delete;
+
+	~server() { stop(); }
+};
+
+} // namespace single_instance
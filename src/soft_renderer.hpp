@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define IMV_SSE2
+#	include <emmintrin.h>
+#endif
+
+#include "image_buffer.hpp"
+#include "thread_pool.hpp"
+
+// CPU compositing backend: draws a premultiplied BGRA image under an arbitrary
+// affine transform into an offscreen buffer with bilinear filtering. Used when
+// there is no usable D3D device and headlessly by the benchmarks.
+namespace soft {
+
+// Row-vector convention, same as D2D1::Matrix3x2F: x' = x*m11 + y*m21 + dx
+struct affine {
+	float m11 = 1.0f, m12 = 0.0f;
+	float m21 = 0.0f, m22 = 1.0f;
+	float dx = 0.0f, dy = 0.0f;
+
+	static affine translation(float x, float y) noexcept { return {1.0f, 0.0f, 0.0f, 1.0f, x, y}; }
+	static affine scale(float sx, float sy) noexcept { return {sx, 0.0f, 0.0f, sy, 0.0f, 0.0f}; }
+
+	// `*this` first, then `o`
+	affine operator*(const affine& o) const noexcept {
+		return {
+			m11 * o.m11 + m12 * o.m21, m11 * o.m12 + m12 * o.m22,
+			m21 * o.m11 + m22 * o.m21, m21 * o.m12 + m22 * o.m22,
+			dx * o.m11 + dy * o.m21 + o.dx, dx * o.m12 + dy * o.m22 + o.dy
+		};
+	}
+
+	affine inverted() const noexcept {
+		const float invdet = 1.0f / (m11 * m22 - m12 * m21);
+		return {
+			invdet * m22, invdet * -m12,
+			invdet * -m21, invdet * m11,
+			invdet * (m21 * dy - m22 * dx), invdet * (m12 * dx - m11 * dy)
+		};
+	}
+};
+
+// Maps source pixel space to the space of the same image rotated clockwise
+// by `quarter_turns` * 90 degrees.
+inline affine rotation(int quarter_turns, float width, float height) noexcept {
+	switch (quarter_turns & 3) {
+	case 1: return {0.0f, 1.0f, -1.0f, 0.0f, height, 0.0f};
+	case 2: return {-1.0f, 0.0f, 0.0f, -1.0f, width, height};
+	case 3: return {0.0f, -1.0f, 1.0f, 0.0f, 0.0f, width};
+	default: return {};
+	}
+}
+
+namespace detail {
+
+// Range of integer x in [0, n) for which lo <= a + b*x < hi.
+inline void solve_range(float a, float b, float lo, float hi, std::int64_t n, std::int64_t& x0, std::int64_t& x1) noexcept {
+	if (b == 0.0f) {
+		if (a >= lo && a < hi) { x0 = 0; x1 = n; }
+		else { x0 = x1 = 0; }
+		return;
+	}
+	double t0 = (lo - a) / double(b), t1 = (hi - a) / double(b);
+	if (t0 > t1) std::swap(t0, t1);
+	x0 = std::clamp<std::int64_t>(static_cast<std::int64_t>(std::ceil(t0)), 0, n);
+	x1 = std::clamp<std::int64_t>(static_cast<std::int64_t>(std::ceil(t1)), 0, n);
+	if (x1 < x0) x1 = x0;
+}
+
+inline std::uint32_t lerp_scalar(std::uint32_t p0, std::uint32_t p1, std::uint32_t w) noexcept {
+	// two channels at a time in 0x00FF00FF lanes
+	const std::uint32_t rb = ((p0 & 0x00FF00FF) * (256 - w) + (p1 & 0x00FF00FF) * w) >> 8;
+	const std::uint32_t ag = (((p0 >> 8) & 0x00FF00FF) * (256 - w) + ((p1 >> 8) & 0x00FF00FF) * w) >> 8;
+	return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+inline std::uint32_t over_scalar(std::uint32_t s, std::uint32_t bg) noexcept {
+	const std::uint32_t inv = 255 - (s >> 24);
+	if (inv == 0) return s;
+	auto scale = [inv](std::uint32_t x) {
+		x *= inv;
+		return ((x + ((x >> 8) & 0x00FF00FF) + 0x00800080) >> 8) & 0x00FF00FF;
+	};
+	return s + (scale(bg & 0x00FF00FF) | (scale((bg >> 8) & 0x00FF00FF) << 8));
+}
+
+// Bilinear sample with the coordinates clamped to the image, for the edges.
+inline std::uint32_t sample_clamped(const image_buffer& src, float u, float v) noexcept {
+	const float maxu = static_cast<float>(src.width - 1), maxv = static_cast<float>(src.height - 1);
+	u = std::clamp(u, 0.0f, maxu);
+	v = std::clamp(v, 0.0f, maxv);
+	const auto ix = static_cast<std::uint32_t>(u), iy = static_cast<std::uint32_t>(v);
+	const auto ix1 = std::min(ix + 1, src.width - 1), iy1 = std::min(iy + 1, src.height - 1);
+	const auto fx = static_cast<std::uint32_t>((u - ix) * 256.0f), fy = static_cast<std::uint32_t>((v - iy) * 256.0f);
+	const auto* r0 = src.data() + size_t(iy) * src.width;
+	const auto* r1 = src.data() + size_t(iy1) * src.width;
+	return lerp_scalar(lerp_scalar(r0[ix], r0[ix1], fx), lerp_scalar(r1[ix], r1[ix1], fx), fy);
+}
+
+// Interior span, every sample and its right/bottom neighbour are inside.
+inline void sample_span(const image_buffer& src, std::uint32_t* dst, std::int64_t n,
+	float u, float v, float du, float dv, std::uint32_t background) noexcept
+{
+	const auto* pixels = src.data();
+	const size_t stride = src.width;
+#ifdef IMV_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bg = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(background)), zero);
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c256 = _mm_set1_epi16(256);
+
+	for (std::int64_t i = 0; i < n; ++i, u += du, v += dv) {
+		const int ix = static_cast<int>(u), iy = static_cast<int>(v);
+		const int fx = static_cast<int>((u - ix) * 256.0f), fy = static_cast<int>((v - iy) * 256.0f);
+		const auto* p = pixels + iy * stride + ix;
+
+		// [p00 p01] and [p10 p11] widened to 16 bits per channel
+		const __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+		const __m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + stride)), zero);
+
+		const __m128i wy = _mm_set1_epi16(static_cast<short>(fy));
+		__m128i col = _mm_add_epi16(_mm_mullo_epi16(top, _mm_sub_epi16(c256, wy)), _mm_mullo_epi16(bottom, wy));
+		col = _mm_srli_epi16(col, 8);
+
+		const __m128i wx = _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<short>(256 - fx)), _mm_set1_epi16(static_cast<short>(fx)));
+		col = _mm_mullo_epi16(col, wx);
+		col = _mm_srli_epi16(_mm_add_epi16(col, _mm_srli_si128(col, 8)), 8);
+
+		// premultiplied "over" the background: s + bg * (255 - a) / 255
+		const __m128i inv_alpha = _mm_sub_epi16(c255, _mm_shufflelo_epi16(col, _MM_SHUFFLE(3, 3, 3, 3)));
+		__m128i b = _mm_mullo_epi16(bg, inv_alpha);
+		b = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(b, _mm_srli_epi16(b, 8)), _mm_set1_epi16(128)), 8);
+		col = _mm_add_epi16(col, b);
+
+		dst[i] = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(col, zero)));
+	}
+#else
+	for (std::int64_t i = 0; i < n; ++i, u += du, v += dv) {
+		const auto ix = static_cast<std::uint32_t>(u), iy = static_cast<std::uint32_t>(v);
+		const auto fx = static_cast<std::uint32_t>((u - ix) * 256.0f), fy = static_cast<std::uint32_t>((v - iy) * 256.0f);
+		const auto* p = pixels + iy * stride + ix;
+		dst[i] = over_scalar(lerp_scalar(lerp_scalar(p[0], p[1], fx), lerp_scalar(p[stride], p[stride + 1], fx), fy), background);
+	}
+#endif
+}
+
+} // namespace detail
+
+// Renders rows [y0, y1) of `target`. `transform` maps source pixel space to target pixel space.
+inline void render_band(const image_buffer& src, image_buffer& target, const affine& transform,
+	std::uint32_t background, std::uint32_t y0, std::uint32_t y1) noexcept
+{
+	const auto inv = transform.inverted();
+	const std::int64_t tw = target.width;
+	const float sw = static_cast<float>(src.width), sh = static_cast<float>(src.height);
+
+	for (std::uint32_t y = y0; y < y1; ++y) {
+		auto* row = target.data() + size_t(y) * target.width;
+		if (!src) {
+			std::fill(row, row + tw, background);
+			continue;
+		}
+
+		// source coordinates of the pixel centres, shifted so that integer
+		// values land on source pixel centres
+		const float py = y + 0.5f;
+		const float u0 = 0.5f * inv.m11 + py * inv.m21 + inv.dx - 0.5f;
+		const float v0 = 0.5f * inv.m12 + py * inv.m22 + inv.dy - 0.5f;
+		const float du = inv.m11, dv = inv.m12;
+
+		// covered: the nearest source pixel exists; interior: the 2x2 footprint
+		// is inside, shrunk by a pixel to stay clear of rounding at the edges
+		std::int64_t cu0, cu1, cv0, cv1, iu0, iu1, iv0, iv1;
+		detail::solve_range(u0, du, -0.5f, sw - 0.5f, tw, cu0, cu1);
+		detail::solve_range(v0, dv, -0.5f, sh - 0.5f, tw, cv0, cv1);
+		detail::solve_range(u0, du, 0.0f, sw - 1.0f, tw, iu0, iu1);
+		detail::solve_range(v0, dv, 0.0f, sh - 1.0f, tw, iv0, iv1);
+
+		const std::int64_t c0 = std::max(cu0, cv0), c1 = std::max(c0, std::min(cu1, cv1));
+		std::int64_t i0 = std::max({iu0, iv0, c0}) + 1, i1 = std::min({iu1, iv1, c1}) - 1;
+		if (i1 <= i0) i0 = i1 = c1;
+
+		std::fill(row, row + c0, background);
+		for (std::int64_t x = c0; x < i0; ++x) {
+			row[x] = detail::over_scalar(detail::sample_clamped(src, u0 + du * x, v0 + dv * x), background);
+		}
+		detail::sample_span(src, row + i0, i1 - i0, u0 + du * i0, v0 + dv * i0, du, dv, background);
+		for (std::int64_t x = i1; x < c1; ++x) {
+			row[x] = detail::over_scalar(detail::sample_clamped(src, u0 + du * x, v0 + dv * x), background);
+		}
+		std::fill(row + c1, row + tw, background);
+	}
+}
+
+// Bands go to their own threads rather than the decode pool, so a frame
+// never waits behind queued decodes and a decode never behind a frame.
+struct render_pool_tag;
+using render_pool = thread_pool<3, render_pool_tag>;
+
+// Renders the whole target split into horizontal bands across the pool,
+// blocks until every band is done. Must not be called from a pool thread.
+template<typename ThreadPool>
+void render(ThreadPool& pool, const image_buffer& src, image_buffer& target, const affine& transform, std::uint32_t background) {
+	const std::uint32_t n_bands = static_cast<std::uint32_t>(ThreadPool::number_of_threads()) * 2;
+	const std::uint32_t band = std::max<std::uint32_t>(16, (target.height + n_bands - 1) / n_bands);
+
+	std::vector<std::future<void>> jobs;
+	for (std::uint32_t y = band; y < target.height; y += band) {
+		jobs.push_back(async<true>(pool.ctx(), [&, y]() {
+			render_band(src, target, transform, background, y, std::min(y + band, target.height));
+		}));
+	}
+	// the calling thread takes the first band itself
+	render_band(src, target, transform, background, 0, std::min(band, target.height));
+	for (auto& job : jobs) job.wait();
+}
+
+} // namespace soft
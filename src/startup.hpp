@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include "metrics.hpp"
+#include "singleton.hpp"
+
+// Startup runs its stages side by side instead of one after another: the
+// D3D device is created on a thread of its own, the opened picture decodes
+// on the pool from the first moment and its folder is enumerated behind
+// it. Each stage records when it finished, relative to process entry, in a
+// `startup.*_ms` gauge; the first frame on screen closes the timeline.
+namespace startup {
+
+enum class stage : size_t {
+	device,
+	first_decode,
+	catalog,
+	first_frame,
+	count
+};
+
+class timeline {
+	static constexpr size_t n_stages = static_cast<size_t>(stage::count);
+	using clock = std::chrono::steady_clock;
+
+	clock::time_point origin_ = clock::now();
+	std::array<std::atomic<double>, n_stages> ms_{};
+	std::array<std::atomic<bool>, n_stages> done_{};
+	std::array<metrics::gauge*, n_stages> gauges_{
+		&metrics::get_gauge("startup.device_ms"),
+		&metrics::get_gauge("startup.first_decode_ms"),
+		&metrics::get_gauge("startup.catalog_ms"),
+		&metrics::get_gauge("startup.first_frame_ms"),
+	};
+public:
+	// Before any stage starts.
+	void begin() noexcept { origin_ = clock::now(); }
+
+	// Only the first mark of a stage counts; later images, windows and
+	// handoffs go through the same code.
+	void mark(stage s) noexcept {
+		const auto i = static_cast<size_t>(s);
+		if (done_[i].exchange(true)) return;
+		const double ms = std::chrono::duration<double, std::milli>(clock::now() - origin_).count();
+		ms_[i].store(ms);
+		gauges_[i]->set(ms);
+	}
+
+	bool done(stage s) const noexcept { return done_[static_cast<size_t>(s)]; }
+	// 0 until the stage is done
+	double ms(stage s) const noexcept { return ms_[static_cast<size_t>(s)]; }
+};
+
+} // namespace startup
+
+using startup_timeline = singleton<startup::timeline>;
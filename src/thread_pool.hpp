@@ -1,15 +1,18 @@
 #pragma once
 
 #include "singleton.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/post.hpp>
 #include <boost/asio/use_future.hpp>
 #include <boost/thread/thread.hpp>
 #include <future>
 
-template<size_t NUMBER_OF_THREADS>
-class thread_pool : public singleton<thread_pool<NUMBER_OF_THREADS>> {
-	friend singleton<thread_pool<NUMBER_OF_THREADS>>;
+// Tag tells apart pools of the same size that must not share threads.
+template<size_t NUMBER_OF_THREADS, typename Tag = void>
+class thread_pool : public singleton<thread_pool<NUMBER_OF_THREADS, Tag>> {
+	friend singleton<thread_pool<NUMBER_OF_THREADS, Tag>>;
 
 	boost::asio::io_context ioc_;
 	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard_;
@@ -45,7 +48,19 @@ using thread_pool_8 = thread_pool<8>;
 template<bool UseFuture, typename Executor, typename Func, typename... Args>
 std::enable_if_t<!UseFuture, void>
 async(Executor& ctx, Func&& job, Args&&... args) {
-	boost::asio::post(ctx, std::bind(std::forward<Func>(job), std::forward<Args>(args)...));
+	static auto& queue_depth = metrics::get_gauge("pool.queue_depth");
+	queue_depth.add(1.0);
+	// when tracing also record how long the job sat in the queue before a thread picked it up
+	boost::asio::post(ctx, [posted = trace::enabled() ? trace::tracer::get_instance().now() : -1,
+		fn = std::bind(std::forward<Func>(job), std::forward<Args>(args)...)]() mutable {
+		queue_depth.add(-1.0);
+		if (posted >= 0) [[unlikely]] {
+			auto& t = trace::tracer::get_instance();
+			t.record("queued", "pool", posted, t.now());
+		}
+		IMV_TRACE_SCOPE("task", "pool");
+		fn();
+	});
 }
 
 template<bool UseFuture, typename Executor, typename Func, typename... Args>
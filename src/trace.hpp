@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "singleton.hpp"
+
+// Lightweight scoped timers exported as Chrome trace events (chrome://tracing,
+// ui.perfetto.dev). Every thread records into its own ring buffer, the owner
+// is the only writer so recording takes no locks; a dump reads the slots
+// under a sequence number each and drops the ones it saw being rewritten.
+// A ring's memory is taken a chunk at a time as it fills, a thread that
+// records nothing costs a few hundred bytes. With tracing switched off a
+// scope costs a relaxed load and a branch; define IMV_NO_TRACE to compile the
+// macros out entirely.
+namespace trace {
+
+struct event {
+	const char* name;
+	const char* category;
+	std::int64_t begin_ns;
+	std::int64_t duration_ns;
+	std::int64_t arg;
+};
+
+constexpr std::int64_t no_arg = -1;
+
+class ring {
+	static constexpr size_t chunk_size = 1024, chunks = 16;
+	static constexpr size_t capacity = chunk_size * chunks;
+
+	// Event n of the ring is whole while seq is 2n + 2 before and after it
+	// is read, the writer sets 2n + 1 first. The fields are atomics so a
+	// read racing the writer is a stale value that gets dropped, not UB.
+	struct slot {
+		std::atomic<std::uint64_t> seq{0};
+		std::atomic<const char*> name{nullptr};
+		std::atomic<const char*> category{nullptr};
+		std::atomic<std::int64_t> begin_ns{0};
+		std::atomic<std::int64_t> duration_ns{0};
+		std::atomic<std::int64_t> arg{0};
+	};
+
+	std::array<std::atomic<slot*>, chunks> chunks_{};
+	std::atomic<std::uint64_t> head_{0};
+	std::uint32_t tid_;
+	std::atomic<const char*> name_{nullptr};
+public:
+	void push(const event& ev) noexcept {
+		const auto head = head_.load(std::memory_order_relaxed);
+		const auto i = head % capacity;
+		auto* chunk = chunks_[i / chunk_size].load(std::memory_order_relaxed);
+		if (!chunk) {
+			// out of memory the event is lost, a trace isn't worth failing for
+			chunk = new (std::nothrow) slot[chunk_size];
+			if (!chunk) return;
+			chunks_[i / chunk_size].store(chunk, std::memory_order_release);
+		}
+		auto& s = chunk[i % chunk_size];
+		s.seq.store(2 * head + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		s.name.store(ev.name, std::memory_order_relaxed);
+		s.category.store(ev.category, std::memory_order_relaxed);
+		s.begin_ns.store(ev.begin_ns, std::memory_order_relaxed);
+		s.duration_ns.store(ev.duration_ns, std::memory_order_relaxed);
+		s.arg.store(ev.arg, std::memory_order_relaxed);
+		s.seq.store(2 * head + 2, std::memory_order_release);
+		head_.store(head + 1, std::memory_order_release);
+	}
+
+	// Copies out what is in the ring without stopping the writer, events
+	// overwritten during the copy are dropped.
+	void snapshot(std::vector<event>& out) const {
+		const auto head = head_.load(std::memory_order_acquire);
+		const auto first = head > capacity ? head - capacity : 0;
+		for (auto n = first; n < head; ++n) {
+			const auto i = n % capacity;
+			const auto* chunk = chunks_[i / chunk_size].load(std::memory_order_acquire);
+			const auto& s = chunk[i % chunk_size];
+			const auto seq = s.seq.load(std::memory_order_acquire);
+			if (seq != 2 * n + 2) continue;
+			event ev{s.name.load(std::memory_order_relaxed), s.category.load(std::memory_order_relaxed),
+				s.begin_ns.load(std::memory_order_relaxed), s.duration_ns.load(std::memory_order_relaxed),
+				s.arg.load(std::memory_order_relaxed)};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (s.seq.load(std::memory_order_relaxed) == seq) out.push_back(ev);
+		}
+	}
+
+	// Bytes of events held.
+	size_t bytes() const noexcept {
+		size_t n = 0;
+		for (auto& c : chunks_) if (c.load(std::memory_order_relaxed)) n += chunk_size * sizeof(slot);
+		return n;
+	}
+
+	std::uint32_t tid() const noexcept { return tid_; }
+	const char* name() const noexcept { return name_; }
+	void set_name(const char* name) noexcept { name_ = name; }
+
+	explicit ring(std::uint32_t tid) : tid_{tid} {}
+	ring(const ring&) = delete;
+	ring& operator=(const ring&) = delete;
+
+	~ring() {
+		for (auto& c : chunks_) delete[] c.load(std::memory_order_relaxed);
+	}
+};
+
+class tracer : public singleton<tracer> {
+	friend singleton<tracer>;
+
+	std::atomic_bool enabled_{false};
+	std::mutex mutex_;
+	std::vector<std::unique_ptr<ring>> rings_;
+	const std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+
+	ring* register_thread() {
+		std::lock_guard<std::mutex> lk(mutex_);
+		// rings outlive their threads so a dump can still see what they did
+		rings_.push_back(std::make_unique<ring>(static_cast<std::uint32_t>(rings_.size() + 1)));
+		return rings_.back().get();
+	}
+
+	tracer() = default;
+public:
+	bool enabled() const noexcept { return enabled_.load(std::memory_order_relaxed); }
+	void enable(bool on) noexcept { enabled_.store(on, std::memory_order_relaxed); }
+
+	std::int64_t now() const noexcept {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+	}
+
+	ring& this_thread_ring() {
+		thread_local ring* r = register_thread();
+		return *r;
+	}
+
+	// `name` must be a string literal or otherwise outlive the tracer
+	void name_thread(const char* name) { this_thread_ring().set_name(name); }
+
+	void record(const char* name, const char* category, std::int64_t begin_ns, std::int64_t end_ns, std::int64_t arg = no_arg) {
+		this_thread_ring().push(event{name, category, begin_ns, end_ns - begin_ns, arg});
+	}
+
+	// Writes everything recorded so far in the Chrome trace-event JSON format.
+	void dump(std::ostream& os) {
+		struct thread_events {
+			std::uint32_t tid;
+			const char* name;
+			std::vector<event> events;
+		};
+		std::vector<thread_events> threads;
+		{
+			std::lock_guard<std::mutex> lk(mutex_);
+			for (auto& r : rings_) {
+				threads.push_back({r->tid(), r->name(), {}});
+				r->snapshot(threads.back().events);
+			}
+		}
+
+		auto us = [](std::int64_t ns) { return static_cast<double>(ns) / 1000.0; };
+
+		os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		for (auto& [tid, name, events] : threads) {
+			os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+				<< ",\"args\":{\"name\":\"";
+			if (name) os << name;
+			else os << "thread " << tid;
+			os << "\"}}";
+			first = false;
+			for (auto& ev : events) {
+				os << ",\n{\"name\":\"" << ev.name << "\",\"cat\":\"" << ev.category
+					<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << us(ev.begin_ns) << ",\"dur\":" << us(ev.duration_ns);
+				if (ev.arg != no_arg) os << ",\"args\":{\"id\":" << ev.arg << "}";
+				os << "}";
+			}
+		}
+		os << "\n]}\n";
+	}
+};
+
+inline bool enabled() noexcept { return tracer::get_instance().enabled(); }
+
+class scope {
+	const char* name_;
+	const char* category_;
+	std::int64_t arg_;
+	std::int64_t begin_;
+public:
+	scope(const char* name, const char* category, std::int64_t arg = no_arg) noexcept
+		: name_{name}, category_{category}, arg_{arg}
+		, begin_{enabled() ? tracer::get_instance().now() : -1}
+	{
+	}
+
+	~scope() {
+		if (begin_ < 0) [[likely]] return;
+		auto& t = tracer::get_instance();
+		t.record(name_, category_, begin_, t.now(), arg_);
+	}
+
+	scope(const scope&) = delete;
+	scope& operator=(const scope&) = delete;
+};
+
+} // namespace trace
+
+#define IMV_TRACE_CONCAT_(a, b) a##b
+#define IMV_TRACE_CONCAT(a, b) IMV_TRACE_CONCAT_(a, b)
+
+#ifndef IMV_NO_TRACE
+#	define IMV_TRACE_SCOPE(name, category) \
+		trace::scope IMV_TRACE_CONCAT(trace_scope_, __LINE__)(name, category)
+#	define IMV_TRACE_SCOPE_ARG(name, category, arg) \
+		trace::scope IMV_TRACE_CONCAT(trace_scope_, __LINE__)(name, category, static_cast<std::int64_t>(arg))
+#else
+#	define IMV_TRACE_SCOPE(name, category)
+#	define IMV_TRACE_SCOPE_ARG(name, category, arg)
+#endif
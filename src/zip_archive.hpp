@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catalog.hpp"
+#include "inflate.hpp"
+#include "pixel_arena.hpp"
+
+// ZIP and CBZ archives as a catalog. The central directory is read once into
+// an index of the pictures in it, sorted by name like a folder; a member is
+// read with one seek and inflated straight into an arena buffer, so nothing
+// is extracted to disk. The index is immutable, any thread may read members
+// at the same time, each read opens the file on its own.
+namespace zip {
+
+inline bool is_archive(const fs::path& path) {
+	if (!path.has_extension()) return false;
+	auto ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+	return ext == ".zip" || ext == ".cbz";
+}
+
+struct entry {
+	std::string name;              // as stored, '/' separated
+	std::uint64_t header_offset;   // of the local header
+	std::uint64_t compressed_size;
+	std::uint64_t size;
+	std::uint16_t method;          // 0 stored, 8 deflate
+};
+
+namespace detail {
+
+inline std::uint16_t u16(const std::uint8_t* p) noexcept { return static_cast<std::uint16_t>(p[0] | p[1] << 8); }
+inline std::uint32_t u32(const std::uint8_t* p) noexcept { return u16(p) | std::uint32_t(u16(p + 2)) << 16; }
+inline std::uint64_t u64(const std::uint8_t* p) noexcept { return u32(p) | std::uint64_t(u32(p + 4)) << 32; }
+
+class file {
+	FILE* f_ = nullptr;
+public:
+	explicit file(const fs::path& path) noexcept {
+#ifdef _WIN32
+		f_ = _wfopen(path.c_str(), L"rb");
+#else
+		f_ = std::fopen(path.c_str(), "rb");
+#endif
+	}
+	file(const file&) = delete;
+	file& operator=(const file&) = delete;
+	~file() {
+		if (f_) std::fclose(f_);
+	}
+
+	explicit operator bool() const noexcept { return f_ != nullptr; }
+
+	bool read(std::uint64_t offset, void* data, size_t size) noexcept {
+#ifdef _WIN32
+		if (_fseeki64(f_, static_cast<__int64>(offset), SEEK_SET) != 0) return false;
+#else
+		if (fseeko(f_, static_cast<off_t>(offset), SEEK_SET) != 0) return false;
+#endif
+		return std::fread(data, 1, size, f_) == size;
+	}
+};
+
+// Resource forks macOS adds to the archives it makes, "__MACOSX/._a.jpg".
+inline bool is_metadata(std::string_view name) noexcept {
+	return name.rfind("__MACOSX/", 0) == 0 || name.find("/._") != std::string_view::npos || name.rfind("._", 0) == 0;
+}
+
+} // namespace detail
+
+class archive {
+	fs::path path_;
+	std::vector<entry> entries_;
+
+	// Where the central directory is and how many headers it holds, from the
+	// end of central directory record and its ZIP64 twin.
+	bool locate_directory(detail::file& f, std::uint64_t file_size, std::uint64_t& offset, std::uint64_t& size, std::uint64_t& count) {
+		// the record is 22 bytes and a comment of up to 64K follows it
+		const auto tail = static_cast<size_t>(std::min<std::uint64_t>(file_size, 22 + 0xFFFF));
+		std::vector<std::uint8_t> buf(tail);
+		if (!f.read(file_size - tail, buf.data(), tail)) return false;
+		for (size_t i = tail - 22 + 1; i-- > 0;) {
+			const auto* p = buf.data() + i;
+			if (detail::u32(p) != 0x06054b50) continue;
+			count = detail::u16(p + 10);
+			size = detail::u32(p + 12);
+			offset = detail::u32(p + 16);
+			if (count != 0xFFFF && size != 0xFFFFFFFF && offset != 0xFFFFFFFF) return true;
+
+			// the ZIP64 locator sits right before it
+			const std::uint64_t eocd = file_size - tail + i;
+			std::uint8_t locator[20], record[56];
+			if (eocd < 20 || !f.read(eocd - 20, locator, 20) || detail::u32(locator) != 0x07064b50) return false;
+			if (!f.read(detail::u64(locator + 8), record, 56) || detail::u32(record) != 0x06064b50) return false;
+			count = detail::u64(record + 32);
+			size = detail::u64(record + 40);
+			offset = detail::u64(record + 48);
+			return true;
+		}
+		return false;
+	}
+
+	bool index() {
+		std::error_code ec;
+		const auto file_size = fs::file_size(path_, ec);
+		if (ec || file_size < 22) return false;
+		detail::file f(path_);
+		if (!f) return false;
+
+		std::uint64_t offset, size, count;
+		if (!locate_directory(f, file_size, offset, size, count)) return false;
+		if (offset + size > file_size || count > size / 46) return false;
+		std::vector<std::uint8_t> dir(static_cast<size_t>(size));
+		if (!f.read(offset, dir.data(), dir.size())) return false;
+
+		const auto* p = dir.data();
+		const auto* end = p + dir.size();
+		for (std::uint64_t i = 0; i < count; ++i) {
+			if (end - p < 46 || detail::u32(p) != 0x02014b50) return false;
+			const auto flags = detail::u16(p + 8);
+			entry e{};
+			e.method = detail::u16(p + 10);
+			e.compressed_size = detail::u32(p + 20);
+			e.size = detail::u32(p + 24);
+			const size_t name_len = detail::u16(p + 28), extra_len = detail::u16(p + 30), comment_len = detail::u16(p + 32);
+			e.header_offset = detail::u32(p + 42);
+			if (static_cast<size_t>(end - p) < 46 + name_len + extra_len + comment_len) return false;
+			e.name.assign(reinterpret_cast<const char*>(p + 46), name_len);
+
+			// 64-bit sizes and offset, only those whose 32-bit field is full
+			for (const auto* x = p + 46 + name_len, *x_end = x + extra_len; x_end - x >= 4;) {
+				const auto id = detail::u16(x), len = detail::u16(x + 2);
+				if (static_cast<size_t>(x_end - x - 4) < len) break;
+				if (id == 0x0001) {
+					const auto* v = x + 4;
+					auto take = [&](std::uint64_t& field) {
+						if (field != 0xFFFFFFFF || v + 8 > x + 4 + len) return;
+						field = detail::u64(v);
+						v += 8;
+					};
+					take(e.size);
+					take(e.compressed_size);
+					take(e.header_offset);
+				}
+				x += 4 + len;
+			}
+			p += 46 + name_len + extra_len + comment_len;
+
+			// encrypted members and other methods can't be read
+			if (flags & 1 || (e.method != 0 && e.method != 8) || e.size == 0) continue;
+			if (detail::is_metadata(e.name) || !is_picture(fs::path(e.name))) continue;
+			entries_.push_back(std::move(e));
+		}
+		std::sort(entries_.begin(), entries_.end(), [](const entry& a, const entry& b) { return a.name < b.name; });
+		return true;
+	}
+public:
+	// Null when `path` isn't a ZIP archive that can be read.
+	static std::shared_ptr<const archive> open(const fs::path& path) {
+		auto a = std::make_shared<archive>(path);
+		if (!a->index()) return nullptr;
+		return a;
+	}
+
+	const fs::path& path() const noexcept { return path_; }
+	const std::vector<entry>& entries() const noexcept { return entries_; }
+
+	// What a member is shown as, the archive's path and the member's name.
+	fs::path member_path(size_t i) const { return path_ / entries_[i].name; }
+
+	// The member's bytes, empty when it can't be read or doesn't inflate to
+	// the size the directory gives.
+	pixel_arena::buffer read(size_t i) const {
+		const auto& e = entries_[i];
+		detail::file f(path_);
+		std::uint8_t header[30];
+		if (!f || !f.read(e.header_offset, header, sizeof(header)) || detail::u32(header) != 0x04034b50) return {};
+		// the local name and extra field may differ from the central ones
+		const auto data_offset = e.header_offset + 30 + detail::u16(header + 26) + detail::u16(header + 28);
+
+		auto& arena = pixel_arena::get_instance();
+		auto out = arena.acquire(static_cast<size_t>(e.size));
+		if (e.method == 0) {
+			if (e.compressed_size != e.size || !f.read(data_offset, out.data(), out.size())) out.reset();
+			return out;
+		}
+		auto compressed = arena.acquire(static_cast<size_t>(e.compressed_size));
+		if (!f.read(data_offset, compressed.data(), compressed.size())) return {};
+		inflate::span_output span(out.data(), out.size());
+		if (!inflate::raw(compressed.data(), compressed.size(), span, span.capacity()) || span.size() != out.size()) out.reset();
+		return out;
+	}
+
+	explicit archive(const fs::path& path) : path_{path} {}
+};
+
+// The pictures of `a` as a catalog, entry i is member i.
+inline catalog make_catalog(std::shared_ptr<const archive> a) {
+	catalog c;
+	const auto dir = c.add_directory(a->path());
+	size_t name_bytes = 0;
+	for (auto& e : a->entries()) name_bytes += e.name.size();
+	c.reserve(a->entries().size(), name_bytes);
+	// the archive sorted them already
+	for (auto& e : a->entries()) c.add(dir, e.name, e.size, 0);
+	c.set_archive(std::move(a));
+	return c;
+}
+
+} // namespace zip
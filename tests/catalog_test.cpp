@@ -0,0 +1,154 @@
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "check.hpp"
+#include "catalog.hpp"
+
+namespace {
+
+struct file {
+	std::string dir, name;
+	std::uint64_t size;
+	std::int64_t mtime;
+};
+
+// what sort() has to agree with: directory, then name, byte for byte
+std::vector<file> sorted(std::vector<file> files) {
+	std::stable_sort(files.begin(), files.end(), [](const file& a, const file& b) {
+		return std::tie(a.dir, a.name) < std::tie(b.dir, b.name);
+	});
+	return files;
+}
+
+catalog catalog_of(const std::vector<file>& files) {
+	catalog c;
+	for (auto& f : files) c.add(c.add_directory(f.dir), f.name, f.size, f.mtime);
+	c.sort();
+	return c;
+}
+
+bool same(const catalog& c, const std::vector<file>& files) {
+	if (c.size() != files.size()) return false;
+	for (size_t i = 0; i < c.size(); ++i) {
+		if (c.directory(i) != files[i].dir || c.name(i) != files[i].name) return false;
+		if (c.file_bytes(i) != files[i].size || c.mtime(i) != files[i].mtime) return false;
+	}
+	return true;
+}
+
+} // namespace
+
+TEST(sort_against_std_sort) {
+	std::mt19937 rng(30);
+	// names sharing 8, 16 and more bytes, ending inside a key or right at
+	// its end, and the same name twice
+	const std::vector<std::string> stems = {"", "a", "IMG_", "IMG_0001", "IMG_00010002", "DSC_20240101_12345678_", "\xC3\xA9t\xC3\xA9"};
+	for (int round = 0; round < 20; ++round) {
+		std::vector<file> files;
+		const std::vector<std::string> dirs = {"/b", "/a", "/a/z", "/c"};
+		const auto dir_count = 1 + rng() % dirs.size();
+		for (int i = 0; i < 500; ++i) {
+			std::string name = stems[rng() % stems.size()];
+			for (auto n = rng() % 12; n; --n) name += static_cast<char>("09_.aZ\x7F\xFF"[rng() % 8]);
+			if (name.empty()) name = "x";
+			files.push_back({dirs[rng() % dir_count], name, rng(), static_cast<std::int64_t>(rng()) - (1 << 30)});
+		}
+		const auto c = catalog_of(files);
+		const auto want = sorted(files);
+		CHECK(c.size() == want.size());
+		for (size_t i = 0; i < c.size(); ++i) {
+			CHECK(c.directory(i) == want[i].dir);
+			CHECK(c.name(i) == want[i].name);
+		}
+		// the columns go with their names; equal names may swap, but only
+		// with each other
+		for (size_t i = 0; i < c.size(); ++i) {
+			bool found = false;
+			for (size_t j = i; j < want.size() && want[j].dir == c.directory(i) && want[j].name == c.name(i); ++j) {
+				found = found || (want[j].size == c.file_bytes(i) && want[j].mtime == c.mtime(i));
+			}
+			for (size_t j = i; j-- > 0 && want[j].dir == c.directory(i) && want[j].name == c.name(i);) {
+				found = found || (want[j].size == c.file_bytes(i) && want[j].mtime == c.mtime(i));
+			}
+			CHECK(found);
+		}
+	}
+}
+
+TEST(sort_keeps_the_columns) {
+	const std::vector<file> files = {
+		{"/p", "c.jpg", 3, 30}, {"/p", "a.jpg", 1, 10}, {"/p", "b.jpg", 2, 20}, {"/o", "z.jpg", 4, 40}};
+	CHECK(same(catalog_of(files), sorted(files)));
+}
+
+TEST(find_every_entry) {
+	std::mt19937 rng(31);
+	std::vector<file> files;
+	for (int i = 0; i < 2000; ++i) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "IMG_%06u.jpg", unsigned(rng() % 1000000));
+		files.push_back({i % 3 ? "/pictures" : "/pictures/2024", name, 0, 0});
+	}
+	const auto c = catalog_of(files);
+	for (size_t i = 0; i < c.size(); ++i) {
+		// the first of equal names
+		const auto at = c.find(c.path(i));
+		CHECK(at >= 0);
+		CHECK(c.path(static_cast<size_t>(at)) == c.path(i));
+		CHECK(at == 0 || c.path(static_cast<size_t>(at - 1)) != c.path(i));
+	}
+	CHECK(c.find("/pictures/IMG_.jpg") == -1);
+	CHECK(c.find("/elsewhere/" + std::string(c.name(0))) == -1);
+	CHECK(c.find("/pictures/zzz.jpg") == -1);
+	CHECK(c.find("/a/a.jpg") == -1);
+	CHECK(catalog().find("/pictures/a.jpg") == -1);
+}
+
+TEST(directories_are_interned) {
+	catalog c;
+	const auto a = c.add_directory("/pictures/");
+	CHECK(c.add_directory("/pictures") == a);
+	CHECK(c.add_directory("/other") != a);
+	CHECK(c.add_directory("/pictures") == a);
+	c.add(a, "b.jpg", 1, 0);
+	CHECK(c.directory(0) == "/pictures");
+	CHECK(c.path(0) == fs::path("/pictures") / "b.jpg");
+}
+
+TEST(format_is_the_extension) {
+	catalog c;
+	const auto dir = c.add_directory("/p");
+	for (const char* name : {"a.jpg", "noext", "album.2024/photo", "archive/x.PNG", ".hidden", "a.b.gif"}) c.add(dir, name, 0, 0);
+	CHECK(c.format(0) == ".jpg");
+	CHECK(c.format(1).empty());
+	CHECK(c.format(2).empty());
+	CHECK(c.format(3) == ".PNG");
+	CHECK(c.format(4) == ".hidden");
+	CHECK(c.format(5) == ".gif");
+	CHECK(is_picture("x/IMG.JPG"));
+	CHECK(is_picture("a.webp"));
+	CHECK(!is_picture("a.txt"));
+	CHECK(!is_picture("jpg"));
+}
+
+TEST(scan_lists_only_pictures_in_order) {
+	const auto dir = fs::temp_directory_path() / "imv_catalog_test";
+	fs::remove_all(dir);
+	fs::create_directories(dir / "sub.jpg");
+	for (const char* name : {"b.jpg", "a.PNG", "c.txt", "IMG_10.gif", "IMG_9.gif"}) std::ofstream(dir / name) << name;
+	const auto c = catalog::scan(dir);
+	CHECK(c.size() == 4);
+	CHECK(c.size() == 4 && c.name(0) == "IMG_10.gif" && c.name(1) == "IMG_9.gif" && c.name(2) == "a.PNG" && c.name(3) == "b.jpg");
+	CHECK(c.size() == 4 && c.file_bytes(3) == 5);
+	const auto files = scan_directory(dir);
+	CHECK(files.size() == 4 && files[3] == dir / "b.jpg");
+	const auto one = catalog::of_file(dir / "a.PNG");
+	CHECK(one.size() == 1 && one.name(0) == "a.PNG" && one.file_bytes(0) == 5);
+	fs::remove_all(dir);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// Just enough of a test harness for the portable headers:
+//
+//   TEST(name) { CHECK(a == b); }
+//   int main() { return check::run(); }
+//
+// A failed CHECK prints where it is and the test goes on; run() returns
+// non-zero when anything failed.
+namespace check {
+
+struct test {
+	const char* name;
+	void (*fn)();
+};
+
+inline std::vector<test>& tests() {
+	static std::vector<test> all;
+	return all;
+}
+
+inline int& failures() {
+	static int n = 0;
+	return n;
+}
+
+struct registrar {
+	registrar(const char* name, void (*fn)()) { tests().push_back({name, fn}); }
+};
+
+inline void fail(const char* file, int line, const char* expr) {
+	std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+	++failures();
+}
+
+inline int run() {
+	for (auto& t : tests()) {
+		const auto before = failures();
+		t.fn();
+		std::fprintf(stderr, "%s %s\n", failures() == before ? "ok  " : "FAIL", t.name);
+	}
+	std::fprintf(stderr, "%zu tests, %d failed checks\n", tests().size(), failures());
+	return failures() ? 1 : 0;
+}
+
+} // namespace check
+
+#define CHECK(expr) ((expr) ? void() : ::check::fail(__FILE__, __LINE__, #expr))
+
+#define TEST(name) \
+	static void name(); \
+	static const ::check::registrar name##_registrar(#name, name); \
+	static void name()
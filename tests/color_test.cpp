@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "color.hpp"
+
+namespace {
+
+// What the LUT stands for, in floats: source curves, the two matrices,
+// clipping and the sRGB encoding of the displays used here.
+void reference(const color::profile& source, const color::profile& display, const std::uint32_t rgb[3], int out[3]) {
+	const auto m = color::multiply(color::inverse(display.to_xyz), source.to_xyz);
+	float lin[3];
+	for (int c = 0; c < 3; ++c) lin[c] = source.trc[c].eval(static_cast<float>(rgb[c]) / 255.0f);
+	for (int c = 0; c < 3; ++c) {
+		const double v = std::clamp(m[c * 3] * lin[0] + m[c * 3 + 1] * lin[1] + m[c * 3 + 2] * lin[2], 0.0f, 1.0f);
+		const double e = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+		out[2 - c] = static_cast<int>(std::lround(e * 255.0));
+	}
+}
+
+// The largest difference from the reference over `samples` random colours.
+int worst_error(const color::profile& source, const color::profile& display, int samples) {
+	const color::lut lut(source, display);
+	std::mt19937 rng(2024);
+	int worst = 0;
+	for (int i = 0; i < samples; ++i) {
+		const std::uint32_t rgb[3] = {std::uint32_t(rng() & 0xFF), std::uint32_t(rng() & 0xFF), std::uint32_t(rng() & 0xFF)};
+		std::uint32_t got[3];
+		int want[3];
+		lut.map(rgb[0], rgb[1], rgb[2], got);
+		reference(source, display, rgb, want);
+		for (int c = 0; c < 3; ++c) worst = std::max(worst, std::abs(static_cast<int>(got[c]) - want[c]));
+	}
+	return worst;
+}
+
+// A matrix/TRC profile the way an ICC file holds one.
+struct icc_writer {
+	std::vector<std::uint8_t> bytes = std::vector<std::uint8_t>(132, 0);
+	std::vector<std::pair<const char*, std::vector<std::uint8_t>>> tags;
+
+	static void be32(std::vector<std::uint8_t>& v, std::uint32_t x) {
+		for (int s = 24; s >= 0; s -= 8) v.push_back(static_cast<std::uint8_t>(x >> s));
+	}
+	static void be16(std::vector<std::uint8_t>& v, std::uint16_t x) {
+		v.push_back(static_cast<std::uint8_t>(x >> 8));
+		v.push_back(static_cast<std::uint8_t>(x));
+	}
+	static void sig(std::vector<std::uint8_t>& v, const char* s) { v.insert(v.end(), s, s + 4); }
+	static void fixed(std::vector<std::uint8_t>& v, float x) { be32(v, static_cast<std::uint32_t>(static_cast<std::int32_t>(std::lround(x * 65536.0f)))); }
+
+	void xyz(const char* tag, float x, float y, float z) {
+		std::vector<std::uint8_t> body;
+		sig(body, "XYZ ");
+		be32(body, 0);
+		fixed(body, x);
+		fixed(body, y);
+		fixed(body, z);
+		tags.push_back({tag, body});
+	}
+
+	void para(const char* tag, std::uint16_t type, std::vector<float> params) {
+		std::vector<std::uint8_t> body;
+		sig(body, "para");
+		be32(body, 0);
+		be16(body, type);
+		be16(body, 0);
+		for (auto p : params) fixed(body, p);
+		tags.push_back({tag, body});
+	}
+
+	void curv(const char* tag, std::vector<std::uint16_t> table) {
+		std::vector<std::uint8_t> body;
+		sig(body, "curv");
+		be32(body, 0);
+		be32(body, static_cast<std::uint32_t>(table.size()));
+		for (auto t : table) be16(body, t);
+		tags.push_back({tag, body});
+	}
+
+	std::vector<std::uint8_t> finish() const {
+		auto out = bytes;
+		auto put = [&](size_t at, const char* s) { std::copy(s, s + 4, out.begin() + at); };
+		put(16, "RGB ");
+		put(20, "XYZ ");
+		put(36, "acsp");
+		out.resize(128);
+		be32(out, static_cast<std::uint32_t>(tags.size()));
+		size_t offset = 132 + tags.size() * 12;
+		std::vector<std::uint8_t> bodies;
+		for (auto& [tag, body] : tags) {
+			sig(out, tag);
+			be32(out, static_cast<std::uint32_t>(offset + bodies.size()));
+			be32(out, static_cast<std::uint32_t>(body.size()));
+			bodies.insert(bodies.end(), body.begin(), body.end());
+		}
+		out.insert(out.end(), bodies.begin(), bodies.end());
+		return out;
+	}
+};
+
+icc_writer srgb_like() {
+	const auto p = color::profile::srgb();
+	icc_writer w;
+	w.xyz("rXYZ", p.to_xyz[0], p.to_xyz[3], p.to_xyz[6]);
+	w.xyz("gXYZ", p.to_xyz[1], p.to_xyz[4], p.to_xyz[7]);
+	w.xyz("bXYZ", p.to_xyz[2], p.to_xyz[5], p.to_xyz[8]);
+	for (const char* trc : {"rTRC", "gTRC", "bTRC"}) w.para(trc, 3, {2.4f, 1.0f / 1.055f, 0.055f / 1.055f, 1.0f / 12.92f, 0.04045f});
+	return w;
+}
+
+} // namespace
+
+TEST(the_lut_matches_the_float_transform) {
+	const auto srgb = color::profile::srgb(), p3 = color::profile::display_p3(), adobe = color::profile::adobe_rgb();
+	CHECK(worst_error(srgb, p3, 20000) <= 1);
+	CHECK(worst_error(p3, srgb, 20000) <= 1);
+	CHECK(worst_error(adobe, srgb, 20000) <= 1);
+}
+
+TEST(grey_stays_grey_between_srgb_and_p3) {
+	// same white and curve, only the primaries differ
+	const color::lut lut(color::profile::srgb(), color::profile::display_p3());
+	for (std::uint32_t v = 0; v < 256; ++v) {
+		std::uint32_t out[3];
+		lut.map(v, v, v, out);
+		CHECK(std::abs(static_cast<int>(out[0]) - static_cast<int>(v)) <= 1);
+		CHECK(out[0] == out[1] && out[1] == out[2]);
+	}
+}
+
+TEST(apply_agrees_with_map) {
+	const color::lut lut(color::profile::adobe_rgb(), color::profile::srgb());
+	std::mt19937 rng(7);
+	std::vector<std::uint32_t> px(4096);
+	for (auto& p : px) p = rng() | 0xFF000000u;
+	auto before = px;
+	lut.apply(px.data(), px.size());
+	for (size_t i = 0; i < px.size(); ++i) {
+		const std::uint32_t p = before[i];
+		std::uint32_t o[3];
+		lut.map((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF, o);
+		const std::uint32_t want = 0xFF000000u | o[0] | (o[1] << 8) | (o[2] << 16);
+		for (int s = 0; s < 32; s += 8) CHECK(std::abs(int((px[i] >> s) & 0xFF) - int((want >> s) & 0xFF)) <= 1);
+	}
+}
+
+TEST(translucent_pixels_stay_premultiplied) {
+	const color::lut lut(color::profile::adobe_rgb(), color::profile::srgb());
+	std::uint32_t px[3] = {0x00000000u, 0x80404040u, 0x40102030u};
+	lut.apply(px, 3);
+	CHECK(px[0] == 0);
+	// the colour of 0x80404040 is 0x80 grey, of 0x40102030 0xC08040
+	const std::uint32_t straight[2][3] = {{0x80, 0x80, 0x80}, {0x40, 0x80, 0xC0}};
+	for (int i = 1; i < 3; ++i) {
+		const std::uint32_t a = px[i] >> 24;
+		CHECK(a == (i == 1 ? 0x80u : 0x40u));
+		std::uint32_t o[3];
+		lut.map(straight[i - 1][0], straight[i - 1][1], straight[i - 1][2], o);
+		for (int c = 0; c < 3; ++c) CHECK(std::abs(int((px[i] >> (8 * c)) & 0xFF) - int((o[c] * a + 127) / 255)) <= 1);
+	}
+}
+
+TEST(matrix_trc_profiles_are_read) {
+	const auto bytes = srgb_like().finish();
+	color::profile p;
+	CHECK(color::parse_icc(bytes.data(), bytes.size(), p));
+	const auto want = color::profile::srgb();
+	for (int i = 0; i < 9; ++i) CHECK(std::abs(p.to_xyz[i] - want.to_xyz[i]) < 1e-4f);
+	for (int c = 0; c < 3; ++c) {
+		for (float x : {0.0f, 0.02f, 0.2f, 0.5f, 1.0f}) CHECK(std::abs(p.trc[c].eval(x) - want.trc[c].eval(x)) < 1e-4f);
+	}
+}
+
+TEST(sampled_and_gamma_curves_are_read) {
+	auto w = srgb_like();
+	w.tags.resize(3);
+	w.curv("rTRC", {0, 16384, 65535});
+	w.curv("gTRC", {std::uint16_t(2.2 * 256)});
+	w.curv("bTRC", {});
+	const auto bytes = w.finish();
+	color::profile p;
+	CHECK(color::parse_icc(bytes.data(), bytes.size(), p));
+	CHECK(std::abs(p.trc[0].eval(0.5f) - 16384.0f / 65535.0f) < 1e-5f);
+	CHECK(std::abs(p.trc[0].eval(0.75f) - (16384.0f / 65535.0f + 1.0f) / 2) < 1e-5f);
+	CHECK(std::abs(p.trc[1].eval(0.5f) - std::pow(0.5f, 563.0f / 256.0f)) < 1e-5f);
+	CHECK(p.trc[2].eval(0.3f) == 0.3f);
+}
+
+TEST(other_profiles_are_declined) {
+	color::profile p;
+	auto bytes = srgb_like().finish();
+	// cut off in the tag data
+	CHECK(!color::parse_icc(bytes.data(), bytes.size() - 1, p));
+	// not a profile
+	auto bad = bytes;
+	bad[36] = 'x';
+	CHECK(!color::parse_icc(bad.data(), bad.size(), p));
+	// CMYK
+	bad = bytes;
+	std::copy_n("CMYK", 4, bad.begin() + 16);
+	CHECK(!color::parse_icc(bad.data(), bad.size(), p));
+	// a curve missing
+	auto w = srgb_like();
+	w.tags.pop_back();
+	bytes = w.finish();
+	CHECK(!color::parse_icc(bytes.data(), bytes.size(), p));
+	// a parametric curve type that doesn't exist
+	w = srgb_like();
+	w.tags.pop_back();
+	w.para("bTRC", 5, {1.0f});
+	bytes = w.finish();
+	CHECK(!color::parse_icc(bytes.data(), bytes.size(), p));
+}
+
+TEST(luts_are_built_once_per_pair) {
+	auto& cache = color::lut_cache::get_instance();
+	const auto srgb = color::profile::srgb(), p3 = color::profile::display_p3();
+	CHECK(!cache.get(srgb, srgb));
+	const auto a = cache.get(p3, srgb);
+	CHECK(a);
+	CHECK(cache.get(p3, srgb) == a);
+	CHECK(cache.get(srgb, p3) != a);
+}
+
+int main() { return check::run(); }
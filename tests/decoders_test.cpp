@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "decoder_registry.hpp"
+
+namespace {
+
+const std::filesystem::path fixtures = FIXTURES;
+
+std::vector<std::uint8_t> bytes_of(const std::filesystem::path& path) {
+	std::ifstream in(path, std::ios::binary);
+	return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+struct picture {
+	std::string file;
+	std::uint32_t width = 0;
+	std::uint32_t height = 0;
+	int tolerance = 0;
+	bool declined = false;
+};
+
+std::vector<picture> listed() {
+	std::vector<picture> out;
+	std::ifstream list(fixtures / "images.txt");
+	for (std::string line; std::getline(list, line);) {
+		std::istringstream fields(line);
+		picture p;
+		std::string second;
+		fields >> p.file >> second;
+		if (second == "declined") {
+			p.declined = true;
+		} else {
+			p.width = static_cast<std::uint32_t>(std::stoul(second));
+			fields >> p.height >> p.tolerance;
+		}
+		out.push_back(p);
+	}
+	return out;
+}
+
+// "jpeg" for jpeg_444.jpg
+std::string codec_of(const std::string& file) {
+	return file.substr(0, file.find('_'));
+}
+
+// Largest channel difference between a decoded picture and Pillow's
+// straight RGBA, once that is premultiplied the way the decoders do.
+int difference(const image_buffer& out, const std::vector<std::uint8_t>& rgba) {
+	int most = 0;
+	for (size_t i = 0; i < size_t(out.width) * out.height; ++i) {
+		const auto* p = &rgba[i * 4];
+		const std::uint32_t a = p[3];
+		const auto premultiplied = [&](std::uint32_t c) { return a == 255 ? c : (c * a + 127) / 255; };
+		const std::uint32_t want[4] = {premultiplied(p[2]), premultiplied(p[1]), premultiplied(p[0]), a};
+		const auto got = out.data()[i];
+		for (int c = 0; c < 4; ++c) most = std::max(most, std::abs(static_cast<int>(got >> (c * 8) & 0xFF) - static_cast<int>(want[c])));
+	}
+	return most;
+}
+
+} // namespace
+
+TEST(pictures_match_pillow) {
+	const auto all = listed();
+	CHECK(all.size() > 40);
+	std::map<std::string, int> most;
+	for (auto& p : all) {
+		if (p.declined) continue;
+		const auto data = bytes_of(fixtures / p.file);
+		CHECK(decoders::native::name(data.data(), data.size()) == codec_of(p.file));
+		std::uint32_t w = 0, h = 0;
+		CHECK(decoders::native::dimensions(data.data(), data.size(), w, h));
+		CHECK(w == p.width && h == p.height);
+		image_buffer out;
+		CHECK(decoders::native::decode(data.data(), data.size(), out));
+		CHECK(out.width == p.width && out.height == p.height);
+		if (!out || out.width != p.width || out.height != p.height) {
+			std::fprintf(stderr, "  %s did not decode\n", p.file.c_str());
+			continue;
+		}
+		const auto d = difference(out, bytes_of(fixtures / (p.file + ".rgba")));
+		if (d > p.tolerance) std::fprintf(stderr, "  %s is %d off\n", p.file.c_str(), d);
+		CHECK(d <= p.tolerance);
+		auto& m = most[codec_of(p.file)];
+		m = std::max(m, d);
+	}
+	for (auto& [codec, d] : most) std::fprintf(stderr, "  %s at most %d off\n", codec.c_str(), d);
+}
+
+TEST(unsupported_variants_are_declined) {
+	for (auto& p : listed()) {
+		if (!p.declined) continue;
+		const auto data = bytes_of(fixtures / p.file);
+		CHECK(decoders::native::name(data.data(), data.size()) == codec_of(p.file));
+		image_buffer out;
+		CHECK(!decoders::native::decode(data.data(), data.size(), out));
+	}
+	const std::uint8_t text[] = "not a picture";
+	image_buffer out;
+	CHECK(decoders::native::name(text, sizeof(text)).empty());
+	CHECK(!decoders::native::decode(text, sizeof(text), out));
+}
+
+// Pictures with bytes changed or cut short, under ASan and UBSan: decoding
+// stays in bounds, and a picture that still decodes is the size
+// dimensions() said. Only those that claim at most 16M pixels are decoded,
+// as the viewer's budget would turn the others down first.
+TEST(mutated_pictures_stay_in_bounds) {
+	std::mt19937 rng(1987);
+	int decoded = 0, tried = 0;
+	for (auto& p : listed()) {
+		const auto bytes = bytes_of(fixtures / p.file);
+		for (int round = 0; round < 300; ++round) {
+			auto bad = bytes;
+			for (auto n = 1 + rng() % 4; n; --n) {
+				// mostly the headers, where the sizes and tables are
+				const auto at = rng() % 2 ? rng() % std::min<size_t>(bad.size(), 200) : rng() % bad.size();
+				switch (rng() % 5) {
+				case 0: bad[at] = static_cast<std::uint8_t>(bad[at] ^ (1 << rng() % 8)); break;
+				case 1: bad[at] = 0xFF; break;
+				case 2: bad[at] = 0; break;
+				case 3: bad[at] = static_cast<std::uint8_t>(rng()); break;
+				default: if (round % 4 == 0) bad.resize(at + 1); break;
+				}
+			}
+			std::uint32_t w = 0, h = 0;
+			if (!decoders::native::dimensions(bad.data(), bad.size(), w, h) || std::uint64_t(w) * h > (16u << 20)) continue;
+			++tried;
+			image_buffer out;
+			if (!decoders::native::decode(bad.data(), bad.size(), out)) continue;
+			++decoded;
+			CHECK(out && out.width == w && out.height == h);
+		}
+	}
+	std::fprintf(stderr, "  %d of %d mutated pictures still decoded\n", decoded, tried);
+}
+
+// Sampling factors that don't divide each other, 3 and 2 say, which random
+// changes seldom come to: on the JPEG pictures, every mix of factors 1 to 4
+// for the three components decodes in bounds or is declined.
+TEST(uneven_sampling_factors_stay_in_bounds) {
+	int decoded = 0, tried = 0;
+	for (const char* file : {"jpeg_444.jpg", "jpeg_420.jpg", "jpeg_progressive.jpg", "jpeg_17x9.jpg"}) {
+		const auto bytes = bytes_of(fixtures / file);
+		size_t sof = 0;
+		for (size_t i = 2; i + 1 < bytes.size() && !sof; ++i) {
+			if (bytes[i] == 0xFF && (bytes[i + 1] == 0xC0 || bytes[i + 1] == 0xC2)) sof = i;
+		}
+		CHECK(sof != 0 && bytes[sof + 9] == 3);
+		if (!sof) continue;
+		for (int mix = 0; mix < 16 * 16 * 16; ++mix) {
+			auto bad = bytes;
+			for (int c = 0; c < 3; ++c) {
+				const int hv = mix >> (c * 4) & 15;
+				bad[sof + 11 + c * 3] = static_cast<std::uint8_t>((1 + hv / 4) << 4 | (1 + hv % 4));
+			}
+			std::uint32_t w = 0, h = 0;
+			if (!decoders::native::dimensions(bad.data(), bad.size(), w, h)) continue;
+			++tried;
+			image_buffer out;
+			if (!decoders::native::decode(bad.data(), bad.size(), out)) continue;
+			++decoded;
+			CHECK(out && out.width == w && out.height == h);
+		}
+	}
+	std::fprintf(stderr, "  %d of %d mixes decoded\n", decoded, tried);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,154 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "duplicate_finder.hpp"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+const auto dir = std::filesystem::temp_directory_path() / "imv_duplicate_finder_test";
+
+// Stands in for the thumbnail decode: "burst_a_2.jpg" is scene a, frame
+// 2, a little brighter for each frame; "single_*.jpg" are unlike anything.
+struct scenes {
+	std::atomic<int> decoded{0};
+
+	phash::finder::decoder decoder() {
+		return [this](const std::filesystem::path& path, image_buffer& out) {
+			++decoded;
+			const auto name = path.filename().string();
+			if (name.rfind("broken", 0) == 0) return false;
+			const bool burst = name.rfind("burst_", 0) == 0;
+			const int scene = burst ? name[6] - 'a' : 10 + name[7] - 'a';
+			const int frame = burst ? name[8] - '0' : 0;
+			out.allocate(48, 36);
+			for (std::uint32_t y = 0; y < out.height; ++y) {
+				for (std::uint32_t x = 0; x < out.width; ++x) {
+					const double u = double(x) / out.width, v = double(y) / out.height;
+					const double l = 0.5 + 0.4 * std::sin(3.0 * (scene + 1) * u + 1.7 * scene) * std::cos(2.0 * (scene % 4 + 1) * v);
+					const auto c = static_cast<std::uint32_t>(std::clamp(l * 230.0 + frame * 3, 0.0, 255.0));
+					out.data()[size_t(y) * out.width + x] = 0xFF000000u | c << 16 | c << 8 | c;
+				}
+			}
+			return true;
+		};
+	}
+};
+
+std::shared_ptr<const catalog> folder(const std::vector<std::string>& names) {
+	std::filesystem::create_directories(dir / "pictures");
+	for (auto& name : names) std::ofstream(dir / "pictures" / name) << name;
+	return std::make_shared<const catalog>(catalog::scan(dir / "pictures"));
+}
+
+// null if the groups took more than a few seconds
+std::shared_ptr<const phash::groups> wait(phash::finder& f) {
+	for (int i = 0; i < 500; ++i) {
+		if (auto g = f.get()) return g;
+		std::this_thread::sleep_for(10ms);
+	}
+	return nullptr;
+}
+
+std::int64_t at(const catalog& c, const std::string& name) {
+	for (size_t i = 0; i < c.size(); ++i) {
+		if (c.name(i) == name) return static_cast<std::int64_t>(i);
+	}
+	return -1;
+}
+
+} // namespace
+
+TEST(bursts_are_grouped_and_listed) {
+	std::filesystem::remove_all(dir);
+	const auto pictures = folder({"burst_a_1.jpg", "burst_a_2.jpg", "burst_a_3.jpg", "burst_b_1.jpg", "burst_b_2.jpg",
+		"single_a.jpg", "single_b.jpg", "broken.jpg"});
+	scenes s;
+	phash::finder f(dir / "cache", dir / "listing.txt", s.decoder());
+	CHECK(f.get() == nullptr);
+	f.start(pictures);
+	const auto g = wait(f);
+	CHECK(g != nullptr);
+	if (!g) return;
+	CHECK(s.decoded == 8);
+	CHECK(f.hashed() == 8 && f.to_hash() == 8);
+	CHECK(g->n_groups == 2);
+	CHECK(g->next.size() == pictures->size() && g->size.size() == pictures->size());
+
+	// next goes round each burst in catalog order
+	const auto a1 = at(*pictures, "burst_a_1.jpg"), a2 = at(*pictures, "burst_a_2.jpg"), a3 = at(*pictures, "burst_a_3.jpg");
+	const auto b1 = at(*pictures, "burst_b_1.jpg"), b2 = at(*pictures, "burst_b_2.jpg");
+	CHECK(g->next[a1] == a2 && g->next[a2] == a3 && g->next[a3] == a1);
+	CHECK(g->next[b1] == b2 && g->next[b2] == b1);
+	CHECK(g->size[a1] == 3 && g->size[b2] == 2);
+	for (const char* alone : {"single_a.jpg", "single_b.jpg", "broken.jpg"}) {
+		const auto i = at(*pictures, alone);
+		CHECK(g->next[i] == i && g->size[i] == 1);
+	}
+
+	// a path per line, a blank line after each group
+	std::ifstream listing(dir / "listing.txt");
+	std::stringstream text;
+	text << listing.rdbuf();
+	size_t lines = 0, blank = 0;
+	for (std::string line; std::getline(text, line); ++lines) blank += line.empty();
+	CHECK(lines == 7 && blank == 2);
+	CHECK(text.str().find((dir / "pictures" / "burst_b_2.jpg").string()) != std::string::npos);
+	CHECK(text.str().find("single_a") == std::string::npos);
+}
+
+TEST(a_folder_seen_before_is_grouped_from_the_cache) {
+	// the cache the test before left, a new picture is the only decode
+	const auto pictures = folder({"burst_b_3.jpg"});
+	scenes s;
+	phash::finder f(dir / "cache", dir / "listing.txt", s.decoder());
+	f.start(pictures);
+	const auto g = wait(f);
+	CHECK(g != nullptr);
+	if (!g) return;
+	CHECK(s.decoded == 2); // the new one and broken.jpg, which never hashed
+	CHECK(f.to_hash() == 2);
+	CHECK(g->n_groups == 2);
+	CHECK(g->size[at(*pictures, "burst_b_3.jpg")] == 3);
+}
+
+TEST(groups_reach_into_other_folders) {
+	std::filesystem::create_directories(dir / "elsewhere");
+	std::ofstream(dir / "elsewhere" / "burst_a_4.jpg") << "x";
+	scenes s;
+	phash::finder f(dir / "cache", dir / "listing.txt", s.decoder());
+	const auto other = std::make_shared<const catalog>(catalog::scan(dir / "elsewhere"));
+	f.start(other);
+	const auto g = wait(f);
+	CHECK(g != nullptr);
+	if (!g) return;
+	// counted with the burst in the first folder, but nothing to step to here
+	CHECK(g->size[0] == 4 && g->next[0] == 0);
+}
+
+TEST(stop_drops_the_groups) {
+	scenes s;
+	phash::finder f(dir / "cache", dir / "listing.txt", s.decoder());
+	f.start(std::make_shared<const catalog>(catalog::scan(dir / "pictures")));
+	CHECK(wait(f) != nullptr);
+	f.stop();
+	CHECK(f.get() == nullptr);
+	f.stop();
+	// a start abandons what runs for the catalog before
+	f.start(std::make_shared<const catalog>(catalog::scan(dir / "pictures")));
+	f.start(std::make_shared<const catalog>(catalog::scan(dir / "elsewhere")));
+	const auto g = wait(f);
+	CHECK(g != nullptr && g->size.size() == 1);
+	std::filesystem::remove_all(dir);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "entry_set.hpp"
+
+namespace {
+
+std::vector<std::int64_t> listed(const entry_set& s) {
+	std::vector<std::int64_t> out;
+	s.for_each([&](size_t i) { out.push_back(static_cast<std::int64_t>(i)); });
+	return out;
+}
+
+} // namespace
+
+TEST(empty_and_sealed) {
+	entry_set none(1000);
+	none.seal();
+	CHECK(none.empty());
+	CHECK(none.universe() == 1000);
+	CHECK(none.rank(500) == 0);
+	CHECK(!none.contains(999));
+	CHECK(!none.contains(1000));
+	entry_set zero(0);
+	zero.seal();
+	CHECK(zero.empty());
+	CHECK(zero.rank(0) == 0);
+}
+
+TEST(rank_and_at_against_a_list) {
+	std::mt19937 rng(50);
+	for (const size_t universe : {1u, 63u, 64u, 65u, 511u, 512u, 513u, 10000u, 100003u}) {
+		for (const unsigned density : {1u, 10u, 50u, 100u}) {
+			std::vector<std::int64_t> kept;
+			for (size_t i = 0; i < universe; ++i) {
+				if (rng() % 100 < density) kept.push_back(static_cast<std::int64_t>(i));
+			}
+			const auto s = entry_set::of(universe, kept.begin(), kept.end());
+			CHECK(s.size() == kept.size());
+			CHECK(listed(s) == kept);
+			for (size_t k = 0; k < kept.size(); ++k) CHECK(s.at(k) == kept[k]);
+			for (size_t i = 0; i <= universe; i += 1 + universe / 997) {
+				const auto below = std::lower_bound(kept.begin(), kept.end(), static_cast<std::int64_t>(i)) - kept.begin();
+				CHECK(s.rank(i) == static_cast<size_t>(below));
+				CHECK(s.contains(i) == std::binary_search(kept.begin(), kept.end(), static_cast<std::int64_t>(i)));
+			}
+		}
+	}
+}
+
+TEST(intersection) {
+	const std::vector<int> a{0, 3, 64, 65, 700, 9999}, b{3, 4, 65, 700, 701};
+	const auto both = entry_set::of(10000, a.begin(), a.end()) & entry_set::of(10000, b.begin(), b.end());
+	CHECK((listed(both) == std::vector<std::int64_t>{3, 65, 700}));
+	CHECK(both.size() == 3);
+	CHECK(both.at(2) == 700);
+	CHECK(both.rank(701) == 3);
+	const std::vector<int> c{3, 65, 700};
+	CHECK(both == entry_set::of(10000, c.begin(), c.end()));
+}
+
+int main() { return check::run(); }
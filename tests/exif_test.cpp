@@ -0,0 +1,333 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "exif_index.hpp"
+
+namespace {
+
+using bytes = std::vector<std::uint8_t>;
+
+// A TIFF structure the way cameras write it: IFD0 with make, model,
+// orientation and time, pointing to an Exif IFD with the original time,
+// ISO, dimensions and lens. Values longer than 4 bytes follow the IFDs.
+class tiff_writer {
+	bool little_;
+	bytes out_;
+	bytes data_;
+	struct entry {
+		std::uint16_t tag, type;
+		std::uint32_t count;
+		std::uint32_t value;
+		std::string text;
+	};
+
+	void u16(bytes& b, std::uint32_t v) const {
+		if (little_) b.insert(b.end(), {std::uint8_t(v), std::uint8_t(v >> 8)});
+		else b.insert(b.end(), {std::uint8_t(v >> 8), std::uint8_t(v)});
+	}
+	void u32(bytes& b, std::uint32_t v) const {
+		if (little_) { u16(b, v & 0xFFFF); u16(b, v >> 16); }
+		else { u16(b, v >> 16); u16(b, v & 0xFFFF); }
+	}
+
+	// the entries, their long values go at `data_at` on
+	bytes ifd(const std::vector<entry>& entries, std::uint32_t& data_at) {
+		bytes b;
+		u16(b, static_cast<std::uint32_t>(entries.size()));
+		for (auto& e : entries) {
+			u16(b, e.tag);
+			u16(b, e.type);
+			u32(b, e.count);
+			if (e.type == 2 && e.count > 4) {
+				u32(b, data_at);
+				data_.insert(data_.end(), e.text.begin(), e.text.end());
+				data_.push_back(0);
+				data_at += e.count;
+			} else if (e.type == 2) {
+				bytes v(e.text.begin(), e.text.end());
+				v.resize(4, 0);
+				b.insert(b.end(), v.begin(), v.end());
+			} else if (e.type == 3) {
+				u16(b, e.value);
+				u16(b, 0);
+			} else {
+				u32(b, e.value);
+			}
+		}
+		u32(b, 0);
+		return b;
+	}
+public:
+	explicit tiff_writer(bool little) : little_{little} {}
+
+	bytes write(const exif::fields& f, const std::string& modified = {}) {
+		auto text = [](std::uint16_t tag, const std::string& s) { return entry{tag, 2, static_cast<std::uint32_t>(s.size() + 1), 0, s}; };
+		std::vector<entry> ifd0{
+			text(0x010F, f.make), text(0x0110, f.model),
+			{0x0112, 3, 1, f.orientation, {}},
+		};
+		if (!modified.empty()) ifd0.push_back(text(0x0132, modified));
+		ifd0.push_back({0x8769, 4, 1, 0, {}});
+		char taken[32];
+		const auto days = f.taken / 86400, secs = f.taken % 86400;
+		const auto day = exif::day_name(days);
+		std::snprintf(taken, sizeof(taken), "%.4s:%.2s:%.2s %02d:%02d:%02d", day.c_str(), day.c_str() + 5, day.c_str() + 8,
+			static_cast<int>(secs / 3600), static_cast<int>(secs / 60 % 60), static_cast<int>(secs % 60));
+		std::vector<entry> exif_ifd{
+			text(0x9003, f.taken ? taken : ""),
+			{0x8827, 3, 1, f.iso, {}},
+			{0xA002, 4, 1, f.width, {}},
+			{0xA003, 4, 1, f.height, {}},
+			text(0xA434, f.lens),
+		};
+
+		const std::uint32_t ifd0_at = 8;
+		const auto ifd0_size = static_cast<std::uint32_t>(2 + ifd0.size() * 12 + 4);
+		const auto exif_at = ifd0_at + ifd0_size;
+		ifd0.back().value = exif_at;
+		const auto exif_size = static_cast<std::uint32_t>(2 + exif_ifd.size() * 12 + 4);
+		std::uint32_t data_at = exif_at + exif_size;
+
+		out_.clear();
+		data_.clear();
+		out_.insert(out_.end(), little_ ? "II" : "MM", (little_ ? "II" : "MM") + 2);
+		u16(out_, 42);
+		u32(out_, ifd0_at);
+		const auto a = ifd(ifd0, data_at);
+		const auto b = ifd(exif_ifd, data_at);
+		out_.insert(out_.end(), a.begin(), a.end());
+		out_.insert(out_.end(), b.begin(), b.end());
+		out_.insert(out_.end(), data_.begin(), data_.end());
+		return out_;
+	}
+};
+
+// The markers of a baseline JPEG up to its first scan.
+bytes jpeg_file(const bytes& tiff, std::uint16_t frame_width, std::uint16_t frame_height) {
+	bytes b{0xFF, 0xD8};
+	// a JFIF segment ahead of the Exif one, as some writers put it
+	b.insert(b.end(), {0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+	const auto len = static_cast<std::uint32_t>(2 + 6 + tiff.size());
+	b.insert(b.end(), {0xFF, 0xE1, std::uint8_t(len >> 8), std::uint8_t(len)});
+	b.insert(b.end(), {'E', 'x', 'i', 'f', 0, 0});
+	b.insert(b.end(), tiff.begin(), tiff.end());
+	b.insert(b.end(), {0xFF, 0xC0, 0x00, 0x0B, 8, std::uint8_t(frame_height >> 8), std::uint8_t(frame_height),
+		std::uint8_t(frame_width >> 8), std::uint8_t(frame_width), 1, 1, 0x11, 0});
+	b.insert(b.end(), {0xFF, 0xDA, 0x00, 0x08, 1, 1, 0, 0, 0x3F, 0});
+	b.insert(b.end(), {0x12, 0x34, 0xFF, 0xD9});
+	return b;
+}
+
+exif::fields camera_fields() {
+	exif::fields f;
+	f.taken = exif::detail::days_from_civil(2024, 5, 1) * 86400 + 13 * 3600 + 14 * 60 + 15;
+	f.make = "Canon";
+	f.model = "Canon EOS R5";
+	f.lens = "RF24-105mm F4 L IS USM";
+	f.iso = 800;
+	f.width = 8192;
+	f.height = 5464;
+	f.orientation = 6;
+	return f;
+}
+
+bool same(const exif::fields& a, const exif::fields& b) {
+	return a.taken == b.taken && a.make == b.make && a.model == b.model && a.lens == b.lens && a.iso == b.iso
+		&& a.width == b.width && a.height == b.height && a.orientation == b.orientation;
+}
+
+struct temp_dir {
+	std::filesystem::path path;
+	explicit temp_dir(const char* name) : path{std::filesystem::temp_directory_path() / name} {
+		std::filesystem::remove_all(path);
+		std::filesystem::create_directories(path);
+	}
+	~temp_dir() {
+		std::error_code ec;
+		std::filesystem::remove_all(path, ec);
+	}
+};
+
+void write_file(const std::filesystem::path& path, const bytes& b) {
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(b.data()), static_cast<std::streamsize>(b.size()));
+}
+
+} // namespace
+
+TEST(parse_time) {
+	CHECK(exif::detail::parse_time("1970:01:01 00:00:00") == 0);
+	CHECK(exif::detail::parse_time("2000:03:01 00:00:01") == 951868801);
+	CHECK(exif::detail::parse_time("2024:02:29 23:59:59") == exif::detail::days_from_civil(2024, 2, 29) * 86400 + 86399);
+	CHECK(exif::detail::parse_time("    :  :     :  :  ") == 0);
+	CHECK(exif::detail::parse_time("2024:13:01 00:00:00") == 0);
+	CHECK(exif::detail::parse_time("2024:05:01") == 0);
+	CHECK(exif::day_name(exif::detail::days_from_civil(1999, 12, 31)) == "1999-12-31");
+	CHECK(exif::day_name(exif::detail::days_from_civil(1969, 7, 20)) == "1969-07-20");
+}
+
+TEST(jpeg_with_exif) {
+	const auto expected = camera_fields();
+	for (const bool little : {true, false}) {
+		const auto file = jpeg_file(tiff_writer(little).write(expected), 8192, 5464);
+		exif::fields f;
+		CHECK(exif::read(file.data(), file.size(), f));
+		CHECK(same(f, expected));
+	}
+}
+
+TEST(frame_dimensions_win_over_exif) {
+	const auto file = jpeg_file(tiff_writer(true).write(camera_fields()), 1024, 683);
+	exif::fields f;
+	CHECK(exif::read(file.data(), file.size(), f));
+	CHECK(f.width == 1024);
+	CHECK(f.height == 683);
+	CHECK(f.iso == 800);
+}
+
+TEST(raw_tiff_and_modified_time) {
+	auto expected = camera_fields();
+	expected.taken = 0;
+	const auto file = tiff_writer(false).write(expected, "2021:06:30 08:00:00");
+	exif::fields f;
+	CHECK(exif::read(file.data(), file.size(), f));
+	// no original time, the modified one stands in
+	CHECK(f.taken == exif::detail::parse_time("2021:06:30 08:00:00"));
+	CHECK(f.model == expected.model);
+	CHECK(f.lens == expected.lens);
+}
+
+TEST(short_text_fits_the_entry) {
+	auto expected = camera_fields();
+	expected.make = "Sony";
+	expected.model = "A7";
+	const auto file = jpeg_file(tiff_writer(true).write(expected), 8192, 5464);
+	exif::fields f;
+	CHECK(exif::read(file.data(), file.size(), f));
+	CHECK(f.make == "Sony");
+	CHECK(f.model == "A7");
+}
+
+TEST(truncated_and_mutated_headers) {
+	const auto file = jpeg_file(tiff_writer(true).write(camera_fields()), 8192, 5464);
+	// every prefix, read exactly into a buffer of its own size so ASan sees
+	// any read past it
+	for (size_t n = 0; n < file.size(); ++n) {
+		const bytes prefix(file.begin(), file.begin() + static_cast<std::ptrdiff_t>(n));
+		exif::fields f;
+		exif::read(prefix.data(), prefix.size(), f);
+		CHECK(f.orientation <= 8);
+	}
+	std::mt19937 rng(49);
+	for (int i = 0; i < 20000; ++i) {
+		auto mutated = file;
+		const int flips = 1 + static_cast<int>(rng() % 4);
+		for (int k = 0; k < flips; ++k) mutated[rng() % mutated.size()] = static_cast<std::uint8_t>(rng());
+		exif::fields f;
+		exif::read(mutated.data(), mutated.size(), f);
+		CHECK(f.orientation <= 8);
+		CHECK(f.make.size() <= 1024 && f.model.size() <= 1024 && f.lens.size() <= 1024);
+	}
+}
+
+TEST(index_names_and_filters) {
+	exif::index idx(4);
+	auto f = camera_fields();
+	idx.set(0, f);
+	// "Canon" + "EOS R5" is the same camera as "Canon EOS R5"
+	f.model = "EOS R5";
+	f.orientation = 1;
+	idx.set(1, f);
+	f.make = "Nikon";
+	f.model = "Z 9";
+	f.iso = 6400;
+	f.taken += 86400;
+	idx.set(2, f);
+	idx.set(3, exif::fields{});
+
+	CHECK(idx.camera(0) == idx.camera(1));
+	CHECK(idx.camera_name(idx.camera(0)) == "Canon EOS R5");
+	CHECK(idx.camera_name(idx.camera(2)) == "Nikon Z 9");
+	CHECK(idx.camera(3) == 0);
+	CHECK(idx.day(3) == -1);
+	// orientation 6 turns the landscape frame upright
+	CHECK(idx.shape(0) == exif::shape::portrait);
+	CHECK(idx.shape(1) == exif::shape::landscape);
+
+	exif::filter none;
+	CHECK(idx.select(none).size() == 4);
+	exif::filter canon;
+	canon.camera = idx.camera(0);
+	CHECK((idx.select(canon) == std::vector<std::int64_t>{0, 1}));
+	exif::filter fast;
+	fast.iso_min = 1000;
+	CHECK((idx.select(fast) == std::vector<std::int64_t>{2}));
+	exif::filter day;
+	day.day = idx.day(0);
+	day.shape = exif::shape::landscape;
+	CHECK((idx.select(day) == std::vector<std::int64_t>{1}));
+}
+
+TEST(store_round_trip) {
+	temp_dir dir("imv_exif_store");
+	exif::store s;
+	s.put("/a/b.jpg", {123, 456, camera_fields()});
+	CHECK(s.save(dir.path / "exif.cache"));
+	exif::store loaded;
+	loaded.load(dir.path / "exif.cache");
+	CHECK(loaded.size() == 1);
+	const auto* e = loaded.find("/a/b.jpg", 123, 456);
+	CHECK(e && same(e->fields, camera_fields()));
+	CHECK(!loaded.find("/a/b.jpg", 124, 456));
+	// a foreign file leaves it empty
+	write_file(dir.path / "other", bytes(64, 0xAB));
+	exif::store foreign;
+	foreign.load(dir.path / "other");
+	CHECK(foreign.size() == 0);
+}
+
+TEST(indexer_reads_once_then_uses_the_cache) {
+	temp_dir dir("imv_exif_indexer");
+	const auto pictures = dir.path / "pictures";
+	std::filesystem::create_directories(pictures);
+	auto f = camera_fields();
+	for (int i = 0; i < 6; ++i) {
+		f.iso = 100u << i;
+		write_file(pictures / ("img" + std::to_string(i) + ".jpg"), jpeg_file(tiff_writer(i % 2).write(f), 8192, 5464));
+	}
+	auto wait = [](exif::indexer& x) {
+		for (int i = 0; i < 1000 && !x.get(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return x.get();
+	};
+	auto& read = metrics::get_counter("exif.read");
+	const auto cat = std::make_shared<const catalog>(catalog::scan(pictures));
+	CHECK(cat->size() == 6);
+
+	const auto before = read.value();
+	{
+		exif::indexer x(dir.path / "exif.cache");
+		x.start(cat);
+		const auto idx = wait(x);
+		CHECK(idx != nullptr);
+		if (idx) {
+			for (size_t i = 0; i < 6; ++i) CHECK(idx->iso(i) == 100u << i);
+		}
+	}
+	CHECK(read.value() == before + 6);
+	{
+		exif::indexer x(dir.path / "exif.cache");
+		x.start(cat);
+		const auto idx = wait(x);
+		CHECK(idx && idx->iso(5) == 3200);
+	}
+	CHECK(read.value() == before + 6);
+}
+
+int main() { return check::run(); }
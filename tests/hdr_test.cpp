@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "hdr.hpp"
+
+namespace {
+
+bool is_nan(std::uint16_t h) { return (h & 0x7C00) == 0x7C00 && (h & 0x3FF) != 0; }
+
+// One RGBA half pixel.
+void put(std::uint16_t* p, float r, float g, float b, float a) {
+	p[0] = hdr::float_to_half(r);
+	p[1] = hdr::float_to_half(g);
+	p[2] = hdr::float_to_half(b);
+	p[3] = hdr::float_to_half(a);
+}
+
+std::uint32_t map_one(const hdr::tone& t, float r, float g, float b, float a) {
+	std::uint16_t px[4];
+	put(px, r, g, b, a);
+	std::uint32_t out = 0;
+	hdr::mapper(t).run(px, &out, 1);
+	return out;
+}
+
+// sRGB encoding of a straight linear value, in doubles.
+int encode(double v) {
+	v = std::clamp(v, 0.0, 1.0);
+	return static_cast<int>(std::lround((v <= 0.0031308 ? 12.92 * v : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055) * 255.0));
+}
+
+int channel(std::uint32_t p, int shift) { return static_cast<int>((p >> shift) & 0xFF); }
+
+} // namespace
+
+TEST(every_half_survives_a_round_trip) {
+	for (std::uint32_t h = 0; h < 0x10000; ++h) {
+		const auto x = static_cast<std::uint16_t>(h);
+		if (is_nan(x)) {
+			// large, for the mapper to clip
+			CHECK(std::abs(hdr::half_to_float(x)) >= 65536.0f);
+			continue;
+		}
+		CHECK(hdr::float_to_half(hdr::half_to_float(x)) == x);
+	}
+	CHECK(hdr::half_to_float(0x3C00) == 1.0f);
+	CHECK(hdr::half_to_float(0xC000) == -2.0f);
+	CHECK(hdr::half_to_float(0x0001) == std::ldexp(1.0f, -24));
+	CHECK(hdr::half_to_float(0x7BFF) == 65504.0f);
+}
+
+TEST(floats_round_to_the_nearest_half) {
+	std::mt19937 rng(38);
+	std::uniform_real_distribution<float> exponent(-26.0f, 16.0f);
+	for (int i = 0; i < 200000; ++i) {
+		const float f = std::exp2(exponent(rng)) * (rng() & 1 ? -1.0f : 1.0f);
+		const auto h = hdr::float_to_half(f);
+		if ((h & 0x7FFF) >= 0x7C00) {
+			// only what rounds past the largest half overflows
+			CHECK(std::abs(f) >= 65520.0f);
+			continue;
+		}
+		const float d = std::abs(f - hdr::half_to_float(h));
+		for (int step : {-1, 1}) {
+			const auto n = static_cast<std::uint16_t>((h & 0x7FFF) + step);
+			if ((h & 0x7FFF) == 0 && step < 0) continue;
+			const float e = std::abs(std::abs(f) - hdr::half_to_float(n));
+			CHECK(d < e || (d == e && (h & 1) == 0));
+		}
+	}
+	CHECK(hdr::float_to_half(1e6f) == 0x7C00);
+	CHECK(hdr::float_to_half(-1e6f) == 0xFC00);
+	CHECK(hdr::float_to_half(NAN) == 0x7E00);
+}
+
+TEST(exposure_and_clipping) {
+	const hdr::tone flat;
+	CHECK(map_one(flat, 1.0f, 0.5f, 0.0f, 1.0f) == (0xFF000000u | 255u << 16 | std::uint32_t(encode(0.5)) << 8));
+	// out of range either way clips
+	CHECK(map_one(flat, 3.0f, -1.0f, 0.25f, 1.0f) == (0xFF000000u | 255u << 16 | std::uint32_t(encode(0.25))));
+	// a stop up doubles
+	const hdr::tone brighter{1.0f, false};
+	CHECK(std::abs(channel(map_one(brighter, 0.25f, 0.25f, 0.25f, 1.0f), 8) - encode(0.5)) <= 1);
+	CHECK(map_one(flat, 1.0f, 1.0f, 1.0f, 0.0f) == 0);
+}
+
+TEST(reinhard_rolls_off_to_white) {
+	const hdr::tone curve{0.0f, true};
+	for (float v : {0.1f, 0.5f, 1.0f, 2.0f, 3.5f}) {
+		const double want = v * (1.0 + v / (hdr::tone::white * hdr::tone::white)) / (1.0 + v);
+		CHECK(std::abs(channel(map_one(curve, v, v, v, 1.0f), 0) - encode(want)) <= 1);
+	}
+	CHECK(channel(map_one(curve, 4.0f, 4.0f, 4.0f, 1.0f), 16) == 255);
+	// below white nothing clips
+	CHECK(channel(map_one(curve, 3.0f, 3.0f, 3.0f, 1.0f), 16) < 255);
+}
+
+TEST(translucent_pixels_keep_their_colour) {
+	const hdr::tone flat;
+	// premultiplied 0.25 at half coverage is 0.5 straight
+	const auto p = map_one(flat, 0.25f, 0.25f, 0.25f, 0.5f);
+	const int a = static_cast<int>(p >> 24);
+	CHECK(a == 128);
+	CHECK(std::abs(channel(p, 0) - (encode(0.5) * a + 127) / 255) <= 1);
+	CHECK(channel(p, 0) == channel(p, 8) && channel(p, 8) == channel(p, 16));
+}
+
+TEST(rows_reduce_to_box_averages) {
+	const std::uint32_t width = 37, height = 23;
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> value(0.0f, 4.0f);
+	std::vector<std::uint16_t> src(size_t(width) * height * 4);
+	for (auto& h : src) h = hdr::float_to_half(value(rng));
+
+	for (std::uint32_t k : {0u, 1u, 2u, 3u}) {
+		hdr::reducer r(width, height, k);
+		// fed in uneven bites, the way a decoder hands rows over
+		for (std::uint32_t y = 0; y < height;) {
+			const std::uint32_t n = std::min(height - y, 1 + y % 4);
+			r.add(src.data() + size_t(y) * width * 4, n);
+			y += n;
+		}
+		const auto out = r.take();
+		const std::uint32_t box = 1u << k;
+		CHECK(out.width == width >> k && out.height == height >> k);
+		int worst = 0;
+		for (std::uint32_t y = 0; y < out.height; ++y) {
+			for (std::uint32_t x = 0; x < out.width; ++x) {
+				for (int c = 0; c < 4; ++c) {
+					double sum = 0.0;
+					for (std::uint32_t dy = 0; dy < box; ++dy) {
+						for (std::uint32_t dx = 0; dx < box; ++dx) sum += hdr::half_to_float(src[((size_t(y) * box + dy) * width + x * box + dx) * 4 + c]);
+					}
+					const auto want = hdr::float_to_half(static_cast<float>(sum / (box * box)));
+					const auto got = out.data()[(size_t(y) * out.width + x) * 4 + c];
+					worst = std::max(worst, std::abs(int(got) - int(want)));
+				}
+			}
+		}
+		// float sums round differently from double ones by at most an ulp
+		CHECK(worst <= (k == 0 ? 0 : 1));
+	}
+}
+
+TEST(a_level_smaller_than_a_box_is_one_pixel) {
+	std::vector<std::uint16_t> src(3 * 4);
+	for (int i = 0; i < 3; ++i) put(src.data() + i * 4, 1.0f, 1.0f, 1.0f, 1.0f);
+	hdr::reducer r(3, 1, 2);
+	r.add(src.data(), 1);
+	const auto out = r.take();
+	CHECK(out.width == 1 && out.height == 1);
+}
+
+int main() { return check::run(); }
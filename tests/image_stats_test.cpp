@@ -0,0 +1,89 @@
+#include <array>
+#include <cstdint>
+#include <random>
+
+#include "check.hpp"
+#include "image_stats.hpp"
+
+namespace {
+
+image_buffer noise(std::uint32_t width, std::uint32_t height, std::uint32_t seed) {
+	image_buffer b;
+	b.allocate(width, height);
+	std::mt19937 rng(seed);
+	for (size_t i = 0; i < size_t(width) * height; ++i) b.data()[i] = rng() | 0xFF000000u;
+	return b;
+}
+
+// One pixel at a time, the way the histograms are defined.
+image_stats reference(const image_buffer& img) {
+	image_stats s;
+	for (size_t i = 0; i < size_t(img.width) * img.height; ++i) {
+		const std::uint32_t p = img.data()[i];
+		const std::uint32_t b = p & 0xFF, g = (p >> 8) & 0xFF, r = (p >> 16) & 0xFF;
+		++s.blue.histogram[b];
+		++s.green.histogram[g];
+		++s.red.histogram[r];
+		++s.luma.histogram[(b * 29 + g * 150 + r * 77) >> 8];
+	}
+	s.pixels = std::uint64_t(img.width) * img.height;
+	for (auto* c : {&s.blue, &s.green, &s.red, &s.luma}) c->summarize(s.pixels);
+	return s;
+}
+
+bool same(const image_stats::channel& a, const image_stats::channel& b) {
+	return a.histogram == b.histogram && a.min == b.min && a.max == b.max && a.mean == b.mean;
+}
+
+} // namespace
+
+TEST(histograms_count_every_pixel_once) {
+	// widths that leave 0 to 3 pixels after the groups of four
+	for (std::uint32_t width : {1u, 2u, 3u, 4u, 5u, 7u, 64u, 301u}) {
+		const auto img = noise(width, 37, width);
+		const auto s = image_stats::compute(img, true);
+		const auto want = reference(img);
+		CHECK(s.exact);
+		CHECK(s.pixels == std::uint64_t(width) * 37);
+		CHECK(same(s.blue, want.blue));
+		CHECK(same(s.green, want.green));
+		CHECK(same(s.red, want.red));
+		CHECK(same(s.luma, want.luma));
+	}
+}
+
+TEST(runs_of_one_value) {
+	image_buffer img;
+	img.allocate(50, 20);
+	for (size_t i = 0; i < 1000; ++i) img.data()[i] = i < 250 ? 0xFF000000u : 0xFFFFFFFFu;
+	const auto s = image_stats::compute(img, false);
+	CHECK(!s.exact);
+	CHECK(s.red.histogram[0] == 250 && s.red.histogram[255] == 750);
+	CHECK(s.luma.min == 0);
+	CHECK(s.red.max == 255);
+	CHECK(s.green.mean == 255.0 * 750 / 1000);
+	CHECK(s.clipped_highlights() == 0.75);
+	CHECK(s.clipped_shadows() == 0.25);
+}
+
+TEST(the_worst_channel_counts_as_clipped) {
+	image_buffer img;
+	img.allocate(4, 1);
+	img.data()[0] = 0xFFFF0000u;
+	img.data()[1] = 0xFFFF0000u;
+	img.data()[2] = 0xFF00FF00u;
+	img.data()[3] = 0xFF102030u;
+	const auto s = image_stats::compute(img, true);
+	CHECK(s.clipped_highlights() == 0.5);
+	CHECK(s.clipped_shadows() == 0.0);
+}
+
+TEST(no_pixels_no_stats) {
+	const auto s = image_stats::compute(image_buffer{}, true);
+	CHECK(s.pixels == 0);
+	CHECK(s.luma.min == 0 && s.luma.max == 0 && s.luma.mean == 0.0);
+	CHECK(s.clipped_highlights() == 0.0);
+	CHECK(s.clipped_shadows() == 0.0);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,159 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "inflate.hpp"
+
+namespace {
+
+std::vector<std::uint8_t> load(const std::string& name) {
+	std::ifstream f(std::string(FIXTURES) + "/" + name, std::ios::binary);
+	return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+
+// the zlib streams make_fixtures.py wrote, and what each inflates to
+struct stream {
+	std::string name;
+	std::vector<std::uint8_t> zz, raw;
+};
+
+const std::vector<stream>& streams() {
+	static const auto all = []() {
+		std::vector<stream> out;
+		std::ifstream list(std::string(FIXTURES) + "/inflate.txt");
+		for (std::string name; std::getline(list, name);) out.push_back({name, load(name + ".zz"), load(name + ".raw")});
+		return out;
+	}();
+	return all;
+}
+
+} // namespace
+
+TEST(zlib_streams_inflate_to_what_python_compressed) {
+	CHECK(streams().size() > 60);
+	for (auto& s : streams()) {
+		std::vector<std::uint8_t> out;
+		const bool ok = inflate::zlib(s.zz.data(), s.zz.size(), out);
+		CHECK(ok);
+		CHECK(out == s.raw);
+		if (!ok || out != s.raw) std::fprintf(stderr, "  %s\n", s.name.c_str());
+	}
+}
+
+TEST(raw_streams_report_what_they_consumed) {
+	for (auto& s : streams()) {
+		std::vector<std::uint8_t> out;
+		size_t consumed = 0;
+		CHECK(inflate::raw(s.zz.data() + 2, s.zz.size() - 2, out, size_t(1) << 31, &consumed));
+		CHECK(consumed == s.zz.size() - 6);
+		CHECK(out == s.raw);
+	}
+}
+
+TEST(span_output_fills_exactly_and_stops) {
+	for (auto& s : streams()) {
+		std::vector<std::uint8_t> buf(s.raw.size() + 1, 0xAA);
+		inflate::span_output exact(buf.data(), s.raw.size());
+		CHECK(inflate::raw(s.zz.data() + 2, s.zz.size() - 2, exact, exact.capacity()));
+		CHECK(exact.size() == s.raw.size());
+		CHECK(std::equal(s.raw.begin(), s.raw.end(), buf.begin()));
+		CHECK(buf.back() == 0xAA);
+		if (s.raw.empty()) continue;
+		// one byte short of room is refused, and nothing is written past it
+		std::vector<std::uint8_t> small(s.raw.size(), 0xAA);
+		inflate::span_output shorter(small.data(), s.raw.size() - 1);
+		CHECK(!inflate::raw(s.zz.data() + 2, s.zz.size() - 2, shorter, shorter.capacity()));
+		CHECK(small.back() == 0xAA);
+		std::vector<std::uint8_t> out;
+		CHECK(!inflate::zlib(s.zz.data(), s.zz.size(), out, s.raw.size() - 1));
+	}
+}
+
+TEST(truncated_and_damaged_streams_are_refused) {
+	for (auto& s : streams()) {
+		if (s.zz.size() > 4000) continue;
+		for (size_t n = 0; n < s.zz.size(); ++n) {
+			std::vector<std::uint8_t> out;
+			CHECK(!inflate::zlib(s.zz.data(), n, out));
+		}
+		std::vector<std::uint8_t> out;
+		auto bad = s.zz;
+		bad.back() ^= 1;
+		CHECK(!inflate::zlib(bad.data(), bad.size(), out));
+		bad = s.zz;
+		bad[0] = (bad[0] & 0xF0) | 7;
+		CHECK(!inflate::zlib(bad.data(), bad.size(), out));
+		bad = s.zz;
+		++bad[1];
+		CHECK(!inflate::zlib(bad.data(), bad.size(), out));
+	}
+	const std::uint8_t preset[] = {0x78, 0xBB, 0, 0, 0, 1, 0x03, 0x00, 0, 0, 0, 1};
+	std::vector<std::uint8_t> out;
+	CHECK(!inflate::zlib(preset, sizeof(preset), out));
+	// block type 3 doesn't exist
+	const std::uint8_t reserved[] = {0x07, 0, 0, 0};
+	CHECK(!inflate::raw(reserved, sizeof(reserved), out));
+}
+
+TEST(stored_block_by_hand) {
+	const std::uint8_t stored[] = {0x01, 0x03, 0x00, 0xFC, 0xFF, 'a', 'b', 'c'};
+	std::vector<std::uint8_t> out;
+	size_t consumed = 0;
+	CHECK(inflate::raw(stored, sizeof(stored), out, size_t(1) << 31, &consumed));
+	CHECK((out == std::vector<std::uint8_t>{'a', 'b', 'c'}));
+	CHECK(consumed == sizeof(stored));
+	// LEN and NLEN disagree
+	const std::uint8_t mismatched[] = {0x01, 0x03, 0x00, 0xFC, 0xFE, 'a', 'b', 'c'};
+	out.clear();
+	CHECK(!inflate::raw(mismatched, sizeof(mismatched), out));
+}
+
+TEST(adler32_known_values) {
+	CHECK(inflate::adler32(nullptr, 0) == 1);
+	const std::string wiki = "Wikipedia";
+	CHECK(inflate::adler32(reinterpret_cast<const std::uint8_t*>(wiki.data()), wiki.size()) == 0x11E60398);
+	// past the 5552 byte runs the sums are reduced in
+	const std::vector<std::uint8_t> ff(100000, 0xFF);
+	std::uint32_t a = 1, b = 0;
+	for (auto v : ff) {
+		a = (a + v) % 65521;
+		b = (b + a) % 65521;
+	}
+	CHECK(inflate::adler32(ff.data(), ff.size()) == (b << 16 | a));
+}
+
+// Mutated streams, under ASan and UBSan: whatever comes out, nothing is
+// read or written out of bounds and the output stays under its limit.
+TEST(mutated_streams_stay_in_bounds) {
+	std::mt19937 rng(1950);
+	int inflated = 0;
+	for (auto& s : streams()) {
+		if (s.zz.size() < 8 || s.zz.size() > 20000) continue;
+		for (int round = 0; round < 300; ++round) {
+			auto bad = s.zz;
+			for (auto n = 1 + rng() % 4; n; --n) {
+				const auto at = rng() % bad.size();
+				switch (rng() % 3) {
+				case 0: bad[at] ^= static_cast<std::uint8_t>(1u << rng() % 8); break;
+				case 1: bad[at] = static_cast<std::uint8_t>(rng()); break;
+				default: bad.resize(at + 1); break;
+				}
+			}
+			std::vector<std::uint8_t> out;
+			const size_t limit = s.raw.size() + 64;
+			if (inflate::zlib(bad.data(), bad.size(), out, limit)) ++inflated;
+			CHECK(out.size() <= limit);
+			std::vector<std::uint8_t> buf(s.raw.size() + 1);
+			inflate::span_output span(buf.data(), buf.size());
+			inflate::raw(bad.data() + 2, bad.size() - 2, span, span.capacity());
+			CHECK(span.size() <= buf.size());
+		}
+	}
+	std::fprintf(stderr, "  %d mutated streams still inflated\n", inflated);
+}
+
+int main() { return check::run(); }
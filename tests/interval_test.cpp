@@ -0,0 +1,66 @@
+#include <cstdint>
+
+#include "check.hpp"
+#include "interval.hpp"
+
+TEST(interval_stops_at_its_ends) {
+	Interval<int> i(0, 4, 2);
+	CHECK(i() == 0);
+	--i;
+	CHECK(i() == 0);
+	++i;
+	++i;
+	CHECK(i() == 4);
+	++i;
+	CHECK(i() == 4);
+	i.set_value(3);
+	++i;
+	CHECK(i() == 3);
+	CHECK(i.reset() == 0);
+}
+
+TEST(circular_wraps_round) {
+	CirculalInterval<std::int64_t> i(0, 2, 1);
+	--i;
+	CHECK(i() == 2);
+	++i;
+	CHECK(i() == 0);
+	CirculalInterval<std::int64_t> one(5, 5, 1);
+	++one;
+	CHECK(one() == 5);
+	--one;
+	CHECK(one() == 5);
+	// a step that doesn't divide the range wraps to the other end
+	CirculalInterval<int> odd(0, 10, 3);
+	odd.set_value(9);
+	++odd;
+	CHECK(odd() == 0);
+	--odd;
+	CHECK(odd() == 10);
+}
+
+TEST(plus_and_minus_are_repeated_steps) {
+	struct range {
+		int first, last, step;
+	};
+	for (const auto& [first, last, step] : {range{0, 0, 1}, range{0, 9, 1}, range{-5, 5, 1}, range{0, 10, 3}, range{3, 100, 7}}) {
+		for (int start = first; start <= last; start += step) {
+			CirculalInterval<int> from(first, last, step);
+			from.set_value(start);
+			auto up = from, down = from;
+			for (size_t ix = 0; ix < 300; ++ix) {
+				CHECK((from + ix)() == up());
+				CHECK((from - ix)() == down());
+				++up;
+				--down;
+			}
+		}
+	}
+	// far past a wrap in one go
+	CirculalInterval<std::int64_t> big(0, 999999, 1);
+	big.set_value(10);
+	CHECK((big + 5000000000u)() == (5000000010 % 1000000));
+	CHECK((big - 11)() == 999999);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,63 @@
+#include <stdexcept>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+
+#include "check.hpp"
+#include "load_pipeline.hpp"
+
+namespace {
+
+double depth() {
+	return metrics::get_gauge("pool.queue_depth").value();
+}
+
+load::task<> stage(int& ran) {
+	++ran;
+	co_return;
+}
+
+} // namespace
+
+TEST(spawned_loads_are_queued_until_they_run) {
+	boost::asio::io_context ioc;
+	const auto before = depth();
+	int ran = 0;
+	for (int i = 0; i < 5; ++i) load::spawn(ioc.get_executor(), stage(ran));
+	CHECK(depth() == before + 5);
+	CHECK(ran == 0);
+	ioc.run();
+	CHECK(ran == 5);
+	CHECK(depth() == before);
+}
+
+TEST(a_yield_is_queued_until_it_resumes) {
+	boost::asio::io_context ioc;
+	auto strand = boost::asio::make_strand(ioc);
+	const auto before = depth();
+	double waiting = 0.0;
+	// the load yields behind a job that looks at the gauge
+	load::spawn(strand, [](decltype(strand) strand, double& waiting) -> load::task<> {
+		boost::asio::post(strand, [&waiting]() { waiting = depth(); });
+		co_await load::yield(strand);
+	}(strand, waiting));
+	ioc.run();
+	CHECK(waiting == before + 1);
+	CHECK(depth() == before);
+}
+
+TEST(an_escaping_load_is_counted) {
+	boost::asio::io_context ioc;
+	auto& escaped = metrics::get_counter("load.escaped");
+	const auto before = escaped.value();
+	const auto depth_before = depth();
+	load::spawn(ioc.get_executor(), []() -> load::task<> {
+		throw std::runtime_error("decode");
+		co_return;
+	}());
+	ioc.run();
+	CHECK(escaped.value() == before + 1);
+	CHECK(depth() == depth_before);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,372 @@
+#!/usr/bin/env python3
+"""Inputs for the tests that need another implementation to agree with.
+
+    python3 make_fixtures.py build/fixtures
+
+Everything is made from fixed seeds, so the same files come out every time.
+inflate.txt lists the zlib streams, zip.txt the members each archive should
+list, in order, and their sizes. images.txt lists pictures Pillow wrote, or
+that are written here where Pillow can't, with what Pillow decodes them to
+in name.rgba, straight RGBA, and how far off a decoder may be. Pictures the
+decoders should decline are listed as such.
+"""
+
+import os
+import random
+import struct
+import sys
+import zipfile
+import zlib
+
+from PIL import Image
+
+
+def write(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+# zlib streams of data that exercises stored, fixed and dynamic blocks,
+# long matches, the full 32K window and blocks ended by a flush
+
+def inflate_inputs():
+    rng = random.Random(1951)
+    words = [b"the", b"picture", b"of", b"a", b"beach", b"at", b"dusk", b"DSC_0001.JPG", b"\x00\xff"]
+    text = b" ".join(rng.choice(words) for _ in range(40000))
+    noise = bytes(rng.getrandbits(8) for _ in range(70000))
+    runs = b"".join(bytes([rng.getrandbits(8)]) * rng.randint(1, 300) for _ in range(1500))
+    block = bytes(rng.getrandbits(8) for _ in range(1000))
+    far = block + bytes(rng.getrandbits(8) for _ in range(31000)) + block
+    return {"empty": b"", "byte": b"x", "text": text, "noise": noise, "runs": runs, "far": far}
+
+
+def make_inflate(out):
+    names = []
+    strategies = {"default": zlib.Z_DEFAULT_STRATEGY, "filtered": zlib.Z_FILTERED,
+                  "huffman": zlib.Z_HUFFMAN_ONLY, "rle": zlib.Z_RLE, "fixed": zlib.Z_FIXED}
+    for data_name, data in inflate_inputs().items():
+        for level in (0, 1, 6, 9):
+            for strategy_name, strategy in strategies.items():
+                if level == 0 and strategy_name != "default":
+                    continue
+                name = "%s_%d_%s" % (data_name, level, strategy_name)
+                c = zlib.compressobj(level, zlib.DEFLATED, 15, 9, strategy)
+                write(os.path.join(out, name + ".raw"), data)
+                write(os.path.join(out, name + ".zz"), c.compress(data) + c.flush())
+                names.append(name)
+        # a block per 4K, some of them ended by an empty stored block
+        c = zlib.compressobj(6)
+        stream = b""
+        for i in range(0, len(data), 4096):
+            stream += c.compress(data[i:i + 4096])
+            stream += c.flush(zlib.Z_SYNC_FLUSH if i // 4096 % 2 else zlib.Z_FULL_FLUSH)
+        stream += c.flush()
+        name = data_name + "_flushed"
+        write(os.path.join(out, name + ".raw"), data)
+        write(os.path.join(out, name + ".zz"), stream)
+        names.append(name)
+    write(os.path.join(out, "inflate.txt"), "".join(n + "\n" for n in names).encode())
+
+
+# ZIP archives. A member's bytes are its name over and over, each round
+# xored with the round number, so the test can tell what it should read.
+
+def content(name, size):
+    b = name.encode()
+    return bytes(b[i % len(b)] ^ ((i // len(b)) & 0x0F) for i in range(size))
+
+
+def make_album(path):
+    expected = []
+    with zipfile.ZipFile(path, "w") as z:
+        z.comment = b"c" * 65000
+        for name, size, method in [("b.jpg", 50000, zipfile.ZIP_DEFLATED), ("a.JPG", 3000, zipfile.ZIP_STORED),
+                                   ("sub/c.png", 70000, zipfile.ZIP_DEFLATED), ("sub/z.gif", 1, zipfile.ZIP_STORED)]:
+            z.writestr(zipfile.ZipInfo(name), content(name, size), compress_type=method)
+            expected.append((name, size))
+        # none of these are listed
+        for name in ("notes.txt", "__MACOSX/._b.jpg", "sub/._c.png", "._x.jpg", "dir/"):
+            z.writestr(zipfile.ZipInfo(name), content(name, 100))
+        z.writestr(zipfile.ZipInfo("empty.jpg"), b"")
+        z.writestr(zipfile.ZipInfo("packed.jpg"), content("packed.jpg", 5000), compress_type=zipfile.ZIP_BZIP2)
+        z.writestr(zipfile.ZipInfo("locked.jpg"), content("locked.jpg", 100))
+    # zipfile won't write the encrypted flag, so it's set afterwards in the
+    # central header, whose name starts 46 bytes in
+    with open(path, "r+b") as f:
+        data = f.read()
+        at = data.rindex(b"locked.jpg") - 46
+        assert data[at:at + 4] == b"PK\x01\x02"
+        f.seek(at + 8)
+        f.write(b"\x01\x00")
+    return sorted(expected)
+
+
+def make_zip64(path):
+    """Every size and offset in the ZIP64 extra field and the end records
+    saying so, which is what archives over 4 GB look like."""
+    members = [("p%02d.jpg" % i, 200 + 97 * i) for i in range(20)]
+    body, central = b"", b""
+    for name, size in members:
+        data = zlib.compressobj(6, zlib.DEFLATED, -15)
+        packed = data.compress(content(name, size)) + data.flush()
+        crc = zlib.crc32(content(name, size))
+        offset = len(body)
+        local_extra = struct.pack("<HHQQ", 1, 16, size, len(packed))
+        body += struct.pack("<IHHHHHIIIHH", 0x04034b50, 45, 0, 8, 0, 0, crc, 0xFFFFFFFF, 0xFFFFFFFF,
+                            len(name), len(local_extra)) + name.encode() + local_extra + packed
+        extra = struct.pack("<HHQQQ", 1, 24, size, len(packed), offset)
+        central += struct.pack("<IHHHHHHIIIHHHHHII", 0x02014b50, 45, 45, 0, 8, 0, 0, crc, 0xFFFFFFFF, 0xFFFFFFFF,
+                               len(name), len(extra), 0, 0, 0, 0, 0xFFFFFFFF) + name.encode() + extra
+    record_at = len(body) + len(central)
+    record = struct.pack("<IQHHIIQQQQ", 0x06064b50, 44, 45, 45, 0, 0, len(members), len(members), len(central), len(body))
+    locator = struct.pack("<IIQI", 0x07064b50, 0, record_at, 1)
+    end = struct.pack("<IHHHHIIH", 0x06054b50, 0, 0, 0xFFFF, 0xFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0)
+    write(path, body + central + record + locator + end)
+    return members
+
+
+def make_zip(out):
+    lines = []
+    for archive, make in (("album.zip", make_album), ("zip64.cbz", make_zip64)):
+        for name, size in make(os.path.join(out, archive)):
+            lines.append("%s %s %d\n" % (archive, name, size))
+    write(os.path.join(out, "zip.txt"), "".join(lines).encode())
+
+
+# Pictures: gradients, a checkerboard and noise, which is what JPEG's
+# transform and PNG's filters do the most work on.
+
+def picture(size, mode, seed):
+    w, h = size
+    rng = random.Random(seed)
+    pixels = []
+    for y in range(h):
+        for x in range(w):
+            r = x * 255 // max(1, w - 1)
+            g = y * 255 // max(1, h - 1)
+            b = (x // 8 + y // 8) % 2 * 200 + rng.randint(0, 55)
+            a = (x * 3 + y * 5) % 256
+            pixels.append((r, g, b, a))
+    rgba = Image.new("RGBA", size)
+    rgba.putdata(pixels)
+    if mode == "RGBA":
+        return rgba
+    if mode == "LA":
+        return rgba.convert("LA")
+    if mode == "P":
+        return rgba.convert("RGB").quantize(colors=200, dither=Image.Dither.NONE)
+    return rgba.convert("RGB").convert(mode)
+
+
+def png_chunk(kind, body):
+    return struct.pack(">I", len(body)) + kind + body + struct.pack(">I", zlib.crc32(kind + body))
+
+
+def png_filter(kind, row, prev, bpp):
+    out = bytearray()
+    for i, v in enumerate(row):
+        a = row[i - bpp] if i >= bpp else 0
+        b = prev[i] if prev else 0
+        c = prev[i - bpp] if prev and i >= bpp else 0
+        if kind == 1:
+            v -= a
+        elif kind == 2:
+            v -= b
+        elif kind == 3:
+            v -= (a + b) // 2
+        elif kind == 4:
+            p = a + b - c
+            pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+            v -= a if pa <= pb and pa <= pc else b if pb <= pc else c
+        out.append(v & 0xFF)
+    return bytes(out)
+
+
+def png_write(path, size, color_type, depth, samples, interlace):
+    """samples(x, y) are the pixel's samples, big-endian 16-bit at depth 16.
+    Rows cycle through the five filters."""
+    w, h = size
+    channels = {0: 1, 2: 3, 4: 2, 6: 4}[color_type]
+    bpp = max(1, channels * depth // 8)
+    passes = [(0, 0, 8, 8), (4, 0, 8, 8), (0, 4, 4, 8), (2, 0, 4, 4), (0, 2, 2, 4), (1, 0, 2, 2), (0, 1, 1, 2)] if interlace else [(0, 0, 1, 1)]
+    raw = b""
+    n = 0
+    for x0, y0, dx, dy in passes:
+        prev = None
+        for y in range(y0, h, dy):
+            bits = []
+            for x in range(x0, w, dx):
+                for s in samples(x, y):
+                    bits.append((s, depth))
+            row = bytearray()
+            acc, count = 0, 0
+            for value, width in bits:
+                if width >= 8:
+                    row += value.to_bytes(width // 8, "big")
+                    continue
+                acc = acc << width | value
+                count += width
+                if count == 8:
+                    row.append(acc)
+                    acc, count = 0, 0
+            if count:
+                row.append(acc << (8 - count))
+            kind = n % 5
+            n += 1
+            raw += bytes([kind]) + png_filter(kind, bytes(row), prev, bpp)
+            prev = bytes(row)
+    header = struct.pack(">IIBBBBB", w, h, depth, color_type, 0, 0, interlace)
+    write(path, b"\x89PNG\r\n\x1a\n" + png_chunk(b"IHDR", header) + png_chunk(b"IDAT", zlib.compress(raw, 9)) + png_chunk(b"IEND", b""))
+
+
+def bmp_write(path, size, bpp, pixels, masks=None, top_down=False, palette=None):
+    """pixels(x, y) is the stored value of a pixel: an index, a packed
+    value for `masks`, or (b, g, r)."""
+    w, h = size
+    row_bytes = (w * bpp + 31) // 32 * 4
+    rows = []
+    for y in range(h):
+        row = bytearray()
+        acc, count = 0, 0
+        for x in range(w):
+            v = pixels(x, y)
+            if bpp == 24:
+                row += bytes(v)
+            elif bpp in (16, 32):
+                row += v.to_bytes(bpp // 8, "little")
+            else:
+                acc = acc << bpp | v
+                count += bpp
+                if count == 8:
+                    row.append(acc)
+                    acc, count = 0, 0
+        if count:
+            row.append(acc << (8 - count))
+        rows.append(bytes(row).ljust(row_bytes, b"\0"))
+    data = b"".join(rows if top_down else reversed(rows))
+    colors = b"".join(bytes((b, g, r, 0)) for r, g, b in palette or [])
+    if masks:
+        # a V4 header, the masks alpha included are part of it
+        info = struct.pack("<IiiHHIIiiII", 108, w, -h if top_down else h, 1, bpp, 3, len(data), 2835, 2835, 0, 0)
+        info += struct.pack("<IIII", *masks) + b"BGRs" + b"\0" * 48
+    else:
+        info = struct.pack("<IiiHHIIiiII", 40, w, -h if top_down else h, 1, bpp, 0, len(data), 2835, 2835, len(palette or []), 0)
+    offset = 14 + len(info) + len(colors)
+    write(path, b"BM" + struct.pack("<IHHI", offset + len(data), 0, 0, offset) + info + colors + data)
+
+
+def make_images(out):
+    lines = []
+
+    def listed(name, tolerance, reference=None):
+        path = os.path.join(out, name)
+        image = Image.open(path)
+        image.seek(0)
+        rgba = reference or image.convert("RGBA")
+        write(path + ".rgba", rgba.tobytes())
+        lines.append("%s %d %d %d\n" % (name, rgba.width, rgba.height, tolerance))
+
+    # JPEG, within one level of libjpeg's integer transform and triangle
+    # upsampling
+    small, wide = (97, 61), (333, 221)
+    jpegs = [
+        ("jpeg_444.jpg", small, "RGB", dict(quality=90, subsampling=0)),
+        ("jpeg_422.jpg", small, "RGB", dict(quality=90, subsampling=1)),
+        ("jpeg_420.jpg", wide, "RGB", dict(quality=90, subsampling=2)),
+        ("jpeg_411.jpg", small, "RGB", dict(quality=90, subsampling="4:1:1")),
+        ("jpeg_1x1.jpg", (1, 1), "RGB", dict(subsampling=2)),
+        ("jpeg_17x9.jpg", (17, 9), "RGB", dict(subsampling=2)),
+        ("jpeg_grey.jpg", small, "L", dict(quality=85)),
+        ("jpeg_progressive.jpg", wide, "RGB", dict(quality=85, progressive=True, subsampling=2)),
+        ("jpeg_progressive_444.jpg", small, "RGB", dict(quality=85, progressive=True, subsampling=0)),
+        ("jpeg_progressive_grey.jpg", small, "L", dict(progressive=True)),
+        ("jpeg_optimized.jpg", small, "RGB", dict(optimize=True)),
+        ("jpeg_q100.jpg", small, "RGB", dict(quality=100, subsampling=0)),
+        ("jpeg_q5.jpg", small, "RGB", dict(quality=5)),
+        ("jpeg_restarts.jpg", wide, "RGB", dict(quality=90, restart_marker_blocks=3)),
+        ("jpeg_rgb.jpg", small, "RGB", dict(quality=90, keep_rgb=True, subsampling=0)),
+    ]
+    for i, (name, size, mode, options) in enumerate(jpegs):
+        picture(size, mode, i).save(os.path.join(out, name), "JPEG", **options)
+        listed(name, 1)
+    picture(small, "CMYK", 99).save(os.path.join(out, "jpeg_cmyk.jpg"), "JPEG")
+    lines.append("jpeg_cmyk.jpg declined\n")
+
+    # PNG, exact
+    for i, mode in enumerate(("RGB", "RGBA", "L", "LA", "P", "1")):
+        name = "png_%s.png" % mode.lower()
+        picture(small, mode, i).save(os.path.join(out, name), "PNG")
+        listed(name, 0)
+    p = picture(small, "P", 7)
+    p.save(os.path.join(out, "png_p_alpha.png"), "PNG", transparency=bytes(range(0, 256, 3))[:100])
+    listed("png_p_alpha.png", 0)
+    picture((33, 17), "P", 8).quantize(colors=12).save(os.path.join(out, "png_p4.png"), "PNG", bits=4)
+    listed("png_p4.png", 0)
+    rgb = picture(small, "RGB", 9)
+    rgb.save(os.path.join(out, "png_rgb_key.png"), "PNG", transparency=rgb.getpixel((5, 5)))
+    listed("png_rgb_key.png", 0)
+    grey = picture(small, "L", 10)
+    grey.save(os.path.join(out, "png_grey_key.png"), "PNG", transparency=grey.getpixel((7, 3)))
+    listed("png_grey_key.png", 0)
+    # what Pillow can't write: Adam7, every filter, 16 bits and 2-bit grey
+    src = picture(small, "RGBA", 11)
+    px = src.load()
+    png_write(os.path.join(out, "png_adam7_rgba.png"), small, 6, 8, lambda x, y: px[x, y], 1)
+    listed("png_adam7_rgba.png", 0)
+    png_write(os.path.join(out, "png_filters_rgb.png"), small, 2, 8, lambda x, y: px[x, y][:3], 0)
+    listed("png_filters_rgb.png", 0)
+    for name, ct, interlace in (("png_rgb16.png", 2, 0), ("png_adam7_rgba16.png", 6, 1), ("png_la16.png", 4, 0), ("png_grey16.png", 0, 1)):
+        channels = {0: 1, 2: 3, 4: 2, 6: 4}[ct]
+        samples = lambda x, y, c=channels: [(v << 8) | (v ^ 0x5A) for v in (px[x, y][:c] if c > 2 else px[x, y][::3][:c])]
+        png_write(os.path.join(out, name), small, ct, 16, samples, interlace)
+        # Pillow keeps 16-bit grey as such, the decoders take the high byte
+        reference = None
+        if ct == 0:
+            reference = Image.new("RGBA", small)
+            reference.putdata([(px[x, y][0],) * 3 + (255,) for y in range(small[1]) for x in range(small[0])])
+        listed(name, 0, reference)
+    png_write(os.path.join(out, "png_adam7_grey2.png"), (13, 11), 0, 2, lambda x, y: [(x + y) % 4], 1)
+    listed("png_adam7_grey2.png", 0)
+
+    # GIF, exact
+    p = picture(small, "P", 12)
+    p.save(os.path.join(out, "gif_plain.gif"), "GIF", interlace=False)
+    listed("gif_plain.gif", 0)
+    p.save(os.path.join(out, "gif_interlaced.gif"), "GIF", interlace=True, transparency=3)
+    listed("gif_interlaced.gif", 0)
+    picture((40, 30), "1", 13).convert("P").save(os.path.join(out, "gif_two.gif"), "GIF")
+    listed("gif_two.gif", 0)
+    frames = [picture(small, "P", 14 + i) for i in range(3)]
+    frames[0].save(os.path.join(out, "gif_animated.gif"), "GIF", save_all=True, append_images=frames[1:], duration=100, loop=0)
+    listed("gif_animated.gif", 0)
+
+    # BMP, exact but for 5-bit channels that Pillow widens by repeating bits
+    for i, mode in enumerate(("RGB", "L", "P", "1")):
+        name = "bmp_%s.bmp" % mode.lower()
+        picture((33, 17) if mode == "1" else small, mode, 20 + i).save(os.path.join(out, name), "BMP")
+        listed(name, 0)
+    bmp_write(os.path.join(out, "bmp_top_down.bmp"), small, 24, lambda x, y: px[x, y][2::-1], top_down=True)
+    listed("bmp_top_down.bmp", 0)
+    ramp = [(i * 16, 255 - i * 16, i * 7) for i in range(16)]
+    bmp_write(os.path.join(out, "bmp_4bit.bmp"), (21, 9), 4, lambda x, y: (x + y) % 16, palette=ramp)
+    listed("bmp_4bit.bmp", 0)
+    bmp_write(os.path.join(out, "bmp_565.bmp"), small, 16, lambda x, y: (px[x, y][0] >> 3) << 11 | (px[x, y][1] >> 2) << 5 | px[x, y][2] >> 3,
+              masks=(0xF800, 0x07E0, 0x001F, 0))
+    listed("bmp_565.bmp", 1)
+    bmp_write(os.path.join(out, "bmp_alpha.bmp"), small, 32, lambda x, y: px[x, y][3] << 24 | px[x, y][0] << 16 | px[x, y][1] << 8 | px[x, y][2],
+              masks=(0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000))
+    listed("bmp_alpha.bmp", 0)
+
+    write(os.path.join(out, "images.txt"), "".join(lines).encode())
+
+
+def main():
+    out = sys.argv[1]
+    os.makedirs(out, exist_ok=True)
+    make_inflate(out)
+    make_zip(out)
+    make_images(out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,135 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "memory_governor.hpp"
+
+namespace {
+
+using namespace std::chrono_literals;
+using memory::pressure;
+
+// What the listener was told, in order.
+struct heard {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<pressure> levels;
+	// a listener slow to pass the level on
+	std::chrono::microseconds delay{0};
+
+	memory::governor::listener listener() {
+		return [this](pressure p) {
+			if (delay.count()) std::this_thread::sleep_for(delay);
+			std::lock_guard<std::mutex> lk(mutex);
+			levels.push_back(p);
+			cv.notify_all();
+		};
+	}
+
+	std::vector<pressure> all() {
+		std::lock_guard<std::mutex> lk(mutex);
+		return levels;
+	}
+
+	// until the last level heard is `p`, false after a few seconds
+	bool wait_for(pressure p) {
+		std::unique_lock<std::mutex> lk(mutex);
+		return cv.wait_for(lk, 5s, [&]() { return !levels.empty() && levels.back() == p; });
+	}
+};
+
+} // namespace
+
+TEST(each_change_of_level_is_heard_once) {
+	heard h;
+	memory::governor g(1h);
+	g.start(h.listener());
+	CHECK(g.level() == pressure::none);
+	for (const auto p : {pressure::low, pressure::low, pressure::none, pressure::critical, pressure::low, pressure::critical}) g.raise(p);
+	// lower levels only refresh what was raised
+	CHECK((h.all() == std::vector<pressure>{pressure::low, pressure::critical}));
+	CHECK(g.level() == pressure::critical);
+	CHECK(metrics::get_gauge("memory.pressure").value() == 2.0);
+	g.stop();
+}
+
+TEST(pressure_ends_after_calm) {
+	heard h;
+	memory::governor g(100ms);
+	g.start(h.listener());
+	const auto start = std::chrono::steady_clock::now();
+	g.raise(pressure::low);
+	// reported again, it lasts calm past the last report
+	std::this_thread::sleep_for(60ms);
+	g.raise(pressure::low);
+	const auto last = std::chrono::steady_clock::now();
+	CHECK(h.wait_for(pressure::none));
+	const auto ended = std::chrono::steady_clock::now();
+	CHECK(ended - last >= 100ms);
+	CHECK(ended - start < 3s);
+	CHECK((h.all() == std::vector<pressure>{pressure::low, pressure::none}));
+	CHECK(g.level() == pressure::none);
+	CHECK(metrics::get_gauge("memory.pressure").value() == 0.0);
+	// and can come back
+	g.raise(pressure::critical);
+	CHECK(h.wait_for(pressure::none));
+	CHECK((h.all() == std::vector<pressure>{pressure::low, pressure::none, pressure::critical, pressure::none}));
+	g.stop();
+}
+
+// raise() on other threads, with pauses about as long as the calm, against
+// the watcher ending the pressure in between: the listener hears no level
+// twice in a row, and the last one it heard is the governor's.
+TEST(racing_raises_are_heard_in_order) {
+	for (int round = 0; round < 40; ++round) {
+		heard h;
+		h.delay = 200us;
+		memory::governor g(1ms);
+		g.start(h.listener());
+		std::atomic<bool> done{false};
+		std::vector<std::thread> raisers;
+		for (int t = 0; t < 3; ++t) {
+			raisers.emplace_back([&, t]() {
+				while (!done) {
+					g.raise(t == 0 ? pressure::low : pressure::critical);
+					std::this_thread::sleep_for(std::chrono::microseconds(500 + 400 * t));
+				}
+			});
+		}
+		std::this_thread::sleep_for(100ms);
+		done = true;
+		for (auto& t : raisers) t.join();
+		// the watcher is still ending what was raised last
+		std::this_thread::sleep_for(5ms);
+		g.stop();
+		const auto levels = h.all();
+		CHECK(!levels.empty());
+		for (size_t i = 1; i < levels.size(); ++i) CHECK(levels[i] != levels[i - 1]);
+		CHECK(!levels.empty() && levels.back() == g.level());
+	}
+}
+
+TEST(stop_joins_the_watcher) {
+	{
+		memory::governor g(1h);
+		const auto start = std::chrono::steady_clock::now();
+		g.start({});
+		g.raise(pressure::critical);
+		g.stop();
+		g.stop();
+		// woken rather than left to time out
+		CHECK(std::chrono::steady_clock::now() - start < 500ms);
+		CHECK(g.level() == pressure::critical);
+	}
+	{
+		// stopped by the destructor, or never started
+		memory::governor started, idle;
+		started.start({});
+	}
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,165 @@
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "check.hpp"
+#include "metrics.hpp"
+
+// The registry is a process-wide singleton, every test uses its own names.
+
+// A flat JSON object, {"name": number or null, ...}, the way dump() lays it
+// out: one member per line.
+static bool flat_json(const std::string& text) {
+	if (text == "{\n}\n") return true;
+	if (text.rfind("{\n", 0) != 0 || text.size() < 4 || text.compare(text.size() - 3, 3, "\n}\n") != 0) return false;
+	std::istringstream lines(text.substr(2, text.size() - 5));
+	std::string line;
+	bool last = false;
+	while (std::getline(lines, line)) {
+		if (last) return false;
+		if (line.back() == ',') line.pop_back();
+		else last = true;
+		const auto colon = line.find("\": ");
+		if (line.rfind("  \"", 0) != 0 || colon == std::string::npos || colon <= 3) return false;
+		for (auto c : line.substr(3, colon - 3)) if (c == '"' || c == '\\' || c < ' ') return false;
+		const auto value = line.substr(colon + 3);
+		if (value == "null") continue;
+		// a JSON number: no nan, inf, leading + or bare dot
+		size_t i = value[0] == '-' ? 1 : 0;
+		if (i >= value.size() || !std::isdigit(static_cast<unsigned char>(value[i]))) return false;
+		if (value[i] == '0' && i + 1 < value.size() && std::isdigit(static_cast<unsigned char>(value[i + 1]))) return false;
+		size_t used = 0;
+		std::stod(value, &used);
+		if (used != value.size() || value.find_first_not_of("0123456789.eE+-") != std::string::npos) return false;
+	}
+	return last;
+}
+
+TEST(counter_adds_and_resets) {
+	auto& c = metrics::get_counter("test.counter");
+	CHECK(c.value() == 0);
+	c.add();
+	c.add(41);
+	CHECK(c.value() == 42);
+	CHECK(&metrics::get_counter("test.counter") == &c);
+	CHECK(metrics::registry::get_instance().value("test.counter") == 42.0);
+	c.reset();
+	CHECK(c.value() == 0);
+}
+
+TEST(gauge_sets_adds_and_scopes) {
+	auto& g = metrics::get_gauge("test.gauge");
+	g.set(2.5);
+	g.add(1.0);
+	g.add(-0.5);
+	CHECK(g.value() == 3.0);
+	{
+		metrics::gauge_scope a(g), b(g);
+		CHECK(g.value() == 5.0);
+	}
+	CHECK(g.value() == 3.0);
+	CHECK(metrics::registry::get_instance().value("test.never_registered") == 0.0);
+}
+
+TEST(histogram_empty) {
+	metrics::histogram h;
+	CHECK(h.count() == 0);
+	CHECK(h.max() == 0.0);
+	CHECK(h.percentile(0.0) == 0.0);
+	CHECK(h.percentile(0.5) == 0.0);
+	CHECK(h.percentile(1.0) == 0.0);
+}
+
+TEST(histogram_single_sample) {
+	metrics::histogram h;
+	h.record(3.1);
+	CHECK(h.count() == 1);
+	CHECK(h.max() == 3.1);
+	// the bucket edge is 3.25, capped at the largest value seen
+	CHECK(h.percentile(0.0) == 3.1);
+	CHECK(h.percentile(0.5) == 3.1);
+	CHECK(h.percentile(0.99) == 3.1);
+}
+
+TEST(histogram_percentiles) {
+	metrics::histogram h;
+	// 1..100 ms, one each
+	for (int i = 1; i <= 100; ++i) h.record(i);
+	CHECK(h.count() == 100);
+	CHECK(h.max() == 100.0);
+	// the p-th value lands in [v, v + 0.25)
+	CHECK(h.percentile(0.50) == 50.25);
+	CHECK(h.percentile(0.95) == 95.25);
+	CHECK(h.percentile(0.99) == 99.25);
+	CHECK(h.percentile(1.00) == 100.0);
+	h.reset();
+	CHECK(h.count() == 0);
+	CHECK(h.percentile(0.5) == 0.0);
+}
+
+TEST(histogram_edges) {
+	metrics::histogram h;
+	h.record(0.0);
+	h.record(-1.0);
+	CHECK(h.percentile(1.0) == 0.0);
+	// past the last bucket, reported as the largest value seen
+	h.record(1000.0);
+	CHECK(h.percentile(1.0) == 1000.0);
+	CHECK(h.max() == 1000.0);
+}
+
+TEST(snapshot_sorted_with_histograms) {
+	metrics::get_counter("snap.b").add(2);
+	metrics::get_gauge("snap.a").set(1.0);
+	auto& h = metrics::get_histogram("snap.h");
+	h.record(1.0);
+	h.record(2.0);
+
+	const auto samples = metrics::registry::get_instance().snapshot();
+	CHECK(std::is_sorted(samples.begin(), samples.end(), [](auto& a, auto& b) { return a.name < b.name; }));
+	auto value = [&](const std::string& name) {
+		for (auto& s : samples) if (s.name == name) return s.value;
+		return -1.0;
+	};
+	CHECK(value("snap.a") == 1.0);
+	CHECK(value("snap.b") == 2.0);
+	CHECK(value("snap.h.count") == 2.0);
+	CHECK(value("snap.h.max") == 2.0);
+	CHECK(value("snap.h.p50") == 1.25);
+	CHECK(value("snap.h.p95") == 2.0);
+	CHECK(value("snap.h.p99") == 2.0);
+}
+
+TEST(dump_to_file_is_json) {
+	metrics::get_gauge("dump.nan").set(std::numeric_limits<double>::quiet_NaN());
+	metrics::get_gauge("dump.inf").set(std::numeric_limits<double>::infinity());
+	metrics::get_gauge("dump.minus_inf").set(-std::numeric_limits<double>::infinity());
+	metrics::get_counter("dump.count").add(7);
+
+	const auto path = std::filesystem::temp_directory_path() / "imv_metrics_test.json";
+	{
+		std::ofstream os(path);
+		metrics::registry::get_instance().dump(os);
+	}
+	std::ifstream is(path);
+	std::stringstream ss;
+	ss << is.rdbuf();
+	const auto text = ss.str();
+	std::filesystem::remove(path);
+
+	CHECK(flat_json(text));
+	CHECK(text.find("\"dump.nan\": null") != std::string::npos);
+	CHECK(text.find("\"dump.inf\": null") != std::string::npos);
+	CHECK(text.find("\"dump.minus_inf\": null") != std::string::npos);
+	CHECK(text.find("\"dump.count\": 7") != std::string::npos);
+	CHECK(!flat_json("{\n  \"a\": nan\n}\n"));
+	CHECK(!flat_json("{\n  \"a\": inf,\n}\n"));
+}
+
+int main() {
+	return check::run();
+}
@@ -0,0 +1,137 @@
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "name_filter.hpp"
+
+namespace {
+
+std::shared_ptr<const catalog> catalog_of(const std::vector<std::string>& names) {
+	catalog c;
+	const auto dir = c.add_directory("/pictures");
+	for (auto& name : names) c.add(dir, name, 1, 0);
+	c.sort();
+	return std::make_shared<const catalog>(std::move(c));
+}
+
+// what the index has to agree with: every name searched in lower case
+std::vector<std::int64_t> scan(const catalog& c, const std::string& query) {
+	std::vector<std::int64_t> out;
+	const auto q = names::fold(query);
+	for (size_t i = 0; i < c.size(); ++i) {
+		if (names::fold(c.name(i)).find(q) != std::string::npos) out.push_back(static_cast<std::int64_t>(i));
+	}
+	return out;
+}
+
+std::vector<std::int64_t> listed(const names::search::result& r) {
+	std::vector<std::int64_t> out;
+	if (r) r->for_each([&](size_t i) { out.push_back(static_cast<std::int64_t>(i)); });
+	return out;
+}
+
+} // namespace
+
+TEST(short_queries_are_filtered) {
+	const auto c = catalog_of({"DSC_0001.JPG", "IMG_2000.jpg", "beach.png", "ab", "a", "x.gif"});
+	auto idx = std::make_shared<const names::index>(c);
+	names::search s(idx);
+	CHECK(!s.find(""));
+	for (const std::string q : {"a", "A", "d", "j", "ab", "AB", "g.", "pg", "_", ".", "q", "zz"}) {
+		const auto found = s.find(q);
+		CHECK(found != nullptr);
+		CHECK(listed(found) == scan(*c, q));
+	}
+}
+
+TEST(a_name_ending_in_the_pair_is_found) {
+	// the pair only occurs as a name's last two bytes
+	const auto c = catalog_of({"ab", "xab", "abx", "ba"});
+	names::search s(std::make_shared<const names::index>(c));
+	CHECK(listed(s.find("ab")) == scan(*c, "ab"));
+	CHECK(s.find("ab")->size() == 3);
+}
+
+TEST(bytes_without_a_class_of_their_own) {
+	const auto c = catalog_of({"caf\xC3\xA9.jpg", "na\xC3\xAFve.png", "a+b.jpg", "a(1).jpg", "plain.jpg"});
+	names::search s(std::make_shared<const names::index>(c));
+	for (const std::string q : {"\xC3", "\xC3\xA9", "\xC3\xAF", "+", "a+", "+b", "(1)", "(", "a(1", "\xA9.j"}) {
+		CHECK(listed(s.find(q)) == scan(*c, q));
+	}
+}
+
+TEST(typed_and_erased_against_a_scan) {
+	std::mt19937 rng(50);
+	const char* const places[] = {"Paris", "Beach", "Alps", "Caf\xC3\xA9"};
+	std::vector<std::string> names;
+	for (int i = 0; i < 3000; ++i) {
+		char name[64];
+		switch (i % 4) {
+		case 0: std::snprintf(name, sizeof(name), "DSC_%04u.JPG", unsigned(rng() % 3000)); break;
+		case 1: std::snprintf(name, sizeof(name), "IMG_%05d.jpg", i); break;
+		case 2: std::snprintf(name, sizeof(name), "PXL_2024%02u%02u_%u.jpg", unsigned(rng() % 12 + 1), unsigned(rng() % 28 + 1), unsigned(rng() % 900)); break;
+		default: std::snprintf(name, sizeof(name), "%s %d - edited (%u).png", places[rng() % 4], i, unsigned(rng() % 3)); break;
+		}
+		names.push_back(name);
+	}
+	const auto c = catalog_of(names);
+	names::search s(std::make_shared<const names::index>(c));
+
+	const std::string alphabet = "dsc_0123456789.jpgimxlpar ebh-()\xC3\xA9";
+	for (int round = 0; round < 300; ++round) {
+		// a query picked from a name, or made up, typed then partly erased
+		std::string text;
+		if (round % 3 != 2) {
+			const auto& name = names[rng() % names.size()];
+			const auto from = rng() % name.size();
+			text = name.substr(from, 1 + rng() % 10);
+		} else {
+			for (int k = 0; k < 1 + static_cast<int>(rng() % 6); ++k) text += alphabet[rng() % alphabet.size()];
+		}
+		for (size_t n = 1; n <= text.size(); ++n) {
+			const auto q = text.substr(0, n);
+			CHECK(listed(s.find(q)) == scan(*c, q));
+		}
+		for (size_t n = text.size(); n-- > 1 + text.size() / 2;) {
+			const auto q = text.substr(0, n);
+			CHECK(listed(s.find(q)) == scan(*c, q));
+		}
+	}
+}
+
+TEST(trigrams_at_a_place_that_are_not_the_query) {
+	// so few names that every trigram and place has a set: the trigrams
+	// of "abcd" first apart, a match after the first "abc", from either end
+	const auto c = catalog_of({"abcd", "xabcd", "abcxbcd", "abcabcd", "bcdabc", "zzabcd", "abcdzz", "abc_bcd.jpg", "x_abcd.jpg"});
+	names::search s(std::make_shared<const names::index>(c));
+	for (const std::string q : {"abcd", "abcdz", "bcd", "abcab", "cd.j", "bcd.jpg", "_abcd", "abc_bcd"}) {
+		for (size_t n = 1; n <= q.size(); ++n) CHECK(listed(s.find(q.substr(0, n))) == scan(*c, q.substr(0, n)));
+		names::search pasted(std::make_shared<const names::index>(c));
+		CHECK(listed(pasted.find(q)) == scan(*c, q));
+	}
+}
+
+TEST(a_step_that_keeps_everything_shares_the_set) {
+	const auto c = catalog_of({"IMG_0001.jpg", "IMG_0002.jpg", "IMG_0003.jpg"});
+	names::search s(std::make_shared<const names::index>(c));
+	const auto img = s.find("img_");
+	const auto img0 = s.find("img_0");
+	CHECK(img0->size() == 3);
+	CHECK(img.get() == img0.get());
+	// Backspace is the step kept before
+	CHECK(s.find("img_").get() == img.get());
+}
+
+TEST(empty_catalog) {
+	const auto c = catalog_of({});
+	names::search s(std::make_shared<const names::index>(c));
+	CHECK(s.find("a")->empty());
+	CHECK(s.find("ab")->empty());
+	CHECK(s.find("abc")->empty());
+	CHECK(s.find("abcd")->empty());
+}
+
+int main() { return check::run(); }
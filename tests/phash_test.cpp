@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "phash.hpp"
+
+namespace {
+
+// `h` with `bits` different bits flipped
+std::uint64_t flip(std::uint64_t h, int bits, std::mt19937_64& rng) {
+	std::vector<int> at(64);
+	std::iota(at.begin(), at.end(), 0);
+	std::shuffle(at.begin(), at.end(), rng);
+	for (int k = 0; k < bits; ++k) h ^= std::uint64_t(1) << at[k];
+	return h;
+}
+
+// What index::groups() has to agree with: every pair compared, the
+// smallest id of each connected set as its group.
+std::vector<std::uint32_t> pairwise_groups(const phash::index& index) {
+	const auto n = static_cast<std::uint32_t>(index.size());
+	std::vector<std::uint32_t> group(n);
+	std::iota(group.begin(), group.end(), 0u);
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (std::uint32_t a = 0; a < n; ++a) {
+			for (std::uint32_t b = a + 1; b < n; ++b) {
+				if (group[a] == group[b] || !index.similar(index.at(a), index.at(b))) continue;
+				const auto low = std::min(group[a], group[b]), high = std::max(group[a], group[b]);
+				for (auto& g : group) if (g == high) g = low;
+				changed = true;
+			}
+		}
+	}
+	return group;
+}
+
+// Bursts: each hash either new or a few bits off one made before, about
+// as many within the radius as past it.
+std::vector<phash::hashes> bursts(size_t n, std::mt19937_64& rng) {
+	std::vector<phash::hashes> out;
+	for (size_t i = 0; i < n; ++i) {
+		if (out.empty() || rng() % 3 == 0) {
+			out.push_back({rng(), rng()});
+		} else {
+			const auto& from = out[rng() % out.size()];
+			const int p_bits = static_cast<int>(rng() % 10), d_bits = static_cast<int>(rng() % 16);
+			out.push_back({flip(from.d, d_bits, rng), flip(from.p, p_bits, rng)});
+		}
+	}
+	return out;
+}
+
+// A smooth picture with a few bright blobs, drawn at any size; `noise`
+// adds that much either way to each channel.
+image_buffer picture(std::uint32_t w, std::uint32_t h, int kind, int noise, std::mt19937_64& rng) {
+	image_buffer b;
+	b.allocate(w, h);
+	for (std::uint32_t y = 0; y < h; ++y) {
+		for (std::uint32_t x = 0; x < w; ++x) {
+			const double u = double(x) / w, v = double(y) / h;
+			double l = kind == 0 ? 0.6 * u + 0.3 * v : 0.8 * (1.0 - v) * (0.5 + 0.5 * std::sin(9.0 * u));
+			const double cx = kind == 0 ? 0.3 : 0.7, cy = kind == 0 ? 0.6 : 0.25;
+			l += 0.5 * std::exp(-((u - cx) * (u - cx) + (v - cy) * (v - cy)) * 40.0);
+			auto channel = [&](double s) {
+				const int c = static_cast<int>(std::clamp(s, 0.0, 1.0) * 255.0) + (noise ? static_cast<int>(rng() % (2 * noise + 1)) - noise : 0);
+				return static_cast<std::uint32_t>(std::clamp(c, 0, 255));
+			};
+			b.data()[size_t(y) * w + x] = 0xFF000000u | channel(l) << 16 | channel(l * 0.9) << 8 | channel(l * 0.8);
+		}
+	}
+	return b;
+}
+
+} // namespace
+
+TEST(groups_against_a_pairwise_scan) {
+	std::mt19937_64 rng(35);
+	for (const int radius : {0, 3, 6, 10}) {
+		for (const size_t n : {0u, 1u, 2u, 60u, 700u}) {
+			const phash::index index(bursts(n, rng), radius);
+			CHECK(index.size() == n);
+			const auto groups = index.groups();
+			CHECK(groups == pairwise_groups(index));
+			// and every query finds exactly the near ones
+			for (std::uint32_t id = 0; id < n; id += 1 + static_cast<std::uint32_t>(n / 50)) {
+				std::vector<std::uint32_t> near_ids;
+				for (std::uint32_t other = 0; other < n; ++other) {
+					if (index.similar(index.at(id), index.at(other))) near_ids.push_back(other);
+				}
+				CHECK(index.query(index.at(id)) == near_ids);
+			}
+		}
+	}
+}
+
+TEST(the_radius_is_inclusive) {
+	std::mt19937_64 rng(6);
+	const phash::index index({}, 6);
+	for (int round = 0; round < 200; ++round) {
+		const phash::hashes a{rng(), rng()};
+		CHECK(index.similar(a, {flip(a.d, 12, rng), flip(a.p, 6, rng)}));
+		CHECK(!index.similar(a, {flip(a.d, 12, rng), flip(a.p, 7, rng)}));
+		CHECK(!index.similar(a, {flip(a.d, 13, rng), flip(a.p, 6, rng)}));
+	}
+	CHECK(phash::index({}, 99).radius() == 31);
+	CHECK(phash::index({}, -1).radius() == 0);
+}
+
+// The same picture at another size and with noise hashes within the
+// radius the finder uses, a different one doesn't.
+TEST(similar_pictures_hash_close) {
+	std::mt19937_64 rng(64);
+	const auto a = phash::compute(picture(64, 48, 0, 0, rng));
+	const auto smaller = phash::compute(picture(40, 30, 0, 0, rng));
+	const auto noisy = phash::compute(picture(64, 48, 0, 6, rng));
+	const auto other = phash::compute(picture(64, 48, 1, 0, rng));
+	const phash::index index({}, 6);
+	CHECK(index.similar(a, smaller));
+	CHECK(index.similar(a, noisy));
+	CHECK(!index.similar(a, other));
+	CHECK(phash::distance(a.p, other.p) > 12);
+	// the DC term's bit stays clear
+	CHECK((a.p >> 63) == 0);
+	CHECK(phash::compute(image_buffer{}).p == 0);
+}
+
+TEST(store_round_trip) {
+	const auto dir = std::filesystem::temp_directory_path() / "imv_phash_test";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+	phash::store s;
+	s.put("/pictures/a.jpg", {100, 5, {1, 2}});
+	s.put("/pictures/\xC3\xA9t\xC3\xA9.jpg", {200, -7, {~0ull, 3}});
+	CHECK(s.save(dir / "cache"));
+	CHECK(!std::filesystem::exists(dir / "cache.tmp"));
+
+	phash::store loaded;
+	loaded.load(dir / "cache");
+	CHECK(loaded.entries().size() == 2);
+	const auto* e = loaded.find("/pictures/\xC3\xA9t\xC3\xA9.jpg", 200, -7);
+	CHECK(e && e->hashes.d == ~0ull && e->hashes.p == 3);
+	// a file that changed is hashed again
+	CHECK(!loaded.find("/pictures/a.jpg", 101, 5));
+	CHECK(!loaded.find("/pictures/a.jpg", 100, 6));
+	CHECK(!loaded.find("/pictures/b.jpg", 100, 5));
+
+	phash::store none;
+	none.load(dir / "missing");
+	CHECK(none.entries().empty());
+	std::ofstream(dir / "foreign") << "not a cache at all";
+	none.load(dir / "foreign");
+	CHECK(none.entries().empty());
+	std::filesystem::remove_all(dir);
+}
+
+int main() { return check::run(); }
@@ -0,0 +1,196 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "scrub_previews.hpp"
+
+namespace {
+
+using namespace std::chrono_literals;
+using pool = thread_pool<2, struct scrub_test>;
+using previews = scrub::previews<pool>;
+
+// A decoder whose calls can be held until the test lets them go, and a
+// listener to wait for what came in.
+struct fake {
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool hold = false;
+	std::vector<std::int64_t> decoded, heard;
+	std::uint32_t width = 400, height = 300;
+
+	previews::decoder decoder() {
+		return [this](std::int64_t idx, image_buffer& out) {
+			std::unique_lock<std::mutex> lk(mutex);
+			decoded.push_back(idx);
+			cv.notify_all();
+			cv.wait(lk, [this]() { return !hold; });
+			if (idx == 13) return false;
+			out.allocate(width, height);
+			std::fill(out.data(), out.data() + size_t(width) * height, 0xFF000000u | static_cast<std::uint32_t>(idx));
+			return true;
+		};
+	}
+
+	previews::listener listener() {
+		return [this](std::int64_t idx) {
+			std::lock_guard<std::mutex> lk(mutex);
+			heard.push_back(idx);
+			cv.notify_all();
+		};
+	}
+
+	void release() {
+		std::lock_guard<std::mutex> lk(mutex);
+		hold = false;
+		cv.notify_all();
+	}
+
+	// until `n` decodes started, false after a few seconds
+	bool wait_decoded(size_t n) {
+		std::unique_lock<std::mutex> lk(mutex);
+		return cv.wait_for(lk, 5s, [&]() { return decoded.size() >= n; });
+	}
+
+	bool wait_heard(size_t n) {
+		std::unique_lock<std::mutex> lk(mutex);
+		return cv.wait_for(lk, 5s, [&]() { return heard.size() >= n; });
+	}
+
+	std::vector<std::int64_t> all_decoded() {
+		std::lock_guard<std::mutex> lk(mutex);
+		return decoded;
+	}
+};
+
+// One preview of the fake's 400x300 pictures at side 64: halved to 100x75.
+constexpr size_t preview_bytes = 100 * 75 * 4;
+
+} // namespace
+
+TEST(shrink_halves_down_to_twice_the_side) {
+	image_buffer big;
+	big.allocate(1000, 500);
+	const auto small = scrub::shrink(std::move(big), 100);
+	CHECK(small.width == 125 && small.height == 62);
+	image_buffer tiny;
+	tiny.allocate(90, 200);
+	const auto same = scrub::shrink(std::move(tiny), 100);
+	CHECK(same.width == 90 && same.height == 200);
+}
+
+TEST(the_bar_ends_are_the_first_and_last) {
+	CHECK(scrub::index_at(0.0f, 500.0f, 100) == 0);
+	CHECK(scrub::index_at(500.0f, 500.0f, 100) == 99);
+	CHECK(scrub::index_at(250.0f, 500.0f, 101) == 50);
+	CHECK(scrub::index_at(-20.0f, 500.0f, 100) == 0);
+	CHECK(scrub::index_at(900.0f, 500.0f, 100) == 99);
+	CHECK(scrub::index_at(300.0f, 500.0f, 1) == 0);
+	CHECK(scrub::index_at(300.0f, 0.0f, 100) == 0);
+}
+
+TEST(a_request_is_decoded_and_heard) {
+	fake f;
+	previews p(pool::get_instance(), 1 << 20, 64, f.listener());
+	p.reset(f.decoder());
+	CHECK(!p.find(5));
+	p.request(5);
+	CHECK(f.wait_heard(1));
+	const auto preview = p.find(5);
+	CHECK(preview && preview->width == 100 && preview->height == 75);
+	CHECK(preview && preview->data()[0] == 0xFF000005u);
+	CHECK(p.bytes() == preview_bytes);
+	// cached, not decoded again
+	p.request(5);
+	CHECK(f.all_decoded() == std::vector<std::int64_t>{5});
+}
+
+TEST(positions_passed_over_are_never_decoded) {
+	fake f;
+	f.hold = true;
+	previews p(pool::get_instance(), 1 << 20, 64, f.listener());
+	p.reset(f.decoder());
+	auto& skipped = metrics::get_counter("scrub.skipped");
+	const auto skipped_before = skipped.value();
+	p.request(1);
+	CHECK(f.wait_decoded(1));
+	// dragged on while 1 decodes
+	for (std::int64_t i = 2; i <= 9; ++i) p.request(i);
+	f.release();
+	CHECK(f.wait_heard(2));
+	CHECK(f.all_decoded() == (std::vector<std::int64_t>{1, 9}));
+	CHECK(skipped.value() - skipped_before == 7);
+}
+
+TEST(previews_stay_within_the_budget) {
+	fake f;
+	previews p(pool::get_instance(), 2 * preview_bytes, 64, f.listener());
+	p.reset(f.decoder());
+	for (std::int64_t i = 0; i < 3; ++i) {
+		p.request(i);
+		CHECK(f.wait_heard(size_t(i) + 1));
+		// used last, so 1 goes when 2 comes
+		CHECK(p.find(0));
+	}
+	CHECK(p.bytes() == 2 * preview_bytes);
+	CHECK(p.find(0) && p.find(2) && !p.find(1));
+}
+
+TEST(unreadable_pictures_leave_no_preview) {
+	fake f;
+	previews p(pool::get_instance(), 1 << 20, 64, f.listener());
+	p.reset(f.decoder());
+	p.request(13);
+	CHECK(f.wait_decoded(1));
+	p.request(14);
+	CHECK(f.wait_heard(1));
+	CHECK(!p.find(13) && p.find(14));
+}
+
+TEST(a_reset_drops_what_the_old_catalog_decodes) {
+	fake f;
+	f.hold = true;
+	previews p(pool::get_instance(), 1 << 20, 64, f.listener());
+	p.reset(f.decoder());
+	p.request(3);
+	CHECK(f.wait_decoded(1));
+	p.reset(f.decoder());
+	f.release();
+	p.request(4);
+	CHECK(f.wait_heard(1));
+	CHECK(!p.find(3) && p.find(4));
+	CHECK(f.all_decoded() == (std::vector<std::int64_t>{3, 4}));
+	std::lock_guard<std::mutex> lk(f.mutex);
+	CHECK(f.heard == std::vector<std::int64_t>{4});
+	CHECK(p.bytes() == preview_bytes);
+}
+
+TEST(destruction_waits_for_the_pool_job) {
+	fake f;
+	f.hold = true;
+	std::thread releaser;
+	{
+		previews p(pool::get_instance(), 1 << 20, 64, f.listener());
+		p.reset(f.decoder());
+		p.request(1);
+		CHECK(f.wait_decoded(1));
+		releaser = std::thread([&]() {
+			std::this_thread::sleep_for(50ms);
+			f.release();
+		});
+	}
+	// `p` went only once its job was through with it
+	CHECK(f.wait_heard(1));
+	releaser.join();
+}
+
+int main() {
+	const int failed = check::run();
+	pool::get_instance().stop();
+	return failed;
+}
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "check.hpp"
+#include "single_instance.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+std::string endpoint(const char* name) {
+	return (fs::temp_directory_path() / ("imv-test-" + std::to_string(::getpid()) + "-" + name + ".sock")).string();
+}
+
+// The paths a server was handed, in order.
+struct received {
+	std::mutex mutex;
+	std::vector<std::string> paths;
+
+	single_instance::server::handler handler() {
+		return [this](std::string path) {
+			std::lock_guard<std::mutex> lk(mutex);
+			paths.push_back(std::move(path));
+			return true;
+		};
+	}
+
+	std::vector<std::string> all() {
+		std::lock_guard<std::mutex> lk(mutex);
+		return paths;
+	}
+};
+
+// A raw connection to `at` that sends `bytes` and then nothing.
+single_instance::detail::handle quiet_client(const std::string& at, const std::string& bytes = {}) {
+	const auto h = single_instance::detail::connect(at, 5000ms);
+	if (h != single_instance::detail::invalid_handle() && !bytes.empty()) {
+		single_instance::detail::write_exact(h, bytes.data(), bytes.size(), clock_type::now() + 1s);
+	}
+	return h;
+}
+
+} // namespace
+
+TEST(forward_hands_over_the_path) {
+	const auto at = endpoint("forward");
+	received got;
+	single_instance::server server;
+	CHECK(server.claim(at));
+	server.serve(got.handler());
+	CHECK(single_instance::forward(at, "C:\\pictures\\IMG_0001.jpg"));
+	CHECK(single_instance::forward(at, std::string(single_instance::max_path_bytes, 'x')));
+	CHECK(!single_instance::forward(at, std::string(single_instance::max_path_bytes + 1, 'x')));
+	server.stop();
+	const auto paths = got.all();
+	CHECK(paths.size() == 2);
+	CHECK(paths.size() == 2 && paths[0] == "C:\\pictures\\IMG_0001.jpg");
+	CHECK(paths.size() == 2 && paths[1].size() == single_instance::max_path_bytes);
+	CHECK(!fs::exists(at));
+}
+
+TEST(one_owner_at_a_time) {
+	const auto at = endpoint("owner");
+	single_instance::server first;
+	CHECK(first.claim(at));
+	first.serve([](std::string) { return true; });
+	single_instance::server second;
+	CHECK(!second.claim(at));
+	first.stop();
+	CHECK(second.claim(at));
+	second.stop();
+}
+
+TEST(a_socket_left_by_a_crash_is_claimed) {
+	const auto at = endpoint("stale");
+	std::ofstream(at) << "";
+	CHECK(fs::exists(at));
+	single_instance::server server;
+	CHECK(server.claim(at));
+	server.stop();
+}
+
+TEST(a_quiet_client_is_dropped) {
+	const auto at = endpoint("quiet");
+	received got;
+	single_instance::server server(200ms);
+	CHECK(server.claim(at));
+	server.serve(got.handler());
+	// connected and silent, then half a length
+	const auto silent = quiet_client(at);
+	const auto half = quiet_client(at, std::string("\x05\x00", 2));
+	CHECK(silent != single_instance::detail::invalid_handle());
+	CHECK(half != single_instance::detail::invalid_handle());
+	const auto start = clock_type::now();
+	CHECK(single_instance::forward(at, "after", 5000ms));
+	CHECK(clock_type::now() - start < 2s);
+	CHECK(got.all() == std::vector<std::string>{"after"});
+	single_instance::detail::close(silent);
+	single_instance::detail::close(half);
+	server.stop();
+}
+
+TEST(stop_ends_a_request_that_never_comes) {
+	const auto at = endpoint("stop");
+	single_instance::server server(300ms);
+	CHECK(server.claim(at));
+	server.serve([](std::string) { return true; });
+	const auto silent = quiet_client(at);
+	// let the server thread take the connection and wait on it
+	std::this_thread::sleep_for(50ms);
+	const auto start = clock_type::now();
+	server.stop();
+	CHECK(clock_type::now() - start < 2s);
+	single_instance::detail::close(silent);
+}
+
+TEST(a_handler_that_declines_is_reported) {
+	const auto at = endpoint("decline");
+	single_instance::server server;
+	CHECK(server.claim(at));
+	server.serve([](std::string) { return false; });
+	CHECK(!single_instance::forward(at, "refused"));
+	server.stop();
+	CHECK(!single_instance::forward(at, "nobody", 200ms));
+}
+
+TEST(mailbox_keeps_what_was_told) {
+	single_instance::mailbox box;
+	CHECK(box.put("a", []() { return true; }));
+	CHECK(!box.put("b", []() { return false; }));
+	CHECK(box.put("c", []() { return true; }));
+	CHECK(box.take() == "a");
+	CHECK(box.take() == "c");
+	CHECK(!box.take());
+}
+
+TEST(a_closed_mailbox_drops_and_refuses) {
+	single_instance::mailbox box;
+	CHECK(box.put("a", []() { return true; }));
+	box.close();
+	bool told = false;
+	CHECK(!box.put("b", [&]() { return told = true; }));
+	CHECK(!told);
+	CHECK(!box.take());
+}
+
+int main() { return check::run(); }
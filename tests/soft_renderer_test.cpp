@@ -0,0 +1,86 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+
+#include "check.hpp"
+#include "soft_renderer.hpp"
+
+using tp = thread_pool_3;
+
+static image_buffer pattern(std::uint32_t width, std::uint32_t height) {
+	image_buffer b;
+	b.allocate(width, height);
+	for (std::uint32_t y = 0; y < height; ++y) {
+		for (std::uint32_t x = 0; x < width; ++x) {
+			b.data()[size_t(y) * width + x] = 0xFF000000u | ((x * 7) & 0xFF) << 16 | ((y * 5) & 0xFF) << 8 | ((x ^ y) & 0xFF);
+		}
+	}
+	return b;
+}
+
+static bool same(const image_buffer& a, const image_buffer& b) {
+	return a.width == b.width && a.height == b.height
+		&& std::equal(a.data(), a.data() + size_t(a.width) * a.height, b.data());
+}
+
+TEST(identity_copies_the_source) {
+	const auto src = pattern(300, 200);
+	image_buffer target;
+	target.allocate(300, 200);
+	soft::render(soft::render_pool::get_instance(), src, target, {}, 0xFFD3D3D3);
+	CHECK(same(src, target));
+}
+
+TEST(bands_match_one_pass) {
+	const auto src = pattern(640, 480);
+	const auto transform = soft::affine::scale(1.1f, 1.1f) * soft::affine::translation(31.5f, 12.25f);
+	image_buffer banded, whole;
+	banded.allocate(800, 600);
+	whole.allocate(800, 600);
+	soft::render(soft::render_pool::get_instance(), src, banded, transform, 0xFFD3D3D3);
+	soft::render_band(src, whole, transform, 0xFFD3D3D3, 0, whole.height);
+	CHECK(same(banded, whole));
+	// the corners outside the picture are the background
+	CHECK(banded.data()[0] == 0xFFD3D3D3);
+	CHECK(banded.data()[size_t(800) * 600 - 1] == 0xFFD3D3D3);
+}
+
+// A frame must not wait for the decode pool: with every decode thread
+// busy it still finishes.
+TEST(frame_does_not_wait_for_decodes) {
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool release = false;
+	std::vector<std::future<void>> busy;
+	for (size_t i = 0; i < tp::number_of_threads(); ++i) {
+		busy.push_back(async<true>(tp::get_instance().ctx(), [&]() {
+			std::unique_lock<std::mutex> lk(mutex);
+			cv.wait(lk, [&]() { return release; });
+		}));
+	}
+
+	const auto src = pattern(256, 256);
+	image_buffer target;
+	target.allocate(512, 512);
+	auto frame = std::async(std::launch::async, [&]() {
+		soft::render(soft::render_pool::get_instance(), src, target, soft::affine::scale(2.0f, 2.0f), 0xFFD3D3D3);
+	});
+	CHECK(frame.wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		release = true;
+	}
+	cv.notify_all();
+	for (auto& f : busy) f.wait();
+	frame.wait();
+}
+
+int main() {
+	const int failed = check::run();
+	soft::render_pool::get_instance().stop();
+	tp::get_instance().stop();
+	return failed;
+}
@@ -0,0 +1,101 @@
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "trace.hpp"
+
+TEST(ring_is_sized_lazily) {
+	trace::ring r(1);
+	CHECK(r.bytes() == 0);
+	r.push({"a", "test", 1, 2, 3});
+	const auto one_chunk = r.bytes();
+	CHECK(one_chunk > 0);
+	CHECK(one_chunk < 64 * 1024);
+	for (int i = 0; i < 100; ++i) r.push({"a", "test", i, 1, trace::no_arg});
+	CHECK(r.bytes() == one_chunk);
+}
+
+TEST(snapshot_in_order) {
+	trace::ring r(1);
+	for (std::int64_t i = 0; i < 10; ++i) r.push({"a", "test", i, 1, i});
+	std::vector<trace::event> out;
+	r.snapshot(out);
+	CHECK(out.size() == 10);
+	for (std::int64_t i = 0; i < 10 && i < static_cast<std::int64_t>(out.size()); ++i) {
+		CHECK(out[i].begin_ns == i);
+		CHECK(out[i].arg == i);
+	}
+}
+
+TEST(ring_keeps_the_latest) {
+	trace::ring r(1);
+	constexpr std::int64_t n = 40000;
+	for (std::int64_t i = 0; i < n; ++i) r.push({"a", "test", i, 1, i});
+	std::vector<trace::event> out;
+	r.snapshot(out);
+	CHECK(!out.empty());
+	CHECK(out.size() < static_cast<size_t>(n));
+	CHECK(out.back().begin_ns == n - 1);
+	bool ascending = true;
+	for (size_t i = 1; i < out.size(); ++i) ascending &= out[i].begin_ns == out[i - 1].begin_ns + 1;
+	CHECK(ascending);
+}
+
+// A dump racing the writer sees whole events or none: every event the
+// writer records has its fields tied together.
+TEST(snapshot_while_writing) {
+	trace::ring r(1);
+	std::atomic_bool started{false}, stop{false};
+	std::thread writer([&] {
+		for (std::int64_t i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+			r.push({"w", "test", i, -i, i * 3});
+			if (i == 1000) started = true;
+		}
+	});
+	while (!started) std::this_thread::yield();
+	size_t torn = 0, seen = 0;
+	for (int pass = 0; pass < 200; ++pass) {
+		std::vector<trace::event> out;
+		r.snapshot(out);
+		seen += out.size();
+		for (auto& ev : out) {
+			if (ev.duration_ns != -ev.begin_ns || ev.arg != ev.begin_ns * 3) ++torn;
+		}
+	}
+	stop = true;
+	writer.join();
+	CHECK(torn == 0);
+	CHECK(seen > 0);
+}
+
+TEST(dump_names_threads) {
+	auto& t = trace::tracer::get_instance();
+	t.enable(true);
+	std::thread([] {
+		trace::tracer::get_instance().name_thread("worker");
+		IMV_TRACE_SCOPE("job", "test");
+	}).join();
+	{
+		IMV_TRACE_SCOPE_ARG("step", "test", 42);
+	}
+	t.enable(false);
+	{
+		IMV_TRACE_SCOPE("off", "test");
+	}
+
+	std::ostringstream os;
+	t.dump(os);
+	const auto text = os.str();
+	CHECK(text.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+	CHECK(text.find("\"args\":{\"name\":\"worker\"}") != std::string::npos);
+	CHECK(text.find("\"name\":\"job\",\"cat\":\"test\"") != std::string::npos);
+	CHECK(text.find("\"args\":{\"id\":42}") != std::string::npos);
+	CHECK(text.find("\"name\":\"off\"") == std::string::npos);
+}
+
+int main() {
+	return check::run();
+}
@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "zip_archive.hpp"
+
+namespace {
+
+const fs::path fixtures = FIXTURES;
+
+// as make_fixtures.py makes them: the name over and over, each round
+// xored with its number
+std::vector<std::uint8_t> content(const std::string& name, size_t size) {
+	std::vector<std::uint8_t> out(size);
+	for (size_t i = 0; i < size; ++i) out[i] = static_cast<std::uint8_t>(name[i % name.size()] ^ ((i / name.size()) & 0x0F));
+	return out;
+}
+
+struct member {
+	std::string name;
+	std::uint64_t size;
+};
+
+// per archive, the members it should list in order
+std::map<std::string, std::vector<member>> expected() {
+	std::map<std::string, std::vector<member>> out;
+	std::ifstream list(fixtures / "zip.txt");
+	for (std::string line; std::getline(list, line);) {
+		std::istringstream fields(line);
+		std::string archive, name;
+		std::uint64_t size = 0;
+		fields >> archive >> name >> size;
+		out[archive].push_back({name, size});
+	}
+	return out;
+}
+
+bool same(const pixel_arena::buffer& b, const std::vector<std::uint8_t>& want) {
+	return b && b.size() == want.size() && std::equal(want.begin(), want.end(), b.data());
+}
+
+} // namespace
+
+TEST(archives_list_and_read_their_pictures) {
+	const auto all = expected();
+	CHECK(all.size() == 2);
+	for (auto& [file, members] : all) {
+		const auto a = zip::archive::open(fixtures / file);
+		CHECK(a != nullptr);
+		if (!a) continue;
+		CHECK(a->entries().size() == members.size());
+		for (size_t i = 0; i < members.size() && i < a->entries().size(); ++i) {
+			const auto& e = a->entries()[i];
+			CHECK(e.name == members[i].name);
+			CHECK(e.size == members[i].size);
+			CHECK(same(a->read(i), content(members[i].name, members[i].size)));
+			CHECK(a->member_path(i) == fixtures / file / members[i].name);
+		}
+	}
+}
+
+TEST(archive_as_a_catalog) {
+	const auto a = zip::archive::open(fixtures / "album.zip");
+	CHECK(a != nullptr);
+	if (!a) return;
+	const auto c = zip::make_catalog(a);
+	CHECK(c.size() == a->entries().size());
+	CHECK(c.archive() == a);
+	for (size_t i = 0; i < c.size(); ++i) {
+		CHECK(c.name(i) == a->entries()[i].name);
+		CHECK(c.file_bytes(i) == a->entries()[i].size);
+	}
+	CHECK(c.size() > 2 && c.format(2) == ".png");
+}
+
+TEST(what_is_not_an_archive) {
+	CHECK(zip::is_archive("a/b.ZIP"));
+	CHECK(zip::is_archive("b.cbz"));
+	CHECK(!zip::is_archive("b.zip.jpg"));
+	CHECK(!zip::is_archive("zip"));
+	CHECK(zip::archive::open(fixtures / "missing.zip") == nullptr);
+	CHECK(zip::archive::open(fixtures / "inflate.txt") == nullptr);
+}
+
+// Archives with bytes changed or cut short, under ASan and UBSan: opening
+// and reading them stays in bounds, and a member either reads whole or
+// comes back empty.
+TEST(mutated_archives_stay_in_bounds) {
+	std::mt19937 rng(1989);
+	const auto dir = fs::temp_directory_path() / "imv_zip_test";
+	fs::create_directories(dir);
+	int opened = 0;
+	for (const char* file : {"album.zip", "zip64.cbz"}) {
+		std::ifstream in(fixtures / file, std::ios::binary);
+		const std::vector<char> bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+		for (int round = 0; round < 400; ++round) {
+			auto bad = bytes;
+			for (auto n = 1 + rng() % 3; n; --n) {
+				// mostly the directory and headers, where the offsets are
+				const auto at = rng() % 2 ? bad.size() - 1 - rng() % std::min<size_t>(bad.size(), 66000 + 2000) : rng() % bad.size();
+				switch (rng() % 4) {
+				case 0: bad[at] = static_cast<char>(bad[at] ^ (1 << rng() % 8)); break;
+				case 1: bad[at] = static_cast<char>(0xFF); break;
+				case 2: bad[at] = static_cast<char>(rng()); break;
+				default: if (round % 8 == 0) bad.resize(at + 1); break;
+				}
+			}
+			const auto path = dir / file;
+			std::ofstream(path, std::ios::binary).write(bad.data(), static_cast<std::streamsize>(bad.size()));
+			const auto a = zip::archive::open(path);
+			if (!a) continue;
+			++opened;
+			for (size_t i = 0; i < a->entries().size() && i < 8; ++i) {
+				const auto& e = a->entries()[i];
+				if (e.size > (64u << 20) || e.compressed_size > (64u << 20)) continue;
+				const auto b = a->read(i);
+				CHECK(!b || b.size() == e.size);
+			}
+		}
+	}
+	fs::remove_all(dir);
+	std::fprintf(stderr, "  %d mutated archives still opened\n", opened);
+}
+
+int main() { return check::run(); }
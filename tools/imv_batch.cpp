@@ -0,0 +1,11 @@
+// Standalone batch front end, same as `imv --batch` without the viewer.
+//
+// Linux:
+//   g++ -std=c++20 -O2 -I../src imv_batch.cpp -o imv_batch -lboost_thread -lpthread
+//   ./imv_batch ~/shoot --out ~/shoot/web --resize 2048x2048
+
+#include "batch.hpp"
+
+int main(int argc, char* argv[]) {
+	return batch::main(std::vector<std::string>(argv + 1, argv + argc));
+}